@@ -2,6 +2,9 @@
 # Build options for crosscompiling libseawolf under Linux.
 CFLAGS += -D__SW_Linux__ -D__SW_Blackfin__
 
+# Use Q15 fixed point PID controllers, which suit the 16 bit multipliers
+CFLAGS += -DPID_FIXED_Q15
+
 # Build options
 CC = bfin-linux-uclibc-gcc
 LDFLAGS = -fPIC -lrt
@@ -31,19 +31,28 @@
 
 /* Include all Seawolf development headers */
 #include "seawolf/ardcomm.h"
+#include "seawolf/blob.h"
+#include "seawolf/clock.h"
 #include "seawolf/comm.h"
 #include "seawolf/config.h"
 #include "seawolf/dictionary.h"
+#include "seawolf/executor.h"
+#include "seawolf/histogram.h"
 #include "seawolf/list.h"
 #include "seawolf/logging.h"
 #include "seawolf/notify.h"
+#include "seawolf/periodic.h"
 #include "seawolf/pid.h"
+#include "seawolf/pidbank.h"
+#include "seawolf/pidfixed.h"
 #include "seawolf/queue.h"
+#include "seawolf/scheduler.h"
 #include "seawolf/serial.h"
 #include "seawolf/stack.h"
 #include "seawolf/synch.h"
 #include "seawolf/task.h"
 #include "seawolf/timer.h"
+#include "seawolf/trace.h"
 #include "seawolf/util.h"
 #include "seawolf/var.h"
 
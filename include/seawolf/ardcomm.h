@@ -5,6 +5,7 @@
 #ifndef __SEAWOLF_ARDCOMM_INCLUDE_H
 #define __SEAWOLF_ARDCOMM_INCLUDE_H
 
+#include "seawolf/dictionary.h"
 #include "seawolf/serial.h"
 
 /* Message types
@@ -38,12 +39,57 @@
      format := "{TERMINATE|NULL}"
 */
 
+/**
+ * Maximum length of a frame message type including the terminator
+ */
+#define ARDCOMM_MAX_TYPE 32
+
+/**
+ * Maximum length of frame data including the terminator
+ */
+#define ARDCOMM_MAX_DATA 256
+
+/**
+ * Reading from the device failed
+ */
+#define ARDCOMM_EIO -1
+
+/**
+ * A malformed frame was received
+ */
+#define ARDCOMM_EFRAME -2
+
+/**
+ * \brief A received frame
+ *
+ * A parsed ArdComm frame along with the time it was received
+ */
+typedef struct {
+    /**
+     * Message type
+     */
+    char type[ARDCOMM_MAX_TYPE];
+
+    /**
+     * Message data
+     */
+    char data[ARDCOMM_MAX_DATA];
+
+    /**
+     * Receive time in nanoseconds of the chunk containing the start of the
+     * frame (see Timer_getTimestamp())
+     */
+    int64_t timestamp;
+} ArdComm_Frame;
+
 /* Message transmission */
 void ArdComm_sendMessage(SerialPort sp, char* msgtype, char* buffer);
 int ArdComm_getMessage(SerialPort sp, char* msgtype, char* buffer);
+int ArdComm_getFrame(Serial_Reader* reader, ArdComm_Frame* frame);
 
 /* Connection initialization */
 int ArdComm_handshake(SerialPort sp);
 int ArdComm_getId(SerialPort sp, char* id);
+Dictionary* ArdComm_probeAll(const char** paths, int n, double timeout);
 
 #endif // #ifndef __SEAWOLF_ARDCOMM_INCLUDE_H
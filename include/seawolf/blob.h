@@ -0,0 +1,312 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_BLOB_INCLUDE_H
+#define __SEAWOLF_BLOB_INCLUDE_H
+
+#include "seawolf/comm.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * \addtogroup Blob
+ * \{
+ */
+
+/**
+ * Longest channel name, including the terminating null
+ */
+#define BLOB_NAME_LEN 64
+
+/**
+ * Identifies a blob channel segment ("SWBF")
+ * \private
+ */
+#define BLOB_SHM_MAGIC 0x53574246
+
+/**
+ * Layout version
+ * \private
+ */
+#define BLOB_SHM_VERSION 1
+
+/**
+ * \brief Name of a segment created by a producer, formatted with the process
+ * ID and a counter
+ * \private
+ */
+#define BLOB_SHM_NAME_FORMAT "/seawolf_blob.%d.%d"
+
+/**
+ * \brief Address the header of a slot
+ * \private
+ */
+#define BLOB_SHM_SLOT(header, i) \
+    ((Blob_ShmSlot*) (((char*) (header)) + (header)->headers_offset + (i) * sizeof(Blob_ShmSlot)))
+
+/**
+ * \brief Address the data of a slot
+ * \private
+ */
+#define BLOB_SHM_DATA(header, i) \
+    (((char*) (header)) + (header)->data_offset + (i) * (header)->slot_stride)
+
+/**
+ * \brief Start of a channel segment
+ *
+ * The header is followed by slot_count slot headers at headers_offset and
+ * slot_count data areas of slot_stride bytes at data_offset. The data areas
+ * are page aligned.
+ *
+ * \private
+ */
+typedef struct {
+    /**
+     * BLOB_SHM_MAGIC
+     * \private
+     */
+    uint32_t magic;
+
+    /**
+     * BLOB_SHM_VERSION
+     * \private
+     */
+    uint32_t version;
+
+    /**
+     * Number of slots
+     * \private
+     */
+    uint32_t slot_count;
+
+    /**
+     * Unused
+     * \private
+     */
+    uint32_t reserved0;
+
+    /**
+     * Largest frame a slot holds
+     * \private
+     */
+    uint64_t slot_size;
+
+    /**
+     * Distance between the data of consecutive slots, slot_size rounded up to
+     * a page
+     * \private
+     */
+    uint64_t slot_stride;
+
+    /**
+     * Offset of the slot headers
+     * \private
+     */
+    uint64_t headers_offset;
+
+    /**
+     * Offset of the first slot's data
+     * \private
+     */
+    uint64_t data_offset;
+
+    /**
+     * Pads the header to a cache line
+     * \private
+     */
+    char reserved[16];
+} Blob_ShmHeader;
+
+/**
+ * \brief State of one slot
+ *
+ * refs is -1 while the producer owns the slot and otherwise counts the
+ * consumers reading it. The producer only takes a slot no consumer holds, and
+ * a consumer only takes a slot the producer does not, so a frame is never
+ * overwritten while it is being read. Each slot fills a cache line.
+ *
+ * \private
+ */
+typedef struct {
+    /**
+     * -1 while being written, otherwise the number of readers
+     * \private
+     */
+    volatile int32_t refs;
+
+    /**
+     * Unused, aligns sequence
+     * \private
+     */
+    uint32_t reserved0;
+
+    /**
+     * Sequence number of the frame in the slot, 0 if none has been written
+     * \private
+     */
+    volatile uint64_t sequence;
+
+    /**
+     * Length of the frame in the slot
+     * \private
+     */
+    volatile uint64_t length;
+
+    /**
+     * Pads the slot to a cache line
+     * \private
+     */
+    char reserved[40];
+} Blob_ShmSlot;
+
+/**
+ * \brief A blob channel
+ *
+ * Returned by Blob_create() to the producer and Blob_open() to consumers
+ */
+typedef struct {
+    /**
+     * Name of the channel
+     * \private
+     */
+    char name[BLOB_NAME_LEN];
+
+    /**
+     * Name of the shared memory segment
+     * \private
+     */
+    char segment[BLOB_NAME_LEN];
+
+    /**
+     * True for the channel's producer
+     * \private
+     */
+    bool producer;
+
+    /**
+     * The mapped segment
+     * \private
+     */
+    Blob_ShmHeader* header;
+
+    /**
+     * Size of the mapping
+     * \private
+     */
+    size_t size;
+
+    /**
+     * Slot returned by Blob_allocate() and not yet published, or -1
+     * \private
+     */
+    int writing;
+
+    /**
+     * Slot most recently published by the producer
+     * \private
+     */
+    int last_slot;
+
+    /**
+     * Sequence number of the most recently published frame
+     * \private
+     */
+    uint64_t sequence;
+
+    /**
+     * Slot of the newest frame announced to a consumer
+     * \private
+     */
+    int latest_slot;
+
+    /**
+     * Sequence number of the newest frame announced to a consumer
+     * \private
+     */
+    uint64_t latest_sequence;
+
+    /**
+     * Sequence number of the last frame returned by Blob_receive()
+     * \private
+     */
+    uint64_t received;
+
+    /**
+     * Set once the producer closes the channel
+     * \private
+     */
+    bool closed;
+
+    /**
+     * Frames announced to a consumer which it never received
+     * \private
+     */
+    uint64_t dropped;
+
+    /**
+     * Protects the consumer state
+     * \private
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Signaled when a frame is announced or the channel closes
+     * \private
+     */
+    pthread_cond_t frame_available;
+} Blob_Channel;
+
+/**
+ * \brief A frame held by a consumer
+ *
+ * Filled in by Blob_receive(). The data stays valid, and is not overwritten by
+ * the producer, until the frame is passed to Blob_release()
+ */
+typedef struct {
+    /**
+     * The frame, in the producer's shared memory segment
+     */
+    const void* data;
+
+    /**
+     * Length of the frame in bytes
+     */
+    size_t length;
+
+    /**
+     * Sequence number of the frame, counting from 1
+     */
+    uint64_t sequence;
+
+    /**
+     * Channel the frame was received on
+     * \private
+     */
+    Blob_Channel* channel;
+
+    /**
+     * Slot holding the frame
+     * \private
+     */
+    int slot;
+} Blob_Frame;
+
+/** \} */
+
+void Blob_init(void);
+Blob_Channel* Blob_create(const char* name, size_t slot_size, int slot_count);
+void* Blob_allocate(Blob_Channel* channel);
+int Blob_publish(Blob_Channel* channel, size_t length);
+Blob_Channel* Blob_open(const char* name);
+int Blob_receive(Blob_Channel* channel, Blob_Frame* frame);
+void Blob_release(Blob_Frame* frame);
+uint64_t Blob_getDropped(Blob_Channel* channel);
+void Blob_closeChannel(Blob_Channel* channel);
+void Blob_inputMessage(Comm_Message* message);
+void Blob_close(void);
+
+#endif // #ifndef __SEAWOLF_BLOB_INCLUDE_H
@@ -0,0 +1,61 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_CLOCK_INCLUDE_H
+#define __SEAWOLF_CLOCK_INCLUDE_H
+
+#include "seawolf/comm.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \addtogroup Clock
+ * \{
+ */
+
+/**
+ * Maximum number of functions which can be registered with Clock_addListener()
+ */
+#define CLOCK_MAX_LISTENERS 8
+
+/**
+ * Sources of time
+ */
+typedef enum {
+    /**
+     * The system monotonic clock
+     */
+    CLOCK_SOURCE_REAL = 0,
+
+    /**
+     * A local virtual clock which can be stepped or run at any rate
+     */
+    CLOCK_SOURCE_VIRTUAL = 1,
+
+    /**
+     * A virtual clock owned by the hub and shared by all applications which
+     * use this source
+     */
+    CLOCK_SOURCE_HUB = 2,
+} Clock_Source;
+
+/** \} */
+
+void Clock_init(void);
+void Clock_setSource(Clock_Source source);
+Clock_Source Clock_getSource(void);
+bool Clock_isVirtual(void);
+int64_t Clock_now(void);
+void Clock_sleep(double seconds);
+void Clock_sleepUntil(int64_t deadline);
+int64_t Clock_getRealDelay(int64_t deadline);
+int Clock_step(int64_t ns);
+int Clock_setRate(double rate);
+double Clock_getRate(void);
+void Clock_set(int64_t now, double rate);
+int Clock_addListener(void (*func)(void));
+void Clock_inputMessage(Comm_Message* message);
+
+#endif // #ifndef __SEAWOLF_CLOCK_INCLUDE_H
@@ -5,8 +5,11 @@
 #ifndef __SEAWOLF_COMM_INCLUDE_H
 #define __SEAWOLF_COMM_INCLUDE_H
 
+#include "seawolf/histogram.h"
 #include "seawolf/mem_pool.h"
 
+#include <stdbool.h>
+
 /**
  * \addtogroup Comm
  * \{
@@ -79,6 +82,67 @@ typedef struct {
     MemPool_Alloc* alloc;
 } Comm_PackedMessage;
 
+/**
+ * Prefix of a hub server address which names a Unix domain socket rather than
+ * an IP address, see Comm_setServer()
+ */
+#define COMM_UNIX_PREFIX "unix:"
+
+/**
+ * Hub server address which connects to a hub embedded in the application
+ * rather than over a socket, see Comm_setInprocHub()
+ */
+#define COMM_INPROC_PREFIX "inproc:"
+
+/**
+ * \brief A hub running inside the application
+ *
+ * Registered with Comm_setInprocHub() by a hub embedded in the application.
+ * Requests are handed to the hub by a direct call on the thread making them,
+ * and the hub hands back messages for the application through deliver.
+ */
+typedef struct {
+    /**
+     * Open the application's connection to the hub. deliver is called with
+     * every message the hub sends the application, and with NULL once the hub
+     * has closed the connection. Returns the connection
+     */
+    void* (*connect)(void (*deliver)(Comm_PackedMessage* packed_message));
+
+    /**
+     * Process a message sent by the application. The hub copies the message
+     */
+    void (*send)(void* connection, Comm_PackedMessage* packed_message);
+} Comm_InprocHub;
+
+/**
+ * Maximum length of a request type name, including the terminating null
+ */
+#define COMM_LATENCY_NAME_LEN 48
+
+/**
+ * Maximum number of request types round trip times are kept for
+ */
+#define COMM_LATENCY_MAX_TYPES 32
+
+/**
+ * \brief Round trip statistics for one type of request
+ * \private
+ */
+typedef struct {
+    /**
+     * Request type, the first two components of the request
+     * \private
+     */
+    char request[COMM_LATENCY_NAME_LEN];
+
+    /**
+     * Nanoseconds between sending each request and receiving its response
+     * \private
+     */
+    Histogram latency;
+} Comm_LatencyStats;
+
 /** \} */
 
 /**
@@ -100,6 +164,15 @@ void Comm_Message_destroy(Comm_Message* message);
 void Comm_setPassword(const char* password);
 void Comm_setServer(const char* server);
 void Comm_setPort(uint16_t port);
+void Comm_setInprocHub(const Comm_InprocHub* hub);
+void Comm_setLatencyStats(bool enabled);
+void Comm_setLatencyLogInterval(double seconds);
+int Comm_getLatencyStats(const char* request, Histogram* latency);
+void Comm_resetLatencyStats(void);
+void Comm_logLatencyStats(void);
+int Comm_syncHubTime(int samples);
+int64_t Comm_getHubTimeOffset(void);
+int64_t Comm_getHubTimeUncertainty(void);
 void Comm_close(void);
 
 #endif // #ifndef __SEAWOLF_COMM_INCLUDE_H
@@ -0,0 +1,159 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_EXECUTOR_INCLUDE_H
+#define __SEAWOLF_EXECUTOR_INCLUDE_H
+
+#include "seawolf/queue.h"
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/**
+ * \addtogroup Executor
+ * \{
+ */
+
+/**
+ * \brief A submitted task
+ *
+ * A future represents a task submitted to an executor. Once the task has run
+ * its return value can be collected with Task_join()
+ */
+typedef struct {
+    /**
+     * The function to call
+     * \private
+     */
+    int (*func)(void*);
+
+    /**
+     * Argument to pass to func
+     * \private
+     */
+    void* arg;
+
+    /**
+     * Return value of func
+     * \private
+     */
+    int retval;
+
+    /**
+     * True once func has returned
+     * \private
+     */
+    bool done;
+
+    /**
+     * True if nobody will join the task, in which case it is freed by the
+     * worker which runs it
+     * \private
+     */
+    bool detached;
+
+    /**
+     * Protects done and detached
+     * \private
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Signaled when the task completes
+     * \private
+     */
+    pthread_cond_t finished;
+} Task_Future;
+
+/**
+ * \brief A pool of worker threads
+ *
+ * Tasks submitted from outside the pool are placed in a shared queue. Tasks
+ * submitted by a worker are pushed onto that worker's own deque, and idle
+ * workers steal from the deques of busy ones.
+ */
+typedef struct {
+    /**
+     * Per worker state, max_workers entries
+     * \private
+     */
+    struct Task_Worker* workers;
+
+    /**
+     * Tasks submitted from outside the pool
+     * \private
+     */
+    Queue* injected;
+
+    /**
+     * Minimum number of workers kept alive
+     * \private
+     */
+    int min_workers;
+
+    /**
+     * Maximum number of workers
+     * \private
+     */
+    int max_workers;
+
+    /**
+     * Number of running workers
+     * \private
+     */
+    int running;
+
+    /**
+     * Number of workers waiting for tasks
+     * \private
+     */
+    int idle;
+
+    /**
+     * Number of tasks queued but not yet started
+     * \private
+     */
+    int pending;
+
+    /**
+     * True once Task_Executor_destroy() has been called
+     * \private
+     */
+    bool shutdown;
+
+    /**
+     * Protects the counters above
+     * \private
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Signaled when tasks are queued or the pool is shutting down
+     * \private
+     */
+    pthread_cond_t available;
+
+    /**
+     * Signaled when a worker exits
+     * \private
+     */
+    pthread_cond_t exited;
+} Task_Executor;
+
+/** \} */
+
+Task_Executor* Task_Executor_new(int min_workers, int max_workers);
+Task_Future* Task_Executor_submit(Task_Executor* executor, int (*func)(void*), void* arg);
+void Task_Executor_parallelFor(Task_Executor* executor, int start, int end, int grain, void (*body)(int, int, void*), void* arg);
+int Task_Executor_getWorkerCount(Task_Executor* executor);
+void Task_Executor_destroy(Task_Executor* executor);
+
+Task_Executor* Task_getDefaultExecutor(void);
+Task_Future* Task_submit(int (*func)(void*), void* arg);
+void Task_parallelFor(int start, int end, int grain, void (*body)(int, int, void*), void* arg);
+bool Task_isDone(Task_Future* future);
+int Task_join(Task_Future* future);
+void Task_detach(Task_Future* future);
+
+#endif // #ifndef __SEAWOLF_EXECUTOR_INCLUDE_H
@@ -0,0 +1,80 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_HISTOGRAM_INCLUDE_H
+#define __SEAWOLF_HISTOGRAM_INCLUDE_H
+
+#include <stdint.h>
+
+/**
+ * \addtogroup Histogram
+ * \{
+ */
+
+/**
+ * Number of bits of precision kept for each value. Recorded values are exact
+ * below 2^HISTOGRAM_SUB_BITS and within 1/2^HISTOGRAM_SUB_BITS above
+ */
+#define HISTOGRAM_SUB_BITS 5
+
+/**
+ * Number of buckets needed to cover all non-negative int64_t values
+ */
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS) << HISTOGRAM_SUB_BITS)
+
+/**
+ * \brief Histogram
+ *
+ * A log-linear histogram of non-negative integer values, typically latencies
+ * in nanoseconds. Recording is O(1) and the memory used is fixed regardless of
+ * the range of values. A histogram is not thread safe, callers recording from
+ * multiple threads should use one histogram per thread and combine them with
+ * Histogram_merge().
+ */
+typedef struct {
+    /**
+     * Number of values in each bucket
+     * \private
+     */
+    uint64_t counts[HISTOGRAM_BUCKETS];
+
+    /**
+     * Total number of values recorded
+     * \private
+     */
+    uint64_t count;
+
+    /**
+     * Smallest value recorded
+     * \private
+     */
+    int64_t min;
+
+    /**
+     * Largest value recorded
+     * \private
+     */
+    int64_t max;
+
+    /**
+     * Sum of all values recorded
+     * \private
+     */
+    double sum;
+} Histogram;
+
+/** \} */
+
+Histogram* Histogram_new(void);
+void Histogram_init(Histogram* histogram);
+void Histogram_record(Histogram* histogram, int64_t value);
+void Histogram_merge(Histogram* dest, const Histogram* src);
+uint64_t Histogram_getCount(const Histogram* histogram);
+int64_t Histogram_getMin(const Histogram* histogram);
+int64_t Histogram_getMax(const Histogram* histogram);
+double Histogram_getMean(const Histogram* histogram);
+int64_t Histogram_getPercentile(const Histogram* histogram, double percentile);
+void Histogram_destroy(Histogram* histogram);
+
+#endif // #ifndef __SEAWOLF_HISTOGRAM_INCLUDE_H
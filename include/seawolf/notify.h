@@ -61,4 +61,7 @@ int Notify_available(void);
 /* Filter messages, NULL filter to clear filters */
 void Notify_filter(Notify_FilterType filter_type, char* filter);
 
+/* Apply a single filter to a notification, as the hub does */
+bool Notify_matchFilter(Notify_FilterType filter_type, const char* filter, const char* notification);
+
 #endif // #ifndef __SEAWOLF_NOTIFY_INCLUDE_H
@@ -0,0 +1,131 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_PERIODIC_INCLUDE_H
+#define __SEAWOLF_PERIODIC_INCLUDE_H
+
+#include "seawolf/histogram.h"
+#include "seawolf/task.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * \addtogroup Periodic
+ * \{
+ */
+
+/**
+ * \brief Options for Task_periodic()
+ *
+ * Options which can not be applied (for example due to insufficient
+ * privileges) are logged and otherwise ignored
+ */
+typedef struct {
+    /**
+     * CPU to pin the loop thread to, or -1 to allow any CPU
+     */
+    int cpu;
+
+    /**
+     * SCHED_FIFO priority to run the loop thread at, or 0 to keep the default
+     * scheduling policy
+     */
+    int priority;
+
+    /**
+     * Lock all current and future memory of the process with mlockall() to
+     * avoid page faults in the loop
+     */
+    bool lock_memory;
+
+    /**
+     * Log the loop statistics when it stops
+     */
+    bool log_stats;
+} Task_PeriodicOptions;
+
+/**
+ * \brief Periodic loop statistics
+ */
+typedef struct {
+    /**
+     * Number of times the function has been called
+     */
+    uint64_t iterations;
+
+    /**
+     * Number of deadlines missed because the previous call overran
+     */
+    uint64_t overruns;
+
+    /**
+     * Nanoseconds between each deadline and the loop waking up for it
+     */
+    Histogram latency;
+
+    /**
+     * Nanoseconds spent in each call to the function
+     */
+    Histogram runtime;
+} Task_PeriodicStats;
+
+/**
+ * \brief A periodic loop
+ */
+typedef struct {
+    /**
+     * Function called each period
+     * \private
+     */
+    int (*func)(void);
+
+    /**
+     * Period in nanoseconds
+     * \private
+     */
+    int64_t period;
+
+    /**
+     * Options the loop was started with
+     * \private
+     */
+    Task_PeriodicOptions options;
+
+    /**
+     * Thread running the loop
+     * \private
+     */
+    Task_Handle thread;
+
+    /**
+     * Set to request the loop stop
+     * \private
+     */
+    bool stop;
+
+    /**
+     * Statistics
+     * \private
+     */
+    Task_PeriodicStats stats;
+
+    /**
+     * Protects stop and stats
+     * \private
+     */
+    pthread_mutex_t lock;
+} Task_Periodic;
+
+/** \} */
+
+void Task_PeriodicOptions_init(Task_PeriodicOptions* options);
+Task_Periodic* Task_periodic(int (*func)(void), double period, const Task_PeriodicOptions* options);
+void Task_Periodic_getStats(Task_Periodic* periodic, Task_PeriodicStats* stats);
+void Task_Periodic_resetStats(Task_Periodic* periodic);
+void Task_Periodic_logStats(Task_Periodic* periodic);
+void Task_Periodic_stop(Task_Periodic* periodic);
+
+#endif // #ifndef __SEAWOLF_PERIODIC_INCLUDE_H
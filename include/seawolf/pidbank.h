@@ -0,0 +1,138 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_PIDBANK_INCLUDE_H
+#define __SEAWOLF_PIDBANK_INCLUDE_H
+
+#include "seawolf/timer.h"
+
+/**
+ * \addtogroup PIDBank
+ * \{
+ */
+
+/**
+ * \brief A bank of PID controllers
+ *
+ * Each field holds one value per controller, indexed by controller
+ */
+typedef struct {
+    /**
+     * Number of controllers
+     * \private
+     */
+    int n;
+
+    /**
+     * Timer shared by all controllers
+     * \private
+     */
+    Timer* timer;
+
+    /**
+     * Proportional coefficients
+     * \private
+     */
+    double* p;
+
+    /**
+     * Integral coefficients
+     * \private
+     */
+    double* i;
+
+    /**
+     * Reciprocals of the integral coefficients, or 0 where the coefficient is 0
+     * \private
+     */
+    double* i_inv;
+
+    /**
+     * Derivative coefficients
+     * \private
+     */
+    double* d;
+
+    /**
+     * Set points
+     * \private
+     */
+    double* sp;
+
+    /**
+     * Linear region sizes
+     * \private
+     */
+    double* active_region;
+
+    /**
+     * Last errors
+     * \private
+     */
+    double* e_last;
+
+    /**
+     * Error integrals
+     * \private
+     */
+    double* e_dt;
+
+    /**
+     * 0 while a controller is paused, 1 otherwise
+     * \private
+     */
+    double* running;
+
+    /**
+     * Raw, then filtered, error derivatives of the last update
+     * \private
+     */
+    double* diff;
+
+    /**
+     * Derivative filter history for all controllers
+     * \private
+     */
+    double* d_buf;
+
+    /**
+     * Offset of each controller's history in d_buf
+     * \private
+     */
+    int* d_offset;
+
+    /**
+     * Length of each controller's derivative filter
+     * \private
+     */
+    int* d_n;
+
+    /**
+     * Next history slot to write for each controller
+     * \private
+     */
+    int* d_head;
+
+    /**
+     * Running sum of each controller's history
+     * \private
+     */
+    double* d_sum;
+} PIDBank;
+
+/** \} */
+
+PIDBank* PIDBank_new(int n);
+int PIDBank_getCount(PIDBank* bank);
+void PIDBank_setCoefficients(PIDBank* bank, int k, double p, double i, double d);
+void PIDBank_setSetPoint(PIDBank* bank, int k, double sp);
+void PIDBank_setActiveRegion(PIDBank* bank, int k, double active_region);
+int PIDBank_setDerivativeBufferSize(PIDBank* bank, int k, int n);
+void PIDBank_pause(PIDBank* bank, int k);
+void PIDBank_resetIntegral(PIDBank* bank, int k);
+void PIDBank_update(PIDBank* bank, const double* pv, double* mv);
+void PIDBank_updateWithDelta(PIDBank* bank, double delta_t, const double* pv, double* mv);
+void PIDBank_destroy(PIDBank* bank);
+
+#endif // #ifndef __SEAWOLF_PIDBANK_INCLUDE_H
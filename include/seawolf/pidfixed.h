@@ -0,0 +1,175 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_PIDFIXED_INCLUDE_H
+#define __SEAWOLF_PIDFIXED_INCLUDE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \addtogroup PIDFixed
+ * \{
+ */
+
+#ifdef PID_FIXED_Q15
+
+/**
+ * Number of fractional bits in a PIDFixed_Value
+ */
+# define PIDFIXED_FRAC_BITS 15
+
+/**
+ * A signal value in Q15 format, representing [-1, 1)
+ */
+typedef int16_t PIDFixed_Value;
+
+/**
+ * Wider type used for intermediate results
+ */
+typedef int32_t PIDFixed_Accum;
+
+#else
+
+/**
+ * Number of fractional bits in a PIDFixed_Value
+ */
+# define PIDFIXED_FRAC_BITS 31
+
+/**
+ * A signal value in Q31 format, representing [-1, 1)
+ */
+typedef int32_t PIDFixed_Value;
+
+/**
+ * Wider type used for intermediate results
+ */
+typedef int64_t PIDFixed_Accum;
+
+#endif
+
+/**
+ * Largest representable value, just under 1
+ */
+#define PIDFIXED_MAX ((PIDFixed_Value) ((((PIDFixed_Accum) 1) << PIDFIXED_FRAC_BITS) - 1))
+
+/**
+ * Smallest representable value, -1
+ */
+#define PIDFIXED_MIN ((PIDFixed_Value) (-PIDFIXED_MAX - 1))
+
+/**
+ * \brief A gain, stored as a fraction scaled by a power of two
+ * \private
+ */
+typedef struct {
+    /**
+     * Fraction in the same format as a PIDFixed_Value
+     * \private
+     */
+    PIDFixed_Value mantissa;
+
+    /**
+     * The gain is mantissa * 2^shift
+     * \private
+     */
+    int shift;
+} PIDFixed_Gain;
+
+/**
+ * \brief A fixed point PID controller
+ */
+typedef struct {
+    /**
+     * Proportional gain
+     * \private
+     */
+    PIDFixed_Gain p;
+
+    /**
+     * Integral gain multiplied by the period
+     * \private
+     */
+    PIDFixed_Gain i;
+
+    /**
+     * Derivative gain divided by the period and the derivative filter length
+     * \private
+     */
+    PIDFixed_Gain d;
+
+    /**
+     * Double precision coefficients, kept to recompute the gains
+     * \private
+     */
+    double coefficients[3];
+
+    /**
+     * Update period in seconds
+     * \private
+     */
+    double period;
+
+    /**
+     * Set point
+     * \private
+     */
+    PIDFixed_Value sp;
+
+    /**
+     * Linear region size, or 0 for none
+     * \private
+     */
+    PIDFixed_Value active_region;
+
+    /**
+     * Integral term, with extra fractional bits, saturated to the output range
+     * \private
+     */
+    PIDFixed_Accum integral;
+
+    /**
+     * Errors of the last d_n updates, oldest at d_head
+     * \private
+     */
+    PIDFixed_Value* d_buf;
+
+    /**
+     * Derivative filter length
+     * \private
+     */
+    int d_n;
+
+    /**
+     * Next history slot to write
+     * \private
+     */
+    int d_head;
+
+    /**
+     * Run state of the controller
+     * \private
+     */
+    bool paused;
+} PIDFixed;
+
+/** \} */
+
+PIDFixed_Value PIDFixed_fromDouble(double value);
+double PIDFixed_toDouble(PIDFixed_Value value);
+PIDFixed_Value PIDFixed_add(PIDFixed_Value a, PIDFixed_Value b);
+PIDFixed_Value PIDFixed_sub(PIDFixed_Value a, PIDFixed_Value b);
+PIDFixed_Value PIDFixed_mul(PIDFixed_Value a, PIDFixed_Value b);
+
+PIDFixed* PIDFixed_new(double period, PIDFixed_Value sp, double p, double i, double d);
+void PIDFixed_pause(PIDFixed* pid);
+PIDFixed_Value PIDFixed_update(PIDFixed* pid, PIDFixed_Value pv);
+void PIDFixed_resetIntegral(PIDFixed* pid);
+void PIDFixed_setCoefficients(PIDFixed* pid, double p, double i, double d);
+void PIDFixed_setSetPoint(PIDFixed* pid, PIDFixed_Value sp);
+void PIDFixed_setActiveRegion(PIDFixed* pid, PIDFixed_Value active_region);
+int PIDFixed_setDerivativeBufferSize(PIDFixed* pid, int n);
+void PIDFixed_destroy(PIDFixed* pid);
+
+#endif // #ifndef __SEAWOLF_PIDFIXED_INCLUDE_H
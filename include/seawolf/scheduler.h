@@ -0,0 +1,41 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_SCHEDULER_INCLUDE_H
+#define __SEAWOLF_SCHEDULER_INCLUDE_H
+
+#include <stdint.h>
+
+/**
+ * \addtogroup Scheduler
+ * \{
+ */
+
+/**
+ * Resolution of the scheduler in nanoseconds. Deadlines are rounded up to a
+ * multiple of this
+ */
+#define SCHEDULER_RESOLUTION 1000000LL
+
+/**
+ * log2 of the number of slots in each level of the timer wheel
+ */
+#define SCHEDULER_WHEEL_BITS 6
+
+/**
+ * Number of levels in the timer wheel. Deadlines further away than
+ * 2^(SCHEDULER_WHEEL_BITS * SCHEDULER_WHEEL_LEVELS) ticks are parked in the
+ * last level until they come into range
+ */
+#define SCHEDULER_WHEEL_LEVELS 4
+
+/** \} */
+
+int Scheduler_after(double delay, void (*func)(void*), void* arg);
+int Scheduler_at(int64_t deadline, void (*func)(void*), void* arg);
+int Scheduler_every(double period, void (*func)(void*), void* arg);
+int Scheduler_cancel(int id);
+int Scheduler_getPendingCount(void);
+
+#endif // #ifndef __SEAWOLF_SCHEDULER_INCLUDE_H
@@ -6,6 +6,8 @@
 #define __SEAWOLF_SERIAL_INCLUDE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * Serial port handler
@@ -13,6 +15,50 @@
  */
 typedef int SerialPort;
 
+/**
+ * Size of the buffer in a Serial_Reader
+ */
+#define SERIAL_READER_BUFFER_SIZE 256
+
+/**
+ * \brief Buffered serial reader
+ *
+ * Reads data from a serial port in chunks and hands it out byte by byte. Each
+ * chunk is tagged with the monotonic time at which it was read from the device.
+ */
+typedef struct {
+    /**
+     * Serial port being read from
+     * \private
+     */
+    SerialPort sp;
+
+    /**
+     * Data from the last read
+     * \private
+     */
+    unsigned char buffer[SERIAL_READER_BUFFER_SIZE];
+
+    /**
+     * Index of the next unread byte in buffer
+     * \private
+     */
+    size_t head;
+
+    /**
+     * Number of valid bytes in buffer
+     * \private
+     */
+    size_t length;
+
+    /**
+     * Receive time of the data in buffer in nanoseconds (see
+     * Timer_getTimestamp())
+     * \private
+     */
+    int64_t timestamp;
+} Serial_Reader;
+
 /* Initialization/shutdown */
 void Serial_init(void);
 void Serial_close(void);
@@ -26,6 +72,8 @@ void Serial_setBlocking(SerialPort sp);
 void Serial_setNonBlocking(SerialPort sp);
 void Serial_setBaud(SerialPort sp, int baud);
 void Serial_flush(SerialPort sp);
+void Serial_flushInput(SerialPort sp);
+void Serial_drain(SerialPort sp);
 
 /* IO commands */
 int Serial_getByte(SerialPort sp);
@@ -35,6 +83,11 @@ int Serial_get(SerialPort sp, void* buffer, size_t count);
 int Serial_sendByte(SerialPort sp, unsigned char b);
 int Serial_send(SerialPort sp, void* buffer, size_t count);
 
+Serial_Reader* Serial_Reader_new(SerialPort sp);
+int Serial_Reader_getByte(Serial_Reader* reader, int64_t* timestamp);
+size_t Serial_Reader_buffered(Serial_Reader* reader);
+void Serial_Reader_destroy(Serial_Reader* reader);
+
 void Serial_setDTR(SerialPort sp, int value);
 int Serial_available(SerialPort sp);
 
@@ -15,10 +15,37 @@
  */
 typedef pthread_t Task_Handle;
 
+/**
+ * \brief Cooperative cancellation token
+ *
+ * A token is passed to a task which periodically checks it with
+ * Task_CancelToken_isCancelled() and returns early once it has been cancelled
+ */
+typedef struct {
+    /**
+     * True once the token has been cancelled
+     * \private
+     */
+    bool cancelled;
+
+    /**
+     * Protects cancelled
+     * \private
+     */
+    pthread_mutex_t lock;
+} Task_CancelToken;
+
 int Task_watchdog(int (*func)(void), double timeout, int* retval);
+int Task_timeout(int (*func)(Task_CancelToken*, void*), void* arg, double timeout, int* retval);
 Task_Handle Task_background(int (*func)(void));
 pid_t Task_spawnApplication(char* path, char* args, ...);
 void Task_kill(Task_Handle task);
 void Task_wait(Task_Handle task);
 
+Task_CancelToken* Task_CancelToken_new(void);
+void Task_CancelToken_cancel(Task_CancelToken* token);
+bool Task_CancelToken_isCancelled(Task_CancelToken* token);
+int Task_CancelToken_cancelAfter(Task_CancelToken* token, double timeout);
+void Task_CancelToken_destroy(Task_CancelToken* token);
+
 #endif // #ifndef __SEAWOLF_TASK_INCLUDE_H
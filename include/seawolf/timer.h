@@ -5,28 +5,58 @@
 #ifndef __SEAWOLF_TIMER_INCLUDE_H
 #define __SEAWOLF_TIMER_INCLUDE_H
 
+#include <stdint.h>
 #include <time.h>
 
+/**
+ * \addtogroup Timer
+ * \{
+ */
+
+/**
+ * Clock sources used by Timer objects
+ */
+typedef enum {
+    /**
+     * The system monotonic clock
+     */
+    TIMER_CLOCK_MONOTONIC = 0,
+
+    /**
+     * The processor time stamp counter, calibrated against the monotonic clock.
+     * Only available on x86 processors with an invariant TSC
+     */
+    TIMER_CLOCK_TSC = 1,
+} Timer_ClockSource;
+
+/** \} */
+
 /**
  * Timer
  * \private
  */
 typedef struct {
     /**
-     * Starting time
+     * Starting time in nanoseconds
      * \private
      */
-    double base;
+    int64_t base;
 
     /**
-     * Time at last delta
+     * Time at last delta in nanoseconds
      * \private
      */
-    double last;
+    int64_t last;
 } Timer;
 
 void Timer_init(void);
+int Timer_setClockSource(Timer_ClockSource source);
+Timer_ClockSource Timer_getClockSource(void);
+int64_t Timer_getTimestamp(void);
+int64_t Timer_now(void);
 Timer* Timer_new(void);
+int64_t Timer_getDeltaNS(Timer* tm);
+int64_t Timer_getTotalNS(Timer* tm);
 double Timer_getDelta(Timer* tm);
 double Timer_getTotal(Timer* tm);
 void Timer_reset(Timer* tm);
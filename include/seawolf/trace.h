@@ -0,0 +1,46 @@
+/**
+ * \file
+ */
+
+#ifndef __SEAWOLF_TRACE_INCLUDE_H
+#define __SEAWOLF_TRACE_INCLUDE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \addtogroup Trace
+ * \{
+ */
+
+/**
+ * Number of events kept for each thread. Must be a power of two
+ */
+#define TRACE_RING_SIZE 4096
+
+/**
+ * Longest thread name kept, including the terminating null
+ */
+#define TRACE_NAME_LEN 32
+
+/**
+ * File the trace is written to if none is given, formatted with the process ID
+ */
+#define TRACE_DEFAULT_FILE "/tmp/seawolf-trace.%d.json"
+
+/** \} */
+
+void Trace_init(void);
+void Trace_setEnabled(bool enabled);
+bool Trace_enabled(void);
+void Trace_setFile(const char* filename);
+void Trace_setLogger(void (*func)(short level, char* message));
+void Trace_setThreadName(const char* name);
+void Trace_begin(const char* name);
+void Trace_end(const char* name);
+void Trace_instant(const char* name);
+void Trace_complete(const char* name, int64_t start);
+int Trace_dump(const char* filename);
+void Trace_close(void);
+
+#endif // #ifndef __SEAWOLF_TRACE_INCLUDE_H
@@ -5,9 +5,13 @@
 #ifndef __SEAWOLF_VAR_INCLUDE_H
 #define __SEAWOLF_VAR_INCLUDE_H
 
+#include "seawolf/histogram.h"
+
 void Var_init(void);
 float Var_get(char* name);
 void Var_setAutoNotify(bool autonotify);
+void Var_setTimestamps(bool enabled);
+void Var_setSharedMemory(bool enabled);
 void Var_set(char* name, float value);
 void Var_close(void);
 
@@ -18,6 +22,9 @@ void Var_unbind(char* name);
 bool Var_stale(char* name);
 bool Var_poked(char* name);
 void Var_touch(char* name);
+int64_t Var_getTimestamp(char* name);
+int64_t Var_getLatency(char* name);
+void Var_getLatencyStats(Histogram* latency);
 void Var_sync(void);
 void Var_inputMessage(Comm_Message* message);
 
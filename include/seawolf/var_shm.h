@@ -0,0 +1,152 @@
+/**
+ * \file
+ * \brief Layout of the hub variable table shared memory segment
+ */
+
+#ifndef __SEAWOLF_VAR_SHM_INCLUDE_H
+#define __SEAWOLF_VAR_SHM_INCLUDE_H
+
+#include <stdint.h>
+
+/**
+ * \addtogroup Var
+ * \{
+ */
+
+/**
+ * Identifies a hub variable table ("SWVT")
+ * \private
+ */
+#define VAR_SHM_MAGIC 0x53575654
+
+/**
+ * Layout version
+ * \private
+ */
+#define VAR_SHM_VERSION 1
+
+/**
+ * Size of a variable name in the segment, including the terminating null
+ * \private
+ */
+#define VAR_SHM_NAME_LEN 64
+
+/**
+ * \brief Name of the segment published by the hub listening on a port
+ * \private
+ */
+#define VAR_SHM_NAME_FORMAT "/seawolf_vars.%d"
+
+/**
+ * \brief Address the name of a variable
+ * \private
+ */
+#define VAR_SHM_NAME(header, i) \
+    (((char*) (header)) + (header)->names_offset + (i) * VAR_SHM_NAME_LEN)
+
+/**
+ * \brief Address the slot of a variable
+ * \private
+ */
+#define VAR_SHM_SLOT(header, i) \
+    ((Var_ShmSlot*) (((char*) (header)) + (header)->slots_offset + (i) * (header)->slot_size))
+
+/**
+ * \brief Start of the segment
+ *
+ * The header is followed by var_count names of VAR_SHM_NAME_LEN bytes at
+ * names_offset and var_count slots of slot_size bytes at slots_offset, both in
+ * the order of the hub's variable definitions.
+ *
+ * \private
+ */
+typedef struct {
+    /**
+     * VAR_SHM_MAGIC
+     * \private
+     */
+    uint32_t magic;
+
+    /**
+     * VAR_SHM_VERSION
+     * \private
+     */
+    uint32_t version;
+
+    /**
+     * Number of variables
+     * \private
+     */
+    uint32_t var_count;
+
+    /**
+     * Size of each slot, a multiple of the cache line size
+     * \private
+     */
+    uint32_t slot_size;
+
+    /**
+     * Chosen by the hub each time it starts and sent in response to VAR SHM,
+     * so a client can tell the segment belongs to the hub it is connected to
+     * \private
+     */
+    uint64_t token;
+
+    /**
+     * Offset of the variable names
+     * \private
+     */
+    uint64_t names_offset;
+
+    /**
+     * Offset of the first slot
+     * \private
+     */
+    uint64_t slots_offset;
+
+    /**
+     * Pads the header to a cache line
+     * \private
+     */
+    char reserved[24];
+} Var_ShmHeader;
+
+/**
+ * \brief The current value of one variable
+ *
+ * Each slot fills a cache line so updates to one variable do not disturb
+ * readers of another. The hub makes sequence odd while it writes the value and
+ * even again once it is done, so readers copy the value and retry if sequence
+ * was odd or changed in the meantime.
+ *
+ * \private
+ */
+typedef struct {
+    /**
+     * Incremented before and after each write
+     * \private
+     */
+    volatile uint32_t sequence;
+
+    /**
+     * Unused, aligns value
+     * \private
+     */
+    uint32_t reserved0;
+
+    /**
+     * The variable value
+     * \private
+     */
+    double value;
+
+    /**
+     * Pads the slot to a cache line
+     * \private
+     */
+    char reserved[48];
+} Var_ShmSlot;
+
+/** \} */
+
+#endif // #ifndef __SEAWOLF_VAR_SHM_INCLUDE_H
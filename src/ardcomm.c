@@ -6,6 +6,7 @@
 #include "seawolf.h"
 
 #include <ctype.h>
+#include <poll.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -27,6 +28,38 @@
  */
 #define END_FRAME    '}'
 
+/**
+ * State of a port being probed by ArdComm_probeAll()
+ * \private
+ */
+struct ProbeState {
+    /**
+     * The open port
+     * \private
+     */
+    SerialPort sp;
+
+    /**
+     * Data read from the port but not yet parsed
+     * \private
+     */
+    char buffer[ARDCOMM_MAX_TYPE + ARDCOMM_MAX_DATA];
+
+    /**
+     * Number of bytes in buffer
+     * \private
+     */
+    size_t length;
+
+    /**
+     * True once the port has been identified or given up on
+     * \private
+     */
+    bool done;
+};
+
+static bool ArdComm_probeParse(struct ProbeState* state, char* id);
+
 /**
  * \defgroup Ard Arduino
  * \ingroup Hardware
@@ -83,6 +116,75 @@ int ArdComm_getMessage(SerialPort sp, char* msgtype, char* buffer) {
     return 1;
 }
 
+/**
+ * \brief Get a timestamped frame
+ *
+ * Read the next complete frame from a buffered reader. If a new frame starts
+ * before the current one is complete, the partial frame is discarded and
+ * parsing continues with the new frame. The frame is stamped with the receive
+ * time of the chunk which contained its first byte, so the timestamp is not
+ * affected by how long the data sat in the buffer before this call.
+ *
+ * \param reader The buffered reader to read from
+ * \param[out] frame The frame to store the message type, data and receive time
+ *   into
+ * \return 1 on success, ARDCOMM_EFRAME if a malformed frame was received or
+ *   ARDCOMM_EIO if reading from the device failed. After ARDCOMM_EFRAME the
+ *   next call resumes with the following frame
+ */
+int ArdComm_getFrame(Serial_Reader* reader, ArdComm_Frame* frame) {
+    size_t type_s = 0;
+    size_t data_s = 0;
+    bool in_data = false;
+    int64_t timestamp;
+    int tmp = 0;
+
+    /* Find next frame */
+    while(tmp != START_FRAME) {
+        tmp = Serial_Reader_getByte(reader, &timestamp);
+        if(tmp == -1) {
+            return ARDCOMM_EIO;
+        }
+    }
+    frame->timestamp = timestamp;
+
+    while(true) {
+        tmp = Serial_Reader_getByte(reader, &timestamp);
+
+        if(tmp == -1) {
+            return ARDCOMM_EIO;
+        } else if(tmp == START_FRAME) {
+            /* New frame started, drop the partial one */
+            frame->timestamp = timestamp;
+            type_s = data_s = 0;
+            in_data = false;
+        } else if(!in_data) {
+            if(tmp == TYPE_DIVIDER) {
+                in_data = true;
+            } else if(tmp == END_FRAME || type_s == ARDCOMM_MAX_TYPE - 1) {
+                /* Frame ended without data or type is too long */
+                return ARDCOMM_EFRAME;
+            } else {
+                frame->type[type_s++] = tmp;
+            }
+        } else {
+            if(tmp == END_FRAME) {
+                break;
+            } else if(tmp == TYPE_DIVIDER || data_s == ARDCOMM_MAX_DATA - 1) {
+                /* Invalid type divider or data is too long */
+                return ARDCOMM_EFRAME;
+            } else {
+                frame->data[data_s++] = tmp;
+            }
+        }
+    }
+
+    frame->type[type_s] = '\0';
+    frame->data[data_s] = '\0';
+
+    return 1;
+}
+
 /**
  * \brief Send a message
  * \deprecated Raw serial access should be used instead to keep speed acceptible
@@ -123,7 +225,10 @@ int ArdComm_handshake(SerialPort sp) {
 
     ArdComm_sendMessage(sp, "ESTABLISHED", "NULL");
     ArdComm_sendMessage(sp, "READY", "NULL");
-    Serial_flush(sp);
+
+    /* Discard any further ID frames, but only once READY is on the wire */
+    Serial_drain(sp);
+    Serial_flushInput(sp);
 
     return 0;
 }
@@ -155,4 +260,178 @@ int ArdComm_getId(SerialPort sp, char* id) {
     return 0;
 }
 
+/**
+ * \brief Scan probe data for an ID frame
+ * \private
+ *
+ * Consume complete frames from the buffer of a probed port and stop at the
+ * first ID frame
+ *
+ * \param state The port state to parse
+ * \param[out] id Buffer of at least ARDCOMM_MAX_DATA bytes to store the
+ *   identifier into
+ * \return True if an ID frame was found
+ */
+static bool ArdComm_probeParse(struct ProbeState* state, char* id) {
+    char* start;
+    char* end;
+    char* divider;
+    size_t consumed;
+    bool found = false;
+
+    while(!found) {
+        start = memchr(state->buffer, START_FRAME, state->length);
+        if(start == NULL) {
+            /* Nothing but noise */
+            state->length = 0;
+            break;
+        }
+
+        /* Drop anything before the start of the frame */
+        state->length -= start - state->buffer;
+        memmove(state->buffer, start, state->length);
+
+        /* Skip to the last start byte before the end of the frame so that a
+           truncated frame followed by a good one still parses */
+        end = memchr(state->buffer, END_FRAME, state->length);
+        if(end == NULL) {
+            if(state->length == sizeof(state->buffer)) {
+                /* Frame too long to be an ID, discard it */
+                state->length = 0;
+            }
+            break;
+        }
+
+        *end = '\0';
+        start = strrchr(state->buffer, START_FRAME);
+        divider = strchr(start, TYPE_DIVIDER);
+
+        if(divider && divider - start == 3 && strncmp(start + 1, "ID", 2) == 0 && end - divider - 1 < ARDCOMM_MAX_DATA) {
+            strcpy(id, divider + 1);
+            found = true;
+        }
+
+        consumed = end - state->buffer + 1;
+        state->length -= consumed;
+        memmove(state->buffer, end + 1, state->length);
+    }
+
+    return found;
+}
+
+/**
+ * \brief Open and identify a set of ports concurrently
+ *
+ * Open every given serial device and wait for each to identify itself with an
+ * ID frame, completing the handshake (as ArdComm_handshake()) with each device
+ * that does. All devices are read concurrently, so the total probe time is
+ * bounded by the timeout rather than the number of devices. Devices which fail
+ * to open, or which do not identify themselves before the timeout expires, are
+ * closed and left out of the result.
+ *
+ * Ports are returned in the state given by Serial_open(), i.e. non-blocking at
+ * 9600 baud.
+ *
+ * \param paths Array of device paths to probe
+ * \param n Number of paths
+ * \param timeout Seconds to wait for each device to identify itself
+ * \return A Dictionary mapping device identifiers to pointers to the opened
+ *   SerialPort. The caller is responsible for freeing each value and destroying
+ *   the dictionary
+ */
+Dictionary* ArdComm_probeAll(const char** paths, int n, double timeout) {
+    Dictionary* found = Dictionary_new();
+    struct ProbeState* states = calloc(n, sizeof(struct ProbeState));
+    struct pollfd* fds = calloc(n, sizeof(struct pollfd));
+    int64_t deadline = Timer_getTimestamp() + (int64_t) (timeout * 1e9);
+    int64_t remaining;
+    char id[ARDCOMM_MAX_DATA];
+    SerialPort* sp;
+    int pending = 0;
+    ssize_t count;
+
+    for(int i = 0; i < n; i++) {
+        states[i].sp = Serial_open(paths[i]);
+        states[i].done = (states[i].sp == -1);
+
+        if(states[i].done) {
+            Logging_log(DEBUG, __Util_format("Unable to open %s for probing", paths[i]));
+        } else {
+            pending++;
+        }
+    }
+
+    while(pending) {
+        remaining = deadline - Timer_getTimestamp();
+        if(remaining <= 0) {
+            break;
+        }
+
+        /* Poll only those ports which are still unidentified */
+        for(int i = 0; i < n; i++) {
+            fds[i].fd = states[i].done ? -1 : states[i].sp;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if(poll(fds, n, (int) ((remaining + 999999) / 1000000)) <= 0) {
+            continue;
+        }
+
+        for(int i = 0; i < n; i++) {
+            if(states[i].done || (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) == 0) {
+                continue;
+            }
+
+            count = read(states[i].sp, states[i].buffer + states[i].length, sizeof(states[i].buffer) - states[i].length);
+            if(count <= 0) {
+                if(count == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    /* Device went away */
+                    Serial_closePort(states[i].sp);
+                    states[i].done = true;
+                    pending--;
+                }
+                continue;
+            }
+            states[i].length += count;
+
+            if(!ArdComm_probeParse(&states[i], id)) {
+                continue;
+            }
+
+            states[i].done = true;
+            pending--;
+
+            if(Dictionary_exists(found, id)) {
+                Logging_log(WARNING, __Util_format("Duplicate device ID '%s' on %s, ignoring device", id, paths[i]));
+                Serial_closePort(states[i].sp);
+                continue;
+            }
+
+            /* Same as ArdComm_handshake() */
+            ArdComm_sendMessage(states[i].sp, "ESTABLISHED", "NULL");
+            ArdComm_sendMessage(states[i].sp, "READY", "NULL");
+            Serial_drain(states[i].sp);
+            Serial_flushInput(states[i].sp);
+
+            sp = malloc(sizeof(SerialPort));
+            *sp = states[i].sp;
+            Dictionary_set(found, id, sp);
+        }
+    }
+
+    /* Give up on anything that didn't identify itself */
+    for(int i = 0; i < n; i++) {
+        if(!states[i].done) {
+            Logging_log(DEBUG, __Util_format("No identification from %s before timeout", paths[i]));
+            Serial_closePort(states[i].sp);
+        }
+    }
+
+    free(states);
+    free(fds);
+
+    return found;
+}
+
 /** \} */
@@ -0,0 +1,786 @@
+/**
+ * \file
+ * \brief Core library microbenchmarks
+ *
+ * Times the primitives the rest of the library and the hub are built on:
+ * dictionaries, lists, queues, memory pools, message packing, string
+ * formatting, timers and PID controllers. Each benchmark is warmed up and then
+ * timed over several repetitions. Single threaded runs also report processor
+ * cycles per operation where the time stamp counter can be read, and heap
+ * allocations per operation where the C library allows malloc to be counted.
+ * Thread safe primitives are then run from increasing numbers of threads to
+ * show how they scale.
+ *
+ * Results can be printed as a table, CSV or JSON so that runs can be compared
+ * over time.
+ */
+
+#include "seawolf.h"
+
+#include <unistd.h>
+
+/* The time stamp counter can be read directly on x86 */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define HAVE_CYCLE_COUNTER
+#endif
+
+/* With glibc, malloc can be replaced by a counting wrapper around the real
+   allocator, which the library then calls as well */
+#ifdef __GLIBC__
+# define HAVE_ALLOCATION_COUNTER
+#endif
+
+/** Number of distinct keys used by the dictionary benchmarks */
+#define DICTIONARY_KEYS 1024
+
+/** Number of items kept in the list by the list benchmark */
+#define LIST_ITEMS 64
+
+/** Largest number of threads used for scaling runs */
+#define MAX_THREADS 64
+
+/**
+ * How a benchmark may be run from several threads
+ */
+typedef enum {
+    /** Only run from a single thread */
+    SINGLE_THREAD,
+
+    /** All threads share the state created by a single setup call */
+    SHARED_STATE,
+
+    /** Each thread creates its own state */
+    PER_THREAD_STATE
+} Sharing;
+
+/**
+ * A benchmarked primitive
+ */
+typedef struct {
+    /** Name reported in the results */
+    const char* name;
+
+    /** Create state for run, may be NULL */
+    void* (*setup)(void);
+
+    /** Perform the given number of operations */
+    void (*run)(void* state, unsigned long ops);
+
+    /** Free state created by setup, may be NULL */
+    void (*teardown)(void* state);
+
+    /** How the benchmark is run from several threads */
+    Sharing sharing;
+} Benchmark;
+
+/**
+ * Output formats
+ */
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+} Format;
+
+/**
+ * Benchmark options
+ */
+typedef struct {
+    /** Operations per repetition and thread */
+    unsigned long ops;
+
+    /** Operations run before timing */
+    unsigned long warmup;
+
+    /** Number of timed repetitions */
+    int repetitions;
+
+    /** Largest number of threads for scaling runs */
+    int threads;
+
+    /** Only run benchmarks whose name contains this, or NULL for all */
+    const char* filter;
+
+    /** Output format */
+    Format format;
+} BenchOptions;
+
+/**
+ * Results of one benchmark at one thread count
+ */
+typedef struct {
+    /** Number of threads */
+    int threads;
+
+    /** Median, fastest and slowest repetition in nanoseconds per operation */
+    double ns_median, ns_min, ns_max;
+
+    /** Processor cycles per operation, or -1 if not measured */
+    double cycles;
+
+    /** Heap allocations per operation, or -1 if not measured */
+    double allocations;
+
+    /** Operations per second across all threads */
+    double ops_per_second;
+
+    /** Throughput relative to a single thread */
+    double scaling;
+} Result;
+
+/**
+ * A gate all threads of a scaling run pass through together
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    /** Number of threads waiting at the gate */
+    int waiting;
+
+    /** Number of threads still running the current repetition */
+    int running;
+
+    /** Incremented each time the gate opens */
+    unsigned long generation;
+} Gate;
+
+/**
+ * Arguments of a thread in a scaling run
+ */
+typedef struct {
+    const Benchmark* benchmark;
+    const BenchOptions* options;
+    void* shared_state;
+    Gate* gate;
+} ThreadArgs;
+
+static int64_t read_cycles(void);
+static void start_counting(void);
+static uint64_t stop_counting(void);
+static int compare_double(const void* a, const void* b);
+
+static void* dictionary_setup(void);
+static void dictionary_get(void* state, unsigned long ops);
+static void dictionary_set(void* state, unsigned long ops);
+static void dictionary_set_remove(void* state, unsigned long ops);
+static void dictionary_teardown(void* state);
+static void* list_setup(void);
+static void list_append_remove(void* state, unsigned long ops);
+static void list_teardown(void* state);
+static void* queue_setup(void);
+static void queue_append_pop(void* state, unsigned long ops);
+static void queue_teardown(void* state);
+static void mempool_alloc_free(void* state, unsigned long ops);
+static void comm_pack(void* state, unsigned long ops);
+static void* comm_unpack_setup(void);
+static void comm_unpack(void* state, unsigned long ops);
+static void comm_unpack_teardown(void* state);
+static void util_format(void* state, unsigned long ops);
+static void* timer_setup(void);
+static void timer_get_delta(void* state, unsigned long ops);
+static void timer_teardown(void* state);
+static void* pid_setup(void);
+static void pid_update(void* state, unsigned long ops);
+static void pid_teardown(void* state);
+
+static void run_single(const Benchmark* benchmark, const BenchOptions* options, Result* result);
+static void* scaling_thread(void* _args);
+static void run_threads(const Benchmark* benchmark, const BenchOptions* options, int threads, Result* result);
+static void report(const Benchmark* benchmark, const Result* result, const BenchOptions* options, bool first);
+static void usage(char* arg0);
+
+/** The benchmarks, in the order they are run */
+static const Benchmark benchmarks[] = {
+    {"Dictionary_get", dictionary_setup, dictionary_get, dictionary_teardown, SHARED_STATE},
+    {"Dictionary_set", dictionary_setup, dictionary_set, dictionary_teardown, SHARED_STATE},
+    {"Dictionary_set/remove", dictionary_setup, dictionary_set_remove, dictionary_teardown, SHARED_STATE},
+    {"List_append/remove", list_setup, list_append_remove, list_teardown, SINGLE_THREAD},
+    {"Queue_append/pop", queue_setup, queue_append_pop, queue_teardown, SHARED_STATE},
+    {"MemPool_alloc/reserve/free", NULL, mempool_alloc_free, NULL, SHARED_STATE},
+    {"Comm_packMessage", NULL, comm_pack, NULL, SHARED_STATE},
+    {"Comm_unpackMessage", comm_unpack_setup, comm_unpack, comm_unpack_teardown, SHARED_STATE},
+    {"Util_format", NULL, util_format, NULL, SHARED_STATE},
+    {"Timer_getDelta", timer_setup, timer_get_delta, timer_teardown, PER_THREAD_STATE},
+    {"PID_update", pid_setup, pid_update, pid_teardown, PER_THREAD_STATE},
+};
+
+/** Keys used by the dictionary benchmarks */
+static char dictionary_keys[DICTIONARY_KEYS][16];
+
+/** Stops the compiler discarding results */
+static volatile double sink;
+
+#ifdef HAVE_ALLOCATION_COUNTER
+
+/** The allocator wrapped by the counting functions */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+
+/** True while allocations are being counted */
+static volatile bool counting = false;
+
+/** Allocations made while counting */
+static uint64_t allocations = 0;
+
+void* malloc(size_t size) {
+    if(counting) {
+        allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    if(counting) {
+        allocations++;
+    }
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+    if(counting) {
+        allocations++;
+    }
+    return __libc_realloc(p, size);
+}
+
+static void start_counting(void) {
+    allocations = 0;
+    counting = true;
+}
+
+static uint64_t stop_counting(void) {
+    counting = false;
+    return allocations;
+}
+
+#else
+
+static void start_counting(void) {
+}
+
+static uint64_t stop_counting(void) {
+    return 0;
+}
+
+#endif // #ifdef HAVE_ALLOCATION_COUNTER
+
+/**
+ * \return The time stamp counter, or 0 if it can not be read
+ */
+static int64_t read_cycles(void) {
+#ifdef HAVE_CYCLE_COUNTER
+    uint32_t low, high;
+    __asm__ __volatile__("rdtsc" : "=a" (low), "=d" (high));
+    return (((int64_t) high) << 32) | low;
+#else
+    return 0;
+#endif
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *((const double*) a);
+    double y = *((const double*) b);
+    return (x > y) - (x < y);
+}
+
+static void* dictionary_setup(void) {
+    Dictionary* dict = Dictionary_new();
+
+    for(int k = 0; k < DICTIONARY_KEYS; k++) {
+        Dictionary_set(dict, dictionary_keys[k], dictionary_keys[k]);
+    }
+
+    return dict;
+}
+
+static void dictionary_get(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        sink = (Dictionary_get(state, dictionary_keys[n % DICTIONARY_KEYS]) != NULL);
+    }
+}
+
+/**
+ * \brief Replace the values of existing keys
+ */
+static void dictionary_set(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        Dictionary_set(state, dictionary_keys[n % DICTIONARY_KEYS], dictionary_keys[n % DICTIONARY_KEYS]);
+    }
+}
+
+/**
+ * \brief Insert and remove a new key
+ */
+static void dictionary_set_remove(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        Dictionary_setInt(state, n, state);
+        Dictionary_removeInt(state, n);
+    }
+}
+
+static void dictionary_teardown(void* state) {
+    Dictionary_destroy(state);
+}
+
+static void* list_setup(void) {
+    List* list = List_new();
+
+    for(int k = 0; k < LIST_ITEMS; k++) {
+        List_append(list, dictionary_keys[k]);
+    }
+
+    return list;
+}
+
+/**
+ * \brief Append to the tail and remove from the head of a list
+ */
+static void list_append_remove(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        List_append(state, List_remove(state, 0));
+    }
+}
+
+static void list_teardown(void* state) {
+    List_destroy(state);
+}
+
+static void* queue_setup(void) {
+    return Queue_new();
+}
+
+static void queue_append_pop(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        Queue_append(state, dictionary_keys[n % DICTIONARY_KEYS]);
+        sink = (Queue_pop(state, false) != NULL);
+    }
+}
+
+static void queue_teardown(void* state) {
+    Queue_destroy(state);
+}
+
+/**
+ * \brief Allocate, fill as a small message would and free a pool allocation
+ */
+static void mempool_alloc_free(void* state, unsigned long ops) {
+    MemPool_Alloc* alloc;
+
+    for(unsigned long n = 0; n < ops; n++) {
+        alloc = MemPool_alloc();
+        sink = (MemPool_reserve(alloc, 64) != NULL);
+        MemPool_free(alloc);
+    }
+}
+
+/**
+ * \brief Build, pack and destroy a message, as Comm_sendMessage() does
+ */
+static void comm_pack(void* state, unsigned long ops) {
+    Comm_Message* message;
+
+    for(unsigned long n = 0; n < ops; n++) {
+        message = Comm_Message_new(4);
+        message->components[0] = "VAR";
+        message->components[1] = "SET";
+        message->components[2] = "Depth";
+        message->components[3] = "12.5000";
+        sink = Comm_packMessage(message)->length;
+        Comm_Message_destroy(message);
+    }
+}
+
+/**
+ * \brief Pack a message to be unpacked repeatedly
+ */
+static void* comm_unpack_setup(void) {
+    Comm_Message* message = Comm_Message_new(4);
+
+    message->components[0] = "WATCH";
+    message->components[1] = "Depth";
+    message->components[2] = "12.5000";
+    message->components[3] = "";
+
+    return Comm_packMessage(message);
+}
+
+/**
+ * \brief Copy in, unpack and destroy a message, as the receive thread does
+ */
+static void comm_unpack(void* state, unsigned long ops) {
+    Comm_PackedMessage* source = state;
+    Comm_PackedMessage* packed;
+
+    for(unsigned long n = 0; n < ops; n++) {
+        packed = Comm_PackedMessage_new();
+        packed->length = source->length;
+        packed->data = MemPool_write(packed->alloc, source->data, source->length);
+        sink = Comm_unpackMessage(packed)->count;
+        MemPool_free(packed->alloc);
+    }
+}
+
+static void comm_unpack_teardown(void* state) {
+    MemPool_free(((Comm_PackedMessage*) state)->alloc);
+}
+
+static void util_format(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        sink = Util_format("%s %lu %.4f", "Depth", n, 12.5)[0];
+    }
+}
+
+static void* timer_setup(void) {
+    return Timer_new();
+}
+
+static void timer_get_delta(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        sink = Timer_getDelta(state);
+    }
+}
+
+static void timer_teardown(void* state) {
+    Timer_destroy(state);
+}
+
+static void* pid_setup(void) {
+    PID* pid = PID_new(0.5, 1.0, 0.1, 0.2);
+    PID_setDerivativeBufferSize(pid, 4);
+    return pid;
+}
+
+static void pid_update(void* state, unsigned long ops) {
+    for(unsigned long n = 0; n < ops; n++) {
+        sink = PID_update(state, (n & 0xff) * (1.0 / 256));
+    }
+}
+
+static void pid_teardown(void* state) {
+    PID_destroy(state);
+}
+
+/**
+ * \brief Time a benchmark from the calling thread
+ */
+static void run_single(const Benchmark* benchmark, const BenchOptions* options, Result* result) {
+    double* ns = malloc(options->repetitions * sizeof(double));
+    double* cycles = malloc(options->repetitions * sizeof(double));
+    void* state = benchmark->setup ? benchmark->setup() : NULL;
+    uint64_t allocated = 0;
+    int64_t start, start_cycles;
+
+    benchmark->run(state, options->warmup);
+
+    for(int r = 0; r < options->repetitions; r++) {
+        start_counting();
+        start_cycles = read_cycles();
+        start = Timer_getTimestamp();
+
+        benchmark->run(state, options->ops);
+
+        ns[r] = ((double) (Timer_getTimestamp() - start)) / options->ops;
+        cycles[r] = ((double) (read_cycles() - start_cycles)) / options->ops;
+        allocated += stop_counting();
+    }
+
+    if(benchmark->teardown) {
+        benchmark->teardown(state);
+    }
+
+    qsort(ns, options->repetitions, sizeof(double), compare_double);
+    qsort(cycles, options->repetitions, sizeof(double), compare_double);
+
+    result->threads = 1;
+    result->ns_median = ns[options->repetitions / 2];
+    result->ns_min = ns[0];
+    result->ns_max = ns[options->repetitions - 1];
+#ifdef HAVE_CYCLE_COUNTER
+    result->cycles = cycles[options->repetitions / 2];
+#else
+    result->cycles = -1;
+#endif
+#ifdef HAVE_ALLOCATION_COUNTER
+    result->allocations = ((double) allocated) / (options->ops * options->repetitions);
+#else
+    result->allocations = -1;
+#endif
+    result->ops_per_second = 1e9 / result->ns_median;
+    result->scaling = 1;
+
+    free(ns);
+    free(cycles);
+}
+
+/**
+ * \brief Body of each thread in a scaling run
+ *
+ * Each thread warms up in turn, since some primitives set up per thread state
+ * on first use, and then runs each repetition when the gate opens
+ */
+static void* scaling_thread(void* _args) {
+    ThreadArgs* args = _args;
+    const Benchmark* benchmark = args->benchmark;
+    Gate* gate = args->gate;
+    void* state = args->shared_state;
+    unsigned long generation;
+
+    pthread_mutex_lock(&gate->lock);
+    if(benchmark->sharing == PER_THREAD_STATE) {
+        state = benchmark->setup ? benchmark->setup() : NULL;
+    }
+    benchmark->run(state, args->options->warmup);
+    pthread_mutex_unlock(&gate->lock);
+
+    for(int r = 0; r < args->options->repetitions; r++) {
+        pthread_mutex_lock(&gate->lock);
+        generation = gate->generation;
+        gate->waiting++;
+        pthread_cond_broadcast(&gate->changed);
+        while(gate->generation == generation) {
+            pthread_cond_wait(&gate->changed, &gate->lock);
+        }
+        pthread_mutex_unlock(&gate->lock);
+
+        benchmark->run(state, args->options->ops);
+
+        pthread_mutex_lock(&gate->lock);
+        gate->running--;
+        pthread_cond_broadcast(&gate->changed);
+        pthread_mutex_unlock(&gate->lock);
+    }
+
+    if(benchmark->sharing == PER_THREAD_STATE && benchmark->teardown) {
+        benchmark->teardown(state);
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Time a benchmark run from several threads at once
+ *
+ * Each repetition is timed from when all threads are released until the last
+ * one finishes
+ */
+static void run_threads(const Benchmark* benchmark, const BenchOptions* options, int threads, Result* result) {
+    pthread_t* handles = malloc(threads * sizeof(pthread_t));
+    double* ns = malloc(options->repetitions * sizeof(double));
+    Gate gate = {.waiting = 0, .running = 0, .generation = 0};
+    ThreadArgs args = {benchmark, options, NULL, &gate};
+    int64_t start;
+
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.changed, NULL);
+
+    if(benchmark->sharing == SHARED_STATE && benchmark->setup) {
+        args.shared_state = benchmark->setup();
+    }
+
+    for(int t = 0; t < threads; t++) {
+        pthread_create(&handles[t], NULL, scaling_thread, &args);
+    }
+
+    for(int r = 0; r < options->repetitions; r++) {
+        pthread_mutex_lock(&gate.lock);
+        while(gate.waiting < threads) {
+            pthread_cond_wait(&gate.changed, &gate.lock);
+        }
+        gate.waiting = 0;
+        gate.running = threads;
+        gate.generation++;
+        start = Timer_getTimestamp();
+        pthread_cond_broadcast(&gate.changed);
+
+        while(gate.running > 0) {
+            pthread_cond_wait(&gate.changed, &gate.lock);
+        }
+        ns[r] = ((double) (Timer_getTimestamp() - start)) / options->ops;
+        pthread_mutex_unlock(&gate.lock);
+    }
+
+    for(int t = 0; t < threads; t++) {
+        pthread_join(handles[t], NULL);
+    }
+
+    if(benchmark->sharing == SHARED_STATE && benchmark->teardown) {
+        benchmark->teardown(args.shared_state);
+    }
+
+    qsort(ns, options->repetitions, sizeof(double), compare_double);
+
+    result->threads = threads;
+    result->ns_median = ns[options->repetitions / 2];
+    result->ns_min = ns[0];
+    result->ns_max = ns[options->repetitions - 1];
+    result->cycles = -1;
+    result->allocations = -1;
+    result->ops_per_second = threads * 1e9 / result->ns_median;
+
+    pthread_mutex_destroy(&gate.lock);
+    pthread_cond_destroy(&gate.changed);
+    free(handles);
+    free(ns);
+}
+
+static void report(const Benchmark* benchmark, const Result* result, const BenchOptions* options, bool first) {
+    switch(options->format) {
+    case FORMAT_CSV:
+        if(first) {
+            printf("benchmark,threads,ops,repetitions,ns_per_op,ns_min,ns_max,cycles_per_op,allocs_per_op,ops_per_s,scaling\n");
+        }
+        printf("%s,%d,%lu,%d,%.2f,%.2f,%.2f,", benchmark->name, result->threads, options->ops,
+               options->repetitions, result->ns_median, result->ns_min, result->ns_max);
+        if(result->cycles >= 0) {
+            printf("%.1f", result->cycles);
+        }
+        printf(",");
+        if(result->allocations >= 0) {
+            printf("%.2f", result->allocations);
+        }
+        printf(",%.0f,%.2f\n", result->ops_per_second, result->scaling);
+        break;
+
+    case FORMAT_JSON:
+        printf("%s\n  {\"benchmark\": \"%s\", \"threads\": %d, \"ops\": %lu, \"repetitions\": %d, "
+               "\"ns_per_op\": %.2f, \"ns_min\": %.2f, \"ns_max\": %.2f, ", first ? "[" : ",",
+               benchmark->name, result->threads, options->ops, options->repetitions,
+               result->ns_median, result->ns_min, result->ns_max);
+        if(result->cycles >= 0) {
+            printf("\"cycles_per_op\": %.1f, ", result->cycles);
+        } else {
+            printf("\"cycles_per_op\": null, ");
+        }
+        if(result->allocations >= 0) {
+            printf("\"allocs_per_op\": %.2f, ", result->allocations);
+        } else {
+            printf("\"allocs_per_op\": null, ");
+        }
+        printf("\"ops_per_s\": %.0f, \"scaling\": %.2f}", result->ops_per_second, result->scaling);
+        break;
+
+    default:
+        if(first) {
+            printf("%-28s %7s %10s %10s %10s %10s %8s %13s %8s\n", "Benchmark", "Threads", "ns/op", "min",
+                   "max", "cycles/op", "allocs", "ops/s", "scaling");
+        }
+        printf("%-28s %7d %10.2f %10.2f %10.2f ", benchmark->name, result->threads, result->ns_median,
+               result->ns_min, result->ns_max);
+        if(result->cycles >= 0) {
+            printf("%10.1f ", result->cycles);
+        } else {
+            printf("%10s ", "-");
+        }
+        if(result->allocations >= 0) {
+            printf("%8.2f ", result->allocations);
+        } else {
+            printf("%8s ", "-");
+        }
+        printf("%13.0f %7.2fx\n", result->ops_per_second, result->scaling);
+        break;
+    }
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-l] [-n ops] [-w warmup] [-r repetitions] [-t threads] [-b name] [-f text|csv|json]\n", arg0);
+    printf("  -l              List the benchmarks\n");
+    printf("  -n ops          Operations per repetition and thread (default 200000)\n");
+    printf("  -w warmup       Operations run before timing (default 20000)\n");
+    printf("  -r repetitions  Timed repetitions, the median is reported (default 5)\n");
+    printf("  -t threads      Largest thread count for scaling runs, 1 to disable (default 4)\n");
+    printf("  -b name         Only run benchmarks whose name contains name\n");
+    printf("  -f format       Output as a text table, CSV or JSON (default text)\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = {.ops = 200000, .warmup = 20000, .repetitions = 5, .threads = 4,
+                            .filter = NULL, .format = FORMAT_TEXT};
+    int count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    Result single, result;
+    bool first = true;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hln:w:r:t:b:f:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'l':
+            for(int i = 0; i < count; i++) {
+                printf("%s\n", benchmarks[i].name);
+            }
+            exit(EXIT_SUCCESS);
+        case 'n':
+            options.ops = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            options.warmup = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            options.repetitions = atoi(optarg);
+            break;
+        case 't':
+            options.threads = atoi(optarg);
+            break;
+        case 'b':
+            options.filter = optarg;
+            break;
+        case 'f':
+            if(strcmp(optarg, "text") == 0) {
+                options.format = FORMAT_TEXT;
+            } else if(strcmp(optarg, "csv") == 0) {
+                options.format = FORMAT_CSV;
+            } else if(strcmp(optarg, "json") == 0) {
+                options.format = FORMAT_JSON;
+            } else {
+                fprintf(stderr, "Unknown format '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    options.ops = (options.ops < 1) ? 1 : options.ops;
+    options.repetitions = (options.repetitions < 1) ? 1 : options.repetitions;
+    options.threads = Util_inRange(1, options.threads, MAX_THREADS);
+
+    Timer_init();
+    MemPool_init();
+
+    for(int k = 0; k < DICTIONARY_KEYS; k++) {
+        snprintf(dictionary_keys[k], sizeof(dictionary_keys[k]), "key%d", k);
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(options.filter && strstr(benchmarks[i].name, options.filter) == NULL) {
+            continue;
+        }
+
+        run_single(&benchmarks[i], &options, &single);
+        report(&benchmarks[i], &single, &options, first);
+        first = false;
+
+        if(benchmarks[i].sharing == SINGLE_THREAD) {
+            continue;
+        }
+
+        /* Double the thread count, finishing on the largest requested */
+        for(int threads = 2; threads < 2 * options.threads; threads *= 2) {
+            threads = (threads > options.threads) ? options.threads : threads;
+            run_threads(&benchmarks[i], &options, threads, &result);
+            result.scaling = result.ops_per_second / single.ops_per_second;
+            report(&benchmarks[i], &result, &options, false);
+        }
+    }
+
+    if(options.format == FORMAT_JSON) {
+        printf("%s\n", first ? "[]" : "\n]");
+    }
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * \file
+ * \brief PID bank benchmark
+ *
+ * Compares updating a set of controllers through a PIDBank with looping over
+ * the same number of PID objects. Before timing, both are driven with the same
+ * inputs on a stepped virtual clock and their outputs compared, so that the
+ * speed up is only reported for equivalent results.
+ */
+
+#include "seawolf.h"
+
+#include <math.h>
+#include <unistd.h>
+
+/** Number of ticks compared when checking the bank against PID objects */
+#define CHECK_TICKS 1000
+
+/** Virtual time between ticks when checking, in nanoseconds */
+#define CHECK_PERIOD 10000000LL
+
+/** Largest output difference accepted when checking */
+#define CHECK_TOLERANCE 1e-9
+
+/**
+ * Benchmark options
+ */
+typedef struct {
+    /** Number of controllers */
+    int controllers;
+
+    /** Number of updates of every controller to time */
+    unsigned long iterations;
+
+    /** Length of the derivative filter of each controller */
+    int window;
+
+    /** Output results as CSV */
+    bool csv;
+} BenchOptions;
+
+static void configure(PID** pids, PIDBank* bank, const BenchOptions* options);
+static void fill_inputs(double* pv, int n, unsigned long tick);
+static double check_equivalence(const BenchOptions* options);
+static void report(const char* name, int64_t elapsed, const BenchOptions* options, int64_t baseline);
+static void usage(char* arg0);
+
+/**
+ * \brief Give each controller distinct coefficients
+ *
+ * Either array may be NULL
+ */
+static void configure(PID** pids, PIDBank* bank, const BenchOptions* options) {
+    double p, i, d, sp;
+
+    for(int k = 0; k < options->controllers; k++) {
+        p = 1.0 + 0.1 * k;
+        i = 0.05 * (k % 4);
+        d = 0.2 + 0.01 * k;
+        sp = 0.5 * k;
+
+        if(pids) {
+            pids[k] = PID_new(sp, p, i, d);
+            PID_setDerivativeBufferSize(pids[k], options->window);
+        }
+
+        if(bank) {
+            PIDBank_setCoefficients(bank, k, p, i, d);
+            PIDBank_setSetPoint(bank, k, sp);
+            PIDBank_setDerivativeBufferSize(bank, k, options->window);
+        }
+    }
+}
+
+static void fill_inputs(double* pv, int n, unsigned long tick) {
+    for(int k = 0; k < n; k++) {
+        pv[k] = 0.5 * k + sin(0.01 * tick + k);
+    }
+}
+
+/**
+ * \brief Drive PID objects and a bank with the same inputs and time steps
+ *
+ * \return The largest difference between corresponding outputs
+ */
+static double check_equivalence(const BenchOptions* options) {
+    int n = options->controllers;
+    PID** pids = malloc(n * sizeof(PID*));
+    PIDBank* bank;
+    double* pv = malloc(n * sizeof(double));
+    double* mv = malloc(n * sizeof(double));
+    double worst = 0;
+
+    /* A paused virtual clock gives every timer exactly the same deltas */
+    Clock_setRate(0);
+    Clock_setSource(CLOCK_SOURCE_VIRTUAL);
+
+    bank = PIDBank_new(n);
+    configure(pids, bank, options);
+
+    for(unsigned long tick = 0; tick < CHECK_TICKS; tick++) {
+        Clock_step(CHECK_PERIOD);
+        fill_inputs(pv, n, tick);
+        PIDBank_update(bank, pv, mv);
+
+        for(int k = 0; k < n; k++) {
+            worst = fmax(worst, fabs(PID_update(pids[k], pv[k]) - mv[k]));
+        }
+    }
+
+    for(int k = 0; k < n; k++) {
+        PID_destroy(pids[k]);
+    }
+    PIDBank_destroy(bank);
+    free(pids);
+    free(pv);
+    free(mv);
+
+    Clock_setSource(CLOCK_SOURCE_REAL);
+
+    return worst;
+}
+
+static void report(const char* name, int64_t elapsed, const BenchOptions* options, int64_t baseline) {
+    double updates = (double) options->iterations * options->controllers;
+
+    if(options->csv) {
+        printf("%s,%d,%d,%lu,%.2f,%.2f\n", name, options->controllers, options->window,
+               options->iterations, elapsed / updates, ((double) baseline) / elapsed);
+    } else {
+        printf("%-28s %8.2f ns/controller  %6.2fx\n", name, elapsed / updates, ((double) baseline) / elapsed);
+    }
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-c] [-n controllers] [-i iterations] [-w window]\n", arg0);
+    printf("  -n controllers  Number of controllers (default 12)\n");
+    printf("  -i iterations   Updates of every controller to time (default 1000000)\n");
+    printf("  -w window       Derivative filter length (default 4)\n");
+    printf("  -c              Print results as CSV\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = {.controllers = 12, .iterations = 1000000, .window = 4, .csv = false};
+    PID** pids;
+    PIDBank* bank;
+    double* pv;
+    double* mv;
+    double worst;
+    int64_t start, baseline, elapsed;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hcn:i:w:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'c':
+            options.csv = true;
+            break;
+        case 'n':
+            options.controllers = atoi(optarg);
+            break;
+        case 'i':
+            options.iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            options.window = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    options.controllers = (options.controllers < 1) ? 1 : options.controllers;
+    options.iterations = (options.iterations < 1) ? 1 : options.iterations;
+    options.window = (options.window < 1) ? 1 : options.window;
+
+    Timer_init();
+
+    worst = check_equivalence(&options);
+    if(worst > CHECK_TOLERANCE) {
+        fprintf(stderr, "PIDBank output differs from PID_update by %g\n", worst);
+        exit(EXIT_FAILURE);
+    }
+
+    pids = malloc(options.controllers * sizeof(PID*));
+    bank = PIDBank_new(options.controllers);
+    pv = malloc(options.controllers * sizeof(double));
+    mv = malloc(options.controllers * sizeof(double));
+    configure(pids, bank, &options);
+    fill_inputs(pv, options.controllers, 0);
+
+    if(options.csv) {
+        printf("method,controllers,window,iterations,ns_per_controller,speedup\n");
+    } else {
+        printf("%d controllers, derivative window %d, outputs match to %g\n",
+               options.controllers, options.window, worst);
+    }
+
+    start = Timer_getTimestamp();
+    for(unsigned long j = 0; j < options.iterations; j++) {
+        for(int k = 0; k < options.controllers; k++) {
+            mv[k] = PID_update(pids[k], pv[k]);
+        }
+    }
+    baseline = Timer_getTimestamp() - start;
+    report("PID_update", baseline, &options, baseline);
+
+    start = Timer_getTimestamp();
+    for(unsigned long j = 0; j < options.iterations; j++) {
+        PIDBank_update(bank, pv, mv);
+    }
+    elapsed = Timer_getTimestamp() - start;
+    report("PIDBank_update", elapsed, &options, baseline);
+
+    start = Timer_getTimestamp();
+    for(unsigned long j = 0; j < options.iterations; j++) {
+        PIDBank_updateWithDelta(bank, 0.01, pv, mv);
+    }
+    elapsed = Timer_getTimestamp() - start;
+    report("PIDBank_updateWithDelta", elapsed, &options, baseline);
+
+    for(int k = 0; k < options.controllers; k++) {
+        PID_destroy(pids[k]);
+    }
+    PIDBank_destroy(bank);
+    free(pids);
+    free(pv);
+    free(mv);
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+/**
+ * \file
+ * \brief Fixed point PID accuracy and throughput benchmark
+ *
+ * Drives a PIDFixed controller and a double precision PID controller with the
+ * same process variable and compares their outputs, then times both. The PID
+ * object reads its timer on every update, so it is run on a paused virtual
+ * clock which is stepped by exactly one period per update to give both
+ * controllers the same time steps. Build the library and this benchmark with
+ * PID_FIXED_Q15 defined to measure the Q15 format instead of Q31.
+ */
+
+#include "seawolf.h"
+
+#include <math.h>
+#include <unistd.h>
+
+/**
+ * Benchmark options
+ */
+typedef struct {
+    /** Number of updates compared for accuracy */
+    unsigned long samples;
+
+    /** Number of updates to time */
+    unsigned long iterations;
+
+    /** Controller period in seconds */
+    double period;
+
+    /** Proportional, integral and derivative coefficients */
+    double p, i, d;
+
+    /** Length of the derivative filter */
+    int window;
+
+    /** Output results as CSV */
+    bool csv;
+} BenchOptions;
+
+/**
+ * Accuracy results
+ */
+typedef struct {
+    /** Largest difference between the outputs */
+    double max_error;
+
+    /** Root mean square difference between the outputs */
+    double rms_error;
+} Accuracy;
+
+static double process_variable(unsigned long n, double period);
+static void measure_accuracy(const BenchOptions* options, Accuracy* accuracy);
+static double time_double(const BenchOptions* options);
+static double time_fixed(const BenchOptions* options);
+static void usage(char* arg0);
+
+/**
+ * \brief Process variable at an update
+ *
+ * Two tones plus a step, kept within [-1, 1) so it can be represented in
+ * fixed point
+ */
+static double process_variable(unsigned long n, double period) {
+    double t = n * period;
+    return 0.4 * sin(2 * M_PI * 0.5 * t) + 0.1 * sin(2 * M_PI * 7 * t) + ((n / 500) % 2 ? 0.2 : -0.2);
+}
+
+static void measure_accuracy(const BenchOptions* options, Accuracy* accuracy) {
+    PID* pid;
+    PIDFixed* fixed;
+    double pv, reference, error;
+    double sum_squares = 0;
+
+    Clock_setRate(0);
+    Clock_setSource(CLOCK_SOURCE_VIRTUAL);
+
+    pid = PID_new(0.1, options->p, options->i, options->d);
+    PID_setDerivativeBufferSize(pid, options->window);
+    fixed = PIDFixed_new(options->period, PIDFixed_fromDouble(0.1), options->p, options->i, options->d);
+    PIDFixed_setDerivativeBufferSize(fixed, options->window);
+
+    accuracy->max_error = 0;
+    for(unsigned long n = 0; n < options->samples; n++) {
+        Clock_step((int64_t) (options->period * 1e9));
+        pv = process_variable(n, options->period);
+
+        /* Compare against the double output limited to the same range */
+        reference = fmax(-1.0, fmin(1.0, PID_update(pid, pv)));
+        error = fabs(reference - PIDFixed_toDouble(PIDFixed_update(fixed, PIDFixed_fromDouble(pv))));
+
+        accuracy->max_error = fmax(accuracy->max_error, error);
+        sum_squares += error * error;
+    }
+    accuracy->rms_error = sqrt(sum_squares / options->samples);
+
+    PID_destroy(pid);
+    PIDFixed_destroy(fixed);
+
+    Clock_setSource(CLOCK_SOURCE_REAL);
+}
+
+/**
+ * \return Nanoseconds per PID_update() call
+ */
+static double time_double(const BenchOptions* options) {
+    PID* pid = PID_new(0.1, options->p, options->i, options->d);
+    volatile double sink = 0;
+    int64_t start;
+
+    PID_setDerivativeBufferSize(pid, options->window);
+
+    start = Timer_getTimestamp();
+    for(unsigned long n = 0; n < options->iterations; n++) {
+        sink += PID_update(pid, (n & 0xff) * (1.0 / 512));
+    }
+
+    PID_destroy(pid);
+    return ((double) (Timer_getTimestamp() - start)) / options->iterations;
+}
+
+/**
+ * \return Nanoseconds per PIDFixed_update() call
+ */
+static double time_fixed(const BenchOptions* options) {
+    PIDFixed* fixed = PIDFixed_new(options->period, PIDFixed_fromDouble(0.1), options->p, options->i, options->d);
+    volatile PIDFixed_Accum sink = 0;
+    int64_t start;
+
+    PIDFixed_setDerivativeBufferSize(fixed, options->window);
+
+    start = Timer_getTimestamp();
+    for(unsigned long n = 0; n < options->iterations; n++) {
+        sink += PIDFixed_update(fixed, (PIDFixed_Value) ((n & 0xff) << (PIDFIXED_FRAC_BITS - 9)));
+    }
+
+    PIDFixed_destroy(fixed);
+    return ((double) (Timer_getTimestamp() - start)) / options->iterations;
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-c] [-s samples] [-n iterations] [-t period] [-p p] [-i i] [-d d] [-w window]\n", arg0);
+    printf("  -s samples     Updates compared for accuracy (default 10000)\n");
+    printf("  -n iterations  Updates timed (default 10000000)\n");
+    printf("  -t period      Controller period in seconds (default 0.01)\n");
+    printf("  -p, -i, -d     Controller coefficients (default 0.8, 0.5, 0.02)\n");
+    printf("  -w window      Derivative filter length (default 4)\n");
+    printf("  -c             Print results as CSV\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = {.samples = 10000, .iterations = 10000000, .period = 0.01,
+                            .p = 0.8, .i = 0.5, .d = 0.02, .window = 4, .csv = false};
+    Accuracy accuracy;
+    double double_ns, fixed_ns;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hcs:n:t:p:i:d:w:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'c':
+            options.csv = true;
+            break;
+        case 's':
+            options.samples = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            options.iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            options.period = atof(optarg);
+            break;
+        case 'p':
+            options.p = atof(optarg);
+            break;
+        case 'i':
+            options.i = atof(optarg);
+            break;
+        case 'd':
+            options.d = atof(optarg);
+            break;
+        case 'w':
+            options.window = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    options.samples = (options.samples < 1) ? 1 : options.samples;
+    options.iterations = (options.iterations < 1) ? 1 : options.iterations;
+    options.window = (options.window < 1) ? 1 : options.window;
+    if(options.period <= 0) {
+        fprintf(stderr, "Period must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Timer_init();
+
+    measure_accuracy(&options, &accuracy);
+    double_ns = time_double(&options);
+    fixed_ns = time_fixed(&options);
+
+    if(options.csv) {
+        printf("format,max_error,rms_error,effective_bits,double_ns,fixed_ns\n");
+        printf("Q%d,%g,%g,%.1f,%.2f,%.2f\n", PIDFIXED_FRAC_BITS, accuracy.max_error, accuracy.rms_error,
+               -log2(accuracy.max_error), double_ns, fixed_ns);
+    } else {
+        printf("Format Q%d, %lu samples compared against PID_update\n", PIDFIXED_FRAC_BITS, options.samples);
+        printf("Error: max %g (%.1f bits), rms %g\n", accuracy.max_error, -log2(accuracy.max_error), accuracy.rms_error);
+        printf("PID_update       %8.2f ns/update\n", double_ns);
+        printf("PIDFixed_update  %8.2f ns/update  %6.2fx\n", fixed_ns, double_ns / fixed_ns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,798 @@
+/**
+ * \file
+ * \brief Serial/ArdComm benchmark using pseudo-terminals
+ *
+ * Measures the throughput and parse latency of the Serial and ArdComm
+ * components without any hardware attached. A pseudo-terminal pair is opened
+ * and a child process emulating an Arduino is attached to the master side. The
+ * emulator speaks the ArdComm protocol: it identifies itself with ID frames
+ * until the host completes the handshake and then streams frames at a
+ * configurable rate, optionally mixed with line noise. The host side opens the
+ * slave device with Serial_open() and drives the regular ArdComm routines
+ * against it.
+ */
+
+#include "seawolf.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Identifier reported by the emulated device */
+#define EMULATOR_ID "BenchArduino"
+
+/** Maximum number of devices emulated when benchmarking probing */
+#define MAX_PROBE_PORTS 64
+
+/** Message type used for benchmark frames */
+#define BENCH_TYPE "BENCH"
+
+/** Message type marking the end of the frame stream */
+#define END_TYPE "END"
+
+/** Size of the buffers passed to ArdComm_getMessage */
+#define MESSAGE_BUFFER_SIZE 1024
+
+/** Largest frame payload the emulator will generate */
+#define MAX_PAYLOAD 512
+
+/** Delay after the handshake before streaming, covers the input flush in
+    ArdComm_handshake */
+#define STREAM_DELAY 0.1
+
+/** Milliseconds the host waits for the next frame before giving up */
+#define RECEIVE_TIMEOUT 5000
+
+/** Consecutive read failures after which the host gives up */
+#define MAX_CONSECUTIVE_ERRORS 1000
+
+/**
+ * Benchmark options
+ */
+typedef struct {
+    /** Number of frames to send */
+    unsigned long frames;
+
+    /** Frames per second, 0 to send as fast as possible */
+    double rate;
+
+    /** Probability of injecting noise before each frame */
+    double noise;
+
+    /** Payload size of each frame in bytes */
+    size_t payload;
+
+    /** Output results as a single CSV line */
+    bool csv;
+
+    /** Read through a Serial_Reader with ArdComm_getFrame() */
+    bool buffered;
+
+    /** Number of devices to emulate for the probe benchmark, 0 to disable */
+    int probe_ports;
+
+    /** Number of emulated devices which never identify themselves */
+    int probe_silent;
+
+    /** Probe timeout in seconds */
+    double probe_timeout;
+} BenchOptions;
+
+/**
+ * Results collected by the host side
+ */
+typedef struct {
+    unsigned long received;
+    unsigned long corrupt;
+    unsigned long errors;
+    unsigned long lost;
+    double elapsed;
+    long long bytes_read;
+    long long read_calls;
+    int64_t* latencies;
+    int64_t* queue_latencies;
+} BenchResults;
+
+static int64_t now_ns(void);
+static void sleep_until_ns(int64_t t);
+static bool host_alive(void);
+static int write_all(int fd, const char* buffer, size_t count);
+static bool read_io_counters(long long* rchar, long long* syscr);
+static int compare_int64(const void* a, const void* b);
+static void percentiles(int64_t* values, unsigned long n, double* p50, double* p99, double* max);
+static int open_pty(int* master, char** device);
+static pid_t spawn_emulator(int master, const char* id, const BenchOptions* options, const int* masters, int masters_n);
+static void stop_emulators(void);
+static void catch_signal(int sig);
+static void emulator_run(int master, const char* id, const BenchOptions* options);
+static int probe_run(const BenchOptions* options);
+static int host_run(const char* device, const BenchOptions* options, BenchResults* results);
+static void report(const BenchOptions* options, BenchResults* results);
+static void usage(char* arg0);
+
+/** Running emulator processes, stopped on every exit path */
+static pid_t emulators[MAX_PROBE_PORTS];
+
+/** Number of entries in emulators */
+static int emulators_n = 0;
+
+/** Process the emulators were forked from */
+static pid_t host_pid;
+
+/**
+ * \brief Current monotonic time in nanoseconds
+ *
+ * Both processes share the system monotonic clock so timestamps taken by the
+ * emulator are directly comparable with those taken by the host
+ */
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * \brief Sleep until the given monotonic time
+ */
+static void sleep_until_ns(int64_t t) {
+    int64_t remaining = t - now_ns();
+    struct timespec ts;
+
+    if(remaining <= 0) {
+        return;
+    }
+
+    ts.tv_sec = remaining / 1000000000LL;
+    ts.tv_nsec = remaining % 1000000000LL;
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * \brief Check from an emulator that the host process is still running
+ */
+static bool host_alive(void) {
+    return getppid() == host_pid;
+}
+
+/**
+ * \brief Write an entire buffer, retrying on short writes
+ *
+ * Gives up if the host goes away while the pseudo-terminal is full, so an
+ * emulator never outlives a killed benchmark
+ */
+static int write_all(int fd, const char* buffer, size_t count) {
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+    ssize_t n;
+
+    while(count) {
+        if(poll(&pfd, 1, 1000) <= 0 || !(pfd.revents & POLLOUT)) {
+            if(!host_alive()) {
+                return -1;
+            }
+            continue;
+        }
+
+        n = write(fd, buffer, count);
+        if(n < 0) {
+            if(errno == EAGAIN && !host_alive()) {
+                return -1;
+            } else if(errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return -1;
+        }
+
+        count -= n;
+        buffer += n;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Read the read byte and read syscall counters for this process
+ *
+ * Uses /proc/self/io where available. The emulator runs in a separate process
+ * so these counters only reflect reads performed by the host side.
+ *
+ * \return True if the counters could be read
+ */
+static bool read_io_counters(long long* rchar, long long* syscr) {
+    FILE* io = fopen("/proc/self/io", "r");
+    char line[128];
+    bool found_rchar = false, found_syscr = false;
+
+    if(io == NULL) {
+        return false;
+    }
+
+    while(fgets(line, sizeof(line), io)) {
+        if(sscanf(line, "rchar: %lld", rchar) == 1) {
+            found_rchar = true;
+        } else if(sscanf(line, "syscr: %lld", syscr) == 1) {
+            found_syscr = true;
+        }
+    }
+
+    fclose(io);
+    return found_rchar && found_syscr;
+}
+
+static int compare_int64(const void* a, const void* b) {
+    int64_t x = *((const int64_t*) a);
+    int64_t y = *((const int64_t*) b);
+    return (x > y) - (x < y);
+}
+
+/**
+ * \brief Sort values and return p50, p99 and max in microseconds
+ */
+static void percentiles(int64_t* values, unsigned long n, double* p50, double* p99, double* max) {
+    *p50 = *p99 = *max = 0;
+    if(n == 0) {
+        return;
+    }
+
+    qsort(values, n, sizeof(int64_t), compare_int64);
+    *p50 = values[n / 2] * 1e-3;
+    *p99 = values[(n * 99) / 100] * 1e-3;
+    *max = values[n - 1] * 1e-3;
+}
+
+/**
+ * \brief Allocate a pseudo-terminal pair
+ *
+ * \param[out] master File descriptor of the master side
+ * \param[out] device Newly allocated path of the slave side
+ * \return 0 on success, -1 on failure
+ */
+static int open_pty(int* master, char** device) {
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(*master == -1) {
+        return -1;
+    }
+
+    if(grantpt(*master) == -1 || unlockpt(*master) == -1) {
+        close(*master);
+        return -1;
+    }
+
+    *device = strdup(ptsname(*master));
+    return 0;
+}
+
+/**
+ * \brief Fork an emulator process
+ *
+ * \param master Master side of the emulator's pseudo-terminal
+ * \param id Identifier the emulator reports
+ * \param options Benchmark options
+ * \param masters Other masters, closed in the emulator
+ * \param masters_n Number of other masters
+ * \return The emulator's process ID, or -1 on failure
+ */
+static pid_t spawn_emulator(int master, const char* id, const BenchOptions* options, const int* masters, int masters_n) {
+    pid_t pid;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid = fork();
+    if(pid == 0) {
+        /* Only keep this device's side of the pseudo-terminals, and leave
+           stopping the emulator to the default signal handlers */
+        for(int i = 0; i < masters_n; i++) {
+            close(masters[i]);
+        }
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        /* A pseudo-terminal may block a write even after polling writable,
+           which would keep write_all() from noticing the host has gone */
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+        emulator_run(master, id, options);
+        _exit(EXIT_SUCCESS);
+    } else if(pid > 0) {
+        emulators[emulators_n++] = pid;
+    }
+
+    return pid;
+}
+
+/**
+ * \brief Stop and reap every emulator
+ */
+static void stop_emulators(void) {
+    for(int i = 0; i < emulators_n; i++) {
+        kill(emulators[i], SIGTERM);
+        waitpid(emulators[i], NULL, 0);
+    }
+    emulators_n = 0;
+}
+
+/**
+ * \brief Stop the emulators when the benchmark is interrupted
+ */
+static void catch_signal(int sig) {
+    for(int i = 0; i < emulators_n; i++) {
+        kill(emulators[i], SIGTERM);
+    }
+    _exit(EXIT_FAILURE);
+}
+
+/**
+ * \brief Emulated Arduino
+ *
+ * Identify until the host handshakes and then stream frames to the host. The
+ * handshake is complete once either the ESTABLISHED or the READY message
+ * arrives, as ArdComm_handshake() may discard one of them while still in its
+ * output queue. Each frame carries a sequence number and the time it was written.
+ *
+ * \param master Master side of the pseudo-terminal
+ * \param id Identifier to report
+ * \param options Benchmark options
+ */
+static void emulator_run(int master, const char* id, const BenchOptions* options) {
+    static const char noise_chars[] = "abcxyz0123456789 \r\n|=";
+    struct pollfd fd = {.fd = master, .events = POLLIN};
+    char frame[MAX_PAYLOAD + 64];
+    char input[256];
+    char id_frame[64];
+    size_t input_len = 0;
+    int64_t period, next;
+    ssize_t n;
+    int len;
+
+    snprintf(id_frame, sizeof(id_frame), "{ID|%s}\n", id);
+
+    /* Identify until the host finishes the handshake */
+    while(true) {
+        if(write_all(master, id_frame, strlen(id_frame)) == -1) {
+            return;
+        }
+
+        if(poll(&fd, 1, 100) > 0) {
+            n = read(master, input + input_len, sizeof(input) - input_len - 1);
+            if(n > 0) {
+                input_len += n;
+                input[input_len] = '\0';
+                if(strstr(input, "{ESTABLISHED|NULL}") || strstr(input, "{READY|NULL}")) {
+                    break;
+                }
+
+                /* Keep the tail in case a message straddles two reads */
+                if(input_len > sizeof(input) / 2) {
+                    memmove(input, input + input_len - 16, 16);
+                    input_len = 16;
+                }
+            }
+        }
+    }
+
+    Util_usleep(STREAM_DELAY);
+
+    period = (options->rate > 0) ? (int64_t) (1e9 / options->rate) : 0;
+    next = now_ns();
+
+    for(unsigned long seq = 0; seq < options->frames; seq++) {
+        /* Once the host is gone the pseudo-terminal accepts and discards
+           everything, so check for it now and then */
+        if(seq % 1024 == 0 && !host_alive()) {
+            return;
+        }
+
+        if(period) {
+            sleep_until_ns(next);
+            next += period;
+        }
+
+        if(options->noise > 0 && (rand() / (RAND_MAX + 1.0)) < options->noise) {
+            /* Either a burst of junk between frames or a truncated frame */
+            if(rand() % 2) {
+                len = 1 + rand() % 16;
+                for(int i = 0; i < len; i++) {
+                    frame[i] = noise_chars[rand() % (sizeof(noise_chars) - 1)];
+                }
+            } else {
+                len = snprintf(frame, sizeof(frame), "{" BENCH_TYPE "|%lu", seq);
+            }
+            if(write_all(master, frame, len) == -1) {
+                return;
+            }
+        }
+
+        len = snprintf(frame, sizeof(frame), "{" BENCH_TYPE "|%lu %lld ", seq, (long long) now_ns());
+        while(len < options->payload + 7 && len < MAX_PAYLOAD) {
+            frame[len++] = 'x';
+        }
+        frame[len++] = '}';
+        frame[len++] = '\n';
+
+        if(write_all(master, frame, len) == -1) {
+            break;
+        }
+    }
+
+    write_all(master, "{" END_TYPE "|NULL}\n", strlen("{" END_TYPE "|NULL}\n"));
+
+    /* Hold the master open until the host has drained the stream */
+    while(poll(&fd, 1, 5000) > 0) {
+        if(read(master, input, sizeof(input)) <= 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Benchmark ArdComm_probeAll()
+ *
+ * Emulate a set of devices, some of which never identify themselves, and time
+ * how long it takes to probe all of them
+ *
+ * \param options Benchmark options
+ * \return 0 on success, -1 on failure
+ */
+static int probe_run(const BenchOptions* options) {
+    BenchOptions emulator_options = *options;
+    int masters[MAX_PROBE_PORTS];
+    char* devices[MAX_PROBE_PORTS];
+    char id[32];
+    Dictionary* found;
+    List* ids;
+    int64_t start;
+    double elapsed;
+    int identified;
+
+    /* Emulators identify and then immediately end their stream */
+    emulator_options.frames = 0;
+
+    for(int i = 0; i < options->probe_ports; i++) {
+        if(open_pty(&masters[i], &devices[i]) == -1) {
+            fprintf(stderr, "Unable to allocate pseudo-terminal: %s\n", strerror(errno));
+            return -1;
+        }
+
+        /* The first probe_silent devices are attached but never talk */
+        if(i >= options->probe_silent) {
+            snprintf(id, sizeof(id), "%s%d", EMULATOR_ID, i);
+            if(spawn_emulator(masters[i], id, &emulator_options, masters, i) == -1) {
+                fprintf(stderr, "Unable to fork emulator: %s\n", strerror(errno));
+                stop_emulators();
+                return -1;
+            }
+        }
+    }
+
+    start = now_ns();
+    found = ArdComm_probeAll((const char**) devices, options->probe_ports, options->probe_timeout);
+    elapsed = (now_ns() - start) * 1e-9;
+
+    ids = Dictionary_getKeys(found);
+    identified = List_getSize(ids);
+    for(int i = 0; i < identified; i++) {
+        SerialPort* sp = Dictionary_get(found, List_get(ids, i));
+        Serial_closePort(*sp);
+        free(sp);
+    }
+    List_destroy(ids);
+    Dictionary_destroy(found);
+
+    /* Emulators which were never handshaked identify forever */
+    stop_emulators();
+    for(int i = 0; i < options->probe_ports; i++) {
+        close(masters[i]);
+        free(devices[i]);
+    }
+
+    if(options->csv) {
+        printf("ports,silent,timeout_s,identified,elapsed_s\n");
+        printf("%d,%d,%.3f,%d,%.6f\n", options->probe_ports, options->probe_silent, options->probe_timeout, identified, elapsed);
+    } else {
+        printf("Devices identified   : %d / %d\n", identified, options->probe_ports - options->probe_silent);
+        printf("Probe time           : %.3f s\n", elapsed);
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Host side of the benchmark
+ *
+ * Open the slave device, perform the handshake and parse frames until the
+ * emulator signals the end of the stream. Fails if the emulator stops sending
+ * or the device keeps failing, e.g. because the emulator died.
+ *
+ * \param device Path to the slave device
+ * \param options Benchmark options
+ * \param[out] results Collected measurements
+ * \return 0 on success, -1 on failure
+ */
+static int host_run(const char* device, const BenchOptions* options, BenchResults* results) {
+    char msgtype_buffer[MESSAGE_BUFFER_SIZE];
+    char data_buffer[MESSAGE_BUFFER_SIZE];
+    char* msgtype = msgtype_buffer;
+    char* buffer = data_buffer;
+    Serial_Reader* reader = NULL;
+    ArdComm_Frame frame;
+    int status;
+    long long rchar_start = 0, syscr_start = 0, rchar_end = 0, syscr_end = 0;
+    bool have_io;
+    unsigned long seq, expected = 0;
+    long long sent;
+    int64_t start, received;
+    struct pollfd fd;
+    int consecutive_errors = 0;
+    SerialPort sp;
+
+    sp = Serial_open(device);
+    if(sp == -1) {
+        fprintf(stderr, "Unable to open %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+    Serial_setBlocking(sp);
+
+    fd.fd = sp;
+    fd.events = POLLIN;
+
+    /* Retry until a clean ID frame is read */
+    while(true) {
+        if(poll(&fd, 1, RECEIVE_TIMEOUT) == 0 || consecutive_errors == MAX_CONSECUTIVE_ERRORS) {
+            fprintf(stderr, "No identification from the emulator\n");
+            Serial_closePort(sp);
+            return -1;
+        }
+
+        if(ArdComm_handshake(sp) == 0) {
+            break;
+        }
+        consecutive_errors++;
+    }
+    consecutive_errors = 0;
+
+    /* Repeat READY in case the handshake flushed it before it was sent. ID
+       frames sent before the emulator saw it are skipped below. */
+    ArdComm_sendMessage(sp, "READY", "NULL");
+
+    if(options->buffered) {
+        reader = Serial_Reader_new(sp);
+        msgtype = frame.type;
+        buffer = frame.data;
+    }
+
+    results->latencies = malloc(sizeof(int64_t) * options->frames);
+    results->queue_latencies = malloc(sizeof(int64_t) * options->frames);
+    have_io = read_io_counters(&rchar_start, &syscr_start);
+    start = now_ns();
+
+    while(true) {
+        if(!(reader && Serial_Reader_buffered(reader)) && poll(&fd, 1, RECEIVE_TIMEOUT) == 0) {
+            fprintf(stderr, "Timed out waiting for the emulator\n");
+            status = -1;
+            break;
+        }
+
+        if(reader) {
+            status = ArdComm_getFrame(reader, &frame);
+        } else {
+            status = ArdComm_getMessage(sp, msgtype, buffer);
+        }
+
+        if(status == ARDCOMM_EFRAME) {
+            /* Bad framing, resynchronize on the next frame */
+            results->errors++;
+            continue;
+        } else if(status == -1) {
+            results->errors++;
+            if(++consecutive_errors == MAX_CONSECUTIVE_ERRORS) {
+                fprintf(stderr, "Giving up after %d consecutive read failures\n", consecutive_errors);
+                break;
+            }
+            continue;
+        }
+        consecutive_errors = 0;
+        received = now_ns();
+
+        if(strcmp(msgtype, END_TYPE) == 0) {
+            break;
+        } else if(strcmp(msgtype, "ID") == 0) {
+            continue;
+        }
+
+        if(strcmp(msgtype, BENCH_TYPE) != 0 || strchr(buffer, '{') ||
+           sscanf(buffer, "%lu %lld", &seq, &sent) != 2 || seq >= options->frames) {
+            results->corrupt++;
+            continue;
+        }
+
+        if(seq >= expected) {
+            results->lost += seq - expected;
+            expected = seq + 1;
+        }
+
+        if(reader) {
+            /* Split the total into time on the wire and time spent queued
+               in the reader before being parsed */
+            results->latencies[results->received] = frame.timestamp - sent;
+            results->queue_latencies[results->received] = received - frame.timestamp;
+        } else {
+            results->latencies[results->received] = received - sent;
+        }
+        results->received++;
+    }
+
+    results->elapsed = (now_ns() - start) * 1e-9;
+    if(have_io && read_io_counters(&rchar_end, &syscr_end)) {
+        results->bytes_read = rchar_end - rchar_start;
+        results->read_calls = syscr_end - syscr_start;
+    }
+
+    if(reader) {
+        Serial_Reader_destroy(reader);
+    }
+
+    Serial_closePort(sp);
+    return (status == -1) ? -1 : 0;
+}
+
+/**
+ * \brief Print benchmark results
+ */
+static void report(const BenchOptions* options, BenchResults* results) {
+    double fps = results->received / results->elapsed;
+    double bytes_per_call = -1;
+    double p50, p99, max;
+    double q50 = 0, q99 = 0, qmax = 0;
+
+    if(results->read_calls > 0) {
+        bytes_per_call = (double) results->bytes_read / results->read_calls;
+    }
+
+    percentiles(results->latencies, results->received, &p50, &p99, &max);
+    if(options->buffered) {
+        percentiles(results->queue_latencies, results->received, &q50, &q99, &qmax);
+    }
+
+    if(options->csv) {
+        printf("frames,rate,noise,payload,buffered,received,lost,corrupt,errors,elapsed_s,frames_per_s,bytes_per_syscall,latency_p50_us,latency_p99_us,latency_max_us,queue_p50_us,queue_p99_us,queue_max_us\n");
+        printf("%lu,%.1f,%.3f,%zu,%d,%lu,%lu,%lu,%lu,%.6f,%.1f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+               options->frames, options->rate, options->noise, options->payload, options->buffered,
+               results->received, results->lost, results->corrupt, results->errors,
+               results->elapsed, fps, bytes_per_call, p50, p99, max, q50, q99, qmax);
+        return;
+    }
+
+    printf("Frames received      : %lu / %lu\n", results->received, options->frames);
+    printf("Lost/corrupt/errors  : %lu / %lu / %lu\n", results->lost, results->corrupt, results->errors);
+    printf("Elapsed              : %.3f s\n", results->elapsed);
+    printf("Throughput           : %.1f frames/s\n", fps);
+    if(bytes_per_call >= 0) {
+        printf("Bytes per read call  : %.2f\n", bytes_per_call);
+    } else {
+        printf("Bytes per read call  : n/a\n");
+    }
+
+    if(options->buffered) {
+        printf("Receive latency p50  : %.1f us\n", p50);
+        printf("Receive latency p99  : %.1f us\n", p99);
+        printf("Receive latency max  : %.1f us\n", max);
+        printf("Queue latency p50    : %.1f us\n", q50);
+        printf("Queue latency p99    : %.1f us\n", q99);
+        printf("Queue latency max    : %.1f us\n", qmax);
+    } else {
+        printf("Parse latency p50    : %.1f us\n", p50);
+        printf("Parse latency p99    : %.1f us\n", p99);
+        printf("Parse latency max    : %.1f us\n", max);
+    }
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-b] [-c] [-n frames] [-r rate] [-e noise] [-s payload]\n", arg0);
+    printf("       %s [-h] [-c] -p ports [-q silent] [-t timeout]\n", arg0);
+    printf("  -n frames   Number of frames to stream (default 10000)\n");
+    printf("  -r rate     Frames per second, 0 for unthrottled (default 0)\n");
+    printf("  -e noise    Probability of noise before each frame (default 0)\n");
+    printf("  -s payload  Frame payload size in bytes (default 32)\n");
+    printf("  -b          Use the buffered reader and timestamped frames\n");
+    printf("  -c          Print results as CSV\n");
+    printf("  -p ports    Benchmark ArdComm_probeAll with this many emulated devices\n");
+    printf("  -q silent   Number of probed devices which never identify (default 0)\n");
+    printf("  -t timeout  Probe timeout in seconds (default 1)\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = {.frames = 10000, .rate = 0, .noise = 0, .payload = 32, .csv = false, .buffered = false,
+                           .probe_ports = 0, .probe_silent = 0, .probe_timeout = 1.0};
+    BenchResults results;
+    struct sigaction action;
+    char* device;
+    int master;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hbcn:r:e:s:p:q:t:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'b':
+            options.buffered = true;
+            break;
+        case 'c':
+            options.csv = true;
+            break;
+        case 'n':
+            options.frames = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            options.rate = atof(optarg);
+            break;
+        case 'e':
+            options.noise = atof(optarg);
+            break;
+        case 's':
+            options.payload = Util_inRange(1, atoi(optarg), MAX_PAYLOAD - 32);
+            break;
+        case 'p':
+            options.probe_ports = Util_inRange(0, atoi(optarg), MAX_PROBE_PORTS);
+            break;
+        case 'q':
+            options.probe_silent = atoi(optarg);
+            break;
+        case 't':
+            options.probe_timeout = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Never leave emulators running when interrupted */
+    host_pid = getpid();
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = catch_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    if(options.probe_ports) {
+        options.probe_silent = Util_inRange(0, options.probe_silent, options.probe_ports);
+        return (probe_run(&options) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(options.frames == 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Open the pseudo-terminal pair */
+    if(open_pty(&master, &device) == -1) {
+        fprintf(stderr, "Unable to allocate pseudo-terminal: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if(spawn_emulator(master, EMULATOR_ID, &options, NULL, 0) == -1) {
+        fprintf(stderr, "Unable to fork emulator: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Leave the master to the emulator, so the slave hangs up if it dies */
+    close(master);
+
+    memset(&results, 0, sizeof(results));
+    if(host_run(device, &options, &results) == -1) {
+        stop_emulators();
+        exit(EXIT_FAILURE);
+    }
+
+    stop_emulators();
+
+    report(&options, &results);
+
+    free(results.latencies);
+    free(results.queue_latencies);
+    free(device);
+    return 0;
+}
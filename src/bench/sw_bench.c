@@ -0,0 +1,920 @@
+/**
+ * \file
+ * \brief Hub load generator
+ *
+ * Starts a hub with a generated variable definitions file and drives it with
+ * simulated clients. Each simulated client is a separate process using the
+ * regular libseawolf API, since the library keeps a single hub connection per
+ * process. Load clients issue a weighted mix of Var_get(), Var_set() and
+ * Notify_send() calls. Watcher processes subscribe to every variable and to
+ * the benchmark notifications and measure how long updates take to reach them.
+ * Churn processes can also be run, which repeatedly connect, subscribe to
+ * every variable, set one and close while updates are arriving.
+ *
+ * Several hub executables can be given to run the same load against each of
+ * them. By default the threaded hub and the select() based hub built by
+ * "make sw-bench" are compared side by side. Each hub can also be run a second
+ * time with the clients connected over its Unix domain socket to compare the
+ * two transports.
+ */
+
+#include "seawolf.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** Largest number of hub executables compared in one run */
+#define MAX_HUBS 8
+
+/** Published timestamps kept per variable, a power of two */
+#define PUBLISH_RING 1024
+
+/** Sequence numbers are sent as variable values, so keep them exact floats */
+#define SEQUENCE_MASK 0xffffff
+
+/** Action of the notifications sent by load clients */
+#define NOTIFY_ACTION "BENCH"
+
+/** Seconds to wait for a hub to accept connections */
+#define HUB_START_TIMEOUT 5.0
+
+/** Seconds between the clients being connected and the load starting */
+#define START_DELAY 0.1
+
+/** Seconds watchers are given to receive updates still in flight */
+#define DRAIN_TIME 0.25
+
+/** Longest time in seconds watchers are given to receive every notification */
+#define DELIVERY_TIMEOUT 5.0
+
+/**
+ * Measured operations
+ */
+typedef enum {
+    /** Var_get() round trip */
+    OP_GET,
+
+    /** Var_set() call */
+    OP_SET,
+
+    /** Notify_send() call */
+    OP_NOTIFY,
+
+    /** Var_set() in a load client to the update reaching a watcher */
+    OP_WATCH,
+
+    /** Notify_send() in a load client to the notification reaching a watcher */
+    OP_DELIVER,
+
+    /** Connecting, subscribing, setting and closing in a churn process */
+    OP_CYCLE,
+
+    /** Number of operations */
+    OP_COUNT
+} Operation;
+
+/** Names used in the report */
+static const char* operation_names[OP_COUNT] = {"Var_get", "Var_set", "Notify_send", "WATCH delivery", "NOTIFY delivery", "Connect cycle"};
+
+/** Names used in CSV output */
+static const char* operation_keys[OP_COUNT] = {"get", "set", "notify", "watch", "deliver", "cycle"};
+
+/** Names of the transports clients connect over, indexed by the unix_socket flag */
+static const char* transport_names[2] = {"tcp", "unix"};
+
+/**
+ * Benchmark options
+ */
+typedef struct {
+    /** Hub executables to benchmark */
+    char* hubs[MAX_HUBS];
+
+    /** Number of hub executables */
+    int hub_count;
+
+    /** Number of load clients */
+    int clients;
+
+    /** Number of watchers */
+    int watchers;
+
+    /** Number of churn processes */
+    int churners;
+
+    /** Number of variables defined */
+    int vars;
+
+    /** Seconds of load per hub */
+    double duration;
+
+    /** Operations per second of each load client, 0 for as fast as possible */
+    double rate;
+
+    /** Relative weights of Var_get, Var_set and Notify_send calls */
+    unsigned int mix[3];
+
+    /** Port of the first hub, later hubs use the following ports */
+    uint16_t port;
+
+    /** Output results as CSV */
+    bool csv;
+
+    /** Also run each hub with clients connected over a Unix domain socket */
+    bool compare_unix;
+} BenchOptions;
+
+/**
+ * State shared with the client and watcher processes
+ */
+typedef struct {
+    /** Time the load starts, 0 until every process is connected */
+    volatile int64_t start;
+
+    /** Time the load stops */
+    volatile int64_t stop;
+
+    /** OP_COUNT histograms for each client, followed by each watcher and
+        each churn process */
+    Histogram* results;
+
+    /** Connect cycles whose process crashed or exited with an error */
+    volatile int failed_cycles;
+
+    /** Last sequence number set for each variable */
+    uint32_t* sequence;
+
+    /** Time each sequence number was set, PUBLISH_RING per variable */
+    volatile int64_t* published;
+} SharedState;
+
+/**
+ * Completeness of delivery to the watchers, and process failures, in a run
+ */
+typedef struct {
+    /** Notifications sent, which every watcher should receive */
+    uint64_t expected;
+
+    /** Notifications received, summed over every watcher */
+    uint64_t delivered;
+
+    /** Watchers which exited, or were disconnected, before the run ended */
+    int lost_watchers;
+
+    /** Load clients which exited with an error */
+    int failed_clients;
+
+    /** Connect cycles of the churn processes which failed */
+    int failed_cycles;
+} Delivery;
+
+static SharedState* shared_new(const BenchOptions* options);
+static void shared_reset(SharedState* shared, const BenchOptions* options);
+static int write_configuration(const char* dir, const BenchOptions* options, uint16_t port, bool unix_socket);
+static bool hub_accepting(uint16_t port);
+static pid_t hub_start(const char* hub, const char* dir, uint16_t port);
+static void signal_ready(int fd);
+static void wait_for_start(SharedState* shared);
+static void client_run(int index, const char* conf, char** names, SharedState* shared, const BenchOptions* options, int ready_fd);
+static void* watcher_notifications(void* _results);
+static void watcher_run(int index, const char* conf, char** names, SharedState* shared, const BenchOptions* options, int ready_fd);
+static void churner_run(int index, const char* conf, char** names, SharedState* shared, const BenchOptions* options, int ready_fd);
+static int run_hub(const char* hub, uint16_t port, bool unix_socket, char** names, SharedState* shared, const BenchOptions* options, Histogram* totals, Delivery* delivery);
+static bool delivery_complete(const Delivery* delivery, const BenchOptions* options);
+static void report(const char* hub, bool unix_socket, const Histogram* totals, const Delivery* delivery, const BenchOptions* options, bool header);
+static void usage(char* arg0);
+
+/**
+ * \brief Map memory shared with the processes forked later
+ */
+static SharedState* shared_new(const BenchOptions* options) {
+    size_t processes = options->clients + options->watchers + options->churners;
+    size_t size = sizeof(SharedState) +
+        processes * OP_COUNT * sizeof(Histogram) +
+        options->vars * PUBLISH_RING * sizeof(int64_t) +
+        options->vars * sizeof(uint32_t);
+    SharedState* shared;
+    char* memory;
+    int zero_fd;
+
+    /* A shared mapping of /dev/zero is inherited by forked processes */
+    zero_fd = open("/dev/zero", O_RDWR);
+    if(zero_fd == -1) {
+        return NULL;
+    }
+    memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, zero_fd, 0);
+    close(zero_fd);
+
+    if(memory == MAP_FAILED) {
+        return NULL;
+    }
+
+    shared = (SharedState*) memory;
+    memory += sizeof(SharedState);
+    shared->results = (Histogram*) memory;
+    memory += processes * OP_COUNT * sizeof(Histogram);
+    shared->published = (int64_t*) memory;
+    memory += options->vars * PUBLISH_RING * sizeof(int64_t);
+    shared->sequence = (uint32_t*) memory;
+
+    return shared;
+}
+
+static void shared_reset(SharedState* shared, const BenchOptions* options) {
+    int processes = options->clients + options->watchers + options->churners;
+
+    shared->start = 0;
+    shared->stop = 0;
+    shared->failed_cycles = 0;
+
+    for(int i = 0; i < processes * OP_COUNT; i++) {
+        Histogram_init(&shared->results[i]);
+    }
+
+    memset(shared->sequence, 0, options->vars * sizeof(uint32_t));
+    memset((int64_t*) shared->published, 0, options->vars * PUBLISH_RING * sizeof(int64_t));
+}
+
+/**
+ * \brief Write the hub and client configuration files
+ *
+ * Creates var.defs, hub.conf and app.conf in dir. The hub always listens on
+ * hub.sock in dir as well as on the port, and clients are configured to
+ * connect to the socket when unix_socket is true
+ */
+static int write_configuration(const char* dir, const BenchOptions* options, uint16_t port, bool unix_socket) {
+    char path[256];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/var.defs", dir);
+    if((f = fopen(path, "w")) == NULL) {
+        return -1;
+    }
+    for(int v = 0; v < options->vars; v++) {
+        fprintf(f, "Bench%d = 0.0, 0, 0\n", v);
+    }
+    fclose(f);
+
+    snprintf(path, sizeof(path), "%s/hub.conf", dir);
+    if((f = fopen(path, "w")) == NULL) {
+        return -1;
+    }
+    fprintf(f, "bind_port = %u\nbind_path = %s/hub.sock\npassword = bench\nvar_defs = %s/var.defs\n"
+            "var_db = %s/var.db\nlog_file = %s/hub.log\nlog_replicate_stdout = 0\nlog_level = WARNING\n",
+            (unsigned int) port, dir, dir, dir, dir);
+    fclose(f);
+
+    snprintf(path, sizeof(path), "%s/app.conf", dir);
+    if((f = fopen(path, "w")) == NULL) {
+        return -1;
+    }
+    if(unix_socket) {
+        fprintf(f, "comm_server = " COMM_UNIX_PREFIX "%s/hub.sock\n", dir);
+    } else {
+        fprintf(f, "comm_server = 127.0.0.1\ncomm_port = %u\n", (unsigned int) port);
+    }
+    /* Var_get() would otherwise read the shared variable table instead of
+       asking the hub being measured */
+    fprintf(f, "comm_password = bench\nlog_level = WARNING\nlog_replicate_stdout = 0\nvar_shm = 0\n");
+    fclose(f);
+
+    return 0;
+}
+
+/**
+ * \return True if a connection to the port on the local host succeeds
+ */
+static bool hub_accepting(uint16_t port) {
+    struct sockaddr_in addr;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    bool accepting;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    accepting = (connect(sock, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    close(sock);
+
+    return accepting;
+}
+
+/**
+ * \brief Start a hub and wait for it to accept connections
+ *
+ * \return The process ID of the hub, or -1 if it did not start
+ */
+static pid_t hub_start(const char* hub, const char* dir, uint16_t port) {
+    char conf[256];
+    char search_path[1024];
+    char* library_path;
+    const char* slash;
+    int64_t deadline;
+    pid_t pid;
+    int null_fd;
+
+    snprintf(conf, sizeof(conf), "%s/hub.conf", dir);
+
+    /* Results printed so far must not be copied into the child */
+    fflush(stdout);
+    fflush(stderr);
+
+    pid = fork();
+    if(pid == 0) {
+        /* The hub logs to its log file in dir */
+        null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+
+        /* Let a hub in a build tree find the library built with it */
+        library_path = getenv("LD_LIBRARY_PATH");
+        slash = strrchr(hub, '/');
+        snprintf(search_path, sizeof(search_path), "%.*s..%s%s", slash ? (int) (slash - hub + 1) : 0, hub,
+                 library_path ? ":" : "", library_path ? library_path : "");
+        setenv("LD_LIBRARY_PATH", search_path, 1);
+
+        execl(hub, hub, "-c", conf, (char*) NULL);
+        _exit(127);
+    } else if(pid < 0) {
+        return -1;
+    }
+
+    deadline = Timer_getTimestamp() + (int64_t) (HUB_START_TIMEOUT * 1e9);
+    while(Timer_getTimestamp() < deadline) {
+        if(waitpid(pid, NULL, WNOHANG) == pid) {
+            return -1;
+        }
+        if(hub_accepting(port)) {
+            return pid;
+        }
+        Util_usleep(0.01);
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void signal_ready(int fd) {
+    char c = 0;
+
+    if(write(fd, &c, 1) != 1) {
+        _exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+static void wait_for_start(SharedState* shared) {
+    while(shared->start == 0 || Timer_getTimestamp() < shared->start) {
+        Util_usleep(0.0005);
+    }
+}
+
+/**
+ * \brief Issue the configured mix of calls until the load stops
+ */
+static void client_run(int index, const char* conf, char** names, SharedState* shared, const BenchOptions* options, int ready_fd) {
+    Histogram* results = shared->results + index * OP_COUNT;
+    unsigned int total = options->mix[0] + options->mix[1] + options->mix[2];
+    unsigned int seed = index + 1;
+    unsigned int pick;
+    char name[32];
+    char param[32];
+    uint32_t sequence;
+    int64_t t, next;
+    int v;
+
+    snprintf(name, sizeof(name), "Bench client %d", index);
+    Seawolf_loadConfig(conf);
+    Seawolf_init(name);
+
+    signal_ready(ready_fd);
+    wait_for_start(shared);
+
+    next = shared->start;
+    while((t = Timer_getTimestamp()) < shared->stop) {
+        pick = rand_r(&seed) % total;
+        v = rand_r(&seed) % options->vars;
+
+        if(pick < options->mix[0]) {
+            Var_get(names[v]);
+            Histogram_record(&results[OP_GET], Timer_getTimestamp() - t);
+        } else if(pick < options->mix[0] + options->mix[1]) {
+            /* Publish the time the sequence number is set for the watchers */
+            sequence = __sync_add_and_fetch(&shared->sequence[v], 1) & SEQUENCE_MASK;
+            shared->published[v * PUBLISH_RING + sequence % PUBLISH_RING] = t;
+            Var_set(names[v], sequence);
+            Histogram_record(&results[OP_SET], Timer_getTimestamp() - t);
+        } else {
+            snprintf(param, sizeof(param), "%lld", (long long) t);
+            Notify_send(NOTIFY_ACTION, param);
+            Histogram_record(&results[OP_NOTIFY], Timer_getTimestamp() - t);
+        }
+
+        if(options->rate > 0) {
+            next += (int64_t) (1e9 / options->rate);
+            if(next > t) {
+                Util_usleep((next - Timer_getTimestamp()) * 1e-9);
+            }
+        }
+    }
+
+    Seawolf_close();
+}
+
+/**
+ * \brief Receive benchmark notifications in a watcher
+ *
+ * \param _results Histograms of the watcher
+ * \return Never returns, the watcher is killed when the benchmark ends
+ */
+static void* watcher_notifications(void* _results) {
+    Histogram* results = (Histogram*) _results;
+    char action[64];
+    char param[64];
+
+    while(true) {
+        Notify_get(action, param);
+        Histogram_record(&results[OP_DELIVER], Timer_getTimestamp() - atoll(param));
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Subscribe to every variable and measure update delivery
+ *
+ * Updates of a variable may be coalesced, in which case only the latest value
+ * is measured
+ */
+static void watcher_run(int index, const char* conf, char** names, SharedState* shared, const BenchOptions* options, int ready_fd) {
+    Histogram* results = shared->results + (options->clients + index) * OP_COUNT;
+    pthread_t notifications;
+    char name[32];
+    uint32_t sequence;
+    int64_t published;
+    int64_t now;
+
+    snprintf(name, sizeof(name), "Bench watcher %d", index);
+    Seawolf_loadConfig(conf);
+    Seawolf_init(name);
+
+    Notify_filter(FILTER_ACTION, NOTIFY_ACTION);
+    for(int v = 0; v < options->vars; v++) {
+        Var_subscribe(names[v]);
+    }
+    pthread_create(&notifications, NULL, watcher_notifications, results);
+
+    signal_ready(ready_fd);
+
+    while(true) {
+        Var_sync();
+        now = Timer_getTimestamp();
+
+        for(int v = 0; v < options->vars; v++) {
+            if(Var_poked(names[v])) {
+                sequence = (uint32_t) Var_get(names[v]);
+                published = shared->published[v * PUBLISH_RING + sequence % PUBLISH_RING];
+                if(published > 0) {
+                    Histogram_record(&results[OP_WATCH], now - published);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * \brief Repeatedly connect, subscribe to every variable, set one and close
+ *
+ * The library connects once per process, so each cycle runs in a new child.
+ * Updates from the load keep arriving while the child closes, which must not
+ * crash it
+ */
+static void churner_run(int index, const char* conf, char** names, SharedState* shared, const BenchOptions* options, int ready_fd) {
+    Histogram* results = shared->results + (options->clients + options->watchers + index) * OP_COUNT;
+    char name[32];
+    uint32_t sequence;
+    int status;
+    int64_t t;
+    pid_t pid;
+    int v;
+
+    snprintf(name, sizeof(name), "Bench churner %d", index);
+
+    signal_ready(ready_fd);
+    wait_for_start(shared);
+
+    for(int cycle = 0; (t = Timer_getTimestamp()) < shared->stop; cycle++) {
+        v = (index + cycle) % options->vars;
+
+        pid = fork();
+        if(pid == 0) {
+            Seawolf_loadConfig(conf);
+            Seawolf_init(name);
+
+            for(int i = 0; i < options->vars; i++) {
+                Var_subscribe(names[i]);
+            }
+
+            sequence = __sync_add_and_fetch(&shared->sequence[v], 1) & SEQUENCE_MASK;
+            shared->published[v * PUBLISH_RING + sequence % PUBLISH_RING] = Timer_getTimestamp();
+            Var_set(names[v], sequence);
+
+            Seawolf_close();
+            _exit(EXIT_SUCCESS);
+        }
+
+        if(pid < 0 || waitpid(pid, &status, 0) != pid || !(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)) {
+            __sync_add_and_fetch(&shared->failed_cycles, 1);
+        } else {
+            Histogram_record(&results[OP_CYCLE], Timer_getTimestamp() - t);
+        }
+    }
+}
+
+/**
+ * \brief Run the load against one hub executable
+ *
+ * \param hub Path to the hub executable
+ * \param port Port for the hub to listen on
+ * \param names Variable names
+ * \param shared Memory shared with the client and watcher processes
+ * \param options Benchmark options
+ * \param[out] totals OP_COUNT histograms, merged from every process
+ * \param[out] delivery How completely notifications reached the watchers
+ * \return 0 on success, -1 on failure
+ */
+static int run_hub(const char* hub, uint16_t port, bool unix_socket, char** names, SharedState* shared, const BenchOptions* options, Histogram* totals, Delivery* delivery) {
+    int watchers_end = options->clients + options->watchers;
+    int processes = watchers_end + options->churners;
+    pid_t* pids = calloc(processes, sizeof(pid_t));
+    char dir[64];
+    char conf[256];
+    char path[256];
+    pid_t hub_pid;
+    int ready[2];
+    int connected = 0;
+    int pending;
+    int status;
+    int64_t deadline;
+    uint64_t received;
+    char c;
+    int result = -1;
+
+    memset(delivery, 0, sizeof(Delivery));
+
+    snprintf(dir, sizeof(dir), "/tmp/sw-bench.%d.%u", (int) getpid(), (unsigned int) port);
+    if(mkdir(dir, 0700) || write_configuration(dir, options, port, unix_socket) == -1) {
+        fprintf(stderr, "Unable to write configuration: %s\n", strerror(errno));
+        free(pids);
+        return -1;
+    }
+    snprintf(conf, sizeof(conf), "%s/app.conf", dir);
+
+    hub_pid = hub_start(hub, dir, port);
+    if(hub_pid == -1) {
+        fprintf(stderr, "Hub %s did not start, see %s/hub.log\n", hub, dir);
+        free(pids);
+        return -1;
+    }
+
+    shared_reset(shared, options);
+    if(pipe(ready)) {
+        fprintf(stderr, "Unable to create pipe: %s\n", strerror(errno));
+        goto stop_hub;
+    }
+
+    /* Results printed so far must not be copied into the children */
+    fflush(stdout);
+    fflush(stderr);
+
+    /* Watchers are forked first so they are subscribed before any load */
+    for(int i = processes - 1; i >= 0; i--) {
+        pids[i] = fork();
+        if(pids[i] == 0) {
+            close(ready[0]);
+            if(i < options->clients) {
+                client_run(i, conf, names, shared, options, ready[1]);
+            } else if(i < watchers_end) {
+                watcher_run(i - options->clients, conf, names, shared, options, ready[1]);
+            } else {
+                churner_run(i - watchers_end, conf, names, shared, options, ready[1]);
+            }
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    close(ready[1]);
+
+    /* The pipe closes early if any process fails to connect */
+    while(connected < processes && read(ready[0], &c, 1) == 1) {
+        connected++;
+    }
+    close(ready[0]);
+
+    if(connected == processes) {
+        shared->stop = Timer_getTimestamp() + (int64_t) ((START_DELAY + options->duration) * 1e9);
+        shared->start = shared->stop - (int64_t) (options->duration * 1e9);
+    } else {
+        fprintf(stderr, "Only %d of %d clients connected to %s\n", connected, processes, hub);
+        for(int i = 0; i < processes; i++) {
+            kill(pids[i], SIGKILL);
+        }
+    }
+
+    for(int i = 0; i < options->clients; i++) {
+        waitpid(pids[i], &status, 0);
+        if(connected == processes && !(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)) {
+            fprintf(stderr, "Client %d was disconnected from %s\n", i, hub);
+            delivery->failed_clients++;
+        }
+        delivery->expected += Histogram_getCount(&shared->results[i * OP_COUNT + OP_NOTIFY]);
+    }
+
+    /* Churn processes stop along with the clients */
+    for(int i = watchers_end; i < processes; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+    delivery->failed_cycles = shared->failed_cycles;
+
+    Util_usleep(DRAIN_TIME);
+
+    if(connected == processes) {
+        /* Give the watchers time to receive every notification, noting any
+           which exit early. A watcher only exits if the hub disconnects it */
+        deadline = Timer_getTimestamp() + (int64_t) (DELIVERY_TIMEOUT * 1e9);
+        do {
+            pending = 0;
+            for(int i = options->clients; i < watchers_end; i++) {
+                if(pids[i] == 0) {
+                    continue;
+                } else if(waitpid(pids[i], NULL, WNOHANG) == pids[i]) {
+                    fprintf(stderr, "Watcher %d was disconnected from %s\n", i - options->clients, hub);
+                    delivery->lost_watchers++;
+                    pids[i] = 0;
+                } else if(Histogram_getCount(&shared->results[i * OP_COUNT + OP_DELIVER]) < delivery->expected) {
+                    pending++;
+                }
+            }
+
+            if(pending) {
+                Util_usleep(0.01);
+            }
+        } while(pending && Timer_getTimestamp() < deadline);
+    }
+
+    for(int i = options->clients; i < watchers_end; i++) {
+        if(pids[i]) {
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+
+    if(connected == processes) {
+        for(int i = options->clients; i < watchers_end; i++) {
+            received = Histogram_getCount(&shared->results[i * OP_COUNT + OP_DELIVER]);
+            if(received < delivery->expected) {
+                fprintf(stderr, "Watcher %d received %llu of %llu notifications from %s\n", i - options->clients,
+                        (unsigned long long) received, (unsigned long long) delivery->expected, hub);
+            }
+            delivery->delivered += received;
+        }
+
+        for(int i = 0; i < OP_COUNT; i++) {
+            Histogram_init(&totals[i]);
+        }
+        for(int i = 0; i < processes * OP_COUNT; i++) {
+            Histogram_merge(&totals[i % OP_COUNT], &shared->results[i]);
+        }
+        result = 0;
+    }
+
+stop_hub:
+    kill(hub_pid, SIGTERM);
+    waitpid(hub_pid, NULL, 0);
+
+    if(result == 0) {
+        const char* files[] = {"var.defs", "hub.conf", "app.conf", "hub.log", "var.db", "hub.sock"};
+        for(int i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+            snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+            unlink(path);
+        }
+        rmdir(dir);
+    }
+
+    free(pids);
+    return result;
+}
+
+/**
+ * \brief Check that every notification reached every watcher and no process
+ *   was disconnected
+ */
+static bool delivery_complete(const Delivery* delivery, const BenchOptions* options) {
+    return delivery->delivered >= delivery->expected * options->watchers &&
+        delivery->lost_watchers == 0 && delivery->failed_clients == 0 && delivery->failed_cycles == 0;
+}
+
+static void report(const char* hub, bool unix_socket, const Histogram* totals, const Delivery* delivery, const BenchOptions* options, bool header) {
+    uint64_t expected = delivery->expected * options->watchers;
+    uint64_t dropped = (expected > delivery->delivered) ? expected - delivery->delivered : 0;
+    double drop_ratio = expected ? (double) dropped / expected : 0;
+    uint64_t count;
+
+    if(options->csv) {
+        if(header) {
+            printf("hub,transport,clients,watchers,vars,duration_s,operation,count,per_s,p50_us,p99_us,p999_us,max_us,dropped,drop_ratio\n");
+        }
+        for(int i = 0; i < OP_COUNT; i++) {
+            count = Histogram_getCount(&totals[i]);
+            printf("%s,%s,%d,%d,%d,%.1f,%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f", hub, transport_names[unix_socket],
+                   options->clients, options->watchers,
+                   options->vars, options->duration, operation_keys[i], (unsigned long long) count, count / options->duration,
+                   Histogram_getPercentile(&totals[i], 50) * 1e-3, Histogram_getPercentile(&totals[i], 99) * 1e-3,
+                   Histogram_getPercentile(&totals[i], 99.9) * 1e-3, Histogram_getMax(&totals[i]) * 1e-3);
+            if(i == OP_DELIVER) {
+                printf(",%llu,%.6f\n", (unsigned long long) dropped, drop_ratio);
+            } else {
+                printf(",,\n");
+            }
+        }
+        return;
+    }
+
+    printf("%s over %s: %d clients, %d watchers, %d variables, %.1f s\n", hub, transport_names[unix_socket],
+           options->clients, options->watchers, options->vars, options->duration);
+    printf("  %-16s %10s %10s %9s %9s %9s %9s\n", "Operation", "Count", "Per sec", "p50 us", "p99 us", "p999 us", "Max us");
+    for(int i = 0; i < OP_COUNT; i++) {
+        if(i == OP_CYCLE && options->churners == 0) {
+            continue;
+        }
+
+        count = Histogram_getCount(&totals[i]);
+        printf("  %-16s %10llu %10.1f %9.1f %9.1f %9.1f %9.1f\n", operation_names[i], (unsigned long long) count,
+               count / options->duration, Histogram_getPercentile(&totals[i], 50) * 1e-3,
+               Histogram_getPercentile(&totals[i], 99) * 1e-3, Histogram_getPercentile(&totals[i], 99.9) * 1e-3,
+               Histogram_getMax(&totals[i]) * 1e-3);
+    }
+    printf("  Notifications delivered %llu of %llu, %.2f%% dropped\n", (unsigned long long) delivery->delivered,
+           (unsigned long long) expected, drop_ratio * 100);
+    if(delivery->lost_watchers || delivery->failed_clients) {
+        printf("  %d watchers and %d clients disconnected by the hub\n", delivery->lost_watchers, delivery->failed_clients);
+    }
+    if(delivery->failed_cycles) {
+        printf("  %d connect cycles failed\n", delivery->failed_cycles);
+    }
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-c] [-u] [-H hub]... [-n clients] [-w watchers] [-C churners] [-v vars] [-t seconds] [-r rate] [-m get:set:notify] [-p port]\n", arg0);
+    printf("  -H hub       Hub executable to benchmark, may be repeated (default the\n");
+    printf("               seawolf-hub and seawolf-hub-select builds next to this tool)\n");
+    printf("  -n clients   Number of load clients (default 8)\n");
+    printf("  -w watchers  Number of clients watching every variable (default 2)\n");
+    printf("  -C churners  Number of processes repeatedly connecting, subscribing to every\n");
+    printf("               variable, setting one and closing (default 0)\n");
+    printf("  -v vars      Number of variables (default 16)\n");
+    printf("  -t seconds   Duration of the load on each hub (default 5)\n");
+    printf("  -r rate      Calls per second of each load client, 0 for no limit (default 0)\n");
+    printf("  -m mix       Relative weights of Var_get, Var_set and Notify_send calls (default 40:40:20)\n");
+    printf("  -p port      Port of the first hub, later hubs use the following ports (default 31500)\n");
+    printf("  -u           Run each hub again with clients connected over a Unix domain socket\n");
+    printf("  -c           Print results as CSV\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = {.hub_count = 0, .clients = 8, .watchers = 2, .churners = 0, .vars = 16, .duration = 5,
+                            .rate = 0, .mix = {40, 40, 20}, .port = 31500, .csv = false, .compare_unix = false};
+    static char default_hubs[2][256];
+    const char* variants[] = {"seawolf-hub", "seawolf-hub-select"};
+    Histogram* totals;
+    Delivery delivery;
+    SharedState* shared;
+    char** names;
+    char* slash;
+    int transports;
+    int failures = 0;
+    int runs = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hcuH:n:w:C:v:t:r:m:p:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'c':
+            options.csv = true;
+            break;
+        case 'u':
+            options.compare_unix = true;
+            break;
+        case 'H':
+            if(options.hub_count < MAX_HUBS) {
+                options.hubs[options.hub_count++] = optarg;
+            }
+            break;
+        case 'n':
+            options.clients = atoi(optarg);
+            break;
+        case 'w':
+            options.watchers = atoi(optarg);
+            break;
+        case 'C':
+            options.churners = atoi(optarg);
+            break;
+        case 'v':
+            options.vars = atoi(optarg);
+            break;
+        case 't':
+            options.duration = atof(optarg);
+            break;
+        case 'r':
+            options.rate = atof(optarg);
+            break;
+        case 'm':
+            if(sscanf(optarg, "%u:%u:%u", &options.mix[0], &options.mix[1], &options.mix[2]) != 3) {
+                fprintf(stderr, "Mix should be given as get:set:notify\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            options.port = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    options.clients = (options.clients < 1) ? 1 : options.clients;
+    options.watchers = (options.watchers < 0) ? 0 : options.watchers;
+    options.churners = (options.churners < 0) ? 0 : options.churners;
+    options.vars = (options.vars < 1) ? 1 : options.vars;
+    if(options.duration <= 0 || options.mix[0] + options.mix[1] + options.mix[2] == 0) {
+        fprintf(stderr, "Duration and mix must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Default to both hub builds in ../hub/ relative to this executable */
+    if(options.hub_count == 0) {
+        slash = strrchr(argv[0], '/');
+        for(int i = 0; i < 2; i++) {
+            snprintf(default_hubs[i], sizeof(default_hubs[i]), "%.*s../hub/%s",
+                     slash ? (int) (slash - argv[0] + 1) : 0, argv[0], variants[i]);
+            if(access(default_hubs[i], X_OK) == 0) {
+                options.hubs[options.hub_count++] = default_hubs[i];
+            }
+        }
+
+        if(options.hub_count == 0) {
+            fprintf(stderr, "No hub found, build one with \"make sw-bench\" or give one with -H\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    Timer_init();
+
+    names = malloc(options.vars * sizeof(char*));
+    for(int v = 0; v < options.vars; v++) {
+        names[v] = strdup(__Util_format("Bench%d", v));
+    }
+
+    shared = shared_new(&options);
+    totals = malloc(OP_COUNT * sizeof(Histogram));
+    if(shared == NULL || totals == NULL) {
+        fprintf(stderr, "Unable to allocate shared memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Processes killed at the end of a run must not take the benchmark down */
+    signal(SIGPIPE, SIG_IGN);
+
+    transports = options.compare_unix ? 2 : 1;
+    for(int i = 0; i < options.hub_count; i++) {
+        for(int t = 0; t < transports; t++) {
+            if(run_hub(options.hubs[i], options.port + i * transports + t, t == 1, names, shared, &options, totals, &delivery) == 0) {
+                report(options.hubs[i], t == 1, totals, &delivery, &options, runs++ == 0);
+                if(!delivery_complete(&delivery, &options)) {
+                    fprintf(stderr, "Delivery from %s over %s was incomplete\n", options.hubs[i], transport_names[t]);
+                    failures++;
+                }
+            } else {
+                failures++;
+            }
+        }
+    }
+
+    for(int v = 0; v < options.vars; v++) {
+        free(names[v]);
+    }
+    free(names);
+    free(totals);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
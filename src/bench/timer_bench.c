@@ -0,0 +1,213 @@
+/**
+ * \file
+ * \brief Timestamp cost and precision benchmark
+ *
+ * Measures the cost per call and the observable resolution of each of the
+ * ways of reading the time available to applications: the raw system calls,
+ * Timer_getTimestamp(), and Timer_now() with each Timer clock source. When the
+ * time stamp counter is available its drift from the monotonic clock after
+ * calibration is measured as well.
+ */
+
+#include "seawolf.h"
+
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Benchmark options
+ */
+typedef struct {
+    /** Number of timestamps to take for each method */
+    unsigned long iterations;
+
+    /** Seconds over which to measure clock drift */
+    double drift_time;
+
+    /** Output results as CSV */
+    bool csv;
+} BenchOptions;
+
+/**
+ * A way of reading the time
+ */
+typedef struct {
+    /** Name used in the results */
+    const char* name;
+
+    /** Clock source to select before running, or -1 to leave unchanged */
+    int source;
+
+    /** Read the time in nanoseconds */
+    int64_t (*read)(void);
+} TimeMethod;
+
+static int64_t read_clock_gettime(void);
+static int64_t read_gettimeofday(void);
+static int64_t read_timer_delta(void);
+static void run_method(const TimeMethod* method, const BenchOptions* options);
+static void run_drift(const BenchOptions* options);
+static void usage(char* arg0);
+
+/** Timer used by read_timer_delta() */
+static Timer* delta_timer = NULL;
+
+static int64_t read_clock_gettime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t read_gettimeofday(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((int64_t) tv.tv_sec) * 1000000000LL + tv.tv_usec * 1000LL;
+}
+
+static int64_t read_timer_delta(void) {
+    return Timer_getDeltaNS(delta_timer);
+}
+
+/**
+ * \brief Measure a single method
+ *
+ * The cost is the mean time per call over all iterations. The resolution is
+ * the smallest non-zero difference seen between consecutive readings, and the
+ * repeat rate is the fraction of consecutive readings which were identical.
+ */
+static void run_method(const TimeMethod* method, const BenchOptions* options) {
+    int64_t start, end, previous, now, diff;
+    int64_t resolution = INT64_MAX;
+    unsigned long repeats = 0;
+    volatile int64_t sink = 0;
+    bool is_delta = (method->read == read_timer_delta);
+
+    if(method->source >= 0 && Timer_setClockSource(method->source) == -1) {
+        if(!options->csv) {
+            printf("%-28s unavailable\n", method->name);
+        }
+        return;
+    }
+
+    /* Cost */
+    start = Timer_getTimestamp();
+    for(unsigned long i = 0; i < options->iterations; i++) {
+        sink += method->read();
+    }
+    end = Timer_getTimestamp();
+
+    /* Resolution. Deltas are already differences */
+    previous = method->read();
+    for(unsigned long i = 0; i < options->iterations; i++) {
+        now = method->read();
+        diff = is_delta ? now : now - previous;
+        if(diff == 0) {
+            repeats++;
+        } else if(diff > 0 && diff < resolution) {
+            resolution = diff;
+        }
+        previous = now;
+    }
+
+    if(options->csv) {
+        printf("%s,%.2f,%lld,%.4f\n", method->name,
+               ((double) (end - start)) / options->iterations,
+               (long long) resolution,
+               ((double) repeats) / options->iterations);
+    } else {
+        printf("%-28s %8.2f ns/call  resolution %6lld ns  repeats %5.1f%%\n", method->name,
+               ((double) (end - start)) / options->iterations,
+               (long long) resolution,
+               100.0 * repeats / options->iterations);
+    }
+
+    (void) sink;
+}
+
+/**
+ * \brief Measure the drift of the time stamp counter from the monotonic clock
+ */
+static void run_drift(const BenchOptions* options) {
+    int64_t offset_start, offset_end;
+    double ppm;
+
+    if(Timer_setClockSource(TIMER_CLOCK_TSC) == -1) {
+        return;
+    }
+
+    offset_start = Timer_now() - Timer_getTimestamp();
+    Util_usleep(options->drift_time);
+    offset_end = Timer_now() - Timer_getTimestamp();
+
+    ppm = (offset_end - offset_start) / (options->drift_time * 1e3);
+
+    if(options->csv) {
+        printf("drift_ppm,offset_start_ns,offset_end_ns\n");
+        printf("%.3f,%lld,%lld\n", ppm, (long long) offset_start, (long long) offset_end);
+    } else {
+        printf("TSC drift from monotonic: %.3f ppm (offset %lld ns -> %lld ns over %.1f s)\n",
+               ppm, (long long) offset_start, (long long) offset_end, options->drift_time);
+    }
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-c] [-n iterations] [-d seconds]\n", arg0);
+    printf("  -n iterations  Timestamps taken per method (default 10000000)\n");
+    printf("  -d seconds     Time over which to measure TSC drift, 0 to skip (default 1)\n");
+    printf("  -c             Print results as CSV\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = {.iterations = 10000000, .drift_time = 1.0, .csv = false};
+    const TimeMethod methods[] = {
+        {"clock_gettime", -1, read_clock_gettime},
+        {"gettimeofday", -1, read_gettimeofday},
+        {"Timer_getTimestamp", -1, Timer_getTimestamp},
+        {"Timer_now(monotonic)", TIMER_CLOCK_MONOTONIC, Timer_now},
+        {"Timer_getDeltaNS(monotonic)", TIMER_CLOCK_MONOTONIC, read_timer_delta},
+        {"Timer_now(tsc)", TIMER_CLOCK_TSC, Timer_now},
+        {"Timer_getDeltaNS(tsc)", TIMER_CLOCK_TSC, read_timer_delta},
+    };
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hcn:d:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'c':
+            options.csv = true;
+            break;
+        case 'n':
+            options.iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            options.drift_time = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    options.iterations = (options.iterations < 1) ? 1 : options.iterations;
+
+    Timer_init();
+    delta_timer = Timer_new();
+
+    if(options.csv) {
+        printf("method,ns_per_call,resolution_ns,repeat_fraction\n");
+    }
+
+    for(size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        run_method(&methods[i], &options);
+    }
+
+    if(options.drift_time > 0) {
+        run_drift(&options);
+    }
+
+    Timer_destroy(delta_timer);
+    return 0;
+}
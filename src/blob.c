@@ -0,0 +1,626 @@
+/**
+ * \file
+ * \brief Shared memory blob channels
+ */
+
+#include "seawolf.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t Blob_roundToPage(size_t size);
+static Blob_Channel* Blob_newChannel(const char* name, bool producer);
+static void Blob_destroyChannel(Blob_Channel* channel);
+static int Blob_mapSegment(Blob_Channel* channel);
+static bool Blob_acquire(Blob_ShmSlot* slot, uint64_t sequence);
+
+/** Component initialized */
+static bool initialized = false;
+
+/** Channels created or opened by this process, by name */
+static Dictionary* channels = NULL;
+
+/** Protects channels, and channels from being freed while messages are input */
+static pthread_mutex_t channels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Distinguishes the segments created by this process */
+static int segment_counter = 0;
+
+/**
+ * \defgroup Blob Blob channels
+ * \ingroup Communications
+ * \brief Share large payloads, such as camera frames, between applications on
+ * the same host without copying them through the hub
+ *
+ * A producer creates a named channel backed by a shared memory segment holding
+ * a ring of fixed size slots. It writes each frame directly into a slot
+ * returned by Blob_allocate() and calls Blob_publish(), which sends the hub a
+ * small descriptor of the slot. The hub forwards the descriptor to every
+ * consumer which opened the channel, and consumers read the frame in place
+ * from their own mapping of the segment. Slots are reference counted so the
+ * producer never reuses a slot while a consumer still holds its frame.
+ *
+ * Consumers always receive the newest frame, frames published faster than a
+ * consumer receives them are skipped and counted by Blob_getDropped(). A
+ * consumer which exits without releasing a frame leaves its slot held, so
+ * producers should allow a slot or two more than they need.
+ * \{
+ */
+
+/**
+ * \brief Blob component initialization
+ * \private
+ */
+void Blob_init(void) {
+    channels = Dictionary_new();
+    initialized = true;
+}
+
+/**
+ * \brief Create a channel
+ *
+ * Create a channel of the given name and become its producer. The channel's
+ * segment is created by the calling process and removed when the channel is
+ * closed. Only processes running as the same user can open the channel.
+ *
+ * \param name Name consumers open the channel by, shorter than BLOB_NAME_LEN
+ * \param slot_size Largest frame which will be published
+ * \param slot_count Number of slots in the ring
+ * \return The new channel, or NULL if it could not be created or a channel of
+ * the same name already exists
+ */
+Blob_Channel* Blob_create(const char* name, size_t slot_size, int slot_count) {
+    Blob_Channel* channel;
+    Blob_ShmHeader* header;
+    Comm_Message* request;
+    Comm_Message* response;
+    size_t headers_size;
+    int fd;
+
+    if(strlen(name) >= BLOB_NAME_LEN || strchr(name, ' ') || slot_size == 0 || slot_count <= 0) {
+        Logging_log(ERROR, __Util_format("Invalid blob channel '%s'", name));
+        return NULL;
+    }
+
+    channel = Blob_newChannel(name, true);
+    snprintf(channel->segment, BLOB_NAME_LEN, BLOB_SHM_NAME_FORMAT, (int) getpid(),
+             __sync_fetch_and_add(&segment_counter, 1));
+
+    headers_size = Blob_roundToPage(sizeof(Blob_ShmHeader) + slot_count * sizeof(Blob_ShmSlot));
+    channel->size = headers_size + slot_count * Blob_roundToPage(slot_size);
+
+    /* Consumers increment the reference counts so must be able to write, but
+       no other user may read or modify the frames */
+    fd = shm_open(channel->segment, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd == -1) {
+        Logging_log(ERROR, __Util_format("Unable to create blob segment: %s", strerror(errno)));
+        Blob_destroyChannel(channel);
+        return NULL;
+    }
+
+    if(ftruncate(fd, channel->size) != 0) {
+        close(fd);
+        shm_unlink(channel->segment);
+        Logging_log(ERROR, __Util_format("Unable to size blob segment: %s", strerror(errno)));
+        Blob_destroyChannel(channel);
+        return NULL;
+    }
+
+    header = mmap(NULL, channel->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(header == MAP_FAILED) {
+        shm_unlink(channel->segment);
+        Logging_log(ERROR, __Util_format("Unable to map blob segment: %s", strerror(errno)));
+        Blob_destroyChannel(channel);
+        return NULL;
+    }
+
+    /* ftruncate zeroed the slots, all are free and empty */
+    header->magic = BLOB_SHM_MAGIC;
+    header->version = BLOB_SHM_VERSION;
+    header->slot_count = slot_count;
+    header->slot_size = slot_size;
+    header->slot_stride = Blob_roundToPage(slot_size);
+    header->headers_offset = sizeof(Blob_ShmHeader);
+    header->data_offset = headers_size;
+    channel->header = header;
+
+    request = Comm_Message_new(4);
+    request->components[0] = "BLOB";
+    request->components[1] = "CREATE";
+    request->components[2] = channel->name;
+    request->components[3] = channel->segment;
+    Comm_assignRequestID(request);
+    response = Comm_sendMessage(request);
+    Comm_Message_destroy(request);
+
+    if(response == NULL || response->count != 2 || strcmp(response->components[1], "CREATED") != 0) {
+        Logging_log(ERROR, __Util_format("Blob channel '%s' already exists", name));
+        if(response) {
+            Comm_Message_destroy(response);
+        }
+        munmap(channel->header, channel->size);
+        shm_unlink(channel->segment);
+        Blob_destroyChannel(channel);
+        return NULL;
+    }
+    Comm_Message_destroy(response);
+
+    pthread_mutex_lock(&channels_lock);
+    Dictionary_set(channels, channel->name, channel);
+    pthread_mutex_unlock(&channels_lock);
+
+    return channel;
+}
+
+/**
+ * \brief Allocate a slot to write a frame into
+ *
+ * Return the data of a slot no consumer holds for the producer to write the
+ * next frame into, preferring the slot published longest ago. Calling
+ * Blob_allocate() again before Blob_publish() returns the same slot.
+ *
+ * \param channel A channel created by this process
+ * \return The slot's data, large enough for the slot_size given to
+ * Blob_create(), or NULL if consumers hold every slot
+ */
+void* Blob_allocate(Blob_Channel* channel) {
+    Blob_ShmHeader* header = channel->header;
+    int slot;
+
+    if(channel->writing != -1) {
+        return BLOB_SHM_DATA(header, channel->writing);
+    }
+
+    for(uint32_t i = 1; i <= header->slot_count; i++) {
+        slot = (channel->last_slot + i) % header->slot_count;
+        if(__sync_bool_compare_and_swap(&BLOB_SHM_SLOT(header, slot)->refs, 0, -1)) {
+            channel->writing = slot;
+            return BLOB_SHM_DATA(header, slot);
+        }
+    }
+
+    channel->dropped++;
+    return NULL;
+}
+
+/**
+ * \brief Publish a frame
+ *
+ * Publish the frame written into the slot returned by Blob_allocate() to the
+ * channel's consumers. The producer must not touch the slot afterwards.
+ *
+ * \param channel A channel created by this process
+ * \param length Length of the frame, no larger than the channel's slot_size
+ * \return 0 on success, -1 if no slot was allocated or length is too large
+ */
+int Blob_publish(Blob_Channel* channel, size_t length) {
+    Blob_ShmSlot* slot;
+    Comm_Message* message;
+    char slot_buffer[16];
+    char sequence_buffer[24];
+    char length_buffer[24];
+
+    if(channel->writing == -1 || length > channel->header->slot_size) {
+        return -1;
+    }
+
+    slot = BLOB_SHM_SLOT(channel->header, channel->writing);
+    slot->sequence = ++channel->sequence;
+    slot->length = length;
+
+    /* Make the frame and its descriptor visible before releasing the slot */
+    __sync_synchronize();
+    slot->refs = 0;
+
+    snprintf(slot_buffer, sizeof(slot_buffer), "%d", channel->writing);
+    snprintf(sequence_buffer, sizeof(sequence_buffer), "%llu", (unsigned long long) channel->sequence);
+    snprintf(length_buffer, sizeof(length_buffer), "%llu", (unsigned long long) length);
+    channel->last_slot = channel->writing;
+    channel->writing = -1;
+
+    message = Comm_Message_new(6);
+    message->components[0] = "BLOB";
+    message->components[1] = "PUBLISH";
+    message->components[2] = channel->name;
+    message->components[3] = slot_buffer;
+    message->components[4] = sequence_buffer;
+    message->components[5] = length_buffer;
+    Comm_sendMessage(message);
+    Comm_Message_destroy(message);
+
+    return 0;
+}
+
+/**
+ * \brief Open a channel
+ *
+ * Open a channel created by another application on the same host and start
+ * receiving its frames
+ *
+ * \param name Name of the channel
+ * \return The channel, or NULL if there is no such channel, it is already open
+ * in this process, or its segment could not be mapped
+ */
+Blob_Channel* Blob_open(const char* name) {
+    Blob_Channel* channel;
+    Comm_Message* request;
+    Comm_Message* response;
+
+    if(strlen(name) >= BLOB_NAME_LEN) {
+        Logging_log(ERROR, __Util_format("Invalid blob channel '%s'", name));
+        return NULL;
+    }
+
+    /* Register the channel before opening it so no descriptor sent in between
+       is lost */
+    pthread_mutex_lock(&channels_lock);
+    if(Dictionary_get(channels, name)) {
+        pthread_mutex_unlock(&channels_lock);
+        Logging_log(ERROR, __Util_format("Blob channel '%s' is already open", name));
+        return NULL;
+    }
+    channel = Blob_newChannel(name, false);
+    Dictionary_set(channels, channel->name, channel);
+    pthread_mutex_unlock(&channels_lock);
+
+    request = Comm_Message_new(3);
+    request->components[0] = "BLOB";
+    request->components[1] = "OPEN";
+    request->components[2] = channel->name;
+    Comm_assignRequestID(request);
+    response = Comm_sendMessage(request);
+    Comm_Message_destroy(request);
+
+    if(response && response->count == 4 && strcmp(response->components[1], "CHANNEL") == 0) {
+        strncpy(channel->segment, response->components[3], BLOB_NAME_LEN - 1);
+        if(Blob_mapSegment(channel) == 0) {
+            Comm_Message_destroy(response);
+            return channel;
+        }
+    } else {
+        Logging_log(ERROR, __Util_format("No blob channel '%s'", name));
+    }
+
+    if(response) {
+        Comm_Message_destroy(response);
+    }
+
+    Blob_closeChannel(channel);
+    return NULL;
+}
+
+/**
+ * \brief Receive a frame
+ *
+ * Wait for a frame newer than the last one received and hold it. The frame
+ * must be passed to Blob_release() once it has been read.
+ *
+ * \param channel A channel opened with Blob_open()
+ * \param[out] frame Filled in with the received frame
+ * \return 0 on success, -1 if the channel has been closed
+ */
+int Blob_receive(Blob_Channel* channel, Blob_Frame* frame) {
+    Blob_ShmSlot* slot;
+    uint64_t sequence;
+    int index;
+
+    pthread_mutex_lock(&channel->lock);
+    while(true) {
+        while(!channel->closed && channel->latest_sequence <= channel->received) {
+            pthread_cond_wait(&channel->frame_available, &channel->lock);
+        }
+
+        if(channel->closed) {
+            pthread_mutex_unlock(&channel->lock);
+            return -1;
+        }
+
+        index = channel->latest_slot;
+        sequence = channel->latest_sequence;
+        channel->received = sequence;
+
+        slot = BLOB_SHM_SLOT(channel->header, index);
+        if(Blob_acquire(slot, sequence)) {
+            break;
+        }
+
+        /* The producer has already reused the slot for a newer frame */
+        channel->dropped++;
+    }
+    pthread_mutex_unlock(&channel->lock);
+
+    frame->channel = channel;
+    frame->slot = index;
+    frame->sequence = sequence;
+    frame->length = slot->length;
+    frame->data = BLOB_SHM_DATA(channel->header, index);
+
+    return 0;
+}
+
+/**
+ * \brief Release a frame
+ *
+ * Let the producer reuse the slot holding a frame returned by Blob_receive().
+ * The frame's data must not be read afterwards.
+ *
+ * \param frame The frame
+ */
+void Blob_release(Blob_Frame* frame) {
+    __sync_fetch_and_sub(&BLOB_SHM_SLOT(frame->channel->header, frame->slot)->refs, 1);
+    frame->data = NULL;
+}
+
+/**
+ * \brief Get the number of dropped frames
+ *
+ * For a consumer, the number of frames published which were never returned by
+ * Blob_receive() because a newer frame was published first. For the producer,
+ * the number of times Blob_allocate() found every slot held.
+ *
+ * \param channel The channel
+ * \return Number of dropped frames
+ */
+uint64_t Blob_getDropped(Blob_Channel* channel) {
+    uint64_t dropped;
+
+    pthread_mutex_lock(&channel->lock);
+    dropped = channel->dropped;
+    pthread_mutex_unlock(&channel->lock);
+
+    return dropped;
+}
+
+/**
+ * \brief Close a channel
+ *
+ * Stop producing or consuming frames on a channel and free it. When the
+ * producer closes a channel the hub tells its consumers, whose calls to
+ * Blob_receive() then return -1. A consumer must release any frames it holds
+ * and no thread may be waiting in Blob_receive() when it closes the channel.
+ *
+ * \param channel The channel
+ */
+void Blob_closeChannel(Blob_Channel* channel) {
+    Comm_Message* message;
+
+    pthread_mutex_lock(&channels_lock);
+    if(channels && Dictionary_get(channels, channel->name) == channel) {
+        Dictionary_remove(channels, channel->name);
+        pthread_mutex_unlock(&channels_lock);
+
+        message = Comm_Message_new(3);
+        message->components[0] = "BLOB";
+        message->components[1] = "CLOSE";
+        message->components[2] = channel->name;
+        Comm_sendMessage(message);
+        Comm_Message_destroy(message);
+    } else {
+        pthread_mutex_unlock(&channels_lock);
+    }
+
+    if(channel->header) {
+        munmap(channel->header, channel->size);
+    }
+
+    if(channel->producer) {
+        shm_unlink(channel->segment);
+    }
+
+    Blob_destroyChannel(channel);
+}
+
+/**
+ * \brief Input a new message
+ * \private
+ *
+ * Receive a frame descriptor or close notice for an open channel from the Comm
+ * component
+ *
+ * \param message The input message
+ */
+void Blob_inputMessage(Comm_Message* message) {
+    Blob_Channel* channel;
+    uint64_t sequence;
+    int slot;
+
+    /* <- BLOB FRAME <name> <slot> <sequence> <length>
+       <- BLOB CLOSED <name> */
+
+    pthread_mutex_lock(&channels_lock);
+    if(channels && message->count >= 3 && (channel = Dictionary_get(channels, message->components[2])) != NULL &&
+       !channel->producer) {
+        pthread_mutex_lock(&channel->lock);
+
+        if(message->count == 6 && strcmp(message->components[1], "FRAME") == 0) {
+            slot = atoi(message->components[3]);
+            sequence = strtoull(message->components[4], NULL, 10);
+
+            if(slot >= 0 && (channel->header == NULL || (uint32_t) slot < channel->header->slot_count) &&
+               sequence > channel->latest_sequence) {
+                /* The previous frame was never received */
+                if(channel->latest_sequence > channel->received) {
+                    channel->dropped++;
+                }
+
+                channel->latest_slot = slot;
+                channel->latest_sequence = sequence;
+                pthread_cond_broadcast(&channel->frame_available);
+            }
+        } else if(message->count == 3 && strcmp(message->components[1], "CLOSED") == 0) {
+            channel->closed = true;
+            pthread_cond_broadcast(&channel->frame_available);
+        }
+
+        pthread_mutex_unlock(&channel->lock);
+    }
+    pthread_mutex_unlock(&channels_lock);
+
+    Comm_Message_destroy(message);
+}
+
+/**
+ * \brief Close the Blob component
+ * \private
+ *
+ * Wake any consumers waiting for frames and remove the segments of channels
+ * this process produces. Channels are left mapped since the application may
+ * still hold frames.
+ */
+void Blob_close(void) {
+    Blob_Channel* channel;
+    List* names;
+    char* name;
+
+    if(!initialized) {
+        return;
+    }
+
+    pthread_mutex_lock(&channels_lock);
+    names = Dictionary_getKeys(channels);
+    while((name = List_remove(names, 0)) != NULL) {
+        channel = Dictionary_get(channels, name);
+
+        pthread_mutex_lock(&channel->lock);
+        channel->closed = true;
+        pthread_cond_broadcast(&channel->frame_available);
+        pthread_mutex_unlock(&channel->lock);
+
+        if(channel->producer) {
+            shm_unlink(channel->segment);
+        }
+    }
+    List_destroy(names);
+
+    Dictionary_destroy(channels);
+    channels = NULL;
+    pthread_mutex_unlock(&channels_lock);
+
+    initialized = false;
+}
+
+/** \} */
+
+/**
+ * \brief Round a size up to a whole number of pages
+ *
+ * \param size The size
+ * \return The rounded size
+ */
+static size_t Blob_roundToPage(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+/**
+ * \brief Allocate a channel
+ *
+ * \param name Name of the channel
+ * \param producer True if the channel is being created by this process
+ * \return The new, unmapped channel
+ */
+static Blob_Channel* Blob_newChannel(const char* name, bool producer) {
+    Blob_Channel* channel = calloc(1, sizeof(Blob_Channel));
+
+    strncpy(channel->name, name, BLOB_NAME_LEN - 1);
+    channel->producer = producer;
+    channel->writing = -1;
+    channel->last_slot = -1;
+    channel->latest_slot = -1;
+    pthread_mutex_init(&channel->lock, NULL);
+    pthread_cond_init(&channel->frame_available, NULL);
+
+    return channel;
+}
+
+/**
+ * \brief Free a channel
+ *
+ * \param channel The channel, already unmapped
+ */
+static void Blob_destroyChannel(Blob_Channel* channel) {
+    pthread_mutex_destroy(&channel->lock);
+    pthread_cond_destroy(&channel->frame_available);
+    free(channel);
+}
+
+/**
+ * \brief Map the segment of a channel opened by a consumer
+ *
+ * \param channel The channel, with segment set
+ * \return 0 on success, -1 if the segment can not be mapped or is not a blob
+ * channel
+ */
+static int Blob_mapSegment(Blob_Channel* channel) {
+    Blob_ShmHeader* header = MAP_FAILED;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(channel->segment, O_RDWR, 0);
+    if(fd == -1) {
+        Logging_log(ERROR, __Util_format("Unable to open blob segment: %s", strerror(errno)));
+        return -1;
+    }
+
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(Blob_ShmHeader)) {
+        header = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if(header == MAP_FAILED) {
+        Logging_log(ERROR, "Unable to map blob segment");
+        return -1;
+    }
+
+    if(header->magic != BLOB_SHM_MAGIC || header->version != BLOB_SHM_VERSION ||
+       header->headers_offset + (uint64_t) header->slot_count * sizeof(Blob_ShmSlot) > header->data_offset ||
+       header->data_offset + (uint64_t) header->slot_count * header->slot_stride > (uint64_t) st.st_size) {
+        Logging_log(ERROR, "Invalid blob segment");
+        munmap(header, st.st_size);
+        return -1;
+    }
+
+    pthread_mutex_lock(&channel->lock);
+    channel->header = header;
+    channel->size = st.st_size;
+
+    /* Discard a descriptor received before the slot count was known */
+    if(channel->latest_slot >= (int) header->slot_count) {
+        channel->received = channel->latest_sequence;
+    }
+    pthread_mutex_unlock(&channel->lock);
+
+    return 0;
+}
+
+/**
+ * \brief Take a reference to a slot
+ *
+ * \param slot The slot
+ * \param sequence Sequence number of the frame expected in the slot
+ * \return True if the slot was acquired and still holds the frame, false if
+ * the producer owns it or has written a different frame to it
+ */
+static bool Blob_acquire(Blob_ShmSlot* slot, uint64_t sequence) {
+    int32_t refs;
+
+    do {
+        refs = slot->refs;
+        if(refs < 0) {
+            return false;
+        }
+    } while(!__sync_bool_compare_and_swap(&slot->refs, refs, refs + 1));
+
+    /* Read the sequence only once the slot is held */
+    __sync_synchronize();
+    if(slot->sequence != sequence) {
+        __sync_fetch_and_sub(&slot->refs, 1);
+        return false;
+    }
+
+    return true;
+}
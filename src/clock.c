@@ -0,0 +1,502 @@
+/**
+ * \file
+ * \brief Simulation clock
+ */
+
+#include "seawolf.h"
+
+#include <pthread.h>
+#include <time.h>
+
+static int64_t Clock_getVirtualTime(void);
+static int64_t Clock_getVirtualDelay(int64_t deadline);
+static void Clock_rebase(void);
+static void Clock_notifyListeners(void);
+static void Clock_timedWait(int64_t delay);
+static int Clock_hubRequest(char* command, char* argument);
+
+/**
+ * \defgroup Clock Simulation clock
+ * \ingroup Utilities
+ * \brief Real or virtual time for simulations
+ *
+ * The Clock is the time base used by Timer objects (and so PID controllers),
+ * Util_usleep(), the deadline scheduler and periodic loops. By default it is
+ * the monotonic clock. A virtual clock can instead be selected, either local
+ * to the application or shared by every application connected to the hub,
+ * which can be paused and stepped or free run at any multiple of real time so
+ * that simulations run as fast as the CPU allows.
+ *
+ * Virtual time starts just after the real monotonic time when it is selected
+ * and never runs backwards. Timer_getTimestamp() always returns real time.
+ *
+ * \{
+ */
+
+/**
+ * \cond Clock_Internal
+ * \internal
+ */
+
+/**
+ * The selected source
+ */
+static Clock_Source source = CLOCK_SOURCE_REAL;
+
+/**
+ * Virtual time at real_anchor
+ */
+static int64_t virtual_base = 0;
+
+/**
+ * Real monotonic time at which virtual time was last rebased
+ */
+static int64_t real_anchor = 0;
+
+/**
+ * Virtual seconds per real second. 0 when paused
+ */
+static double rate = 1.0;
+
+/**
+ * Set once Clock_set() has been called for the selected source
+ */
+static bool synchronized = false;
+
+/**
+ * Protects the clock state
+ */
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Broadcast when virtual time is stepped or its rate changes
+ */
+static pthread_cond_t clock_changed = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Functions called when virtual time is stepped or its rate changes
+ */
+static void (*listeners[CLOCK_MAX_LISTENERS])(void);
+
+/**
+ * Number of registered listeners
+ */
+static int listener_count = 0;
+
+/**
+ * \endcond Clock_Internal
+ */
+
+/**
+ * \brief Get the current virtual time
+ * \private
+ *
+ * Must be called with the clock lock held
+ */
+static int64_t Clock_getVirtualTime(void) {
+    return virtual_base + (int64_t) ((Timer_getTimestamp() - real_anchor) * rate);
+}
+
+/**
+ * \brief Get the real time until a virtual time
+ * \private
+ *
+ * Must be called with the clock lock held
+ *
+ * \return Real nanoseconds until the deadline, 0 if it has passed, or -1 if
+ *   the clock is paused
+ */
+static int64_t Clock_getVirtualDelay(int64_t deadline) {
+    int64_t remaining = deadline - Clock_getVirtualTime();
+
+    if(remaining <= 0) {
+        return 0;
+    } else if(rate <= 0) {
+        return -1;
+    }
+
+    /* Round up so a waiter does not wake just before the deadline */
+    return (int64_t) (remaining / rate) + 1;
+}
+
+/**
+ * \brief Move the virtual time anchor to now
+ * \private
+ *
+ * Called before changing the rate so that time already elapsed is kept at the
+ * old rate. Must be called with the clock lock held.
+ */
+static void Clock_rebase(void) {
+    virtual_base = Clock_getVirtualTime();
+    real_anchor = Timer_getTimestamp();
+}
+
+/**
+ * \brief Wake sleepers and call listeners after the clock changes
+ * \private
+ */
+static void Clock_notifyListeners(void) {
+    int count;
+
+    pthread_mutex_lock(&clock_lock);
+    pthread_cond_broadcast(&clock_changed);
+    count = listener_count;
+    pthread_mutex_unlock(&clock_lock);
+
+    for(int i = 0; i < count; i++) {
+        listeners[i]();
+    }
+}
+
+/**
+ * \brief Wait on clock_changed for a real delay
+ * \private
+ *
+ * Must be called with the clock lock held
+ *
+ * \param delay Real nanoseconds to wait, or -1 to wait until signaled
+ */
+static void Clock_timedWait(int64_t delay) {
+    struct timespec deadline;
+
+    if(delay < 0) {
+        pthread_cond_wait(&clock_changed, &clock_lock);
+        return;
+    }
+
+    /* Condition variables wait on the realtime clock */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += delay / 1000000000LL;
+    deadline.tv_nsec += delay % 1000000000LL;
+    if(deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_cond_timedwait(&clock_changed, &clock_lock, &deadline);
+}
+
+/**
+ * \brief Send a clock request to the hub and apply the clock in the response
+ * \private
+ *
+ * \param command The COMM command to send
+ * \param argument Argument to the command, or NULL
+ * \return 0 on success, or -1 if the hub refused the request
+ */
+static int Clock_hubRequest(char* command, char* argument) {
+    static char* namespace = "COMM";
+    Comm_Message* request;
+    Comm_Message* response;
+    int rc = 0;
+
+    request = Comm_Message_new(argument ? 3 : 2);
+    request->components[0] = namespace;
+    request->components[1] = command;
+    if(argument) {
+        request->components[2] = argument;
+    }
+
+    Comm_assignRequestID(request);
+    response = Comm_sendMessage(request);
+    Comm_Message_destroy(request);
+
+    if(response == NULL) {
+        return -1;
+    }
+
+    if(response->count == 4 && strcmp(response->components[1], "CLOCK") == 0) {
+        Clock_set(atoll(response->components[2]), atof(response->components[3]));
+    } else {
+        Logging_log(ERROR, __Util_format("Hub refused clock request %s", command));
+        rc = -1;
+    }
+
+    Comm_Message_destroy(response);
+
+    return rc;
+}
+
+/**
+ * \brief Initialize the Clock component
+ * \private
+ *
+ * When using the hub clock, subscribe to it and fetch its current state
+ */
+void Clock_init(void) {
+    if(source == CLOCK_SOURCE_HUB) {
+        Clock_hubRequest("CLOCK_SYNC", NULL);
+    }
+}
+
+/**
+ * \brief Select the clock source
+ *
+ * Should be called before anything which uses the clock is started, normally
+ * by setting the clock_source configuration option. Selecting a virtual source
+ * starts virtual time at the next whole second of real time.
+ *
+ * \param new_source The source to use
+ */
+void Clock_setSource(Clock_Source new_source) {
+    pthread_mutex_lock(&clock_lock);
+    if(source == CLOCK_SOURCE_REAL && new_source != CLOCK_SOURCE_REAL) {
+        /* Start on a whole second so that steps by whole periods land exactly
+           on scheduler ticks and loop deadlines */
+        real_anchor = Timer_getTimestamp();
+        virtual_base = (real_anchor / 1000000000LL + 1) * 1000000000LL;
+    }
+    source = new_source;
+    synchronized = false;
+    pthread_mutex_unlock(&clock_lock);
+
+    Clock_notifyListeners();
+}
+
+/**
+ * \brief Get the clock source
+ *
+ * \return The selected source
+ */
+Clock_Source Clock_getSource(void) {
+    return source;
+}
+
+/**
+ * \brief Check if the clock is virtual
+ *
+ * \return true if using a local or hub virtual clock
+ */
+bool Clock_isVirtual(void) {
+    return source != CLOCK_SOURCE_REAL;
+}
+
+/**
+ * \brief Get the current time
+ *
+ * \return Nanoseconds on the clock. The epoch matches Timer_getTimestamp()
+ */
+int64_t Clock_now(void) {
+    int64_t now;
+
+    if(source == CLOCK_SOURCE_REAL) {
+        return Timer_getTimestamp();
+    }
+
+    pthread_mutex_lock(&clock_lock);
+    now = Clock_getVirtualTime();
+    pthread_mutex_unlock(&clock_lock);
+
+    return now;
+}
+
+/**
+ * \brief Sleep for a number of seconds of clock time
+ *
+ * \param seconds Seconds to sleep
+ */
+void Clock_sleep(double seconds) {
+    Clock_sleepUntil(Clock_now() + (int64_t) (seconds * 1e9));
+}
+
+/**
+ * \brief Sleep until a clock time
+ *
+ * With a virtual clock this returns as soon as the clock reaches the deadline,
+ * whether by running or by being stepped. While the clock is paused it blocks
+ * until it is stepped past the deadline.
+ *
+ * \param deadline Time to wake at, as returned by Clock_now()
+ */
+void Clock_sleepUntil(int64_t deadline) {
+    struct timespec ts;
+    int64_t delay;
+
+    if(source != CLOCK_SOURCE_REAL) {
+        pthread_mutex_lock(&clock_lock);
+        while(source != CLOCK_SOURCE_REAL && (delay = Clock_getVirtualDelay(deadline)) != 0) {
+            Clock_timedWait(delay);
+        }
+        pthread_mutex_unlock(&clock_lock);
+        return;
+    }
+
+#ifdef __SW_Darwin__
+    delay = deadline - Timer_getTimestamp();
+
+    /* No absolute sleeps available, fall back to a relative sleep */
+    if(delay <= 0) {
+        return;
+    }
+
+    ts.tv_sec = delay / 1000000000LL;
+    ts.tv_nsec = delay % 1000000000LL;
+    nanosleep(&ts, NULL);
+#else
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#endif
+}
+
+/**
+ * \brief Get the real time until a clock time
+ *
+ * Used by code which has to wait for a clock deadline with some other
+ * primitive, such as a condition variable. Such code should also register a
+ * listener with Clock_addListener() and recompute the delay when called.
+ *
+ * \param deadline A time as returned by Clock_now()
+ * \return Real nanoseconds until the deadline, 0 if it has passed, or -1 if
+ *   the clock is paused
+ */
+int64_t Clock_getRealDelay(int64_t deadline) {
+    int64_t delay;
+
+    if(source == CLOCK_SOURCE_REAL) {
+        delay = deadline - Timer_getTimestamp();
+        return (delay > 0) ? delay : 0;
+    }
+
+    pthread_mutex_lock(&clock_lock);
+    delay = Clock_getVirtualDelay(deadline);
+    pthread_mutex_unlock(&clock_lock);
+
+    return delay;
+}
+
+/**
+ * \brief Advance a virtual clock
+ *
+ * With the hub clock the step is applied by the hub to every application
+ * using it
+ *
+ * \param ns Nanoseconds to advance the clock by
+ * \return 0 on success, or -1 if the clock is real or the hub refused the step
+ */
+int Clock_step(int64_t ns) {
+    char* argument;
+    int rc;
+
+    if(source == CLOCK_SOURCE_REAL || ns < 0) {
+        return -1;
+    } else if(source == CLOCK_SOURCE_HUB) {
+        argument = strdup(__Util_format("%lld", (long long) ns));
+        rc = Clock_hubRequest("CLOCK_STEP", argument);
+        free(argument);
+        return rc;
+    }
+
+    pthread_mutex_lock(&clock_lock);
+    virtual_base += ns;
+    pthread_mutex_unlock(&clock_lock);
+
+    Clock_notifyListeners();
+    return 0;
+}
+
+/**
+ * \brief Set the rate of a virtual clock
+ *
+ * With the hub clock the rate is applied by the hub to every application
+ * using it. With the real clock the rate is stored and used once a local
+ * virtual clock is selected, so that a clock can start paused.
+ *
+ * \param new_rate Clock seconds per real second. 0 pauses the clock so that it
+ *   only advances with Clock_step()
+ * \return 0 on success, or -1 if the rate is negative or the hub refused the
+ *   change
+ */
+int Clock_setRate(double new_rate) {
+    char* argument;
+    int rc;
+
+    if(new_rate < 0) {
+        return -1;
+    } else if(source == CLOCK_SOURCE_HUB) {
+        argument = strdup(__Util_format("%f", new_rate));
+        rc = Clock_hubRequest("CLOCK_RATE", argument);
+        free(argument);
+        return rc;
+    }
+
+    pthread_mutex_lock(&clock_lock);
+    Clock_rebase();
+    rate = new_rate;
+    pthread_mutex_unlock(&clock_lock);
+
+    Clock_notifyListeners();
+    return 0;
+}
+
+/**
+ * \brief Get the rate of the clock
+ *
+ * \return Clock seconds per real second
+ */
+double Clock_getRate(void) {
+    return (source == CLOCK_SOURCE_REAL) ? 1.0 : rate;
+}
+
+/**
+ * \brief Set the state of a virtual clock
+ *
+ * Used to apply the clock distributed by the hub. After the first call since
+ * the source was selected the time is only moved forward, so that an update
+ * which is overtaken by a newer one can not turn the clock back.
+ *
+ * \param now The current clock time
+ * \param new_rate Clock seconds per real second
+ */
+void Clock_set(int64_t now, double new_rate) {
+    pthread_mutex_lock(&clock_lock);
+    Clock_rebase();
+    if(!synchronized || now > virtual_base) {
+        virtual_base = now;
+    }
+    synchronized = true;
+    rate = new_rate;
+    pthread_mutex_unlock(&clock_lock);
+
+    Clock_notifyListeners();
+}
+
+/**
+ * \brief Register a function to call when the clock changes
+ *
+ * The function is called whenever a virtual clock is stepped or its rate or
+ * source changes. It is called without any clock locks held and may be called
+ * from any thread.
+ *
+ * \param func The function to call
+ * \return 0 on success, or -1 if CLOCK_MAX_LISTENERS are already registered
+ */
+int Clock_addListener(void (*func)(void)) {
+    int rc = 0;
+
+    pthread_mutex_lock(&clock_lock);
+    if(listener_count < CLOCK_MAX_LISTENERS) {
+        listeners[listener_count++] = func;
+    } else {
+        rc = -1;
+    }
+    pthread_mutex_unlock(&clock_lock);
+
+    return rc;
+}
+
+/**
+ * \brief Process a clock update from the hub
+ * \private
+ *
+ * \param message A COMM CLOCK message
+ */
+void Clock_inputMessage(Comm_Message* message) {
+    if(message->count == 4 && source == CLOCK_SOURCE_HUB) {
+        Clock_set(atoll(message->components[2]), atof(message->components[3]));
+    }
+
+    Comm_Message_destroy(message);
+}
+
+/** \} */
@@ -8,8 +8,10 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 /**
  * \defgroup Comm Low-level communication
@@ -52,6 +54,24 @@ static char* auth_password = NULL;
 /** The actual socket file descriptor */
 static int comm_socket;
 
+/** Hub embedded in the application, see Comm_setInprocHub() */
+static const Comm_InprocHub* inproc_hub = NULL;
+
+/** Connection to the embedded hub, or NULL when connected over a socket */
+static void* inproc_connection = NULL;
+
+/** Messages delivered by the embedded hub for the receive thread */
+static Queue* inproc_queue = NULL;
+
+/** Set once the embedded hub has closed the connection */
+static bool inproc_closed = false;
+
+/** Protects inproc_queue and inproc_closed */
+static pthread_mutex_t inproc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Serializes sending messages */
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /** Task handle for thread that recieves incoming messages */
 static Task_Handle receive_thread;
 
@@ -77,9 +97,38 @@ static pthread_mutex_t response_set_lock = PTHREAD_MUTEX_INITIALIZER;
 /** New response available conditional */
 static pthread_cond_t new_response = PTHREAD_COND_INITIALIZER;
 
+/** Record the round trip time of requests */
+static bool latency_enabled = false;
+
+/** Seconds between logging round trip statistics, or 0 to not log them */
+static double latency_log_interval = 0;
+
+/** Task handle for the thread which logs round trip statistics */
+static Task_Handle latency_log_thread;
+
+/** Round trip statistics for each request type seen */
+static Comm_LatencyStats* latency_stats[COMM_LATENCY_MAX_TYPES];
+
+/** Number of request types in latency_stats */
+static int latency_stats_n = 0;
+
+/** Protects latency_stats */
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Estimated hub monotonic time minus local monotonic time */
+static int64_t hub_time_offset = 0;
+
+/** Maximum error of hub_time_offset, or -1 if it has not been estimated */
+static int64_t hub_time_uncertainty = -1;
+
 static void Comm_authenticate(void);
+static void Comm_inprocDeliver(Comm_PackedMessage* packed_message);
+static void Comm_inputResponse(Comm_Message* message);
 static Comm_PackedMessage* Comm_receivePackedMessage(void);
 static int Comm_receiveThread(void);
+static Comm_LatencyStats* Comm_findLatencyStats(const char* request);
+static void Comm_recordLatency(Comm_Message* message, int64_t latency);
+static int Comm_latencyLogThread(void);
 
 /**
  * \endcond Comm_Private
@@ -95,6 +144,10 @@ static int Comm_receiveThread(void);
  */
 void Comm_init(void) {
     struct sockaddr_in addr;
+    struct sockaddr_un unix_addr;
+    struct sockaddr* connect_addr;
+    socklen_t connect_addr_len;
+    const int nodelay = 1;
 
     if(comm_server == NULL) {
         Logging_log(CRITICAL, "No Comm_server address is set!");
@@ -102,21 +155,55 @@ void Comm_init(void) {
     }
 
     /* Build connection address */
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr(comm_server);
-    addr.sin_port = htons(comm_port);
-
-    /* Create socket */
-    comm_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if(comm_socket == -1) {
-        Logging_log(CRITICAL, __Util_format("Unable to create socket: %s", strerror(errno)));
-        Seawolf_exitError();
+    if(strncmp(comm_server, COMM_INPROC_PREFIX, strlen(COMM_INPROC_PREFIX)) == 0) {
+        if(inproc_hub == NULL) {
+            Logging_log(CRITICAL, "No hub is embedded in the application!");
+            Seawolf_exitError();
+        }
+
+        inproc_queue = Queue_new();
+        inproc_closed = false;
+        inproc_connection = inproc_hub->connect(Comm_inprocDeliver);
+        connect_addr = NULL;
+        connect_addr_len = 0;
+    } else if(strncmp(comm_server, COMM_UNIX_PREFIX, strlen(COMM_UNIX_PREFIX)) == 0) {
+        if(strlen(comm_server + strlen(COMM_UNIX_PREFIX)) >= sizeof(unix_addr.sun_path)) {
+            Logging_log(CRITICAL, __Util_format("Hub socket path is too long: %s", comm_server));
+            Seawolf_exitError();
+        }
+
+        memset(&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        strcpy(unix_addr.sun_path, comm_server + strlen(COMM_UNIX_PREFIX));
+        connect_addr = (struct sockaddr*) &unix_addr;
+        connect_addr_len = sizeof(unix_addr);
+    } else {
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = inet_addr(comm_server);
+        addr.sin_port = htons(comm_port);
+        connect_addr = (struct sockaddr*) &addr;
+        connect_addr_len = sizeof(addr);
     }
 
-    /* Connect socket */
-    if(connect(comm_socket, (struct sockaddr*) &addr, sizeof(addr))) {
-        Logging_log(CRITICAL, __Util_format("Unable to connect to Comm server: %s", strerror(errno)));
-        Seawolf_exitError();
+    if(connect_addr) {
+        /* Create socket */
+        comm_socket = socket(connect_addr->sa_family, SOCK_STREAM, 0);
+        if(comm_socket == -1) {
+            Logging_log(CRITICAL, __Util_format("Unable to create socket: %s", strerror(errno)));
+            Seawolf_exitError();
+        }
+
+        /* Connect socket */
+        if(connect(comm_socket, connect_addr, connect_addr_len)) {
+            Logging_log(CRITICAL, __Util_format("Unable to connect to Comm server: %s", strerror(errno)));
+            Seawolf_exitError();
+        }
+
+        /* Requests are small and each waits for its response, so send them
+           immediately rather than letting Nagle's algorithm hold them back */
+        if(connect_addr->sa_family == AF_INET) {
+            setsockopt(comm_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        }
     }
 
     /* Prepare response set */
@@ -129,6 +216,10 @@ void Comm_init(void) {
 
     /* Authenticate */
     Comm_authenticate();
+
+    if(latency_enabled && latency_log_interval > 0) {
+        latency_log_thread = Task_background(&Comm_latencyLogThread);
+    }
 }
 
 /**
@@ -179,6 +270,12 @@ static Comm_PackedMessage* Comm_receivePackedMessage(void) {
     uint16_t total_data_size;
     int n;
 
+    if(inproc_connection) {
+        /* Once the hub closes the connection a NULL stays at the head of the
+           queue, so every later call fails as it would on a closed socket */
+        return Queue_pop(inproc_queue, true);
+    }
+
     n = recv(comm_socket, &total_data_size, sizeof(uint16_t), MSG_WAITALL|MSG_PEEK);
     if(n != sizeof(uint16_t)) {
         return NULL;
@@ -198,6 +295,63 @@ static Comm_PackedMessage* Comm_receivePackedMessage(void) {
     return packed_message;
 }
 
+/**
+ * \brief Receive a message from an embedded hub
+ *
+ * Passed to the connect function of the embedded hub. Responses are handed
+ * straight to the thread waiting for them, other messages are queued for the
+ * receive thread so they are processed exactly as messages from a socket are
+ *
+ * \param packed_message A message from the hub, which is copied, or NULL once
+ * the hub has closed the connection
+ */
+static void Comm_inprocDeliver(Comm_PackedMessage* packed_message) {
+    Comm_PackedMessage* copy = NULL;
+
+    if(packed_message == NULL) {
+        /* Wait for any request still being processed by the hub */
+        pthread_mutex_lock(&send_lock);
+        pthread_mutex_lock(&inproc_lock);
+        inproc_closed = true;
+        if(inproc_queue) {
+            Queue_append(inproc_queue, NULL);
+        }
+        pthread_mutex_unlock(&inproc_lock);
+        pthread_mutex_unlock(&send_lock);
+        return;
+    }
+
+    copy = Comm_PackedMessage_new();
+    copy->length = packed_message->length;
+    copy->data = MemPool_reserve(copy->alloc, copy->length);
+    memcpy(copy->data, packed_message->data, copy->length);
+
+    if(ntohs(((uint16_t*) copy->data)[1]) != 0) {
+        Comm_inputResponse(Comm_unpackMessage(copy));
+        return;
+    }
+
+    pthread_mutex_lock(&inproc_lock);
+    if(inproc_queue && !inproc_closed) {
+        Queue_append(inproc_queue, copy);
+    } else {
+        MemPool_free(copy->alloc);
+    }
+    pthread_mutex_unlock(&inproc_lock);
+}
+
+/**
+ * \brief Hand a response to the thread waiting for it
+ *
+ * \param message A message with a non-zero request ID
+ */
+static void Comm_inputResponse(Comm_Message* message) {
+    pthread_mutex_lock(&response_set_lock);
+    response_set[message->request_id] = message;
+    pthread_cond_broadcast(&new_response);
+    pthread_mutex_unlock(&response_set_lock);
+}
+
 /**
  * \brief Message receive loop
  *
@@ -210,6 +364,8 @@ static int Comm_receiveThread(void) {
     Comm_Message* message;
     unsigned short error_count = 0;
 
+    Trace_setThreadName("Comm receive");
+
     while(initialized) {
         packed_message = Comm_receivePackedMessage();
 
@@ -240,23 +396,29 @@ static int Comm_receiveThread(void) {
 
         /* Received good packet, reset error count */
         error_count = 0;
+        Trace_begin("Comm_receiveThread");
 
         /* Unpack message */
         message = Comm_unpackMessage(packed_message);
 
         if(message->request_id != 0) {
-            pthread_mutex_lock(&response_set_lock);
-            response_set[message->request_id] = message;
-            pthread_cond_broadcast(&new_response);
-            pthread_mutex_unlock(&response_set_lock);
+            Comm_inputResponse(message);
         } else if(strcmp(message->components[0], "NOTIFY") == 0) {
             /* Inbound notification */
             Notify_inputMessage(message);
         } else if(strcmp(message->components[0], "WATCH") == 0) {
             /* Inbound variable subscription udpdate */
             Var_inputMessage(message);
+        } else if(strcmp(message->components[0], "BLOB") == 0) {
+            /* Inbound blob frame descriptor */
+            Blob_inputMessage(message);
         } else if(strcmp(message->components[0], "COMM") == 0) {
-            if(strcmp(message->components[1], "KICKING") == 0) {
+            if(strcmp(message->components[1], "CLOCK") == 0) {
+                /* Hub clock update */
+                Clock_inputMessage(message);
+                Trace_end("Comm_receiveThread");
+                continue;
+            } else if(strcmp(message->components[1], "KICKING") == 0) {
                 hub_shutdown = true;
                 Logging_log(ERROR, __Util_format("I've been kicked: %s", message->components[2]));
                 Seawolf_exitError();
@@ -266,6 +428,8 @@ static int Comm_receiveThread(void) {
             /* Unknown, unsolicited message */
             MemPool_free(message->alloc);
         }
+
+        Trace_end("Comm_receiveThread");
     }
 
     /* Wake up any stuck Comm_sendMessage call */
@@ -276,6 +440,89 @@ static int Comm_receiveThread(void) {
     return 0;
 }
 
+/**
+ * \brief Find the round trip statistics for a request type
+ *
+ * Must be called with latency_lock held
+ *
+ * \param request The request type
+ * \return The statistics, or NULL if none have been recorded
+ */
+static Comm_LatencyStats* Comm_findLatencyStats(const char* request) {
+    for(int i = 0; i < latency_stats_n; i++) {
+        if(strcmp(latency_stats[i]->request, request) == 0) {
+            return latency_stats[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Record the round trip time of a request
+ *
+ * Requests are grouped by their first two components, e.g. "VAR GET"
+ *
+ * \param message The request
+ * \param latency Nanoseconds between sending the request and receiving its
+ * response
+ */
+static void Comm_recordLatency(Comm_Message* message, int64_t latency) {
+    char request[COMM_LATENCY_NAME_LEN];
+    Comm_LatencyStats* stats;
+
+    snprintf(request, sizeof(request), "%s %s",
+             message->count > 0 ? message->components[0] : "",
+             message->count > 1 ? message->components[1] : "");
+
+    pthread_mutex_lock(&latency_lock);
+    stats = Comm_findLatencyStats(request);
+
+    /* Once the table is nearly full further request types share the last
+       entry */
+    if(stats == NULL && latency_stats_n >= COMM_LATENCY_MAX_TYPES - 1) {
+        strcpy(request, "OTHER");
+        stats = Comm_findLatencyStats(request);
+    }
+
+    if(stats == NULL) {
+        stats = malloc(sizeof(Comm_LatencyStats));
+        strcpy(stats->request, request);
+        Histogram_init(&stats->latency);
+        latency_stats[latency_stats_n++] = stats;
+    }
+
+    Histogram_record(&stats->latency, latency);
+    pthread_mutex_unlock(&latency_lock);
+}
+
+/**
+ * \brief Periodically log round trip statistics
+ *
+ * Spawned by Comm_init() when a log interval is set
+ *
+ * \return Does not return. This task is killed in Comm_close()
+ */
+static int Comm_latencyLogThread(void) {
+    struct timespec interval;
+
+    /* Sleep in real time, since the task may not be killed while it is
+       waiting on a virtual clock */
+    interval.tv_sec = (time_t) latency_log_interval;
+    interval.tv_nsec = (long) ((latency_log_interval - interval.tv_sec) * 1e9);
+
+    while(true) {
+        nanosleep(&interval, NULL);
+
+        /* Only allow the task to be killed while sleeping */
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        Comm_logLatencyStats();
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    }
+
+    return 0;
+}
+
 /**
  * \brief Send a message to the hub
  *
@@ -289,25 +536,42 @@ static int Comm_receiveThread(void) {
  * return the unpacked response. Otherwise, return NULL
  */
 Comm_Message* Comm_sendMessage(Comm_Message* message) {
-    static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
     Comm_PackedMessage* packed_message;
     Comm_Message* response = NULL;
+    bool record = latency_enabled && message->request_id != 0;
+    int64_t start = 0;
     int n;
 
     if(hub_shutdown) {
         return NULL;
     }
 
+    Trace_begin("Comm_sendMessage");
+
     /* Pack message */
     packed_message = Comm_packMessage(message);
 
+    if(record) {
+        start = Timer_getTimestamp();
+    }
+
     /* Send data */
     pthread_mutex_lock(&send_lock);
-    n = send(comm_socket, packed_message->data, packed_message->length, 0);
+    if(inproc_connection == NULL) {
+        n = send(comm_socket, packed_message->data, packed_message->length, 0);
+    } else if(inproc_closed) {
+        n = -1;
+    } else {
+        /* Runs the request to completion, any response has been delivered by
+           the time this returns */
+        inproc_hub->send(inproc_connection, packed_message);
+        n = packed_message->length;
+    }
     pthread_mutex_unlock(&send_lock);
 
     /* Send error */
     if(n < 0) {
+        Trace_end("Comm_sendMessage");
         hub_shutdown = true;
         Logging_log(CRITICAL, "Unable to send message (lost connection to hub), terminating!");
         Seawolf_exitError();
@@ -316,10 +580,14 @@ Comm_Message* Comm_sendMessage(Comm_Message* message) {
 
     /* Expect a response and wait for it */
     if(message->request_id != 0) {
+        Trace_begin("Comm wait for response");
         pthread_mutex_lock(&response_set_lock);
         while(response_set[message->request_id] == NULL) {
             /* Woken up during shutdown. Return NULL */
             if(hub_shutdown) {
+                pthread_mutex_unlock(&response_set_lock);
+                Trace_end("Comm wait for response");
+                Trace_end("Comm_sendMessage");
                 return NULL;
             }
 
@@ -331,8 +599,14 @@ Comm_Message* Comm_sendMessage(Comm_Message* message) {
         response_set[message->request_id] = NULL;
 
         pthread_mutex_unlock(&response_set_lock);
+        Trace_end("Comm wait for response");
+
+        if(record) {
+            Comm_recordLatency(message, Timer_getTimestamp() - start);
+        }
     }
 
+    Trace_end("Comm_sendMessage");
     return response;
 }
 
@@ -539,9 +813,16 @@ void Comm_setPassword(const char* password) {
 /**
  * \brief Set the server to connect to
  *
- * Specify the server to connect to as an IP address given as a string
+ * Specify the server to connect to as an IP address given as a string. A hub
+ * on the same machine which listens on a Unix domain socket (the hub's
+ * bind_path option) can instead be given as COMM_UNIX_PREFIX followed by the
+ * path of the socket, e.g. "unix:/tmp/seawolf-hub.sock", which avoids the cost
+ * of the TCP stack. A hub embedded in the application, see Comm_setInprocHub(),
+ * is given as COMM_INPROC_PREFIX alone. The port is ignored in both cases.
  *
- * \param server The IP address of the server to connect to given as a string
+ * \param server The IP address of the server to connect to given as a string,
+ * or the path of a Unix domain socket prefixed with COMM_UNIX_PREFIX, or
+ * COMM_INPROC_PREFIX for a hub embedded in the application
  */
 void Comm_setServer(const char* server) {
     comm_server = strdup(server);
@@ -558,6 +839,205 @@ void Comm_setPort(uint16_t port) {
     comm_port = port;
 }
 
+/**
+ * \brief Register a hub embedded in the application
+ *
+ * Called by a hub running inside the application so that a server address of
+ * COMM_INPROC_PREFIX connects to it. Requests then run as direct function
+ * calls into the hub rather than round trips over a socket, which makes unit
+ * tests and single process simulations fast and independent of any hub
+ * process. Must be called before Seawolf_init().
+ *
+ * \param hub The embedded hub, or NULL to unregister it
+ */
+void Comm_setInprocHub(const Comm_InprocHub* hub) {
+    inproc_hub = hub;
+}
+
+/**
+ * \brief Enable or disable recording of request round trip times
+ *
+ * When enabled, the time between sending each request which expects a
+ * response and receiving its response is recorded in a histogram for the
+ * type of request, e.g. "VAR GET" or "COMM AUTH". Recording is disabled by
+ * default. Enable it before Seawolf_init() to include authentication.
+ *
+ * \param enabled True to record round trip times
+ */
+void Comm_setLatencyStats(bool enabled) {
+    latency_enabled = enabled;
+}
+
+/**
+ * \brief Set how often round trip statistics are logged
+ *
+ * Must be called before Seawolf_init(). Has no effect unless recording is
+ * enabled with Comm_setLatencyStats()
+ *
+ * \param seconds Seconds between logging statistics with
+ * Comm_logLatencyStats(), or 0 to not log them
+ */
+void Comm_setLatencyLogInterval(double seconds) {
+    latency_log_interval = seconds;
+}
+
+/**
+ * \brief Get round trip statistics
+ *
+ * \param request A request type such as "VAR GET", or NULL to combine all
+ * request types
+ * \param latency Histogram to store round trip times in nanoseconds in
+ * \return 0 on success, or -1 if no requests of the type have been recorded
+ */
+int Comm_getLatencyStats(const char* request, Histogram* latency) {
+    int rc = -1;
+
+    Histogram_init(latency);
+
+    pthread_mutex_lock(&latency_lock);
+    for(int i = 0; i < latency_stats_n; i++) {
+        if(request == NULL || strcmp(latency_stats[i]->request, request) == 0) {
+            Histogram_merge(latency, &latency_stats[i]->latency);
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&latency_lock);
+
+    return rc;
+}
+
+/**
+ * \brief Discard recorded round trip times
+ */
+void Comm_resetLatencyStats(void) {
+    pthread_mutex_lock(&latency_lock);
+    for(int i = 0; i < latency_stats_n; i++) {
+        free(latency_stats[i]);
+    }
+    latency_stats_n = 0;
+    pthread_mutex_unlock(&latency_lock);
+}
+
+/**
+ * \brief Log round trip statistics
+ *
+ * Log the count and percentiles of round trip times for each request type at
+ * INFO level
+ */
+void Comm_logLatencyStats(void) {
+    Comm_LatencyStats* stats = malloc(sizeof(Comm_LatencyStats));
+    int n;
+
+    pthread_mutex_lock(&latency_lock);
+    n = latency_stats_n;
+    pthread_mutex_unlock(&latency_lock);
+
+    /* Copy each entry so the lock is not held while logging, which sends
+       requests of its own */
+    for(int i = 0; i < n; i++) {
+        pthread_mutex_lock(&latency_lock);
+        if(i >= latency_stats_n) {
+            pthread_mutex_unlock(&latency_lock);
+            break;
+        }
+        *stats = *latency_stats[i];
+        pthread_mutex_unlock(&latency_lock);
+
+        Logging_log(INFO, __Util_format("Round trip %s: %llu requests, us p50 %.1f p90 %.1f p99 %.1f max %.1f",
+                                        stats->request,
+                                        (unsigned long long) Histogram_getCount(&stats->latency),
+                                        Histogram_getPercentile(&stats->latency, 50) * 1e-3,
+                                        Histogram_getPercentile(&stats->latency, 90) * 1e-3,
+                                        Histogram_getPercentile(&stats->latency, 99) * 1e-3,
+                                        Histogram_getMax(&stats->latency) * 1e-3));
+    }
+
+    free(stats);
+}
+
+/**
+ * \brief Estimate the offset between the local and hub clocks
+ *
+ * Exchange COMM TIME requests with the hub to estimate the difference between
+ * the hub's Timer_getTimestamp() clock and the local one, in the manner of
+ * NTP. Each exchange brackets the hub's time between the local times the
+ * request was sent and the response received, so the offset is taken from the
+ * exchange with the shortest round trip and is accurate to within half of
+ * that round trip. On a single host both clocks are the same and the estimate
+ * is close to 0.
+ *
+ * \param samples Number of exchanges to make
+ * \return 0 on success, or -1 if the hub did not answer
+ */
+int Comm_syncHubTime(int samples) {
+    static char* namespace = "COMM";
+    static char* command = "TIME";
+
+    Comm_Message* request;
+    Comm_Message* response;
+    int64_t best_rtt = -1;
+    int64_t best_offset = 0;
+    int64_t sent, received, hub_time;
+
+    for(int i = 0; i < samples; i++) {
+        request = Comm_Message_new(2);
+        request->components[0] = namespace;
+        request->components[1] = command;
+        Comm_assignRequestID(request);
+
+        sent = Timer_getTimestamp();
+        response = Comm_sendMessage(request);
+        received = Timer_getTimestamp();
+
+        Comm_Message_destroy(request);
+
+        if(response == NULL) {
+            return -1;
+        } else if(response->count != 3 || strcmp(response->components[1], "TIME") != 0) {
+            Comm_Message_destroy(response);
+            return -1;
+        }
+
+        hub_time = atoll(response->components[2]);
+        Comm_Message_destroy(response);
+
+        if(best_rtt == -1 || received - sent < best_rtt) {
+            best_rtt = received - sent;
+            best_offset = hub_time - (sent + best_rtt / 2);
+        }
+    }
+
+    if(best_rtt == -1) {
+        return -1;
+    }
+
+    hub_time_offset = best_offset;
+    hub_time_uncertainty = best_rtt / 2;
+
+    return 0;
+}
+
+/**
+ * \brief Get the offset between the local and hub clocks
+ *
+ * \return The last estimate made by Comm_syncHubTime() of the hub's
+ * Timer_getTimestamp() clock minus the local one in nanoseconds, or 0 if no
+ * estimate has been made
+ */
+int64_t Comm_getHubTimeOffset(void) {
+    return hub_time_offset;
+}
+
+/**
+ * \brief Get the accuracy of the clock offset estimate
+ *
+ * \return The maximum error of Comm_getHubTimeOffset() in nanoseconds, or -1
+ * if no estimate has been made
+ */
+int64_t Comm_getHubTimeUncertainty(void) {
+    return hub_time_uncertainty;
+}
+
 /**
  * \brief Destroy a message
  *
@@ -578,10 +1058,15 @@ void Comm_Message_destroy(Comm_Message* message) {
  * \private
  */
 void Comm_close(void) {
+    Comm_PackedMessage* packed_message;
     Comm_Message* message;
 
     /* This check is necessary if an error condition is reached in Comm_init */
     if(initialized) {
+        if(latency_enabled && latency_log_interval > 0) {
+            Task_kill(latency_log_thread);
+        }
+
         if(!hub_shutdown) {
             message = Comm_Message_new(2);
             message->components[0] = MemPool_strdup(message->alloc, "COMM");
@@ -592,8 +1077,22 @@ void Comm_close(void) {
             MemPool_free(message->alloc);
         }
 
-        shutdown(comm_socket, SHUT_RDWR);
-        Task_wait(receive_thread);
+        if(inproc_connection) {
+            /* The hub delivers NULL once it has closed the connection */
+            Task_wait(receive_thread);
+
+            pthread_mutex_lock(&inproc_lock);
+            while((packed_message = Queue_pop(inproc_queue, false)) != NULL) {
+                MemPool_free(packed_message->alloc);
+            }
+            Queue_destroy(inproc_queue);
+            inproc_queue = NULL;
+            inproc_connection = NULL;
+            pthread_mutex_unlock(&inproc_lock);
+        } else {
+            shutdown(comm_socket, SHUT_RDWR);
+            Task_wait(receive_thread);
+        }
 
         free(response_set);
         free(response_pending);
@@ -601,6 +1100,8 @@ void Comm_close(void) {
         initialized = false;
     }
 
+    Comm_resetLatencyStats();
+
     if(comm_server) {
         free(comm_server);
     }
@@ -0,0 +1,759 @@
+/**
+ * \file
+ * \brief Thread pool executor
+ */
+
+#include "seawolf.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Seconds an idle worker above the minimum pool size waits for new tasks
+ * before exiting
+ */
+#define IDLE_TIMEOUT 5
+
+/**
+ * Initial capacity of a worker's deque
+ */
+#define DEQUE_INITIAL_CAPACITY 16
+
+/**
+ * Number of ranges per worker Task_Executor_parallelFor() aims for when no
+ * grain size is given
+ */
+#define RANGES_PER_WORKER 4
+
+/**
+ * A worker thread and its deque of tasks
+ * \private
+ */
+struct Task_Worker {
+    /**
+     * The executor this worker belongs to
+     * \private
+     */
+    Task_Executor* executor;
+
+    /**
+     * Circular buffer of tasks. The owner pushes and pops at the bottom, other
+     * workers steal from the top
+     * \private
+     */
+    Task_Future** tasks;
+
+    /**
+     * Size of tasks
+     * \private
+     */
+    size_t capacity;
+
+    /**
+     * Index of the top (oldest) task
+     * \private
+     */
+    size_t top;
+
+    /**
+     * Number of tasks in the deque
+     * \private
+     */
+    size_t count;
+
+    /**
+     * Protects the deque
+     * \private
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * True while a thread is running in this slot
+     * \private
+     */
+    bool active;
+
+    /**
+     * Slot to start the next steal attempt at
+     * \private
+     */
+    int victim;
+};
+
+/**
+ * A slice of a Task_Executor_parallelFor() loop
+ * \private
+ */
+struct ParallelRange {
+    /**
+     * Loop body
+     * \private
+     */
+    void (*body)(int, int, void*);
+
+    /**
+     * Argument to pass to body
+     * \private
+     */
+    void* arg;
+
+    /**
+     * First index of the slice
+     * \private
+     */
+    int start;
+
+    /**
+     * One past the last index of the slice
+     * \private
+     */
+    int end;
+};
+
+static void Task_Executor_initKey(void);
+static void Task_Executor_initDefault(void);
+static Task_Future* Task_Future_new(int (*func)(void*), void* arg);
+static void Task_Future_destroy(Task_Future* future);
+static void Task_Worker_push(struct Task_Worker* worker, Task_Future* future);
+static Task_Future* Task_Worker_pop(struct Task_Worker* worker);
+static Task_Future* Task_Worker_steal(struct Task_Worker* worker);
+static Task_Future* Task_Executor_take(Task_Executor* executor, struct Task_Worker* self);
+static void Task_Executor_run(Task_Future* future);
+static int Task_Executor_spawn(Task_Executor* executor);
+static void* Task_Executor_worker(void* _worker);
+static int Task_Executor_runRange(void* _range);
+
+/**
+ * \defgroup Executor Thread pool executor
+ * \ingroup Multitasking
+ * \brief Run short tasks on a pool of reusable worker threads
+ * \{
+ */
+
+/**
+ * \cond Executor_Internal
+ * \internal
+ */
+
+/**
+ * Thread specific key storing the Task_Worker of a worker thread
+ */
+static pthread_key_t current_worker;
+
+/**
+ * Ensures current_worker is created once
+ */
+static pthread_once_t current_worker_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Executor used by Task_submit() and Task_parallelFor()
+ */
+static Task_Executor* default_executor = NULL;
+
+/**
+ * Ensures the default executor is created once
+ */
+static pthread_once_t default_executor_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \endcond Executor_Internal
+ */
+
+/**
+ * \brief Create the current worker key
+ * \private
+ */
+static void Task_Executor_initKey(void) {
+    pthread_key_create(&current_worker, NULL);
+}
+
+/**
+ * \brief Create the default executor
+ * \private
+ *
+ * The default executor keeps no idle workers and grows up to one worker per
+ * online processor
+ */
+static void Task_Executor_initDefault(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    default_executor = Task_Executor_new(0, (cpus > 0) ? cpus : 1);
+}
+
+/**
+ * \brief Allocate a new future
+ * \private
+ */
+static Task_Future* Task_Future_new(int (*func)(void*), void* arg) {
+    Task_Future* future = malloc(sizeof(Task_Future));
+
+    future->func = func;
+    future->arg = arg;
+    future->retval = 0;
+    future->done = false;
+    future->detached = false;
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->finished, NULL);
+
+    return future;
+}
+
+/**
+ * \brief Free a future
+ * \private
+ */
+static void Task_Future_destroy(Task_Future* future) {
+    pthread_mutex_destroy(&future->lock);
+    pthread_cond_destroy(&future->finished);
+    free(future);
+}
+
+/**
+ * \brief Push a task onto the bottom of a worker's deque
+ * \private
+ */
+static void Task_Worker_push(struct Task_Worker* worker, Task_Future* future) {
+    Task_Future** tasks;
+
+    pthread_mutex_lock(&worker->lock);
+
+    if(worker->count == worker->capacity) {
+        /* Grow the buffer, unwrapping it in the process */
+        tasks = malloc(sizeof(Task_Future*) * worker->capacity * 2);
+        for(size_t i = 0; i < worker->count; i++) {
+            tasks[i] = worker->tasks[(worker->top + i) % worker->capacity];
+        }
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->capacity *= 2;
+        worker->top = 0;
+    }
+
+    worker->tasks[(worker->top + worker->count) % worker->capacity] = future;
+    worker->count++;
+
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/**
+ * \brief Pop the most recently pushed task off a worker's deque
+ * \private
+ */
+static Task_Future* Task_Worker_pop(struct Task_Worker* worker) {
+    Task_Future* future = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    if(worker->count) {
+        worker->count--;
+        future = worker->tasks[(worker->top + worker->count) % worker->capacity];
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return future;
+}
+
+/**
+ * \brief Steal the oldest task from a worker's deque
+ * \private
+ */
+static Task_Future* Task_Worker_steal(struct Task_Worker* worker) {
+    Task_Future* future = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    if(worker->count) {
+        future = worker->tasks[worker->top];
+        worker->top = (worker->top + 1) % worker->capacity;
+        worker->count--;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return future;
+}
+
+/**
+ * \brief Find a task to run
+ * \private
+ *
+ * Look for a task on the worker's own deque, then in the shared queue, and
+ * finally try to steal one from another worker
+ *
+ * \param executor The executor to take a task from
+ * \param self The calling worker, or NULL if called from outside the pool
+ * \return A task, or NULL if none were found
+ */
+static Task_Future* Task_Executor_take(Task_Executor* executor, struct Task_Worker* self) {
+    Task_Future* future = NULL;
+    int start = 0;
+
+    if(self) {
+        future = Task_Worker_pop(self);
+        start = self->victim;
+    }
+
+    if(future == NULL) {
+        future = Queue_pop(executor->injected, false);
+    }
+
+    for(int i = 0; future == NULL && i < executor->max_workers; i++) {
+        struct Task_Worker* victim = &executor->workers[(start + i) % executor->max_workers];
+        if(victim != self) {
+            future = Task_Worker_steal(victim);
+        }
+    }
+
+    if(future) {
+        if(self) {
+            self->victim = (start + 1) % executor->max_workers;
+        }
+
+        pthread_mutex_lock(&executor->lock);
+        executor->pending--;
+        pthread_mutex_unlock(&executor->lock);
+    }
+
+    return future;
+}
+
+/**
+ * \brief Run a task and signal its completion
+ * \private
+ */
+static void Task_Executor_run(Task_Future* future) {
+    int retval = future->func(future->arg);
+    bool detached;
+
+    pthread_mutex_lock(&future->lock);
+    future->retval = retval;
+    future->done = true;
+    detached = future->detached;
+    pthread_cond_broadcast(&future->finished);
+    pthread_mutex_unlock(&future->lock);
+
+    if(detached) {
+        Task_Future_destroy(future);
+    }
+}
+
+/**
+ * \brief Start a new worker
+ * \private
+ *
+ * Must be called with the executor lock held
+ *
+ * \return 0 on success, -1 if the worker could not be started
+ */
+static int Task_Executor_spawn(Task_Executor* executor) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    int rc;
+
+    for(int i = 0; i < executor->max_workers; i++) {
+        if(!executor->workers[i].active) {
+            pthread_attr_init(&attr);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+            executor->workers[i].active = true;
+            rc = pthread_create(&thread, &attr, Task_Executor_worker, &executor->workers[i]);
+            if(rc == 0) {
+                executor->running++;
+            } else {
+                executor->workers[i].active = false;
+                Logging_log(ERROR, __Util_format("Unable to start executor worker: %s", strerror(rc)));
+            }
+
+            pthread_attr_destroy(&attr);
+            return (rc == 0) ? 0 : -1;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * \brief Worker thread main loop
+ * \private
+ *
+ * Run tasks until the executor is destroyed, or until the worker has been idle
+ * for IDLE_TIMEOUT seconds and the pool is larger than its minimum size
+ *
+ * \param _worker The Task_Worker of this thread
+ * \return NULL
+ */
+static void* Task_Executor_worker(void* _worker) {
+    struct Task_Worker* worker = (struct Task_Worker*) _worker;
+    Task_Executor* executor = worker->executor;
+    Task_Future* future;
+    struct timespec deadline;
+    int rc;
+
+    pthread_setspecific(current_worker, worker);
+
+    while(true) {
+        future = Task_Executor_take(executor, worker);
+        if(future) {
+            Task_Executor_run(future);
+            continue;
+        }
+
+        pthread_mutex_lock(&executor->lock);
+
+        if(executor->pending) {
+            /* A task was queued but is not yet visible or is being taken by
+               another worker */
+            pthread_mutex_unlock(&executor->lock);
+            sched_yield();
+            continue;
+        }
+
+        if(executor->shutdown) {
+            break;
+        }
+
+        executor->idle++;
+        if(executor->running > executor->min_workers) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += IDLE_TIMEOUT;
+            rc = pthread_cond_timedwait(&executor->available, &executor->lock, &deadline);
+        } else {
+            rc = pthread_cond_wait(&executor->available, &executor->lock);
+        }
+        executor->idle--;
+
+        if(rc == ETIMEDOUT && executor->pending == 0 && executor->running > executor->min_workers) {
+            break;
+        }
+
+        pthread_mutex_unlock(&executor->lock);
+    }
+
+    /* Still holding the executor lock. The deque is empty since only this
+       thread pushes to it */
+    worker->active = false;
+    executor->running--;
+    pthread_cond_broadcast(&executor->exited);
+    pthread_mutex_unlock(&executor->lock);
+
+    return NULL;
+}
+
+/**
+ * \brief Task wrapper for a parallel for range
+ * \private
+ */
+static int Task_Executor_runRange(void* _range) {
+    struct ParallelRange* range = (struct ParallelRange*) _range;
+    range->body(range->start, range->end, range->arg);
+    return 0;
+}
+
+/**
+ * \brief Create a new executor
+ *
+ * Create a pool of worker threads. min_workers threads are started
+ * immediately and kept for the life of the executor. Additional workers, up to
+ * max_workers, are started when tasks are submitted and no worker is idle, and
+ * exit again after being idle for a few seconds. Passing the same value for
+ * both gives a fixed size pool.
+ *
+ * \param min_workers Number of workers to keep running
+ * \param max_workers Maximum number of workers
+ * \return A new executor
+ */
+Task_Executor* Task_Executor_new(int min_workers, int max_workers) {
+    Task_Executor* executor = malloc(sizeof(Task_Executor));
+
+    pthread_once(&current_worker_once, Task_Executor_initKey);
+
+    max_workers = (max_workers < 1) ? 1 : max_workers;
+    min_workers = Util_inRange(0, min_workers, max_workers);
+
+    executor->workers = calloc(max_workers, sizeof(struct Task_Worker));
+    executor->injected = Queue_new();
+    executor->min_workers = min_workers;
+    executor->max_workers = max_workers;
+    executor->running = 0;
+    executor->idle = 0;
+    executor->pending = 0;
+    executor->shutdown = false;
+    pthread_mutex_init(&executor->lock, NULL);
+    pthread_cond_init(&executor->available, NULL);
+    pthread_cond_init(&executor->exited, NULL);
+
+    for(int i = 0; i < max_workers; i++) {
+        executor->workers[i].executor = executor;
+        executor->workers[i].capacity = DEQUE_INITIAL_CAPACITY;
+        executor->workers[i].tasks = malloc(sizeof(Task_Future*) * DEQUE_INITIAL_CAPACITY);
+        executor->workers[i].victim = (i + 1) % max_workers;
+        pthread_mutex_init(&executor->workers[i].lock, NULL);
+    }
+
+    pthread_mutex_lock(&executor->lock);
+    for(int i = 0; i < min_workers; i++) {
+        Task_Executor_spawn(executor);
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    return executor;
+}
+
+/**
+ * \brief Submit a task to an executor
+ *
+ * Queue func to be called with arg by one of the executor's workers. Tasks
+ * submitted from within a task run on the same executor are run
+ * preferentially by the submitting worker, most recent first. If the executor
+ * has no workers and none can be started, queued tasks are run by the caller
+ * before returning.
+ *
+ * \param executor The executor to run the task on
+ * \param func The function to run
+ * \param arg Argument to pass to func
+ * \return A future which must be passed to either Task_join() or
+ *   Task_detach()
+ */
+Task_Future* Task_Executor_submit(Task_Executor* executor, int (*func)(void*), void* arg) {
+    Task_Future* future = Task_Future_new(func, arg);
+    struct Task_Worker* worker = pthread_getspecific(current_worker);
+    Task_Future* queued;
+    bool run_here = false;
+
+    if(worker && worker->executor == executor) {
+        Task_Worker_push(worker, future);
+    } else {
+        Queue_append(executor->injected, future);
+    }
+
+    pthread_mutex_lock(&executor->lock);
+    executor->pending++;
+    if(executor->idle) {
+        pthread_cond_signal(&executor->available);
+    } else if(executor->running < executor->max_workers) {
+        /* Without any worker the task would never be picked up */
+        run_here = (Task_Executor_spawn(executor) == -1 && executor->running == 0);
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    while(run_here && (queued = Task_Executor_take(executor, NULL)) != NULL) {
+        Task_Executor_run(queued);
+    }
+
+    return future;
+}
+
+/**
+ * \brief Run a loop in parallel
+ *
+ * Split the range [start, end) into slices of grain indices and call body on
+ * each slice from the executor's workers. The calling thread runs slices as
+ * well and returns once all slices have completed.
+ *
+ * \param executor The executor to run the loop on
+ * \param start First index
+ * \param end One past the last index
+ * \param grain Number of indices per slice, or 0 to choose automatically
+ * \param body Function called as body(slice_start, slice_end, arg)
+ * \param arg Argument passed to body
+ */
+void Task_Executor_parallelFor(Task_Executor* executor, int start, int end, int grain, void (*body)(int, int, void*), void* arg) {
+    struct ParallelRange* ranges;
+    Task_Future** futures;
+    int count;
+
+    if(end <= start) {
+        return;
+    }
+
+    if(grain <= 0) {
+        grain = (end - start) / (executor->max_workers * RANGES_PER_WORKER);
+        grain = (grain < 1) ? 1 : grain;
+    }
+
+    count = (end - start + grain - 1) / grain;
+    ranges = malloc(sizeof(struct ParallelRange) * count);
+    futures = malloc(sizeof(Task_Future*) * count);
+
+    for(int i = 0; i < count; i++) {
+        ranges[i].body = body;
+        ranges[i].arg = arg;
+        ranges[i].start = start + i * grain;
+        ranges[i].end = (ranges[i].start + grain < end) ? ranges[i].start + grain : end;
+    }
+
+    /* Run the first slice here while the rest are picked up by workers */
+    for(int i = 1; i < count; i++) {
+        futures[i] = Task_Executor_submit(executor, Task_Executor_runRange, &ranges[i]);
+    }
+    Task_Executor_runRange(&ranges[0]);
+
+    for(int i = 1; i < count; i++) {
+        Task_join(futures[i]);
+    }
+
+    free(ranges);
+    free(futures);
+}
+
+/**
+ * \brief Get the number of running workers
+ *
+ * \param executor The executor
+ * \return Number of worker threads currently running
+ */
+int Task_Executor_getWorkerCount(Task_Executor* executor) {
+    int running;
+
+    pthread_mutex_lock(&executor->lock);
+    running = executor->running;
+    pthread_mutex_unlock(&executor->lock);
+
+    return running;
+}
+
+/**
+ * \brief Destroy an executor
+ *
+ * Wait for all queued tasks to complete and all workers to exit, then free
+ * the executor. No tasks may be submitted once this has been called.
+ *
+ * \param executor The executor to destroy
+ */
+void Task_Executor_destroy(Task_Executor* executor) {
+    pthread_mutex_lock(&executor->lock);
+    executor->shutdown = true;
+    pthread_cond_broadcast(&executor->available);
+    while(executor->running) {
+        pthread_cond_wait(&executor->exited, &executor->lock);
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    for(int i = 0; i < executor->max_workers; i++) {
+        pthread_mutex_destroy(&executor->workers[i].lock);
+        free(executor->workers[i].tasks);
+    }
+
+    pthread_mutex_destroy(&executor->lock);
+    pthread_cond_destroy(&executor->available);
+    pthread_cond_destroy(&executor->exited);
+    Queue_destroy(executor->injected);
+    free(executor->workers);
+    free(executor);
+}
+
+/**
+ * \brief Get the default executor
+ *
+ * The default executor is created on first use. It keeps no idle workers and
+ * grows to at most one worker per online processor.
+ *
+ * \return The default executor
+ */
+Task_Executor* Task_getDefaultExecutor(void) {
+    pthread_once(&default_executor_once, Task_Executor_initDefault);
+    return default_executor;
+}
+
+/**
+ * \brief Submit a task to the default executor
+ *
+ * Unlike Task_background(), no thread is created per call, so this is suited
+ * to short jobs. Long running or blocking work should still use
+ * Task_background() so it does not tie up a worker.
+ *
+ * \param func The function to run
+ * \param arg Argument to pass to func
+ * \return A future which must be passed to either Task_join() or
+ *   Task_detach()
+ */
+Task_Future* Task_submit(int (*func)(void*), void* arg) {
+    return Task_Executor_submit(Task_getDefaultExecutor(), func, arg);
+}
+
+/**
+ * \brief Run a loop in parallel on the default executor
+ *
+ * \param start First index
+ * \param end One past the last index
+ * \param grain Number of indices per slice, or 0 to choose automatically
+ * \param body Function called as body(slice_start, slice_end, arg)
+ * \param arg Argument passed to body
+ * \sa Task_Executor_parallelFor
+ */
+void Task_parallelFor(int start, int end, int grain, void (*body)(int, int, void*), void* arg) {
+    Task_Executor_parallelFor(Task_getDefaultExecutor(), start, end, grain, body, arg);
+}
+
+/**
+ * \brief Check if a task has completed
+ *
+ * \param future The future returned when the task was submitted
+ * \return True if the task has completed
+ */
+bool Task_isDone(Task_Future* future) {
+    bool done;
+
+    pthread_mutex_lock(&future->lock);
+    done = future->done;
+    pthread_mutex_unlock(&future->lock);
+
+    return done;
+}
+
+/**
+ * \brief Wait for a task to complete
+ *
+ * Block until the task completes and return its return value. When called
+ * from a worker thread, other tasks are run while waiting so that tasks may
+ * safely wait on tasks they submit. The future is freed and must not be used
+ * again.
+ *
+ * \param future The future returned when the task was submitted
+ * \return The value returned by the task
+ */
+int Task_join(Task_Future* future) {
+    struct Task_Worker* worker = pthread_getspecific(current_worker);
+    Task_Future* other;
+    int retval;
+
+    while(worker && !Task_isDone(future)) {
+        other = Task_Executor_take(worker->executor, worker);
+        if(other == NULL) {
+            /* Nothing left to help with, the task is running elsewhere */
+            break;
+        }
+        Task_Executor_run(other);
+    }
+
+    pthread_mutex_lock(&future->lock);
+    while(!future->done) {
+        pthread_cond_wait(&future->finished, &future->lock);
+    }
+    retval = future->retval;
+    pthread_mutex_unlock(&future->lock);
+
+    Task_Future_destroy(future);
+    return retval;
+}
+
+/**
+ * \brief Release a task without waiting for it
+ *
+ * The task will still be run, and the future is freed once it completes. The
+ * future must not be used again.
+ *
+ * \param future The future returned when the task was submitted
+ */
+void Task_detach(Task_Future* future) {
+    bool done;
+
+    pthread_mutex_lock(&future->lock);
+    done = future->done;
+    future->detached = true;
+    pthread_mutex_unlock(&future->lock);
+
+    if(done) {
+        Task_Future_destroy(future);
+    }
+}
+
+/** \} */
@@ -0,0 +1,231 @@
+/**
+ * \file
+ * \brief Histogram
+ */
+
+#include "seawolf.h"
+
+/**
+ * Number of sub-buckets in each power of two
+ */
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+static int Histogram_log2(uint64_t value);
+static int Histogram_index(int64_t value);
+static int64_t Histogram_upperBound(int index);
+
+/**
+ * \defgroup Histogram Histogram
+ * \ingroup Utilities
+ * \brief Fixed size log-linear histograms for latency measurements
+ * \{
+ */
+
+/**
+ * \brief Integer base 2 logarithm
+ * \private
+ */
+static int Histogram_log2(uint64_t value) {
+    int log = 0;
+
+    for(int shift = 32; shift; shift >>= 1) {
+        if(value >> shift) {
+            value >>= shift;
+            log += shift;
+        }
+    }
+
+    return log;
+}
+
+/**
+ * \brief Find the bucket for a value
+ * \private
+ *
+ * Values below SUB_BUCKETS each have their own bucket. Above that each power
+ * of two is split into SUB_BUCKETS equally sized buckets.
+ */
+static int Histogram_index(int64_t value) {
+    int exponent;
+
+    if(value < SUB_BUCKETS) {
+        return (value < 0) ? 0 : value;
+    }
+
+    exponent = Histogram_log2(value);
+    return ((exponent - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+        ((value >> (exponent - HISTOGRAM_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/**
+ * \brief Largest value which falls into a bucket
+ * \private
+ */
+static int64_t Histogram_upperBound(int index) {
+    int exponent;
+    int64_t low;
+
+    if(index < SUB_BUCKETS) {
+        return index;
+    }
+
+    exponent = (index >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+    low = (1LL << exponent) | ((int64_t) (index & (SUB_BUCKETS - 1)) << (exponent - HISTOGRAM_SUB_BITS));
+    return low + (1LL << (exponent - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+/**
+ * \brief Create a new histogram
+ *
+ * \return A new, empty histogram
+ */
+Histogram* Histogram_new(void) {
+    Histogram* histogram = malloc(sizeof(Histogram));
+    Histogram_init(histogram);
+    return histogram;
+}
+
+/**
+ * \brief Initialize a histogram
+ *
+ * Initialize, or reset, a histogram which was not created with
+ * Histogram_new(), such as one embedded in another structure
+ *
+ * \param histogram The histogram to initialize
+ */
+void Histogram_init(Histogram* histogram) {
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+    histogram->count = 0;
+    histogram->min = 0;
+    histogram->max = 0;
+    histogram->sum = 0;
+}
+
+/**
+ * \brief Record a value
+ *
+ * \param histogram The histogram to record into
+ * \param value The value to record. Negative values are recorded as 0
+ */
+void Histogram_record(Histogram* histogram, int64_t value) {
+    value = (value < 0) ? 0 : value;
+
+    if(histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if(value > histogram->max) {
+        histogram->max = value;
+    }
+
+    histogram->counts[Histogram_index(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+}
+
+/**
+ * \brief Add the contents of one histogram to another
+ *
+ * \param dest The histogram to add to
+ * \param src The histogram to add
+ */
+void Histogram_merge(Histogram* dest, const Histogram* src) {
+    if(src->count == 0) {
+        return;
+    }
+
+    if(dest->count == 0 || src->min < dest->min) {
+        dest->min = src->min;
+    }
+    if(src->max > dest->max) {
+        dest->max = src->max;
+    }
+
+    for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dest->counts[i] += src->counts[i];
+    }
+    dest->count += src->count;
+    dest->sum += src->sum;
+}
+
+/**
+ * \brief Get the number of values recorded
+ *
+ * \param histogram The histogram
+ * \return The number of values recorded
+ */
+uint64_t Histogram_getCount(const Histogram* histogram) {
+    return histogram->count;
+}
+
+/**
+ * \brief Get the smallest value recorded
+ *
+ * \param histogram The histogram
+ * \return The smallest value, or 0 if the histogram is empty
+ */
+int64_t Histogram_getMin(const Histogram* histogram) {
+    return histogram->min;
+}
+
+/**
+ * \brief Get the largest value recorded
+ *
+ * \param histogram The histogram
+ * \return The largest value, or 0 if the histogram is empty
+ */
+int64_t Histogram_getMax(const Histogram* histogram) {
+    return histogram->max;
+}
+
+/**
+ * \brief Get the mean of the values recorded
+ *
+ * \param histogram The histogram
+ * \return The mean, or 0 if the histogram is empty
+ */
+double Histogram_getMean(const Histogram* histogram) {
+    return histogram->count ? histogram->sum / histogram->count : 0;
+}
+
+/**
+ * \brief Get a percentile
+ *
+ * \param histogram The histogram
+ * \param percentile The percentile to return, between 0 and 100
+ * \return The value below which the given percentage of values fall, accurate
+ *   to the precision of the histogram, or 0 if the histogram is empty
+ */
+int64_t Histogram_getPercentile(const Histogram* histogram, double percentile) {
+    uint64_t target;
+    uint64_t seen = 0;
+    int64_t value;
+
+    if(histogram->count == 0) {
+        return 0;
+    }
+
+    percentile = Util_inRange(0.0, percentile, 100.0);
+    target = (uint64_t) (percentile / 100.0 * histogram->count + 0.5);
+    target = (target < 1) ? 1 : target;
+
+    for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if(seen >= target) {
+            value = Histogram_upperBound(i);
+            return Util_inRange(histogram->min, value, histogram->max);
+        }
+    }
+
+    return histogram->max;
+}
+
+/**
+ * \brief Destroy a histogram
+ *
+ * \param histogram A histogram created with Histogram_new()
+ */
+void Histogram_destroy(Histogram* histogram) {
+    free(histogram);
+}
+
+/** \} */
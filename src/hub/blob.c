@@ -0,0 +1,264 @@
+/**
+ * \file
+ * \brief Blob channel broker
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub.h"
+
+/**
+ * A channel registered by a producer
+ */
+typedef struct {
+    /** Name consumers open the channel by */
+    char* name;
+
+    /** Shared memory segment holding the channel's slots */
+    char* segment;
+
+    /** The producing client */
+    Hub_Client* owner;
+
+    /** Clients which have opened the channel */
+    List* subscribers;
+} Hub_Blob_Channel;
+
+static void Hub_Blob_closeLocked(Hub_Client* client, Hub_Blob_Channel* channel);
+static void Hub_Blob_destroyChannel(Hub_Blob_Channel* channel, bool notify);
+
+/** Channels by name */
+static Dictionary* channels = NULL;
+
+/** Protects channels and the subscriber lists of every channel */
+static pthread_mutex_t channels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \defgroup HubBlob Blob channels
+ * \brief Brokers shared memory channels for large payloads between clients
+ * \{
+ */
+
+/**
+ * \brief Initialize the blob channel broker
+ *
+ * Blob channels carry payloads too large for messages, such as camera frames,
+ * between clients on the same host. A producer writes each frame into a slot of
+ * a shared memory segment it created and tells the hub, which forwards the
+ * slot and sequence number to every client which opened the channel. The
+ * payload itself never passes through the hub. See the Blob component of
+ * libseawolf for the segment layout.
+ */
+void Hub_Blob_init(void) {
+    channels = Dictionary_new();
+}
+
+/**
+ * \brief Register a channel
+ *
+ * \param client The producing client
+ * \param name Name of the channel
+ * \param segment Name of the shared memory segment the producer created
+ * \return 0 on success, -1 if a channel with the name already exists
+ */
+int Hub_Blob_create(Hub_Client* client, const char* name, const char* segment) {
+    Hub_Blob_Channel* channel;
+    int n = -1;
+
+    pthread_mutex_lock(&channels_lock);
+    if(Dictionary_get(channels, name) == NULL) {
+        channel = malloc(sizeof(Hub_Blob_Channel));
+        channel->name = strdup(name);
+        channel->segment = strdup(segment);
+        channel->owner = client;
+        channel->subscribers = List_new();
+        Dictionary_set(channels, name, channel);
+        n = 0;
+    }
+    pthread_mutex_unlock(&channels_lock);
+
+    return n;
+}
+
+/**
+ * \brief Open a channel
+ *
+ * Subscribe the client to frames published on the channel
+ *
+ * \param client The consuming client
+ * \param name Name of the channel
+ * \return The name of the channel's segment, which should be freed by the
+ * caller, or NULL if there is no such channel
+ */
+char* Hub_Blob_open(Hub_Client* client, const char* name) {
+    Hub_Blob_Channel* channel;
+    char* segment = NULL;
+
+    pthread_mutex_lock(&channels_lock);
+    channel = Dictionary_get(channels, name);
+    if(channel) {
+        if(List_indexOf(channel->subscribers, client) == -1) {
+            List_append(channel->subscribers, client);
+        }
+        segment = strdup(channel->segment);
+    }
+    pthread_mutex_unlock(&channels_lock);
+
+    return segment;
+}
+
+/**
+ * \brief Forward a published frame to the channel's subscribers
+ *
+ * \param client The client which published the frame
+ * \param name Name of the channel
+ * \param slot Slot holding the frame
+ * \param sequence Sequence number of the frame
+ * \param length Length of the frame
+ * \return 0 on success, -1 if the client does not own the channel
+ */
+int Hub_Blob_publish(Hub_Client* client, const char* name, const char* slot, const char* sequence, const char* length) {
+    Hub_Blob_Channel* channel;
+    Hub_Client* subscriber;
+    Comm_Message* message;
+    Comm_PackedMessage* packed;
+    int n = -1;
+
+    pthread_mutex_lock(&channels_lock);
+    channel = Dictionary_get(channels, name);
+    if(channel && channel->owner == client) {
+        if(List_getSize(channel->subscribers)) {
+            message = Comm_Message_new(6);
+            message->components[0] = MemPool_strdup(message->alloc, "BLOB");
+            message->components[1] = MemPool_strdup(message->alloc, "FRAME");
+            message->components[2] = MemPool_strdup(message->alloc, name);
+            message->components[3] = MemPool_strdup(message->alloc, slot);
+            message->components[4] = MemPool_strdup(message->alloc, sequence);
+            message->components[5] = MemPool_strdup(message->alloc, length);
+            packed = Comm_packMessage(message);
+
+            for(int i = 0; (subscriber = List_get(channel->subscribers, i)) != NULL; i++) {
+                if(Hub_Net_sendPackedMessage(subscriber, packed) < 0) {
+                    Hub_Net_markClientClosed(subscriber);
+                }
+            }
+
+            Comm_Message_destroy(message);
+        }
+        n = 0;
+    }
+    pthread_mutex_unlock(&channels_lock);
+
+    return n;
+}
+
+/**
+ * \brief Close a channel for a client
+ *
+ * If the client owns the channel the channel is removed and its subscribers
+ * told it has closed, otherwise the client is unsubscribed from it
+ *
+ * \param client The client
+ * \param name Name of the channel
+ */
+void Hub_Blob_closeChannel(Hub_Client* client, const char* name) {
+    Hub_Blob_Channel* channel;
+
+    pthread_mutex_lock(&channels_lock);
+    channel = Dictionary_get(channels, name);
+    if(channel) {
+        Hub_Blob_closeLocked(client, channel);
+    }
+    pthread_mutex_unlock(&channels_lock);
+}
+
+/**
+ * \brief Remove a disconnected client from every channel
+ *
+ * Channels owned by the client are closed and their subscribers told so
+ *
+ * \param client The client
+ */
+void Hub_Blob_removeClient(Hub_Client* client) {
+    List* names;
+    char* name;
+
+    pthread_mutex_lock(&channels_lock);
+    names = Dictionary_getKeys(channels);
+    while((name = List_remove(names, 0)) != NULL) {
+        Hub_Blob_closeLocked(client, Dictionary_get(channels, name));
+    }
+    List_destroy(names);
+    pthread_mutex_unlock(&channels_lock);
+}
+
+/**
+ * \brief Close the blob channel broker
+ */
+void Hub_Blob_close(void) {
+    List* names;
+    char* name;
+
+    if(channels == NULL) {
+        return;
+    }
+
+    names = Dictionary_getKeys(channels);
+    while((name = List_remove(names, 0)) != NULL) {
+        Hub_Blob_destroyChannel(Dictionary_get(channels, name), false);
+    }
+    List_destroy(names);
+    Dictionary_destroy(channels);
+    channels = NULL;
+}
+
+/** \} */
+
+/**
+ * \brief Close a channel for a client
+ *
+ * Must be called with channels_lock held
+ *
+ * \param client The client
+ * \param channel The channel
+ */
+static void Hub_Blob_closeLocked(Hub_Client* client, Hub_Blob_Channel* channel) {
+    int i;
+
+    if(channel->owner == client) {
+        Dictionary_remove(channels, channel->name);
+        Hub_Blob_destroyChannel(channel, true);
+    } else if((i = List_indexOf(channel->subscribers, client)) != -1) {
+        List_remove(channel->subscribers, i);
+    }
+}
+
+/**
+ * \brief Free a channel
+ *
+ * Must be called with channels_lock held
+ *
+ * \param channel The channel, already removed from channels
+ * \param notify If true, send BLOB CLOSED to every subscriber
+ */
+static void Hub_Blob_destroyChannel(Hub_Blob_Channel* channel, bool notify) {
+    Hub_Client* subscriber;
+    Comm_Message* message;
+
+    if(notify && List_getSize(channel->subscribers)) {
+        message = Comm_Message_new(3);
+        message->components[0] = MemPool_strdup(message->alloc, "BLOB");
+        message->components[1] = MemPool_strdup(message->alloc, "CLOSED");
+        message->components[2] = MemPool_strdup(message->alloc, channel->name);
+
+        for(int i = 0; (subscriber = List_get(channel->subscribers, i)) != NULL; i++) {
+            Hub_Net_sendMessage(subscriber, message);
+        }
+
+        Comm_Message_destroy(message);
+    }
+
+    List_destroy(channel->subscribers);
+    free(channel->segment);
+    free(channel->name);
+    free(channel);
+}
@@ -0,0 +1,212 @@
+/**
+ * \file
+ * \brief Traffic capture
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub.h"
+#include "seawolf_hub_capture.h"
+
+#include <arpa/inet.h>
+
+/** Most bytes waiting for the writer before frames are dropped */
+#define CAPTURE_MAX_PENDING (64 * 1024 * 1024)
+
+static int Hub_Capture_writer(void);
+static bool Hub_Capture_isAuth(const char* data, size_t length);
+static void Hub_Capture_queue(uint32_t client, const void* data, uint32_t length);
+
+/** The capture file */
+static FILE* capture_file = NULL;
+
+/** Records waiting to be written */
+static Queue* pending = NULL;
+
+/** Bytes of records waiting to be written */
+static uint64_t pending_bytes = 0;
+
+/** Frames dropped because the writer fell behind */
+static uint64_t dropped = 0;
+
+/** Records written */
+static uint64_t written = 0;
+
+/** Time the capture started */
+static int64_t started;
+
+/** Frames are only recorded while true */
+static bool capturing = false;
+
+/** Queued after the last record to stop the writer */
+static Hub_Capture_Record end_marker;
+
+/** Task handle of the writer */
+static Task_Handle writer_handle;
+
+/**
+ * \defgroup HubCapture Capture
+ * \brief Records client traffic for replay with sw-replay
+ * \{
+ */
+
+/**
+ * \brief Initialize traffic capture
+ *
+ * If the capture_file option is set, every frame received from a client is
+ * recorded to it in the format given in seawolf_hub_capture.h. Passwords are
+ * left out, sw-replay supplies its own when replaying the capture. Receiving
+ * threads only copy each frame to a queue, and a background task writes them
+ * out. If the writer falls more than CAPTURE_MAX_PENDING bytes behind, frames
+ * are dropped rather than delaying clients.
+ */
+void Hub_Capture_init(void) {
+    const char* path = Hub_Config_getOption("capture_file");
+    Hub_Capture_Header header;
+
+    if(strlen(path) == 0) {
+        return;
+    }
+
+    capture_file = fopen(path, "w");
+    if(capture_file == NULL) {
+        Hub_Logging_log(ERROR, Util_format("Unable to open capture file %s: %s", path, strerror(errno)));
+        return;
+    }
+
+    started = Timer_getTimestamp();
+    header.magic = HUB_CAPTURE_MAGIC;
+    header.version = HUB_CAPTURE_VERSION;
+    header.started = started;
+    fwrite(&header, sizeof(header), 1, capture_file);
+
+    pending = Queue_new();
+    writer_handle = Task_background(Hub_Capture_writer);
+    capturing = true;
+
+    Hub_Logging_log(INFO, Util_format("Capturing client traffic to %s", path));
+}
+
+/**
+ * \brief Record a frame received from a client
+ *
+ * \param client The client which sent the frame
+ * \param packed_message The frame, as received
+ */
+void Hub_Capture_recordFrame(Hub_Client* client, Comm_PackedMessage* packed_message) {
+    char auth[COMM_MESSAGE_PREFIX_LEN + sizeof(HUB_CAPTURE_AUTH) + 1];
+
+    if(!capturing) {
+        return;
+    }
+
+    if(Hub_Capture_isAuth(packed_message->data, packed_message->length)) {
+        /* Keep the request ID but replace the password with an empty one */
+        memcpy(auth, packed_message->data, COMM_MESSAGE_PREFIX_LEN);
+        memcpy(auth + COMM_MESSAGE_PREFIX_LEN, HUB_CAPTURE_AUTH, sizeof(HUB_CAPTURE_AUTH));
+        auth[sizeof(auth) - 1] = '\0';
+        ((uint16_t*) auth)[0] = htons(sizeof(auth) - COMM_MESSAGE_PREFIX_LEN);
+        Hub_Capture_queue(client->id, auth, sizeof(auth));
+    } else {
+        Hub_Capture_queue(client->id, packed_message->data, packed_message->length);
+    }
+}
+
+/**
+ * \brief Record a client disconnecting
+ *
+ * \param client The client
+ */
+void Hub_Capture_recordClose(Hub_Client* client) {
+    if(capturing) {
+        Hub_Capture_queue(client->id, NULL, 0);
+    }
+}
+
+/**
+ * \brief Stop capturing
+ *
+ * Waits for the writer to write every queued record and closes the capture
+ * file. Must be called after clients have been closed so their disconnections
+ * are recorded.
+ */
+void Hub_Capture_close(void) {
+    if(!capturing) {
+        return;
+    }
+
+    capturing = false;
+    Queue_append(pending, &end_marker);
+    Task_wait(writer_handle);
+    fclose(capture_file);
+
+    Hub_Logging_log(INFO, Util_format("Captured %llu records, dropped %llu frames",
+                                      (unsigned long long) written, (unsigned long long) dropped));
+}
+
+/** \} */
+
+/**
+ * \brief Check if a frame is a COMM AUTH request
+ */
+static bool Hub_Capture_isAuth(const char* data, size_t length) {
+    return length >= COMM_MESSAGE_PREFIX_LEN + sizeof(HUB_CAPTURE_AUTH) &&
+           memcmp(data + COMM_MESSAGE_PREFIX_LEN, HUB_CAPTURE_AUTH, sizeof(HUB_CAPTURE_AUTH)) == 0;
+}
+
+/**
+ * \brief Copy a record to the queue
+ *
+ * \param client ID of the client
+ * \param data Frame to copy
+ * \param length Length of the frame, or 0 for a disconnection
+ */
+static void Hub_Capture_queue(uint32_t client, const void* data, uint32_t length) {
+    size_t size = sizeof(Hub_Capture_Record) + length;
+    Hub_Capture_Record* record;
+
+    if(__sync_add_and_fetch(&pending_bytes, size) > CAPTURE_MAX_PENDING) {
+        __sync_sub_and_fetch(&pending_bytes, size);
+        __sync_add_and_fetch(&dropped, 1);
+        return;
+    }
+
+    record = malloc(size);
+    record->time = Timer_getTimestamp() - started;
+    record->client = client;
+    record->length = length;
+    if(length) {
+        memcpy(record + 1, data, length);
+    }
+
+    Queue_append(pending, record);
+}
+
+/**
+ * \brief Write queued records to the capture file
+ *
+ * Spawned by Hub_Capture_init()
+ *
+ * \return Returns 0 once end_marker is dequeued by Hub_Capture_close()
+ */
+static int Hub_Capture_writer(void) {
+    Hub_Capture_Record* record;
+    size_t size;
+
+    while((record = Queue_pop(pending, true)) != &end_marker) {
+        size = sizeof(Hub_Capture_Record) + record->length;
+        if(fwrite(record, size, 1, capture_file) != 1) {
+            Hub_Logging_log(ERROR, Util_format("Error writing capture file: %s", strerror(errno)));
+        }
+
+        written++;
+        __sync_sub_and_fetch(&pending_bytes, size);
+        free(record);
+
+        /* Flush whenever the writer catches up */
+        if(Queue_getSize(pending) == 0) {
+            fflush(capture_file);
+        }
+    }
+
+    return 0;
+}
@@ -10,6 +10,7 @@ static char* KICKING = "KICKING";
  * Create a new client object
  */
 Hub_Client* Hub_Client_new(int sock) {
+    static uint32_t last_id = 0;
     Hub_Client* client;
     pthread_mutexattr_t recursive_mutex;
 
@@ -19,11 +20,20 @@ Hub_Client* Hub_Client_new(int sock) {
 
     client = malloc(sizeof(Hub_Client));
     client->sock = sock;
+    client->deliver = NULL;
+    client->id = __sync_add_and_fetch(&last_id, 1);
     client->state = UNAUTHENTICATED;
     client->name = NULL;
     client->filters = NULL;
     client->filters_n = 0;
     client->subscribed_vars = List_new();
+    client->clock_sync = false;
+    client->watch_timestamps = false;
+    client->messages_in = 0;
+    client->bytes_in = 0;
+    client->messages_out = 0;
+    client->bytes_out = 0;
+    client->drops = 0;
 
     pthread_rwlock_init(&client->filter_lock, NULL);
     pthread_rwlock_init(&client->in_use, NULL);
@@ -105,40 +115,11 @@ void Hub_Client_clearFilters(Hub_Client* client) {
 bool Hub_Client_checkFilters(Hub_Client* client, Comm_Message* message) {
     assert(strcmp(message->components[0], "NOTIFY") == 0);
 
-    Notify_FilterType type;
-    char* filter_body;
     bool r = false;
 
     pthread_rwlock_rdlock(&client->filter_lock);
-    for(int i = 0; i < client->filters_n; i++) {
-        type = (Notify_FilterType) client->filters[i][0];
-        filter_body = client->filters[i] + 1;
-
-        switch(type) {
-        case FILTER_MATCH:
-            if(strcmp(message->components[2], filter_body) == 0) {
-                r = true;
-            }
-            break;
-
-        case FILTER_PREFIX:
-            for(int j = 0; message->components[2][j] != '\0'; j++) {
-                if(filter_body[j] == '\0') {
-                    if(message->components[2][j] == ' ') {
-                        r = false;
-                    } else {
-                        break;
-                    }
-                }
-            }
-            break;
-
-        case FILTER_ACTION:
-            if(strncmp(message->components[2], filter_body, strlen(filter_body)) == 0) {
-                r = true;
-            }
-            break;
-        }
+    for(int i = 0; i < client->filters_n && !r; i++) {
+        r = Notify_matchFilter((Notify_FilterType) client->filters[i][0], client->filters[i] + 1, message->components[2]);
     }
 
     pthread_rwlock_unlock(&client->filter_lock);
@@ -0,0 +1,103 @@
+/**
+ * \file
+ * \brief Shared simulation clock
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub.h"
+
+/**
+ * \defgroup HubClock Clock
+ * \brief The virtual clock shared with clients using the hub clock source
+ * \{
+ */
+
+/**
+ * \brief Initialize the clock subsystem
+ *
+ * Select the hub clock according to the clock_source and clock_rate options and
+ * start broadcasting changes to it
+ */
+void Hub_Clock_init(void) {
+    const char* source = Hub_Config_getOption("clock_source");
+
+    if(strcmp(source, "virtual") == 0) {
+        Clock_setRate(atof(Hub_Config_getOption("clock_rate")));
+        Clock_setSource(CLOCK_SOURCE_VIRTUAL);
+    } else if(strcmp(source, "real") != 0) {
+        Hub_Logging_log(ERROR, Util_format("Invalid clock source '%s', using real time", source));
+    }
+
+    Clock_addListener(Hub_Clock_broadcast);
+}
+
+/**
+ * \brief Build a message giving the current state of the clock
+ *
+ * \param request_id Request ID to respond to, or 0 for a broadcast
+ * \return A COMM CLOCK message which must be destroyed by the caller
+ */
+Comm_Message* Hub_Clock_getMessage(uint16_t request_id) {
+    Comm_Message* message = Comm_Message_new(4);
+
+    message->request_id = request_id;
+    message->components[0] = MemPool_strdup(message->alloc, "COMM");
+    message->components[1] = MemPool_strdup(message->alloc, "CLOCK");
+    message->components[2] = MemPool_strdup(message->alloc, Util_format("%lld", (long long) Clock_now()));
+    message->components[3] = MemPool_strdup(message->alloc, Util_format("%f", Clock_getRate()));
+
+    return message;
+}
+
+/**
+ * \brief Send the clock to all synchronized clients
+ *
+ * Called whenever the hub clock is stepped or changes rate
+ */
+void Hub_Clock_broadcast(void) {
+    List* clients = Hub_Net_getClients();
+    Comm_Message* message;
+    Comm_PackedMessage* packed_message;
+    List* send_to;
+    Hub_Client* client;
+    int client_count;
+
+    /* An embedded hub shares the application's clock, which may still change
+       after the hub has stopped */
+    if(clients == NULL) {
+        return;
+    }
+
+    message = Hub_Clock_getMessage(0);
+    packed_message = Comm_packMessage(message);
+    send_to = List_new();
+
+    Hub_Net_acquireGlobalClientsLock();
+    client_count = List_getSize(clients);
+    for(int i = 0; i < client_count; i++) {
+        client = List_get(clients, i);
+
+        /* Clients in the same process already share the hub's clock */
+        if(client->state == CONNECTED && client->clock_sync && client->deliver == NULL) {
+            pthread_rwlock_rdlock(&client->in_use);
+            List_append(send_to, client);
+        }
+    }
+    Hub_Net_releaseGlobalClientsLock();
+
+    client_count = List_getSize(send_to);
+    for(int i = 0; i < client_count; i++) {
+        client = List_get(send_to, i);
+        if(Hub_Net_sendPackedMessage(client, packed_message) < 0) {
+            /* Failed to send, shutdown client */
+            Hub_Logging_log(DEBUG, "Client disconnected, shutting down client");
+            Hub_Net_markClientClosed(client);
+        }
+        pthread_rwlock_unlock(&client->in_use);
+    }
+
+    List_destroy(send_to);
+    Comm_Message_destroy(message);
+}
+
+/** \} */
@@ -6,6 +6,8 @@
 #include "seawolf.h"
 #include "seawolf_hub.h"
 
+#include <sys/stat.h>
+
 /**
  * Represents a configuration option
  */
@@ -33,12 +35,28 @@ static char* hub_config_file = NULL;
 /** Available options and their defaults */
 static Hub_Config_Option valid_options[] = {{"bind_address"        , "127.0.0.1"       },
                                             {"bind_port"           , "31427"           },
+                                            {"bind_path"           , ""                },
                                             {"password"            , ""                },
                                             {"var_db"              , "seawolf_var.db"  },
                                             {"var_defs"            , "seawolf_var.defs"},
+                                            {"var_shm"             , "1"               },
                                             {"log_file"            , ""                },
                                             {"log_replicate_stdout", "1"               },
-                                            {"log_level"           , "NORMAL"          }};
+                                            {"log_level"           , "NORMAL"          },
+                                            {"clock_source"        , "real"            },
+                                            {"clock_rate"          , "1"               },
+                                            {"stats_shm"           , "1"               },
+                                            {"stats_interval"      , "1"               },
+                                            {"trace"               , "0"               },
+                                            {"trace_file"          , ""                },
+                                            {"capture_file"        , ""                },
+                                            {"telemetry_file"      , ""                },
+                                            {"telemetry_max_size"  , "1024"            },
+                                            {"peer_address"        , ""                },
+                                            {"peer_port"           , "31427"           },
+                                            {"peer_password"       , ""                },
+                                            {"peer_vars"           , ""                },
+                                            {"peer_retry"          , "1"               }};
 
 /**
  * \defgroup Config Configuration
@@ -214,4 +232,17 @@ void Hub_Config_close(void) {
     }
 }
 
+/**
+ * \brief Check of the given file exists
+ *
+ * Check if the given file exists
+ *
+ * \param file Path of the file to check
+ * \return True of the file exists, false otherwise
+ */
+bool Hub_fileExists(const char* file) {
+    struct stat s;
+    return stat(file, &s) != -1;
+}
+
 /** \} */
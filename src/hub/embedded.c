@@ -0,0 +1,120 @@
+/**
+ * \file
+ * \brief Hub embedded in an application
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub.h"
+#include "seawolf_hub_embedded.h"
+
+static void* Hub_Embedded_connect(void (*deliver)(Comm_PackedMessage* packed_message));
+static void Hub_Embedded_send(void* connection, Comm_PackedMessage* packed_message);
+
+/** Connects libseawolf to the embedded hub */
+static const Comm_InprocHub inproc_hub = {.connect = Hub_Embedded_connect, .send = Hub_Embedded_send};
+
+/** Set while the embedded hub is running */
+static bool running = false;
+
+/**
+ * \defgroup Embedded Embedded hub
+ * \brief Run the hub inside an application
+ * \{
+ */
+
+/**
+ * \brief Start a hub inside the application
+ *
+ * Start the hub's variable store, notification routing, logging and the rest
+ * of the hub in the calling process and register it with libseawolf, so an
+ * application configured with a comm_server of COMM_INPROC_PREFIX ("inproc:")
+ * connects to it without a socket. Each request runs as a direct call into the
+ * hub on the thread making it, giving unit tests and single process
+ * simulations round trips of microseconds and no dependence on a hub process.
+ *
+ * Must be called before Seawolf_init(). The configuration file is read exactly
+ * as by the seawolf-hub executable. Network options are ignored, but the shared
+ * memory segments enabled by stats_shm and var_shm are named by bind_port, so
+ * an embedded hub should use a port no other hub on the machine uses or turn
+ * them off. The hub shares the application's Clock. An error in the
+ * configuration terminates the process as it would the hub.
+ *
+ * \param conf_file Hub configuration file, or NULL to search the same
+ * locations as the hub
+ */
+void Hub_Embedded_start(const char* conf_file) {
+    if(conf_file) {
+        Hub_Config_loadConfig(conf_file);
+    }
+
+    /* Shared with libseawolf, which may change the clock and so have the hub
+       build messages before Seawolf_init() reaches its own MemPool_init() */
+    MemPool_init();
+
+    Hub_Config_init();
+    Hub_Var_init();
+    Hub_Logging_init();
+    Hub_Clock_init();
+    Hub_Capture_init();
+    Hub_Telemetry_init();
+    Hub_Blob_init();
+    Hub_Net_init();
+    Hub_Stats_init();
+    Hub_Federation_init();
+
+    Hub_Net_startEmbedded();
+    running = true;
+
+    Comm_setInprocHub(&inproc_hub);
+}
+
+/**
+ * \brief Stop the hub running inside the application
+ *
+ * Must be called after Seawolf_close(), any application still connected is
+ * kicked as it would be by a closing hub
+ */
+void Hub_Embedded_stop(void) {
+    if(!running) {
+        return;
+    }
+
+    Comm_setInprocHub(NULL);
+
+    Hub_Logging_log(INFO, "Closing");
+    Hub_Federation_close();
+    Hub_Stats_close();
+    Hub_Net_stopEmbedded();
+    Hub_Net_close();
+    Hub_Blob_close();
+    Hub_Capture_close();
+    Hub_Telemetry_close();
+    Hub_Var_close();
+    Hub_Logging_close();
+    Hub_Config_close();
+    MemPool_close();
+
+    running = false;
+}
+
+/** \} */
+
+/**
+ * \brief Connect the application to the hub
+ *
+ * \param deliver Called with each message the hub sends the application
+ * \return The client representing the application
+ */
+static void* Hub_Embedded_connect(void (*deliver)(Comm_PackedMessage* packed_message)) {
+    return Hub_Net_connectInproc(deliver);
+}
+
+/**
+ * \brief Process a message from the application
+ *
+ * \param connection The client representing the application
+ * \param packed_message The message
+ */
+static void Hub_Embedded_send(void* connection, Comm_PackedMessage* packed_message) {
+    Hub_Net_receiveInproc(connection, packed_message);
+}
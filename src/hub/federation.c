@@ -0,0 +1,584 @@
+/**
+ * \file
+ * \brief Hub federation
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static bool Hub_Federation_connect(void);
+static void Hub_Federation_disconnect(void);
+static int Hub_Federation_send(int sock, Comm_Message* message);
+static int Hub_Federation_queue(Comm_Message* message);
+static int Hub_Federation_sender(void);
+static void Hub_Federation_input(Comm_Message* message);
+static int Hub_Federation_link(void);
+
+/** Replicated variables, each requested with a VAR GET whose request ID is its
+    index plus one */
+static List* replicated = NULL;
+
+/** Filters added by local clients, as "<type>:<filter>", sent to the peer on
+    every connection */
+static Dictionary* filters = NULL;
+
+/** Connection to the peer hub, or -1 */
+static int peer_sock = -1;
+
+/** Set once the connection is established and messages may be forwarded */
+static bool connected = false;
+
+/** Cleared when the hub is closing */
+static bool running = false;
+
+/** Protects peer_sock, connected, running and filters */
+static pthread_mutex_t peer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Held while writing to the peer, so frames are not interleaved and peer_sock
+    is not closed during a send */
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Packed frames waiting to be sent to the peer, ended by NULL when the hub
+    closes */
+static Queue* outbound = NULL;
+
+/** Task maintaining the connection to the peer */
+static Task_Handle link_handle;
+
+/** Task sending queued frames to the peer */
+static Task_Handle sender_handle;
+
+/**
+ * \defgroup Federation Federation
+ * \brief Replicate variables and notifications from a peer hub
+ * \{
+ */
+
+/**
+ * \brief Initialize federation
+ *
+ * If peer_address is set the hub connects to the hub at that address as a
+ * client and replicates every read-write variable whose name starts with one
+ * of the comma separated prefixes in peer_vars. The peer sends each update of
+ * a replicated variable once, and the hub fans it out to its own subscribers
+ * and serves reads from its copy. Sets of replicated variables and all
+ * notifications from local clients are forwarded to the peer and take effect
+ * when the peer sends them back, so both hubs see every change in the same
+ * order. Notification filters of local clients are added to the hub's own
+ * connection to the peer.
+ *
+ * While the peer is unreachable replicated variables keep their last values and
+ * local sets and notifications take effect locally. The connection is retried
+ * every peer_retry seconds. Only one of two federated hubs should name the
+ * other as its peer.
+ */
+void Hub_Federation_init(void) {
+    char* prefixes;
+    char* prefix;
+    char* saveptr;
+    Hub_Var* var;
+
+    if(Hub_Config_getOption("peer_address")[0] == '\0') {
+        return;
+    }
+
+    replicated = List_new();
+    filters = Dictionary_new();
+
+    prefixes = strdup(Hub_Config_getOption("peer_vars"));
+    for(prefix = strtok_r(prefixes, ", ", &saveptr); prefix != NULL; prefix = strtok_r(NULL, ", ", &saveptr)) {
+        for(int i = 0; i < Hub_Var_getCount(); i++) {
+            var = Hub_Var_getByIndex(i);
+            if(!var->replicated && !var->readonly && strncmp(var->name, prefix, strlen(prefix)) == 0) {
+                var->replicated = true;
+                List_append(replicated, var);
+            }
+        }
+    }
+    free(prefixes);
+
+    Hub_Logging_log(INFO, Util_format("Replicating %d variables from peer hub at %s:%s", List_getSize(replicated),
+                                      Hub_Config_getOption("peer_address"), Hub_Config_getOption("peer_port")));
+
+    outbound = Queue_new();
+    running = true;
+    link_handle = Task_background(Hub_Federation_link);
+    sender_handle = Task_background(Hub_Federation_sender);
+}
+
+/**
+ * \brief Forward a variable set to the peer
+ *
+ * \param name Name of the variable
+ * \param value The new value, as sent by the client
+ * \return 0 if the set was forwarded, -1 if it should be applied locally
+ */
+int Hub_Federation_forwardSet(const char* name, const char* value) {
+    static char* var_0 = "VAR";
+    static char* var_1 = "SET";
+
+    Hub_Var* var = Hub_Var_get(name);
+    Comm_Message* message;
+
+    if(var == NULL || !var->replicated) {
+        return -1;
+    }
+
+    message = Comm_Message_new(4);
+    message->components[0] = var_0;
+    message->components[1] = var_1;
+    message->components[2] = (char*) name;
+    message->components[3] = (char*) value;
+
+    return Hub_Federation_queue(message);
+}
+
+/**
+ * \brief Forward a notification to the peer
+ *
+ * \param body The notification
+ * \return 0 if the notification was forwarded, -1 if it should be broadcast
+ * locally
+ */
+int Hub_Federation_forwardNotification(const char* body) {
+    static char* notify_0 = "NOTIFY";
+    static char* notify_1 = "OUT";
+
+    Comm_Message* message;
+
+    if(filters == NULL) {
+        return -1;
+    }
+
+    message = Comm_Message_new(3);
+    message->components[0] = notify_0;
+    message->components[1] = notify_1;
+    message->components[2] = (char*) body;
+
+    return Hub_Federation_queue(message);
+}
+
+/**
+ * \brief Add a local client's notification filter to the peer connection
+ *
+ * Filters are never removed from the peer connection, so a notification no
+ * local client wants any longer may still be sent by the peer until the
+ * connection is next established
+ *
+ * \param type Type of the filter
+ * \param filter The filter
+ */
+void Hub_Federation_addFilter(Notify_FilterType type, const char* filter) {
+    static char* notify_0 = "NOTIFY";
+    static char* notify_1 = "ADD_FILTER";
+
+    Comm_Message* message;
+    char type_str[12];
+    char* key;
+    bool added = false;
+
+    if(filters == NULL) {
+        return;
+    }
+
+    snprintf(type_str, sizeof(type_str), "%d", (int) type);
+    key = malloc(strlen(type_str) + strlen(filter) + 2);
+    sprintf(key, "%s:%s", type_str, filter);
+
+    pthread_mutex_lock(&peer_lock);
+    if(Dictionary_get(filters, key) == NULL) {
+        Dictionary_set(filters, key, filters);
+        added = true;
+    }
+    pthread_mutex_unlock(&peer_lock);
+
+    /* A filter added while the connection is being established may be sent
+       twice, which the peer ignores */
+    if(added) {
+        message = Comm_Message_new(4);
+        message->components[0] = notify_0;
+        message->components[1] = notify_1;
+        message->components[2] = type_str;
+        message->components[3] = (char*) filter;
+        Hub_Federation_queue(message);
+    }
+
+    free(key);
+}
+
+/**
+ * \brief Close federation
+ *
+ * Disconnect from the peer and wait for the connection and sender tasks to exit
+ */
+void Hub_Federation_close(void) {
+    if(replicated == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&peer_lock);
+    running = false;
+    if(peer_sock != -1) {
+        shutdown(peer_sock, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&peer_lock);
+
+    Task_wait(link_handle);
+
+    Queue_append(outbound, NULL);
+    Task_wait(sender_handle);
+    Queue_destroy(outbound);
+    outbound = NULL;
+
+    List_destroy(replicated);
+    Dictionary_destroy(filters);
+    replicated = NULL;
+    filters = NULL;
+}
+
+/** \} */
+
+/**
+ * \brief Maintain the connection to the peer
+ *
+ * Connect to the peer and process the messages it sends until the connection
+ * is lost, then retry every peer_retry seconds until the hub closes
+ *
+ * \return Always 0
+ */
+static int Hub_Federation_link(void) {
+    Comm_PackedMessage* packed_message;
+    Comm_Message* message;
+    double retry = atof(Hub_Config_getOption("peer_retry"));
+
+    while(running) {
+        if(Hub_Federation_connect()) {
+            while((packed_message = Hub_Net_readPackedMessage(peer_sock)) != NULL) {
+                message = Comm_unpackMessage(packed_message);
+                Hub_Federation_input(message);
+                Comm_Message_destroy(message);
+            }
+
+            Hub_Federation_disconnect();
+        }
+
+        /* Check often for the hub closing while waiting to retry */
+        for(double waited = 0; running && waited < retry; waited += 0.1) {
+            Util_usleep(0.1);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Connect and authenticate to the peer and subscribe to everything
+ * replicated from it
+ *
+ * \return True if the connection is established
+ */
+static bool Hub_Federation_connect(void) {
+    static char* comm_0 = "COMM";
+    static char* comm_1 = "AUTH";
+    static char* notify_0 = "NOTIFY";
+    static char* notify_1 = "ADD_FILTER";
+    static char* watch_0 = "WATCH";
+    static char* watch_1 = "ADD";
+    static char* var_0 = "VAR";
+    static char* var_1 = "GET";
+    static bool reported = false;
+
+    /* Bounds connect() and sends, so an unreachable peer does not hold up the
+       hub closing or the clients forwarding to it */
+    const struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+
+    /* Forwarded sets and notifications are small and latency sensitive */
+    const int nodelay = 1;
+
+    struct sockaddr_in addr;
+    Comm_PackedMessage* packed_message;
+    Comm_Message* message;
+    List* keys;
+    char* key;
+    char* filter;
+    Hub_Var* var;
+    bool authenticated;
+    int sock;
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(Hub_Config_getOption("peer_address"));
+    addr.sin_port = htons(atoi(Hub_Config_getOption("peer_port")));
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if(sock == -1) {
+        Hub_Logging_log(ERROR, Util_format("Unable to create peer socket: %s", strerror(errno)));
+        return false;
+    }
+
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if(connect(sock, (struct sockaddr*) &addr, sizeof(addr))) {
+        /* Report an unreachable peer once rather than on every retry */
+        if(!reported) {
+            Hub_Logging_log(ERROR, Util_format("Unable to connect to peer hub: %s", strerror(errno)));
+            reported = true;
+        }
+        close(sock);
+        return false;
+    }
+
+    /* Hub_Federation_close() shuts down peer_sock to wake this task */
+    pthread_mutex_lock(&peer_lock);
+    if(!running) {
+        pthread_mutex_unlock(&peer_lock);
+        close(sock);
+        return false;
+    }
+    peer_sock = sock;
+    pthread_mutex_unlock(&peer_lock);
+
+    message = Comm_Message_new(3);
+    message->request_id = 1;
+    message->components[0] = comm_0;
+    message->components[1] = comm_1;
+    message->components[2] = (char*) Hub_Config_getOption("peer_password");
+    pthread_mutex_lock(&send_lock);
+    Hub_Federation_send(sock, message);
+    pthread_mutex_unlock(&send_lock);
+    Comm_Message_destroy(message);
+
+    packed_message = Hub_Net_readPackedMessage(sock);
+    if(packed_message == NULL) {
+        Hub_Federation_disconnect();
+        return false;
+    }
+
+    message = Comm_unpackMessage(packed_message);
+    authenticated = message->count == 2 && strcmp(message->components[1], "SUCCESS") == 0;
+    Comm_Message_destroy(message);
+
+    if(!authenticated) {
+        Hub_Logging_log(ERROR, "Failed to authenticate with peer hub");
+        Hub_Federation_disconnect();
+        return false;
+    }
+
+    /* Frames queued once connected is set are sent after these, since the
+       sender waits for send_lock */
+    pthread_mutex_lock(&send_lock);
+    pthread_mutex_lock(&peer_lock);
+    keys = Dictionary_getKeys(filters);
+    connected = true;
+    pthread_mutex_unlock(&peer_lock);
+
+    while((key = List_remove(keys, 0)) != NULL) {
+        filter = strdup(key);
+        *strchr(filter, ':') = '\0';
+
+        message = Comm_Message_new(4);
+        message->components[0] = notify_0;
+        message->components[1] = notify_1;
+        message->components[2] = filter;
+        message->components[3] = filter + strlen(filter) + 1;
+        Hub_Federation_send(sock, message);
+        Comm_Message_destroy(message);
+        free(filter);
+    }
+    List_destroy(keys);
+
+    /* Subscribe before reading each variable, so no update made between the two
+       is missed */
+    for(int i = 0; (var = List_get(replicated, i)) != NULL; i++) {
+        message = Comm_Message_new(3);
+        message->components[0] = watch_0;
+        message->components[1] = watch_1;
+        message->components[2] = var->name;
+        Hub_Federation_send(sock, message);
+        Comm_Message_destroy(message);
+
+        message = Comm_Message_new(3);
+        message->request_id = i + 1;
+        message->components[0] = var_0;
+        message->components[1] = var_1;
+        message->components[2] = var->name;
+        Hub_Federation_send(sock, message);
+        Comm_Message_destroy(message);
+    }
+
+    pthread_mutex_unlock(&send_lock);
+
+    Hub_Logging_log(INFO, "Connected to peer hub");
+    reported = false;
+
+    return true;
+}
+
+/**
+ * \brief Close the connection to the peer
+ */
+static void Hub_Federation_disconnect(void) {
+    bool was_connected;
+    int sock;
+
+    pthread_mutex_lock(&peer_lock);
+    was_connected = connected;
+    connected = false;
+    sock = peer_sock;
+    peer_sock = -1;
+    pthread_mutex_unlock(&peer_lock);
+
+    /* Wake a send in progress and wait for it before the descriptor can be
+       reused */
+    shutdown(sock, SHUT_RDWR);
+    pthread_mutex_lock(&send_lock);
+    close(sock);
+    pthread_mutex_unlock(&send_lock);
+
+    if(was_connected && running) {
+        Hub_Logging_log(ERROR, "Lost connection to peer hub, serving replicated variables locally");
+    }
+}
+
+/**
+ * \brief Queue a message to be sent to the peer
+ *
+ * The message is packed and queued for the sender task if the peer is
+ * connected, and destroyed otherwise. Either way the caller must not use it
+ * again.
+ *
+ * \param message The message
+ * \return 0 if the message was queued, -1 if the peer is not connected
+ */
+static int Hub_Federation_queue(Comm_Message* message) {
+    Comm_PackedMessage* packed_message = Comm_packMessage(message);
+    int n = -1;
+
+    pthread_mutex_lock(&peer_lock);
+    if(connected) {
+        Queue_append(outbound, packed_message);
+        n = 0;
+    }
+    pthread_mutex_unlock(&peer_lock);
+
+    if(n == -1) {
+        Comm_Message_destroy(message);
+    }
+
+    return n;
+}
+
+/**
+ * \brief Send queued frames to the peer
+ *
+ * Frames are written without holding peer_lock, so clients forwarding sets
+ * and notifications are never held up by a slow peer. Frames queued for a
+ * connection which has since been lost are dropped. If a frame can not be sent
+ * the connection is shut down, and the connection task reconnects.
+ *
+ * \return Always 0
+ */
+static int Hub_Federation_sender(void) {
+    Comm_PackedMessage* packed_message;
+    size_t sent;
+    int sock;
+    int n;
+
+    while((packed_message = Queue_pop(outbound, true)) != NULL) {
+        pthread_mutex_lock(&send_lock);
+
+        pthread_mutex_lock(&peer_lock);
+        sock = connected ? peer_sock : -1;
+        pthread_mutex_unlock(&peer_lock);
+
+        for(sent = 0; sock != -1 && sent < packed_message->length; sent += n) {
+            n = send(sock, packed_message->data + sent, packed_message->length - sent, 0);
+            if(n <= 0) {
+                pthread_mutex_lock(&peer_lock);
+                connected = false;
+                pthread_mutex_unlock(&peer_lock);
+                shutdown(sock, SHUT_RDWR);
+                break;
+            }
+        }
+
+        pthread_mutex_unlock(&send_lock);
+        MemPool_free(packed_message->alloc);
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Send a message to the peer directly
+ *
+ * Used by the connection task while establishing the connection, before
+ * frames are queued. Must be called with send_lock held. If the message can
+ * not be sent the connection is shut down, so the connection task's next read
+ * fails.
+ *
+ * \param sock The connection to the peer
+ * \param message The message
+ * \return 0 on success, -1 otherwise
+ */
+static int Hub_Federation_send(int sock, Comm_Message* message) {
+    Comm_PackedMessage* packed_message = Comm_packMessage(message);
+    size_t sent = 0;
+    int n;
+
+    while(sent < packed_message->length) {
+        n = send(sock, packed_message->data + sent, packed_message->length - sent, 0);
+        if(n <= 0) {
+            shutdown(sock, SHUT_RDWR);
+            return -1;
+        }
+        sent += n;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Process a message from the peer
+ *
+ * \param message The message
+ */
+static void Hub_Federation_input(Comm_Message* message) {
+    static char* notify_0 = "NOTIFY";
+    static char* notify_1 = "IN";
+
+    Comm_Message* notification;
+    Hub_Var* var;
+
+    /* <- WATCH <var name> <value>
+       <- NOTIFY IN <notification>
+       <- VAR VALUE <RO|RW> <value> (initial value of a replicated variable)
+       <- COMM KICKING <reason> */
+
+    if(message->count == 3 && strcmp(message->components[0], "WATCH") == 0) {
+        Hub_Var_setValue(message->components[1], atof(message->components[2]));
+    } else if(message->count == 3 && strcmp(message->components[0], "NOTIFY") == 0) {
+        notification = Comm_Message_new(3);
+        notification->components[0] = notify_0;
+        notification->components[1] = notify_1;
+        notification->components[2] = message->components[2];
+        Hub_Net_broadcastNotification(notification);
+        Comm_Message_destroy(notification);
+    } else if(message->count == 4 && strcmp(message->components[0], "VAR") == 0) {
+        var = List_get(replicated, message->request_id - 1);
+        if(var) {
+            Hub_Var_setValue(var->name, atof(message->components[3]));
+        }
+    } else if(message->count == 3 && strcmp(message->components[0], "COMM") == 0 &&
+              strcmp(message->components[1], "KICKING") == 0) {
+        Hub_Logging_log(ERROR, Util_format("Disconnected by peer hub: %s", message->components[2]));
+    }
+}
@@ -10,7 +10,6 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/stat.h>
 
 static void Hub_catchSignal(int sig);
 static int _Hub_close(void);
@@ -23,16 +22,6 @@ static void Hub_usage(char* arg0);
  * \{
  */
 
-/**
- * \brief Cause the hub to exit in the event of an error condition
- *
- * Called to cause the hub to quickly exit in the event of an error
- */
-void Hub_exitError(void) {
-    Hub_Logging_log(INFO, "Terminating hub due to error condition");
-    exit(EXIT_FAILURE);
-}
-
 /**
  * \brief Cause the hub to exit
  *
@@ -43,19 +32,6 @@ void Hub_exit(void) {
     exit(EXIT_SUCCESS);
 }
 
-/**
- * \brief Check of the given file exists
- *
- * Check if the given file exists
- *
- * \param file Path of the file to check
- * \return True of the file exists, false otherwise
- */
-bool Hub_fileExists(const char* file) {
-    struct stat s;
-    return stat(file, &s) != -1;
-}
-
 /**
  * \brief Handles signals
  *
@@ -105,7 +81,12 @@ static void Hub_close(void) {
     pthread_mutex_lock(&hub_close_lock);
     if(!closed) {
         Hub_Logging_log(INFO, "Closing");
+        Hub_Federation_close();
+        Hub_Stats_close();
         Hub_Net_close();
+        Hub_Blob_close();
+        Hub_Capture_close();
+        Hub_Telemetry_close();
         Hub_Var_close();
         Hub_Logging_close();
         Hub_Config_close();
@@ -184,10 +165,18 @@ int main(int argc, char** argv) {
     Hub_Config_init();
     Hub_Var_init();
     Hub_Logging_init();
+    Hub_Clock_init();
+    Hub_Capture_init();
+    Hub_Telemetry_init();
+    Hub_Blob_init();
     Hub_Net_init();
+    Hub_Stats_init();
 
     MemPool_init();
 
+    /* Connects to the peer from its own task, which needs MemPool */
+    Hub_Federation_init();
+
     /* Ensure shutdown during normal exit */
     atexit(Hub_close);
 
@@ -110,6 +110,7 @@ void Hub_Logging_logWithName(char* app_name, short log_level, char* msg) {
     time(&t);
     strftime(time_buffer, TIME_BUFFER_SIZE, "%H:%M:%S", localtime(&t));
 
+    Trace_begin("Hub_Logging_write");
     pthread_mutex_lock(&logging_write_lock);
     if(!initialized || (replicate_stdout && log_file_fd != STDOUT_FILENO)) {
         printf("[%s][%s][%s] %s\n", time_buffer, app_name, Logging_getLevelName(log_level), msg);
@@ -120,6 +121,7 @@ void Hub_Logging_logWithName(char* app_name, short log_level, char* msg) {
         fflush(log_file);
     }
     pthread_mutex_unlock(&logging_write_lock);
+    Trace_end("Hub_Logging_write");
 }
 
 /**
@@ -130,9 +132,25 @@ void Hub_Logging_logWithName(char* app_name, short log_level, char* msg) {
 void Hub_Logging_close(void) {
     if(log_file) {
         fflush(log_file);
-        fclose(log_file);
-        close(log_file_fd);
+
+        /* Closing the stream closes its descriptor, which must not be standard
+           output when the hub is embedded in an application */
+        if(log_file_fd != STDOUT_FILENO) {
+            fclose(log_file);
+        }
+        log_file = NULL;
+        initialized = false;
     }
 }
 
+/**
+ * \brief Cause the hub to exit in the event of an error condition
+ *
+ * Called to cause the hub to quickly exit in the event of an error
+ */
+void Hub_exitError(void) {
+    Hub_Logging_log(INFO, "Terminating hub due to error condition");
+    exit(EXIT_FAILURE);
+}
+
 /** \} */
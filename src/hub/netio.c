@@ -17,17 +17,15 @@
  */
 
 /**
- * \brief Receive a message from the given client
+ * \brief Read a packed message from a socket
  *
- * Receive a message which has arrived from the given client. In the event of
- * an error NULL will be returned and the client state may be changed to DEAD.
+ * Block until a whole message has been read from the socket
  *
- * \param client The client to read the message from
- * \return The unpacked message or NULL if an error occured
+ * \param sock The socket to read from
+ * \return The packed message, or NULL if the connection was lost
  */
-Comm_Message* Hub_Net_receiveMessage(Hub_Client* client) {
+Comm_PackedMessage* Hub_Net_readPackedMessage(int sock) {
     Comm_PackedMessage* packed_message;
-    Comm_Message* message;
     uint16_t total_data_size;
     size_t received;
     int n;
@@ -40,7 +38,7 @@ Comm_Message* Hub_Net_receiveMessage(Hub_Client* client) {
        buffer. Theses bytes give us the overall message length. */
     received = 0;
     while(received < COMM_MESSAGE_PREFIX_LEN) {
-        n = recv(client->sock, packed_message->data + received, COMM_MESSAGE_PREFIX_LEN - received, 0);
+        n = recv(sock, packed_message->data + received, COMM_MESSAGE_PREFIX_LEN - received, 0);
         if(n <= 0) {
             goto receive_error;
         }
@@ -56,7 +54,7 @@ Comm_Message* Hub_Net_receiveMessage(Hub_Client* client) {
 
     received = 0;
     while(received < total_data_size) {
-        n = recv(client->sock,
+        n = recv(sock,
                  packed_message->data + COMM_MESSAGE_PREFIX_LEN + received,
                  total_data_size - received, 0);
         if(n <= 0) {
@@ -65,20 +63,74 @@ Comm_Message* Hub_Net_receiveMessage(Hub_Client* client) {
         received += n;
     }
 
-    /* Unpack message */
-    message = Comm_unpackMessage(packed_message);
-    return message;
+    return packed_message;
 
  receive_error:
-    if(client->state != CLOSED) {
-        Hub_Logging_log(ERROR, "Error receiving data (lost connection to client). Closing connection");
-        Hub_Net_markClientClosed(client);
-    }
     MemPool_free(packed_message->alloc);
-
     return NULL;
 }
 
+/**
+ * \brief Receive a message from the given client
+ *
+ * Receive a message which has arrived from the given client. In the event of
+ * an error NULL will be returned and the client state may be changed to DEAD.
+ *
+ * \param client The client to read the message from
+ * \return The unpacked message or NULL if an error occured
+ */
+Comm_Message* Hub_Net_receiveMessage(Hub_Client* client) {
+    Comm_PackedMessage* packed_message = Hub_Net_readPackedMessage(client->sock);
+
+    if(packed_message == NULL) {
+        if(client->state != CLOSED) {
+            Hub_Logging_log(ERROR, "Error receiving data (lost connection to client). Closing connection");
+            Hub_Net_markClientClosed(client);
+        }
+        return NULL;
+    }
+
+    client->messages_in++;
+    client->bytes_in += packed_message->length;
+    Hub_Capture_recordFrame(client, packed_message);
+
+    /* Unpack message */
+    return Comm_unpackMessage(packed_message);
+}
+
+/**
+ * \brief Process a message from a client in the same process
+ *
+ * The equivalent of Hub_Net_receiveMessage() followed by
+ * Hub_Process_process() for a client connected with Hub_Net_connectInproc().
+ * Runs on the application thread which sent the message.
+ *
+ * \param client The client which sent the message
+ * \param packed_message The message, which belongs to the application and is
+ * copied
+ */
+void Hub_Net_receiveInproc(Hub_Client* client, Comm_PackedMessage* packed_message) {
+    Comm_PackedMessage* copy;
+    Comm_Message* message;
+
+    if(client->state == CLOSED) {
+        return;
+    }
+
+    copy = Comm_PackedMessage_new();
+    copy->length = packed_message->length;
+    copy->data = MemPool_reserve(copy->alloc, copy->length);
+    memcpy(copy->data, packed_message->data, copy->length);
+
+    client->messages_in++;
+    client->bytes_in += copy->length;
+    Hub_Capture_recordFrame(client, copy);
+
+    message = Comm_unpackMessage(copy);
+    Hub_Process_process(client, message);
+    Comm_Message_destroy(message);
+}
+
 /**
  * \brief Send a packed message
  *
@@ -90,21 +142,43 @@ Comm_Message* Hub_Net_receiveMessage(Hub_Client* client) {
  */
 int Hub_Net_sendPackedMessage(Hub_Client* client, Comm_PackedMessage* packed_message) {
     struct pollfd fd = {.fd = client->sock, .events = POLLOUT};
+    int64_t start;
     int n = -1;
 
-    pthread_mutex_lock(&client->lock);
+    Trace_begin("Hub_Net_sendPackedMessage");
+
+    if(pthread_mutex_trylock(&client->lock) != 0) {
+        start = Timer_getTimestamp();
+        pthread_mutex_lock(&client->lock);
+        Hub_Stats_countLockWait(Timer_getTimestamp() - start);
+        Trace_complete("Client lock wait", start);
+    }
+
+    if(client->deliver) {
+        /* Client in the same process, it copies the message */
+        client->deliver(packed_message);
+        n = packed_message->length;
+    } else {
+        /* Check if data can be sent without blocking */
+        poll(&fd, 1, 0);
+        if(fd.revents & POLLOUT) {
+            /* Send data */
+            n = send(client->sock, packed_message->data, packed_message->length, 0);
+        } else {
+            /* Socket not ready to accept data */
+            Hub_Logging_log(ERROR, "Unable to write data to full network socket");
+        }
+    }
 
-    /* Check if data can be sent without blocking */
-    poll(&fd, 1, 0);
-    if(fd.revents & POLLOUT) {
-        /* Send data */
-        n = send(client->sock, packed_message->data, packed_message->length, 0);
+    if(n < 0) {
+        client->drops++;
     } else {
-        /* Socket not ready to accept data */
-        Hub_Logging_log(ERROR, "Unable to write data to full network socket");
+        client->messages_out++;
+        client->bytes_out += n;
     }
 
     pthread_mutex_unlock(&client->lock);
+    Trace_end("Hub_Net_sendPackedMessage");
     return n;
 }
 
@@ -169,6 +243,7 @@ void Hub_Net_broadcastNotification(Comm_Message* message) {
     Comm_PackedMessage* packed_message = Comm_packMessage(message);
     List* clients = Hub_Net_getClients();
     int client_count;
+    int checked = 0;
     List* send_to = List_new();
     Hub_Client* client;
 
@@ -180,6 +255,7 @@ void Hub_Net_broadcastNotification(Comm_Message* message) {
         /* Try to avoid locking an unconnected client */
         if(client->state == CONNECTED) {
             pthread_rwlock_rdlock(&client->in_use);
+            checked++;
 
             if(Hub_Client_checkFilters(client, message)) {
                 List_append(send_to, client);
@@ -191,6 +267,8 @@ void Hub_Net_broadcastNotification(Comm_Message* message) {
     Hub_Net_releaseGlobalClientsLock();
 
     client_count = List_getSize(send_to);
+    Hub_Stats_countNotification(checked, client_count);
+
     for(int i = 0; i < client_count; i++) {
         client = List_get(send_to, i);
         if(Hub_Net_sendPackedMessage(client, packed_message) < 0) {
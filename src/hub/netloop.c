@@ -9,20 +9,27 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
-
-/* If left uncommnented the hub will handle clients with threads. Otherwise
-   clients requests will be processed by a single thread and select will be used
-   to select clients ready for data transfer */
-#define USE_THREADS
+#include <sys/un.h>
+#include <unistd.h>
+
+/* By default the hub will handle clients with threads. If the hub is built with
+   HUB_USE_SELECT defined clients requests will be processed by a single thread
+   and select will be used to select clients ready for data transfer */
+#ifndef HUB_USE_SELECT
+# define USE_THREADS
+#endif
 
 static int Hub_Net_removeMarkedClosedClients(void);
 static void Hub_Net_initServerSocket(void);
+static void Hub_Net_initUnixSocket(const char* path);
 
 /* List of active clients */
 static List* clients = NULL;
@@ -39,6 +46,12 @@ static int svr_sock = -1;
 /** Server socket bind address */
 struct sockaddr_in svr_addr;
 
+/** Unix domain server socket, or -1 if bind_path is not set */
+static int unix_sock = -1;
+
+/** Path the Unix domain server socket is bound to */
+static char* unix_path = NULL;
+
 /** Flag to keep Hub_mainLoop running */
 static bool run_mainloop = true;
 
@@ -83,9 +96,17 @@ static int Hub_Net_removeMarkedClosedClients(void) {
     /* NULL pushed to the queue after all clients have been disconnected
        during shutdown */
     while((client = Queue_pop(closed_clients, blocking_close_clients)) != NULL) {
-        /* Immediately close the socket. The client can not longer generate requests */
-        shutdown(client->sock, SHUT_RDWR);
-        close(client->sock);
+        /* Immediately shut down the socket. The client can not longer generate
+           requests. The descriptor stays open until the client is freed, so it
+           is not reused by a new client while updates may still be sent to
+           this one */
+        if(client->deliver) {
+            /* Returns once any request the client is making has finished */
+            client->deliver(NULL);
+        } else {
+            shutdown(client->sock, SHUT_RDWR);
+        }
+        Hub_Capture_recordClose(client);
         
         /* Remove client from clients list */
         Hub_Net_acquireGlobalClientsLock();
@@ -94,7 +115,9 @@ static int Hub_Net_removeMarkedClosedClients(void) {
 
 #ifdef USE_THREADS
         /* Wait for the client thread to terminate */
-        pthread_join(client->thread, NULL);
+        if(client->deliver == NULL) {
+            pthread_join(client->thread, NULL);
+        }
 #endif
         
         /* With the client thread dead and the client removed from the client
@@ -109,6 +132,9 @@ static int Hub_Net_removeMarkedClosedClients(void) {
         while((subscription = List_get(client->subscribed_vars, 0)) != NULL) {
             Hub_Var_deleteSubscriber(client, subscription->name);
         }
+
+        /* Close channels the client produces and leave those it consumes */
+        Hub_Blob_removeClient(client);
         
         /* Clear client filters */
         Hub_Client_clearFilters(client);
@@ -121,6 +147,9 @@ static int Hub_Net_removeMarkedClosedClients(void) {
 #endif
 
         /* The client is completely removed and unused. Safe to free backing memory */
+        if(client->deliver == NULL) {
+            close(client->sock);
+        }
         free(client);
     }
 
@@ -204,8 +233,83 @@ static void Hub_Net_initServerSocket(void) {
         Hub_Logging_log(CRITICAL, Util_format("Error setting socket to listen: %s", strerror(errno)));
         Hub_exitError();
     }
+
+    if(strlen(Hub_Config_getOption("bind_path")) > 0) {
+        Hub_Net_initUnixSocket(Hub_Config_getOption("bind_path"));
+    }
 }
 
+/**
+ * \brief Initialize the Unix domain server socket
+ *
+ * Listen for clients on the same machine at the given path in addition to the
+ * TCP server socket. Clients connect to it with a comm_server of "unix:"
+ * followed by the path, and are served exactly like TCP clients while avoiding
+ * the overhead of the TCP stack.
+ *
+ * \param path Path to bind the socket to
+ */
+static void Hub_Net_initUnixSocket(const char* path) {
+    struct sockaddr_un addr;
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        Hub_Logging_log(CRITICAL, Util_format("Socket path is too long: %s", path));
+        Hub_exitError();
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    unix_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(unix_sock == -1) {
+        Hub_Logging_log(CRITICAL, Util_format("Error creating Unix domain socket: %s", strerror(errno)));
+        Hub_exitError();
+    }
+
+    /* Remove a socket left behind by a hub which unexpectedly died, the same
+       as SO_REUSEADDR does for the TCP socket */
+    unlink(path);
+
+    if(bind(unix_sock, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+        Hub_Logging_log(CRITICAL, Util_format("Error binding socket to %s: %s", path, strerror(errno)));
+        Hub_exitError();
+    }
+    unix_path = strdup(path);
+
+    /* Any local user can connect over TCP, so allow the same here. Clients
+       still have to authenticate */
+    chmod(path, 0666);
+
+    if(listen(unix_sock, MAX_CLIENTS)) {
+        Hub_Logging_log(CRITICAL, Util_format("Error setting socket to listen: %s", strerror(errno)));
+        Hub_exitError();
+    }
+
+    Hub_Logging_log(INFO, Util_format("Accepting client connections on %s", path));
+}
+
+#ifdef USE_THREADS
+/**
+ * \brief Wait for a connection on either server socket
+ *
+ * \return The accepted socket, or -1 on error or if interrupted
+ */
+static int Hub_Net_acceptConnection(void) {
+    struct pollfd fds[2] = {{.fd = svr_sock, .events = POLLIN}, {.fd = unix_sock, .events = POLLIN}};
+
+    if(unix_sock == -1) {
+        return accept(svr_sock, NULL, 0);
+    }
+
+    if(poll(fds, 2, -1) <= 0) {
+        return -1;
+    }
+
+    return accept((fds[1].revents & POLLIN) ? unix_sock : svr_sock, NULL, 0);
+}
+#endif
+
 /**
  * \brief Perform sychronous pre-shutdown for signal handlers
  *
@@ -261,6 +365,7 @@ void Hub_Net_close(void) {
         /* Free the clients lists */
         List_destroy(clients);
         Queue_destroy(closed_clients);
+        clients = NULL;
     }
 }
 
@@ -283,7 +388,14 @@ List* Hub_Net_getClients(void) {
  * a short amount of time if necessary.
  */
 void Hub_Net_acquireGlobalClientsLock(void) {
-    pthread_mutex_lock(&global_clients_lock);
+    int64_t start;
+
+    if(pthread_mutex_trylock(&global_clients_lock) != 0) {
+        start = Timer_getTimestamp();
+        pthread_mutex_lock(&global_clients_lock);
+        Hub_Stats_countLockWait(Timer_getTimestamp() - start);
+        Trace_complete("Clients lock wait", start);
+    }
 }
 
 /**
@@ -309,6 +421,8 @@ static void* Hub_Net_clientThread(void* _client) {
     Hub_Client* client = (Hub_Client*) _client;
     Comm_Message* client_message;
  
+    Trace_setThreadName(Util_format("Client %d", client->sock));
+
     while(client->state != CLOSED) {
         /* Read message from the client  */
         client_message = Hub_Net_receiveMessage(client);
@@ -342,6 +456,7 @@ static void Hub_Net_acceptClient(int client_new) {
        sockets. 250 milliseconds */
     const struct timeval client_timeout = {.tv_sec = 0, .tv_usec = 250 * 1000};
 #endif
+    const int nodelay = 1;
 
     Hub_Client* client;
 
@@ -354,6 +469,10 @@ static void Hub_Net_acceptClient(int client_new) {
 
     Hub_Logging_log(DEBUG, "Accepted new client connection");
 
+    /* Send responses and updates as soon as they are written. This fails
+       harmlessly on Unix domain sockets */
+    setsockopt(client_new, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
     /* Set a timeout on receive operations to keep broken client
        connections from deadlocking the hub */
 #ifndef USE_THREADS
@@ -402,6 +521,7 @@ void Hub_Net_mainLoop(void) {
 
     /* Main loop is now running */
     mainloop_running = true;
+    Trace_setThreadName("Hub main loop");
 
 #ifdef USE_THREADS
     /* Spawn thread to remove clients after they are marked closed */
@@ -411,7 +531,7 @@ void Hub_Net_mainLoop(void) {
     /* Start sending/recieving messages */
     while(run_mainloop) {
 #ifdef USE_THREADS
-        client_new = accept(svr_sock, NULL, 0);
+        client_new = Hub_Net_acceptConnection();
 
         if(run_mainloop == false ) {
             break;
@@ -432,8 +552,11 @@ void Hub_Net_mainLoop(void) {
         /* Zero of the file descriptor set */
         FD_ZERO(&fdset_mask_r);
 
-        /* Add the server socket to the set */
+        /* Add the server sockets to the set */
         FD_SET(svr_sock, &fdset_mask_r);
+        if(unix_sock != -1) {
+            FD_SET(unix_sock, &fdset_mask_r);
+        }
 
         /* Add each client to the set */
         for(i = 0; i < client_count; i++) {
@@ -471,6 +594,12 @@ void Hub_Net_mainLoop(void) {
             client_new = 0;
         }
 
+        if(unix_sock != -1 && FD_ISSET(unix_sock, &fdset_mask_r)) {
+            client_new = accept(unix_sock, NULL, 0);
+            Hub_Net_acceptClient(client_new);
+            client_new = 0;
+        }
+
         /* Check for incoming data */
         for(i = 0; i < client_count; i++) {
             client = List_get(clients, i);
@@ -517,8 +646,76 @@ void Hub_Net_mainLoop(void) {
     mainloop_running = false;
     shutdown(svr_sock, SHUT_RDWR);
     close(svr_sock);
+    if(unix_sock != -1) {
+        close(unix_sock);
+        unlink(unix_path);
+        free(unix_path);
+    }
 
     pthread_cond_broadcast(&mainloop_done);
     pthread_mutex_unlock(&mainloop_done_lock);
 }
+
+/**
+ * \brief Start serving clients in the same process
+ *
+ * Used in place of Hub_Net_mainLoop() by a hub embedded in an application. The
+ * embedded hub opens no server sockets, its clients connect with
+ * Hub_Net_connectInproc() instead.
+ */
+void Hub_Net_startEmbedded(void) {
+#ifdef USE_THREADS
+    /* Spawn thread to remove clients after they are marked closed */
+    close_clients_thread = Task_background(Hub_Net_removeMarkedClosedClients);
+#endif
+}
+
+/**
+ * \brief Connect a client in the same process
+ *
+ * The client's requests are passed to Hub_Net_receiveInproc() by direct calls
+ * and messages sent to it are passed to deliver, so no socket or client thread
+ * is involved.
+ *
+ * \param deliver Called with each message sent to the client, and with NULL
+ * once the client has been closed
+ * \return The new client
+ */
+Hub_Client* Hub_Net_connectInproc(void (*deliver)(Comm_PackedMessage* packed_message)) {
+    Hub_Client* client = Hub_Client_new(-1);
+
+    client->deliver = deliver;
+    Hub_Logging_log(DEBUG, "Accepted new in process client");
+
+    Hub_Net_acquireGlobalClientsLock();
+    List_append(clients, client);
+    Hub_Net_releaseGlobalClientsLock();
+
+    return client;
+}
+
+/**
+ * \brief Stop serving clients in the same process
+ *
+ * Kick any clients still connected and wait for every client to be removed
+ */
+void Hub_Net_stopEmbedded(void) {
+    Hub_Client* client;
+
+    Hub_Net_acquireGlobalClientsLock();
+    for(int i = 0; (client = List_get(clients, i)) != NULL; i++) {
+        Hub_Client_kick(client, "Hub closing");
+    }
+    Hub_Net_releaseGlobalClientsLock();
+
+    /* Ensure removeMarkedClosedClients stops blocking to exit */
+    Queue_append(closed_clients, NULL);
+
+#ifdef USE_THREADS
+    Hub_Net_joinClientThreads();
+#else
+    Hub_Net_removeMarkedClosedClients();
+#endif
+}
+
 /** \} */
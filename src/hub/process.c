@@ -10,6 +10,13 @@ static int Hub_Process_comm(Hub_Client* client, Comm_Message* message);
 static int Hub_Process_notify(Hub_Client* client, Comm_Message* message);
 static int Hub_Process_log(Comm_Message* message);
 static int Hub_Process_var(Hub_Client* client, Comm_Message* message);
+static int Hub_Process_stats(Hub_Client* client, Comm_Message* message);
+static int Hub_Process_blob(Hub_Client* client, Comm_Message* message);
+
+/** Trace span names for requests in each namespace */
+static const char* trace_names[HUB_STATS_NAMESPACES] = {"Process COMM", "Process NOTIFY", "Process VAR",
+                                                        "Process WATCH", "Process LOG", "Process STATS",
+                                                        "Process BLOB"};
 
 /**
  * \defgroup Process Process
@@ -21,7 +28,7 @@ static int Hub_Process_var(Hub_Client* client, Comm_Message* message);
  * \brief Process a message with the COMM prefix
  *
  * Process a message related to core Comm functions. Connection establishment,
- * shutdown, authentication, etc.
+ * shutdown, authentication, the shared clock, etc.
  *
  * \param client The client which sent the receive message
  * \param message The received message
@@ -31,6 +38,7 @@ static int Hub_Process_comm(Hub_Client* client, Comm_Message* message) {
     Comm_Message* response = NULL;
     const char* actual_password;
     char* supplied_password = NULL;
+    int rc;
 
     if(message->count == 3 && strcmp(message->components[1], "AUTH") == 0) {
         actual_password = Hub_Config_getOption("password");
@@ -58,6 +66,42 @@ static int Hub_Process_comm(Hub_Client* client, Comm_Message* message) {
         Comm_Message_destroy(response);
     } else if(message->count == 2 && strcmp(message->components[1], "SHUTDOWN") == 0) {
         Hub_Client_close(client);
+    } else if(client->state != CONNECTED) {
+        return -1;
+    } else if(message->count == 2 && strcmp(message->components[1], "CLOCK_SYNC") == 0) {
+        /* Send the client the clock now and whenever it changes */
+        client->clock_sync = true;
+        response = Hub_Clock_getMessage(message->request_id);
+        Hub_Net_sendMessage(client, response);
+        Comm_Message_destroy(response);
+    } else if(message->count == 2 && strcmp(message->components[1], "TIME") == 0) {
+        /* Monotonic time for clients estimating their offset from the hub */
+        response = Comm_Message_new(3);
+        response->request_id = message->request_id;
+        response->components[0] = MemPool_strdup(response->alloc, "COMM");
+        response->components[1] = MemPool_strdup(response->alloc, "TIME");
+        response->components[2] = MemPool_strdup(response->alloc, Util_format("%lld", (long long) Timer_getTimestamp()));
+        Hub_Net_sendMessage(client, response);
+        Comm_Message_destroy(response);
+    } else if(message->count == 3 && (strcmp(message->components[1], "CLOCK_STEP") == 0 ||
+                                      strcmp(message->components[1], "CLOCK_RATE") == 0)) {
+        if(strcmp(message->components[1], "CLOCK_STEP") == 0) {
+            rc = Clock_step(atoll(message->components[2]));
+        } else {
+            rc = Clock_setRate(atof(message->components[2]));
+        }
+
+        if(rc == 0) {
+            /* Synchronized clients have been sent the change by Hub_Clock_broadcast */
+            response = Hub_Clock_getMessage(message->request_id);
+        } else {
+            response = Comm_Message_new(2);
+            response->request_id = message->request_id;
+            response->components[0] = MemPool_strdup(response->alloc, "COMM");
+            response->components[1] = MemPool_strdup(response->alloc, "CLOCK_REFUSED");
+        }
+        Hub_Net_sendMessage(client, response);
+        Comm_Message_destroy(response);
     } else {
         return -1;
     }
@@ -82,6 +126,12 @@ static int Hub_Process_notify(Hub_Client* client, Comm_Message* message) {
     Comm_Message* notification;
 
     if(message->count == 3 && strcmp(message->components[1], "OUT") == 0) {
+        /* With a peer hub the notification is broadcast once the peer sends
+           it back */
+        if(Hub_Federation_forwardNotification(message->components[2]) == 0) {
+            return 0;
+        }
+
         notification = Comm_Message_new(3);
         notification->components[0] = notify_0;
         notification->components[1] = notify_1;
@@ -94,6 +144,7 @@ static int Hub_Process_notify(Hub_Client* client, Comm_Message* message) {
         Notify_FilterType type = (Notify_FilterType) atoi(message->components[2]);
         const char* filter_body = message->components[3];
         Hub_Client_addFilter(client, type, filter_body);
+        Hub_Federation_addFilter(type, filter_body);
 
     } else if(message->count == 2 && strcmp(message->components[1], "CLEAR_FILTERS") == 0) {
         Hub_Client_clearFilters(client);
@@ -111,6 +162,8 @@ static int Hub_Process_notify(Hub_Client* client, Comm_Message* message) {
  * Process a WATCH mesage. WATCH messages are sent regarding variable
  * subscriptions. Client can request subscriptions be added or removed. The hub
  * will then send WATCH messages to clients to inform them of variable updates.
+ * Clients may also ask for updates to carry the hub's monotonic time at which
+ * the variable was set.
  *
  * \param client Client that sent the message
  * \param message WATCH message to process
@@ -121,9 +174,14 @@ static int Hub_Process_watch(Hub_Client* client, Comm_Message* message) {
     
     /* -> WATCH ADD <var name>
        -> WATCH DEL <var name>
-       <- WATCH <var name> <value> */
-
-    if(message->count == 3) {
+       -> WATCH TIMESTAMPS
+       <- WATCH <var name> <value>
+       <- WATCH <var name> <value> <hub time> (after WATCH TIMESTAMPS) */
+
+    if(message->count == 2 && strcmp(message->components[1], "TIMESTAMPS") == 0) {
+        client->watch_timestamps = true;
+        n = 0;
+    } else if(message->count == 3) {
         if(strcmp(message->components[1], "ADD") == 0) {
             n = Hub_Var_addSubscriber(client, message->components[2]);
             if(n == -1) {
@@ -197,12 +255,19 @@ static int Hub_Process_var(Hub_Client* client, Comm_Message* message) {
 
             pthread_rwlock_unlock(&var->lock);
 
+            Hub_Stats_countVarGet(var);
             Hub_Net_sendMessage(client, response);
             Comm_Message_destroy(response);
 
             return 0;
         }
     } else if(message->count == 4 && strcmp(message->components[1], "SET") == 0) {
+        /* Replicated variables are set by the peer hub, which sends the new
+           value back */
+        if(Hub_Federation_forwardSet(message->components[2], message->components[3]) == 0) {
+            return 0;
+        }
+
         n = Hub_Var_setValue(message->components[2], atof(message->components[3]));
         if(n == -1) {
             Hub_Logging_log(ERROR, Util_format("Set attempted on not-existent variable '%s'", message->components[2]));
@@ -217,11 +282,117 @@ static int Hub_Process_var(Hub_Client* client, Comm_Message* message) {
         Hub_Client_kick(client, Util_format("Invalid variable access (%s)", message->components[2]));
 
         return -1;
+    } else if(message->count == 2 && strcmp(message->components[1], "SHM") == 0) {
+        /* Where a client on this host can read variables directly */
+        response = Hub_Var_getShmMessage(message->request_id);
+        Hub_Net_sendMessage(client, response);
+        Comm_Message_destroy(response);
+
+        return 0;
     }
 
     return -1;
 }
 
+/**
+ * \brief Process a statistics request
+ *
+ * Respond to a STATS message with the requested section of the hub statistics
+ *
+ * \param client The client requesting statistics
+ * \param message The received message
+ * \return 0 on success, -1 otherwise
+ */
+static int Hub_Process_stats(Hub_Client* client, Comm_Message* message) {
+    Comm_Message* response;
+
+    /* -> STATS <section>
+       <- STATS <section> <line> ...
+       <- STATS INVALID */
+
+    if(message->count != 2) {
+        return -1;
+    }
+
+    response = Hub_Stats_getMessage(message->components[1], message->request_id);
+    if(response == NULL) {
+        response = Comm_Message_new(2);
+        response->request_id = message->request_id;
+        response->components[0] = MemPool_strdup(response->alloc, "STATS");
+        response->components[1] = MemPool_strdup(response->alloc, "INVALID");
+    }
+
+    Hub_Net_sendMessage(client, response);
+    Comm_Message_destroy(response);
+
+    return 0;
+}
+
+/**
+ * \brief Process a blob channel message
+ *
+ * Process a message creating, opening, publishing to or closing a blob
+ * channel. Only the descriptor of each frame passes through the hub, the frame
+ * itself stays in the producer's shared memory segment.
+ *
+ * \param client The client which sent the message
+ * \param message The received message
+ * \return 0 on success, -1 otherwise
+ */
+static int Hub_Process_blob(Hub_Client* client, Comm_Message* message) {
+    Comm_Message* response = NULL;
+    char* segment;
+
+    /* -> BLOB CREATE <name> <segment>
+       <- BLOB CREATED
+       <- BLOB EXISTS
+       -> BLOB OPEN <name>
+       <- BLOB CHANNEL <name> <segment>
+       <- BLOB UNKNOWN
+       -> BLOB PUBLISH <name> <slot> <sequence> <length>
+       <- BLOB FRAME <name> <slot> <sequence> <length> (to each consumer)
+       -> BLOB CLOSE <name>
+       <- BLOB CLOSED <name> (to each consumer, if sent by the producer) */
+
+    if(message->count == 6 && strcmp(message->components[1], "PUBLISH") == 0) {
+        return Hub_Blob_publish(client, message->components[2], message->components[3],
+                                message->components[4], message->components[5]);
+    } else if(message->count == 3 && strcmp(message->components[1], "CLOSE") == 0) {
+        Hub_Blob_closeChannel(client, message->components[2]);
+        return 0;
+    } else if(message->count == 4 && strcmp(message->components[1], "CREATE") == 0) {
+        response = Comm_Message_new(2);
+        response->request_id = message->request_id;
+        response->components[0] = MemPool_strdup(response->alloc, "BLOB");
+        if(Hub_Blob_create(client, message->components[2], message->components[3]) == 0) {
+            response->components[1] = MemPool_strdup(response->alloc, "CREATED");
+        } else {
+            response->components[1] = MemPool_strdup(response->alloc, "EXISTS");
+        }
+    } else if(message->count == 3 && strcmp(message->components[1], "OPEN") == 0) {
+        segment = Hub_Blob_open(client, message->components[2]);
+        if(segment) {
+            response = Comm_Message_new(4);
+            response->components[1] = MemPool_strdup(response->alloc, "CHANNEL");
+            response->components[2] = MemPool_strdup(response->alloc, message->components[2]);
+            response->components[3] = MemPool_strdup(response->alloc, segment);
+            free(segment);
+        } else {
+            response = Comm_Message_new(2);
+            response->components[1] = MemPool_strdup(response->alloc, "UNKNOWN");
+        }
+        response->request_id = message->request_id;
+        response->components[0] = MemPool_strdup(response->alloc, "BLOB");
+    } else {
+        return -1;
+    }
+
+    Hub_Net_sendMessage(client, response);
+    Comm_Message_destroy(response);
+
+    return 0;
+}
+
 /**
  * \brief Process a request
  *
@@ -232,26 +403,45 @@ static int Hub_Process_var(Hub_Client* client, Comm_Message* message) {
  * \return 0 on success, -1 otherwise
  */
 int Hub_Process_process(Hub_Client* client, Comm_Message* message) {
+    int64_t start = Timer_getTimestamp();
+    Hub_Stats_Namespace namespace;
+    int rc;
+
     if(message->count == 0) {
         Hub_Client_kick(client, "Illegal message");
         return -1;
     }
 
     if(strcmp(message->components[0], "COMM") == 0) {
-        return Hub_Process_comm(client, message);
-    } else if(client->state == CONNECTED) {
-        if(strcmp(message->components[0], "NOTIFY") == 0) {
-            return Hub_Process_notify(client, message);
-        } else if(strcmp(message->components[0], "VAR") == 0) {
-            return Hub_Process_var(client, message);
-        } else if(strcmp(message->components[0], "WATCH") == 0) {
-            return Hub_Process_watch(client, message);
-        } else if(strcmp(message->components[0], "LOG") == 0) {
-            return Hub_Process_log(message);
-        }
+        namespace = HUB_STATS_COMM;
+        rc = Hub_Process_comm(client, message);
+    } else if(client->state != CONNECTED) {
+        return -1;
+    } else if(strcmp(message->components[0], "NOTIFY") == 0) {
+        namespace = HUB_STATS_NOTIFY;
+        rc = Hub_Process_notify(client, message);
+    } else if(strcmp(message->components[0], "VAR") == 0) {
+        namespace = HUB_STATS_VAR;
+        rc = Hub_Process_var(client, message);
+    } else if(strcmp(message->components[0], "WATCH") == 0) {
+        namespace = HUB_STATS_WATCH;
+        rc = Hub_Process_watch(client, message);
+    } else if(strcmp(message->components[0], "LOG") == 0) {
+        namespace = HUB_STATS_LOG;
+        rc = Hub_Process_log(message);
+    } else if(strcmp(message->components[0], "STATS") == 0) {
+        namespace = HUB_STATS_STATS;
+        rc = Hub_Process_stats(client, message);
+    } else if(strcmp(message->components[0], "BLOB") == 0) {
+        namespace = HUB_STATS_BLOB;
+        rc = Hub_Process_blob(client, message);
+    } else {
+        return -1;
     }
 
-    return -1;
+    Trace_complete(trace_names[namespace], start);
+    Hub_Stats_recordRequest(namespace, Timer_getTimestamp() - start);
+    return rc;
 }
 
 /** \} */
@@ -0,0 +1,1051 @@
+/**
+ * \file
+ * \brief Per-host multiplexing proxy
+ *
+ * seawolf-proxy accepts connections from the applications on one host and
+ * serves them over a single connection to the hub, so the hub's per-client
+ * threads, sockets and WATCH fan out scale with the number of hosts rather
+ * than the number of processes. Applications connect to the proxy exactly as
+ * they would to the hub.
+ *
+ * Request IDs chosen by each application are replaced with IDs unique on the
+ * hub connection and restored on the responses. Subscriptions are shared, the
+ * hub is subscribed to each variable once and the proxy fans every update out
+ * to its local subscribers. Notification filters of every application are
+ * added to the hub connection, and each notification the hub sends is passed
+ * to the applications whose own filters match it. Sets, notifications, log
+ * messages and requests are forwarded unchanged.
+ *
+ * The hub kicks a client which accesses an undefined variable, which would
+ * disconnect every application behind the proxy. Given the hub's variable
+ * definitions with -d, the proxy checks accesses itself and only kicks the
+ * offending application. Blob channels are tied to the connection which
+ * created them and are not available through the proxy.
+ *
+ * If the connection to the hub is lost every application is disconnected, as
+ * it would be by the hub, and the proxy reconnects once a second.
+ */
+
+#include "seawolf.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** Size of each connection's receive buffer, enough for any frame */
+#define RECEIVE_BUFFER (COMM_MESSAGE_PREFIX_LEN + 0xffff)
+
+/** Most components of a frame the proxy inspects */
+#define MAX_COMPONENTS 8
+
+/** Number of request IDs, 0 marks a message which is not a request */
+#define REQUEST_IDS 0x10000
+
+/**
+ * Proxy options
+ */
+typedef struct {
+    /** Address of the hub */
+    char* address;
+
+    /** Port of the hub */
+    uint16_t port;
+
+    /** Hub password, which applications must also authenticate with */
+    char* password;
+
+    /** Address to accept applications on */
+    char* bind_address;
+
+    /** Port to accept applications on */
+    uint16_t bind_port;
+
+    /** Unix domain socket to also accept applications on, or NULL */
+    char* bind_path;
+
+    /** Hub variable definitions file, or NULL */
+    char* var_defs;
+} ProxyOptions;
+
+/**
+ * A connected application
+ */
+typedef struct {
+    /** Socket */
+    int sock;
+
+    /** Received data not yet parsed */
+    char* buffer;
+
+    /** Bytes in buffer */
+    size_t buffered;
+
+    /** True once the application has authenticated */
+    bool authenticated;
+
+    /** True once the connection should be closed */
+    bool closed;
+
+    /** Application is sent every change to the hub clock */
+    bool clock_sync;
+
+    /** Application is sent the hub time with each variable update */
+    bool timestamps;
+
+    /** Notification filters, each the filter type followed by the filter */
+    char** filters;
+
+    /** Number of filters */
+    int filters_n;
+} ProxyClient;
+
+/**
+ * A request forwarded to the hub
+ */
+typedef struct {
+    /** Application which sent the request, or NULL if the slot is free */
+    ProxyClient* client;
+
+    /** Request ID chosen by the application */
+    uint16_t request_id;
+} PendingRequest;
+
+static Dictionary* load_var_defs(const char* file);
+static int listen_tcp(const char* address, uint16_t port);
+static int listen_unix(const char* path);
+static int parse_frame(char* frame, size_t length, char** components);
+static int build_frame(char* frame, uint16_t request_id, int count, char** components);
+static int send_all(int sock, const char* data, size_t length);
+static void send_client(ProxyClient* client, const char* frame, size_t length);
+static void send_client_message(ProxyClient* client, uint16_t request_id, int count, char** components);
+static void send_upstream(const char* frame, size_t length);
+static void send_upstream_message(uint16_t request_id, int count, char** components);
+static void kick(ProxyClient* client, const char* reason);
+static bool check_var(ProxyClient* client, const char* name, bool set);
+static void forward_request(ProxyClient* client, char* frame, size_t length);
+static void subscribe(ProxyClient* client, const char* name);
+static void unsubscribe(ProxyClient* client, const char* name);
+static void add_filter(ProxyClient* client, const char* type, const char* filter);
+static bool check_filters(ProxyClient* client, const char* notification);
+static void process_client_frame(ProxyClient* client, char* frame, size_t length);
+static void process_upstream_frame(char* frame, size_t length);
+static void receive_client(ProxyClient* client);
+static void receive_upstream(void);
+static void accept_client(int listen_sock);
+static void remove_client(ProxyClient* client);
+static int connect_upstream(void);
+static void serve(int tcp_sock, int unix_sock);
+static void catch_signal(int sig);
+static void usage(char* arg0);
+
+/** Proxy options */
+static ProxyOptions options = {.address = "127.0.0.1", .port = 31427, .password = NULL,
+                               .bind_address = "127.0.0.1", .bind_port = 31428, .bind_path = NULL,
+                               .var_defs = NULL};
+
+/** Connection to the hub, or -1 */
+static int upstream = -1;
+
+/** Data received from the hub not yet parsed */
+static char* upstream_buffer = NULL;
+
+/** Bytes in upstream_buffer */
+static size_t upstream_buffered = 0;
+
+/** Connected applications */
+static ProxyClient** clients = NULL;
+
+/** Number of connected applications */
+static int client_count = 0;
+
+/** Applications subscribed to each variable the hub is subscribed to */
+static Dictionary* subscriptions = NULL;
+
+/** Filters added to the hub connection, keyed like ProxyClient filters */
+static Dictionary* upstream_filters = NULL;
+
+/** The hub connection asks for the hub time with each update */
+static bool upstream_timestamps = false;
+
+/** Requests forwarded to the hub, by the ID they were forwarded with */
+static PendingRequest pending[REQUEST_IDS];
+
+/** Next request ID to try */
+static uint16_t next_request_id = 1;
+
+/** Variable definitions, read-only variables mapping to the dictionary
+    itself, or NULL if accesses are not checked */
+static Dictionary* var_defs = NULL;
+
+/** Cleared by a signal to stop the proxy */
+static volatile bool running = true;
+
+/**
+ * \brief Read the hub's variable definitions
+ *
+ * \return The definitions, or NULL if the file could not be read
+ */
+static Dictionary* load_var_defs(const char* file) {
+    Dictionary* defs = Config_readFile(file);
+    Dictionary* vars;
+    List* names;
+    char* name;
+    char* def;
+    float default_value;
+    int persistent, readonly;
+
+    if(defs == NULL) {
+        fprintf(stderr, "Unable to read variable definitions from %s\n", file);
+        return NULL;
+    }
+
+    vars = Dictionary_new();
+    names = Dictionary_getKeys(defs);
+    while((name = List_remove(names, 0)) != NULL) {
+        def = Dictionary_get(defs, name);
+        if(sscanf(def, "%f , %d , %d", &default_value, &persistent, &readonly) != 3) {
+            fprintf(stderr, "Format error in variable definition for variable '%s'\n", name);
+            readonly = 0;
+        }
+        Dictionary_set(vars, name, readonly ? (void*) vars : (void*) defs);
+        free(def);
+    }
+    List_destroy(names);
+
+    /* Only the address of defs is kept, as the value of read-write variables */
+    Dictionary_destroy(defs);
+
+    return vars;
+}
+
+/**
+ * \brief Open a TCP socket accepting applications
+ *
+ * \return The socket, or -1 on failure
+ */
+static int listen_tcp(const char* address, uint16_t port) {
+    const int reuse = 1;
+    struct sockaddr_in addr;
+    int sock;
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(address);
+    addr.sin_port = htons(port);
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(sock == -1 || bind(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(sock, SOMAXCONN) != 0) {
+        fprintf(stderr, "Unable to listen on %s:%u: %s\n", address, port, strerror(errno));
+        return -1;
+    }
+
+    return sock;
+}
+
+/**
+ * \brief Open a Unix domain socket accepting applications
+ *
+ * \return The socket, or -1 on failure
+ */
+static int listen_unix(const char* path) {
+    struct sockaddr_un addr;
+    int sock;
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", path);
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sock == -1 || bind(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(sock, SOMAXCONN) != 0) {
+        fprintf(stderr, "Unable to listen on %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return sock;
+}
+
+/**
+ * \brief Find the components of a frame in place
+ *
+ * \param frame A complete frame
+ * \param length Length of the frame
+ * \param components Filled in with up to MAX_COMPONENTS components
+ * \return The number of components in the frame, or -1 if it is malformed
+ */
+static int parse_frame(char* frame, size_t length, char** components) {
+    int count = ntohs(((uint16_t*) frame)[2]);
+    char* data = frame + COMM_MESSAGE_PREFIX_LEN;
+    char* end = frame + length;
+
+    if(count == 0 || length == COMM_MESSAGE_PREFIX_LEN || end[-1] != '\0') {
+        return -1;
+    }
+
+    for(int i = 0; i < count && i < MAX_COMPONENTS; i++) {
+        if(data >= end) {
+            return -1;
+        }
+        components[i] = data;
+        data += strlen(data) + 1;
+    }
+
+    return count;
+}
+
+/**
+ * \brief Pack a message into a frame
+ *
+ * \param frame Space for the frame, at least RECEIVE_BUFFER bytes
+ * \return The length of the frame
+ */
+static int build_frame(char* frame, uint16_t request_id, int count, char** components) {
+    size_t length = COMM_MESSAGE_PREFIX_LEN;
+    size_t component_length;
+
+    for(int i = 0; i < count; i++) {
+        component_length = strlen(components[i]) + 1;
+        if(length + component_length > RECEIVE_BUFFER) {
+            break;
+        }
+        memcpy(frame + length, components[i], component_length);
+        length += component_length;
+    }
+
+    ((uint16_t*) frame)[0] = htons(length - COMM_MESSAGE_PREFIX_LEN);
+    ((uint16_t*) frame)[1] = htons(request_id);
+    ((uint16_t*) frame)[2] = htons(count);
+
+    return length;
+}
+
+/**
+ * \brief Send data on a blocking socket
+ *
+ * \return 0 on success, -1 if the connection failed
+ */
+static int send_all(int sock, const char* data, size_t length) {
+    size_t sent = 0;
+    int n;
+
+    while(sent < length) {
+        n = send(sock, data + sent, length - sent, 0);
+        if(n <= 0) {
+            return -1;
+        }
+        sent += n;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Send a frame to an application
+ *
+ * An application whose socket is full is disconnected rather than holding up
+ * every other application, since one which silently missed a response would
+ * wait for it forever
+ */
+static void send_client(ProxyClient* client, const char* frame, size_t length) {
+    struct pollfd fd = {.fd = client->sock, .events = POLLOUT};
+
+    if(client->closed) {
+        return;
+    }
+
+    poll(&fd, 1, 0);
+    if(!(fd.revents & POLLOUT)) {
+        client->closed = true;
+        return;
+    }
+
+    if(send_all(client->sock, frame, length) != 0) {
+        client->closed = true;
+    }
+}
+
+/**
+ * \brief Send a message to an application
+ */
+static void send_client_message(ProxyClient* client, uint16_t request_id, int count, char** components) {
+    static char* frame = NULL;
+
+    if(frame == NULL) {
+        frame = malloc(RECEIVE_BUFFER);
+    }
+
+    send_client(client, frame, build_frame(frame, request_id, count, components));
+}
+
+/**
+ * \brief Send a frame to the hub
+ *
+ * If the send fails the connection is shut down, which the main loop notices
+ * the next time it reads from the hub
+ */
+static void send_upstream(const char* frame, size_t length) {
+    if(send_all(upstream, frame, length) != 0) {
+        shutdown(upstream, SHUT_RDWR);
+    }
+}
+
+/**
+ * \brief Send a message to the hub
+ */
+static void send_upstream_message(uint16_t request_id, int count, char** components) {
+    static char* frame = NULL;
+
+    if(frame == NULL) {
+        frame = malloc(RECEIVE_BUFFER);
+    }
+
+    send_upstream(frame, build_frame(frame, request_id, count, components));
+}
+
+/**
+ * \brief Disconnect an application as the hub would
+ */
+static void kick(ProxyClient* client, const char* reason) {
+    char* message[] = {"COMM", "KICKING", (char*) reason};
+
+    send_client_message(client, 0, 3, message);
+    client->closed = true;
+}
+
+/**
+ * \brief Check an application's access to a variable before forwarding it
+ *
+ * \param set True if the variable is being set
+ * \return True if the access may be forwarded, otherwise the application has
+ * been kicked
+ */
+static bool check_var(ProxyClient* client, const char* name, bool set) {
+    void* def;
+    char reason[128];
+
+    if(var_defs == NULL) {
+        return true;
+    }
+
+    def = Dictionary_get(var_defs, name);
+    if(def == NULL || (set && def == var_defs)) {
+        snprintf(reason, sizeof(reason), "Invalid variable access (%s)", name);
+        kick(client, reason);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * \brief Forward a request, replacing its request ID with one unique on the hub
+ * connection
+ */
+static void forward_request(ProxyClient* client, char* frame, size_t length) {
+    uint16_t request_id = ntohs(((uint16_t*) frame)[1]);
+    uint16_t upstream_id;
+
+    if(request_id != 0) {
+        for(upstream_id = next_request_id; pending[upstream_id].client != NULL || upstream_id == 0; upstream_id++) {
+            if(upstream_id == (uint16_t) (next_request_id - 1)) {
+                fprintf(stderr, "Every request ID is in use, dropping request\n");
+                return;
+            }
+        }
+        next_request_id = upstream_id + 1;
+
+        pending[upstream_id].client = client;
+        pending[upstream_id].request_id = request_id;
+        ((uint16_t*) frame)[1] = htons(upstream_id);
+    }
+
+    send_upstream(frame, length);
+}
+
+/**
+ * \brief Subscribe an application to a variable
+ *
+ * Only the first subscriber subscribes the hub connection
+ */
+static void subscribe(ProxyClient* client, const char* name) {
+    char* message[] = {"WATCH", "ADD", (char*) name};
+    List* subscribers = Dictionary_get(subscriptions, name);
+
+    if(subscribers == NULL) {
+        subscribers = List_new();
+        Dictionary_set(subscriptions, name, subscribers);
+        send_upstream_message(0, 3, message);
+    }
+
+    if(List_indexOf(subscribers, client) == -1) {
+        List_append(subscribers, client);
+    }
+}
+
+/**
+ * \brief Unsubscribe an application from a variable
+ *
+ * The last subscriber unsubscribes the hub connection
+ */
+static void unsubscribe(ProxyClient* client, const char* name) {
+    char* message[] = {"WATCH", "DEL", (char*) name};
+    List* subscribers = Dictionary_get(subscriptions, name);
+    int i;
+
+    if(subscribers == NULL || (i = List_indexOf(subscribers, client)) == -1) {
+        return;
+    }
+
+    List_remove(subscribers, i);
+    if(List_getSize(subscribers) == 0) {
+        send_upstream_message(0, 3, message);
+        Dictionary_remove(subscriptions, name);
+        List_destroy(subscribers);
+    }
+}
+
+/**
+ * \brief Add a notification filter to an application
+ *
+ * Filters are also added to the hub connection the first time any application
+ * uses them. They stay on the hub connection until it is next established.
+ */
+static void add_filter(ProxyClient* client, const char* type, const char* filter) {
+    char* message[] = {"NOTIFY", "ADD_FILTER", (char*) type, (char*) filter};
+    char* entry = malloc(strlen(filter) + 2);
+
+    entry[0] = (char) atoi(type);
+    strcpy(entry + 1, filter);
+
+    client->filters = realloc(client->filters, sizeof(char*) * (client->filters_n + 1));
+    client->filters[client->filters_n++] = entry;
+
+    if(Dictionary_get(upstream_filters, entry) == NULL) {
+        Dictionary_set(upstream_filters, entry, upstream_filters);
+        send_upstream_message(0, 4, message);
+    }
+}
+
+/**
+ * \brief Check whether a notification passes an application's filters
+ */
+static bool check_filters(ProxyClient* client, const char* notification) {
+    for(int i = 0; i < client->filters_n; i++) {
+        if(Notify_matchFilter((Notify_FilterType) client->filters[i][0], client->filters[i] + 1, notification)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * \brief Process a frame from an application
+ */
+static void process_client_frame(ProxyClient* client, char* frame, size_t length) {
+    char* components[MAX_COMPONENTS];
+    char* response[2];
+    int count = parse_frame(frame, length, components);
+    uint16_t request_id = ntohs(((uint16_t*) frame)[1]);
+
+    if(count <= 0) {
+        return;
+    }
+
+    if(strcmp(components[0], "COMM") == 0 && count == 3 && strcmp(components[1], "AUTH") == 0) {
+        response[0] = "COMM";
+        if(strcmp(components[2], options.password) == 0) {
+            response[1] = "SUCCESS";
+            send_client_message(client, request_id, 2, response);
+            client->authenticated = true;
+        } else {
+            response[1] = "FAILURE";
+            send_client_message(client, request_id, 2, response);
+            kick(client, "Authentication failure");
+        }
+    } else if(strcmp(components[0], "COMM") == 0 && count == 2 && strcmp(components[1], "SHUTDOWN") == 0) {
+        response[0] = "COMM";
+        response[1] = "CLOSING";
+        send_client_message(client, 0, 2, response);
+        client->closed = true;
+    } else if(!client->authenticated) {
+        return;
+    } else if(strcmp(components[0], "COMM") == 0) {
+        if(count == 2 && strcmp(components[1], "CLOCK_SYNC") == 0) {
+            client->clock_sync = true;
+        }
+        forward_request(client, frame, length);
+    } else if(strcmp(components[0], "VAR") == 0) {
+        if(count == 3 && strcmp(components[1], "GET") == 0 && !check_var(client, components[2], false)) {
+            return;
+        } else if(count == 4 && strcmp(components[1], "SET") == 0 && !check_var(client, components[2], true)) {
+            return;
+        }
+        forward_request(client, frame, length);
+    } else if(strcmp(components[0], "WATCH") == 0) {
+        if(count == 2 && strcmp(components[1], "TIMESTAMPS") == 0) {
+            client->timestamps = true;
+            if(!upstream_timestamps) {
+                upstream_timestamps = true;
+                send_upstream(frame, length);
+            }
+        } else if(count == 3 && check_var(client, components[2], false)) {
+            if(strcmp(components[1], "ADD") == 0) {
+                subscribe(client, components[2]);
+            } else if(strcmp(components[1], "DEL") == 0) {
+                unsubscribe(client, components[2]);
+            }
+        }
+    } else if(strcmp(components[0], "NOTIFY") == 0) {
+        if(count == 4 && strcmp(components[1], "ADD_FILTER") == 0) {
+            add_filter(client, components[2], components[3]);
+        } else if(count == 2 && strcmp(components[1], "CLEAR_FILTERS") == 0) {
+            for(int i = 0; i < client->filters_n; i++) {
+                free(client->filters[i]);
+            }
+            client->filters_n = 0;
+        } else {
+            forward_request(client, frame, length);
+        }
+    } else if(strcmp(components[0], "BLOB") == 0) {
+        kick(client, "Blob channels are not available through seawolf-proxy");
+    } else {
+        /* LOG, STATS and anything else the hub understands */
+        forward_request(client, frame, length);
+    }
+}
+
+/**
+ * \brief Process a frame from the hub
+ */
+static void process_upstream_frame(char* frame, size_t length) {
+    static char* stripped = NULL;
+    char* components[MAX_COMPONENTS];
+    uint16_t request_id = ntohs(((uint16_t*) frame)[1]);
+    size_t stripped_length = 0;
+    PendingRequest* request;
+    List* subscribers;
+    ProxyClient* client;
+    int count;
+
+    if(request_id != 0) {
+        /* Response, restore the application's request ID */
+        request = &pending[request_id];
+        if(request->client) {
+            ((uint16_t*) frame)[1] = htons(request->request_id);
+            send_client(request->client, frame, length);
+            request->client = NULL;
+        }
+        return;
+    }
+
+    count = parse_frame(frame, length, components);
+    if(count <= 0) {
+        return;
+    }
+
+    if(strcmp(components[0], "WATCH") == 0 && (count == 3 || count == 4)) {
+        subscribers = Dictionary_get(subscriptions, components[1]);
+        for(int i = 0; subscribers && (client = List_get(subscribers, i)) != NULL; i++) {
+            if(count == 4 && !client->timestamps) {
+                /* Only sent the time by the hub because another application
+                   asked for it */
+                if(stripped_length == 0) {
+                    if(stripped == NULL) {
+                        stripped = malloc(RECEIVE_BUFFER);
+                    }
+                    stripped_length = build_frame(stripped, 0, 3, components);
+                }
+                send_client(client, stripped, stripped_length);
+            } else {
+                send_client(client, frame, length);
+            }
+        }
+    } else if(strcmp(components[0], "NOTIFY") == 0 && count == 3) {
+        for(int i = 0; i < client_count; i++) {
+            if(clients[i]->authenticated && check_filters(clients[i], components[2])) {
+                send_client(clients[i], frame, length);
+            }
+        }
+    } else if(strcmp(components[0], "COMM") == 0 && count >= 2 && strcmp(components[1], "CLOCK") == 0) {
+        for(int i = 0; i < client_count; i++) {
+            if(clients[i]->clock_sync) {
+                send_client(clients[i], frame, length);
+            }
+        }
+    } else if(strcmp(components[0], "COMM") == 0 && count == 3 && strcmp(components[1], "KICKING") == 0) {
+        fprintf(stderr, "Disconnected by hub: %s\n", components[2]);
+    }
+}
+
+/**
+ * \brief Read and process frames from a readable application
+ */
+static void receive_client(ProxyClient* client) {
+    size_t length;
+    int n;
+
+    n = recv(client->sock, client->buffer + client->buffered, RECEIVE_BUFFER - client->buffered, 0);
+    if(n <= 0) {
+        client->closed = true;
+        return;
+    }
+    client->buffered += n;
+
+    while(!client->closed && client->buffered >= COMM_MESSAGE_PREFIX_LEN) {
+        length = COMM_MESSAGE_PREFIX_LEN + ntohs(((uint16_t*) client->buffer)[0]);
+        if(client->buffered < length) {
+            break;
+        }
+
+        process_client_frame(client, client->buffer, length);
+
+        client->buffered -= length;
+        memmove(client->buffer, client->buffer + length, client->buffered);
+    }
+}
+
+/**
+ * \brief Read and process frames from the hub
+ *
+ * The connection is closed if the hub has closed it
+ */
+static void receive_upstream(void) {
+    size_t length;
+    int n;
+
+    n = recv(upstream, upstream_buffer + upstream_buffered, RECEIVE_BUFFER - upstream_buffered, 0);
+    if(n <= 0) {
+        close(upstream);
+        upstream = -1;
+        return;
+    }
+    upstream_buffered += n;
+
+    while(upstream_buffered >= COMM_MESSAGE_PREFIX_LEN) {
+        length = COMM_MESSAGE_PREFIX_LEN + ntohs(((uint16_t*) upstream_buffer)[0]);
+        if(upstream_buffered < length) {
+            break;
+        }
+
+        process_upstream_frame(upstream_buffer, length);
+
+        upstream_buffered -= length;
+        memmove(upstream_buffer, upstream_buffer + length, upstream_buffered);
+    }
+}
+
+/**
+ * \brief Accept an application
+ */
+static void accept_client(int listen_sock) {
+    ProxyClient* client;
+    int sock = accept(listen_sock, NULL, NULL);
+    const int nodelay = 1;
+
+    if(sock == -1) {
+        return;
+    }
+
+    /* Fails harmlessly for applications on the Unix domain socket */
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    client = calloc(1, sizeof(ProxyClient));
+    client->sock = sock;
+    client->buffer = malloc(RECEIVE_BUFFER);
+
+    clients = realloc(clients, sizeof(ProxyClient*) * (client_count + 1));
+    clients[client_count++] = client;
+}
+
+/**
+ * \brief Disconnect an application and drop its subscriptions and outstanding
+ * requests
+ */
+static void remove_client(ProxyClient* client) {
+    List* names = Dictionary_getKeys(subscriptions);
+    char* name;
+
+    /* Unsubscribing may remove the key, so copy it first */
+    while((name = List_remove(names, 0)) != NULL) {
+        name = strdup(name);
+        unsubscribe(client, name);
+        free(name);
+    }
+    List_destroy(names);
+
+    for(int i = 0; i < REQUEST_IDS; i++) {
+        if(pending[i].client == client) {
+            pending[i].client = NULL;
+        }
+    }
+
+    for(int i = 0; i < client_count; i++) {
+        if(clients[i] == client) {
+            clients[i] = clients[--client_count];
+            break;
+        }
+    }
+
+    for(int i = 0; i < client->filters_n; i++) {
+        free(client->filters[i]);
+    }
+    free(client->filters);
+    free(client->buffer);
+    shutdown(client->sock, SHUT_RDWR);
+    close(client->sock);
+    free(client);
+}
+
+/**
+ * \brief Connect and authenticate to the hub
+ *
+ * \return 0 on success, -1 on failure
+ */
+static int connect_upstream(void) {
+    static bool reported = false;
+    char* message[] = {"COMM", "AUTH", options.password};
+    char* components[MAX_COMPONENTS];
+    struct sockaddr_in addr;
+    const int nodelay = 1;
+    size_t length;
+    int n;
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(options.address);
+    addr.sin_port = htons(options.port);
+
+    upstream = socket(AF_INET, SOCK_STREAM, 0);
+    if(upstream == -1 || connect(upstream, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        /* Report an unreachable hub once rather than on every retry */
+        if(!reported) {
+            fprintf(stderr, "Unable to connect to %s:%u: %s\n", options.address, options.port, strerror(errno));
+            reported = true;
+        }
+        close(upstream);
+        upstream = -1;
+        return -1;
+    }
+    reported = false;
+    setsockopt(upstream, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    send_upstream_message(1, 3, message);
+
+    /* Wait for the response */
+    upstream_buffered = 0;
+    length = COMM_MESSAGE_PREFIX_LEN;
+    while(upstream_buffered < length) {
+        n = recv(upstream, upstream_buffer + upstream_buffered, length - upstream_buffered, 0);
+        if(n <= 0) {
+            break;
+        }
+        upstream_buffered += n;
+        if(upstream_buffered == COMM_MESSAGE_PREFIX_LEN) {
+            length += ntohs(((uint16_t*) upstream_buffer)[0]);
+        }
+    }
+
+    if(upstream_buffered < length || parse_frame(upstream_buffer, length, components) != 2 ||
+       strcmp(components[1], "SUCCESS") != 0) {
+        fprintf(stderr, "Failed to authenticate with hub\n");
+        close(upstream);
+        upstream = -1;
+        return -1;
+    }
+
+    upstream_buffered = 0;
+    upstream_timestamps = false;
+    fprintf(stderr, "Connected to hub at %s:%u\n", options.address, options.port);
+
+    return 0;
+}
+
+/**
+ * \brief Serve applications until the connection to the hub is lost or the
+ * proxy is stopped
+ */
+static void serve(int tcp_sock, int unix_sock) {
+    struct pollfd* fds = NULL;
+    ProxyClient** fd_clients = NULL;
+    int fds_size = 0;
+    int n;
+
+    while(running && upstream != -1) {
+        if(fds_size < client_count + 3) {
+            fds_size = client_count + 16;
+            fds = realloc(fds, sizeof(struct pollfd) * fds_size);
+            fd_clients = realloc(fd_clients, sizeof(ProxyClient*) * fds_size);
+        }
+
+        fds[0].fd = upstream;
+        fds[1].fd = tcp_sock;
+        fds[2].fd = unix_sock;
+        for(int i = 0; i < client_count; i++) {
+            fds[3 + i].fd = clients[i]->sock;
+            fd_clients[3 + i] = clients[i];
+        }
+        n = client_count + 3;
+        for(int i = 0; i < n; i++) {
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if(poll(fds, n, -1) <= 0) {
+            continue;
+        }
+
+        if(fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            receive_upstream();
+        }
+
+        for(int i = 3; i < n; i++) {
+            if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                receive_client(fd_clients[i]);
+            }
+        }
+
+        /* Remove applications only after every frame has been processed, so
+           none is freed while still in fds */
+        for(int i = client_count - 1; i >= 0; i--) {
+            if(clients[i]->closed) {
+                remove_client(clients[i]);
+            }
+        }
+
+        if(fds[1].revents & POLLIN) {
+            accept_client(tcp_sock);
+        }
+        if(unix_sock != -1 && (fds[2].revents & POLLIN)) {
+            accept_client(unix_sock);
+        }
+    }
+
+    free(fds);
+    free(fd_clients);
+}
+
+static void catch_signal(int sig) {
+    running = false;
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-a address] [-p port] [-b address] [-l port] [-u path] [-d defs] -w password\n", arg0);
+    printf("  -a address  Address of the hub (default 127.0.0.1)\n");
+    printf("  -p port     Port of the hub (default 31427)\n");
+    printf("  -w password Hub password, also required from applications\n");
+    printf("  -b address  Address to accept applications on (default 127.0.0.1)\n");
+    printf("  -l port     Port to accept applications on (default 31428)\n");
+    printf("  -u path     Also accept applications on a Unix domain socket at path\n");
+    printf("  -d defs     Hub variable definitions, to check variable accesses\n");
+}
+
+int main(int argc, char** argv) {
+    struct sigaction action;
+    int tcp_sock, unix_sock = -1;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":ha:p:w:b:l:u:d:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'a':
+            options.address = optarg;
+            break;
+        case 'p':
+            options.port = atoi(optarg);
+            break;
+        case 'w':
+            options.password = optarg;
+            break;
+        case 'b':
+            options.bind_address = optarg;
+            break;
+        case 'l':
+            options.bind_port = atoi(optarg);
+            break;
+        case 'u':
+            options.bind_path = optarg;
+            break;
+        case 'd':
+            options.var_defs = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(optind != argc || options.password == NULL) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.var_defs && (var_defs = load_var_defs(options.var_defs)) == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    /* An application closing its connection must not kill the proxy, and
+       stopping the proxy must interrupt poll() */
+    signal(SIGPIPE, SIG_IGN);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = catch_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    tcp_sock = listen_tcp(options.bind_address, options.bind_port);
+    if(tcp_sock == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.bind_path && (unix_sock = listen_unix(options.bind_path)) == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    upstream_buffer = malloc(RECEIVE_BUFFER);
+    subscriptions = Dictionary_new();
+    upstream_filters = Dictionary_new();
+
+    while(running) {
+        if(connect_upstream() != 0) {
+            Util_usleep(1);
+            continue;
+        }
+
+        serve(tcp_sock, unix_sock);
+
+        if(upstream != -1) {
+            close(upstream);
+            upstream = -1;
+        } else if(running) {
+            fprintf(stderr, "Lost connection to hub\n");
+        }
+
+        /* Subscriptions and filters belong to the closed connection */
+        while(client_count > 0) {
+            kick(clients[0], running ? "Lost connection to hub" : "Proxy closing");
+            remove_client(clients[0]);
+        }
+        Dictionary_destroy(subscriptions);
+        Dictionary_destroy(upstream_filters);
+        subscriptions = Dictionary_new();
+        upstream_filters = Dictionary_new();
+    }
+
+    close(tcp_sock);
+    if(unix_sock != -1) {
+        close(unix_sock);
+        unlink(options.bind_path);
+    }
+
+    return 0;
+}
@@ -0,0 +1,668 @@
+/**
+ * \file
+ * \brief Hub traffic replay
+ *
+ * Replays a capture recorded by a hub with the capture_file option against a
+ * running hub. Every client in the capture is emulated by its own connection,
+ * which sends the client's frames byte for byte at the times they were
+ * originally received, scaled by a speed factor, or as fast as possible.
+ * Several copies of the capture can be replayed at once to multiply the load.
+ * Frames are always sent in the order they were captured, so a capture
+ * produces the same request stream on every run.
+ *
+ * The load is open loop, frames are sent on schedule whether or not earlier
+ * requests have been answered. The hub answers each client's requests in
+ * order, so responses are matched to the oldest outstanding request with the
+ * same ID to measure round trip times, even though clients reuse request IDs.
+ * How late each frame was sent is reported as the schedule lag.
+ *
+ * Captures do not contain passwords, so clients authenticate with the password
+ * given with -P instead. The target hub should use the same variable
+ * definitions as the captured hub.
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub_capture.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Size of each connection's receive buffer, enough for any frame */
+#define RECEIVE_BUFFER (COMM_MESSAGE_PREFIX_LEN + 0xffff)
+
+/**
+ * Replay options
+ */
+typedef struct {
+    /** Capture file */
+    char* file;
+
+    /** Address of the hub */
+    char* address;
+
+    /** Port of the hub */
+    uint16_t port;
+
+    /** Password sent in place of the captured clients' passwords */
+    char* password;
+
+    /** Multiple of the captured rate, 0 for as fast as possible */
+    double speed;
+
+    /** Number of copies of each captured client */
+    int copies;
+
+    /** Seconds to wait for outstanding responses after the last frame */
+    double drain;
+
+    /** Output results as CSV */
+    bool csv;
+} ReplayOptions;
+
+/**
+ * A capture loaded into memory
+ */
+typedef struct {
+    /** Contents of the capture file */
+    char* data;
+
+    /** Records in the capture */
+    Hub_Capture_Record** records;
+
+    /** Index of the client which sent each record */
+    int* record_clients;
+
+    /** Number of records */
+    size_t count;
+
+    /** Number of distinct clients */
+    int clients;
+} Capture;
+
+/**
+ * A request waiting for its response
+ */
+typedef struct {
+    /** Request ID */
+    uint16_t request_id;
+
+    /** Time the request was sent */
+    int64_t sent;
+} PendingRequest;
+
+/**
+ * An emulated client connection
+ */
+typedef struct {
+    /** Socket, or -1 if not connected */
+    int sock;
+
+    /** True once the connection has been shut down for writing */
+    bool closing;
+
+    /** True once the connection has closed. Captured clients never reconnect */
+    bool finished;
+
+    /** Received data not yet parsed */
+    char* buffer;
+
+    /** Bytes in buffer */
+    size_t buffered;
+
+    /** Outstanding requests in the order they were sent, a circular buffer */
+    PendingRequest* pending;
+
+    /** Size of pending */
+    int pending_size;
+
+    /** Index of the oldest outstanding request */
+    int pending_head;
+
+    /** Number of outstanding requests */
+    int outstanding;
+} ReplayClient;
+
+/**
+ * Replay results
+ */
+typedef struct {
+    /** Frames sent */
+    uint64_t frames;
+
+    /** Bytes sent */
+    uint64_t bytes;
+
+    /** Requests whose responses never arrived */
+    uint64_t missing;
+
+    /** Connections closed by the hub */
+    uint64_t kicked;
+
+    /** Nanoseconds from the first frame to the last */
+    int64_t elapsed;
+
+    /** Nanoseconds each frame was sent after it was due */
+    Histogram lag;
+
+    /** Request round trip times */
+    Histogram round_trip;
+} ReplayResults;
+
+static Capture* load_capture(const char* file);
+static int connect_client(ReplayClient* client, const ReplayOptions* options);
+static void close_client(ReplayClient* client, ReplayResults* results);
+static size_t auth_frame(char* frame, const char* captured, size_t captured_length, const char* password);
+static int send_frame(ReplayClient* client, const char* data, size_t length, ReplayResults* results);
+static void receive(ReplayClient* client, ReplayResults* results);
+static int outstanding(ReplayClient* clients, int count);
+static void poll_clients(ReplayClient* clients, int count, int timeout, ReplayResults* results);
+static void wait_until(ReplayClient* clients, int count, int64_t due, ReplayResults* results);
+static int replay(Capture* capture, const ReplayOptions* options, ReplayResults* results);
+static void report(Capture* capture, const ReplayOptions* options, ReplayResults* results);
+static void usage(char* arg0);
+
+/**
+ * \brief Read and index a capture file
+ *
+ * \return The capture, or NULL if it could not be read
+ */
+static Capture* load_capture(const char* file) {
+    Capture* capture;
+    Hub_Capture_Header* header;
+    Hub_Capture_Record* record;
+    Dictionary* client_index;
+    size_t capacity = 1024;
+    size_t size, offset;
+    void* index;
+    FILE* f;
+
+    f = fopen(file, "r");
+    if(f == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", file, strerror(errno));
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    capture = malloc(sizeof(Capture));
+    capture->data = malloc(size);
+    if(size < sizeof(Hub_Capture_Header) || fread(capture->data, size, 1, f) != 1) {
+        fprintf(stderr, "Unable to read %s\n", file);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+
+    /* Earlier versions only differ in also recording passwords */
+    header = (Hub_Capture_Header*) capture->data;
+    if(header->magic != HUB_CAPTURE_MAGIC || header->version < 1 || header->version > HUB_CAPTURE_VERSION) {
+        fprintf(stderr, "%s is not a version %d hub capture\n", file, HUB_CAPTURE_VERSION);
+        return NULL;
+    }
+
+    capture->records = malloc(capacity * sizeof(Hub_Capture_Record*));
+    capture->record_clients = malloc(capacity * sizeof(int));
+    capture->count = 0;
+    capture->clients = 0;
+    client_index = Dictionary_new();
+
+    for(offset = sizeof(Hub_Capture_Header); offset + sizeof(Hub_Capture_Record) <= size;
+        offset += sizeof(Hub_Capture_Record) + record->length) {
+        record = (Hub_Capture_Record*) (capture->data + offset);
+        if(offset + sizeof(Hub_Capture_Record) + record->length > size) {
+            /* The hub did not finish writing the capture */
+            fprintf(stderr, "Ignoring truncated record at the end of %s\n", file);
+            break;
+        }
+
+        if(capture->count == capacity) {
+            capacity *= 2;
+            capture->records = realloc(capture->records, capacity * sizeof(Hub_Capture_Record*));
+            capture->record_clients = realloc(capture->record_clients, capacity * sizeof(int));
+        }
+
+        /* Number clients in the order they first appear */
+        index = Dictionary_getInt(client_index, (int) record->client);
+        if(index == NULL) {
+            index = (void*) (intptr_t) ++capture->clients;
+            Dictionary_setInt(client_index, (int) record->client, index);
+        }
+
+        capture->records[capture->count] = record;
+        capture->record_clients[capture->count] = (int) (intptr_t) index - 1;
+        capture->count++;
+    }
+
+    Dictionary_destroy(client_index);
+    return capture;
+}
+
+/**
+ * \brief Open a connection to the hub
+ *
+ * \return 0 on success, -1 on failure
+ */
+static int connect_client(ReplayClient* client, const ReplayOptions* options) {
+    struct sockaddr_in addr;
+    const int nodelay = 1;
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(options->address);
+    addr.sin_port = htons(options->port);
+
+    client->sock = socket(AF_INET, SOCK_STREAM, 0);
+    if(client->sock == -1 || connect(client->sock, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Unable to connect to %s:%u: %s\n", options->address, options->port, strerror(errno));
+        return -1;
+    }
+
+    /* Round trips are measured, so send each frame as it is due */
+    setsockopt(client->sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    return 0;
+}
+
+/**
+ * \brief Close a connection
+ *
+ * Requests still outstanding are counted as missing
+ */
+static void close_client(ReplayClient* client, ReplayResults* results) {
+    close(client->sock);
+    client->sock = -1;
+    client->finished = true;
+    client->buffered = 0;
+
+    results->missing += client->outstanding;
+    client->outstanding = 0;
+}
+
+/**
+ * \brief Build the COMM AUTH frame to send in place of a captured one
+ *
+ * \param frame Space for the frame, at least RECEIVE_BUFFER bytes
+ * \param captured The captured frame
+ * \param captured_length Length of the captured frame
+ * \param password Password to authenticate with
+ * \return The length of the frame, or 0 if captured is not a COMM AUTH frame
+ */
+static size_t auth_frame(char* frame, const char* captured, size_t captured_length, const char* password) {
+    size_t length = COMM_MESSAGE_PREFIX_LEN + sizeof(HUB_CAPTURE_AUTH);
+    size_t password_length = strlen(password) + 1;
+
+    if(captured_length <= length || memcmp(captured + COMM_MESSAGE_PREFIX_LEN, HUB_CAPTURE_AUTH, sizeof(HUB_CAPTURE_AUTH)) != 0 ||
+       length + password_length > RECEIVE_BUFFER) {
+        return 0;
+    }
+
+    memcpy(frame, captured, length);
+    memcpy(frame + length, password, password_length);
+    length += password_length;
+    ((uint16_t*) frame)[0] = htons(length - COMM_MESSAGE_PREFIX_LEN);
+
+    return length;
+}
+
+/**
+ * \brief Send a captured frame
+ *
+ * \return 0 on success, -1 if the connection was closed
+ */
+static int send_frame(ReplayClient* client, const char* data, size_t length, ReplayResults* results) {
+    static const char shutdown_request[] = "COMM\0SHUTDOWN";
+    uint16_t request_id = ntohs(((uint16_t*) data)[1]);
+    PendingRequest* request;
+    size_t sent = 0;
+    int n;
+
+    /* The hub closes the connection after a client shuts down, without
+       answering the request */
+    if(length >= COMM_MESSAGE_PREFIX_LEN + sizeof(shutdown_request) &&
+       memcmp(data + COMM_MESSAGE_PREFIX_LEN, shutdown_request, sizeof(shutdown_request)) == 0) {
+        client->closing = true;
+        request_id = 0;
+    }
+
+    if(request_id != 0) {
+        if(client->outstanding == client->pending_size) {
+            /* Grow the buffer, moving the wrapped part to the new space */
+            client->pending = realloc(client->pending, (client->pending_size * 2 + 16) * sizeof(PendingRequest));
+            memcpy(client->pending + client->pending_size, client->pending, client->pending_head * sizeof(PendingRequest));
+            client->pending_size = client->pending_size * 2 + 16;
+        }
+
+        request = &client->pending[(client->pending_head + client->outstanding) % client->pending_size];
+        request->request_id = request_id;
+        request->sent = Timer_getTimestamp();
+        client->outstanding++;
+    }
+
+    while(sent < length) {
+        n = send(client->sock, data + sent, length - sent, 0);
+        if(n < 0) {
+            return -1;
+        }
+        sent += n;
+    }
+
+    results->frames++;
+    results->bytes += length;
+    return 0;
+}
+
+/**
+ * \brief Read responses from a readable connection
+ */
+static void receive(ReplayClient* client, ReplayResults* results) {
+    int64_t now = Timer_getTimestamp();
+    PendingRequest* request;
+    uint16_t* prefix;
+    uint16_t request_id;
+    size_t length;
+    int n;
+
+    n = recv(client->sock, client->buffer + client->buffered, RECEIVE_BUFFER - client->buffered, 0);
+    if(n <= 0) {
+        if(!client->closing) {
+            results->kicked++;
+        }
+        close_client(client, results);
+        return;
+    }
+    client->buffered += n;
+
+    /* Match each complete response to its request */
+    while(client->buffered >= COMM_MESSAGE_PREFIX_LEN) {
+        prefix = (uint16_t*) client->buffer;
+        length = COMM_MESSAGE_PREFIX_LEN + ntohs(prefix[0]);
+        if(client->buffered < length) {
+            break;
+        }
+
+        /* Older requests with other IDs will never be answered */
+        request_id = ntohs(prefix[1]);
+        for(int i = 0; request_id != 0 && i < client->outstanding; i++) {
+            request = &client->pending[(client->pending_head + i) % client->pending_size];
+            if(request->request_id == request_id) {
+                Histogram_record(&results->round_trip, now - request->sent);
+                results->missing += i;
+                client->pending_head = (client->pending_head + i + 1) % client->pending_size;
+                client->outstanding -= i + 1;
+                break;
+            }
+        }
+
+        client->buffered -= length;
+        memmove(client->buffer, client->buffer + length, client->buffered);
+    }
+}
+
+/**
+ * \brief Count outstanding requests
+ */
+static int outstanding(ReplayClient* clients, int count) {
+    int total = 0;
+
+    for(int i = 0; i < count; i++) {
+        total += clients[i].outstanding;
+    }
+
+    return total;
+}
+
+/**
+ * \brief Wait for and read responses on every connection
+ *
+ * \param timeout Milliseconds to wait, 0 to only read responses which have
+ * already arrived
+ */
+static void poll_clients(ReplayClient* clients, int count, int timeout, ReplayResults* results) {
+    static struct pollfd* fds = NULL;
+    static int* fd_clients = NULL;
+    int n = 0;
+
+    if(fds == NULL) {
+        fds = malloc(count * sizeof(struct pollfd));
+        fd_clients = malloc(count * sizeof(int));
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(clients[i].sock != -1) {
+            fds[n].fd = clients[i].sock;
+            fds[n].events = POLLIN;
+            fd_clients[n++] = i;
+        }
+    }
+
+    if(poll(fds, n, timeout) <= 0) {
+        return;
+    }
+
+    for(int i = 0; i < n; i++) {
+        if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+            receive(&clients[fd_clients[i]], results);
+        }
+    }
+}
+
+/**
+ * \brief Read responses until a frame is due
+ */
+static void wait_until(ReplayClient* clients, int count, int64_t due, ReplayResults* results) {
+    int64_t now;
+
+    while((now = Timer_getTimestamp()) < due) {
+        /* Sleep in poll() until the last millisecond, then spin */
+        poll_clients(clients, count, (int) ((due - now) / 1000000), results);
+    }
+}
+
+/**
+ * \brief Replay the capture
+ *
+ * \return 0 on success, -1 if a connection failed
+ */
+static int replay(Capture* capture, const ReplayOptions* options, ReplayResults* results) {
+    int count = capture->clients * options->copies;
+    ReplayClient* clients = calloc(count, sizeof(ReplayClient));
+    char* auth = malloc(RECEIVE_BUFFER);
+    Hub_Capture_Record* record;
+    ReplayClient* client;
+    int64_t start, due, drain_end;
+    char* frame;
+    size_t length;
+
+    for(int i = 0; i < count; i++) {
+        clients[i].sock = -1;
+        clients[i].buffer = malloc(RECEIVE_BUFFER);
+    }
+
+    start = Timer_getTimestamp();
+    for(size_t i = 0; i < capture->count; i++) {
+        record = capture->records[i];
+
+        if(options->speed > 0) {
+            due = start + (int64_t) (record->time / options->speed);
+            wait_until(clients, count, due, results);
+        } else {
+            due = Timer_getTimestamp();
+            poll_clients(clients, count, 0, results);
+        }
+
+        for(int copy = 0; copy < options->copies; copy++) {
+            client = &clients[copy * capture->clients + capture->record_clients[i]];
+            if(client->finished) {
+                continue;
+            }
+
+            if(record->length == 0) {
+                /* The client disconnected, let the hub close the connection
+                   once it has answered everything already sent */
+                if(client->sock != -1 && !client->closing) {
+                    shutdown(client->sock, SHUT_WR);
+                    client->closing = true;
+                }
+                continue;
+            }
+
+            if(client->sock == -1 && connect_client(client, options) != 0) {
+                return -1;
+            }
+
+            frame = (char*) (record + 1);
+            length = auth_frame(auth, frame, record->length, options->password);
+            if(length) {
+                frame = auth;
+            } else {
+                length = record->length;
+            }
+
+            Histogram_record(&results->lag, Timer_getTimestamp() - due);
+            if(send_frame(client, frame, length, results) != 0) {
+                /* Closed by the hub before it could be read */
+                results->kicked++;
+                close_client(client, results);
+            }
+        }
+    }
+    results->elapsed = Timer_getTimestamp() - start;
+
+    /* Wait for responses still in flight */
+    drain_end = Timer_getTimestamp() + (int64_t) (options->drain * 1e9);
+    while(outstanding(clients, count) && Timer_getTimestamp() < drain_end) {
+        poll_clients(clients, count, 10, results);
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(clients[i].sock != -1) {
+            clients[i].closing = true;
+            close_client(&clients[i], results);
+        }
+    }
+
+    free(auth);
+    return 0;
+}
+
+/**
+ * \brief Print the results
+ */
+static void report(Capture* capture, const ReplayOptions* options, ReplayResults* results) {
+    double seconds = results->elapsed / 1e9;
+    double rate = (seconds > 0) ? results->frames / seconds : 0;
+    Histogram* rtt = &results->round_trip;
+
+    if(options->csv) {
+        printf("clients,copies,speed,frames,bytes,seconds,frames_per_s,lag_p99_us,"
+               "requests,p50_us,p99_us,p999_us,max_us,missing,kicked\n");
+        printf("%d,%d,%.2f,%llu,%llu,%.3f,%.1f,%.1f,%llu,%.1f,%.1f,%.1f,%.1f,%llu,%llu\n",
+               capture->clients, options->copies, options->speed,
+               (unsigned long long) results->frames, (unsigned long long) results->bytes, seconds, rate,
+               Histogram_getPercentile(&results->lag, 99) / 1e3, (unsigned long long) Histogram_getCount(rtt),
+               Histogram_getPercentile(rtt, 50) / 1e3, Histogram_getPercentile(rtt, 99) / 1e3,
+               Histogram_getPercentile(rtt, 99.9) / 1e3, Histogram_getMax(rtt) / 1e3,
+               (unsigned long long) results->missing, (unsigned long long) results->kicked);
+        return;
+    }
+
+    printf("%s: %d clients x %d copies", options->file, capture->clients, options->copies);
+    if(options->speed > 0) {
+        printf(" at %gx speed\n", options->speed);
+    } else {
+        printf(" as fast as possible\n");
+    }
+    printf("  Sent %llu frames, %llu bytes in %.3f s, %.1f frames per second\n",
+           (unsigned long long) results->frames, (unsigned long long) results->bytes, seconds, rate);
+    printf("  Schedule lag   p50 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+           Histogram_getPercentile(&results->lag, 50) / 1e3, Histogram_getPercentile(&results->lag, 99) / 1e3,
+           Histogram_getMax(&results->lag) / 1e3);
+    printf("  Round trip     %llu requests  p50 %.1f us  p99 %.1f us  p999 %.1f us  max %.1f us\n",
+           (unsigned long long) Histogram_getCount(rtt), Histogram_getPercentile(rtt, 50) / 1e3,
+           Histogram_getPercentile(rtt, 99) / 1e3, Histogram_getPercentile(rtt, 99.9) / 1e3,
+           Histogram_getMax(rtt) / 1e3);
+    printf("  Missing        %llu responses, %llu connections closed by the hub\n",
+           (unsigned long long) results->missing, (unsigned long long) results->kicked);
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-c] [-a address] [-p port] [-P password] [-s speed] [-n copies] [-w seconds] capture\n", arg0);
+    printf("  -a address  Address of the hub (default 127.0.0.1)\n");
+    printf("  -p port     Port of the hub (default 31427)\n");
+    printf("  -P password Password of the hub (default none)\n");
+    printf("  -s speed    Multiple of the captured rate, 0 for as fast as possible (default 1)\n");
+    printf("  -n copies   Number of emulated copies of each captured client (default 1)\n");
+    printf("  -w seconds  Time to wait for outstanding responses at the end (default 1)\n");
+    printf("  -c          Print results as CSV\n");
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options = {.file = NULL, .address = "127.0.0.1", .port = 31427, .password = "", .speed = 1,
+                             .copies = 1, .drain = 1, .csv = false};
+    ReplayResults results;
+    Capture* capture;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hca:p:P:s:n:w:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'c':
+            options.csv = true;
+            break;
+        case 'a':
+            options.address = optarg;
+            break;
+        case 'p':
+            options.port = atoi(optarg);
+            break;
+        case 'P':
+            options.password = optarg;
+            break;
+        case 's':
+            options.speed = atof(optarg);
+            break;
+        case 'n':
+            options.copies = atoi(optarg);
+            break;
+        case 'w':
+            options.drain = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(optind != argc - 1 || options.copies < 1 || options.speed < 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    options.file = argv[optind];
+
+    /* A hub closing a connection must not kill the replay */
+    signal(SIGPIPE, SIG_IGN);
+
+    capture = load_capture(options.file);
+    if(capture == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&results, 0, sizeof(results));
+    Histogram_init(&results.lag);
+    Histogram_init(&results.round_trip);
+
+    if(replay(capture, &options, &results) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    report(capture, &options, &results);
+    return 0;
+}
@@ -3,6 +3,7 @@
 #define __SEAWOLF_HUB_INCLUDE_H
 
 #include "seawolf/mem_pool.h"
+#include "seawolf_hub_shm.h"
 
 #include <stdbool.h>
 
@@ -39,10 +40,21 @@ typedef enum {
  */
 typedef struct {
     /**
-     * Client socket
+     * Client socket, -1 for a client in the same process
      */
     int sock;
 
+    /**
+     * Called with each message sent to a client in the same process, NULL for
+     * a client connected over a socket
+     */
+    void (*deliver)(Comm_PackedMessage* packed_message);
+
+    /**
+     * Identifies the connection in traffic captures
+     */
+    uint32_t id;
+
     /**
      * Current state of the client
      */
@@ -73,6 +85,16 @@ typedef struct {
      */
     List* subscribed_vars;
 
+    /**
+     * Client uses the hub clock and is sent every change to it
+     */
+    bool clock_sync;
+
+    /**
+     * Client is sent the hub time with each variable update
+     */
+    bool watch_timestamps;
+
     /**
      * Send/modify lock
      */
@@ -87,6 +109,31 @@ typedef struct {
      * Task which runs the client thread
      */ 
     pthread_t thread;
+
+    /**
+     * Messages received from the client
+     */
+    uint64_t messages_in;
+
+    /**
+     * Bytes received from the client
+     */
+    uint64_t bytes_in;
+
+    /**
+     * Messages sent to the client
+     */
+    uint64_t messages_out;
+
+    /**
+     * Bytes sent to the client
+     */
+    uint64_t bytes_out;
+
+    /**
+     * Messages which could not be sent to the client
+     */
+    uint64_t drops;
 } Hub_Client;
 
 /**
@@ -127,6 +174,16 @@ typedef struct {
      * List of clients subscribed to the variable
      */
     List* subscribers;
+
+    /**
+     * Position of the variable in the definitions, used to index statistics
+     */
+    int index;
+
+    /**
+     * The variable is replicated from a peer hub
+     */
+    bool replicated;
 } Hub_Var;
 
 void Hub_exit(void);
@@ -134,7 +191,9 @@ void Hub_exitError(void);
 bool Hub_fileExists(const char* file);
 int Hub_Process_process(Hub_Client* client, Comm_Message* message);
 
+Comm_PackedMessage* Hub_Net_readPackedMessage(int sock);
 Comm_Message* Hub_Net_receiveMessage(Hub_Client* client);
+void Hub_Net_receiveInproc(Hub_Client* client, Comm_PackedMessage* packed_message);
 int Hub_Net_sendMessage(Hub_Client* client, Comm_Message* message);
 int Hub_Net_sendPackedMessage(Hub_Client* client, Comm_PackedMessage* packed_message);
 void Hub_Net_broadcastMessage(Comm_Message* message);
@@ -155,6 +214,9 @@ List* Hub_Net_getClients(void);
 void Hub_Net_acquireGlobalClientsLock(void);
 void Hub_Net_releaseGlobalClientsLock(void);
 void Hub_Net_mainLoop(void);
+void Hub_Net_startEmbedded(void);
+Hub_Client* Hub_Net_connectInproc(void (*deliver)(Comm_PackedMessage* packed_message));
+void Hub_Net_stopEmbedded(void);
 
 void Hub_Config_init(void);
 void Hub_Config_loadConfig(const char* filename);
@@ -163,11 +225,50 @@ void Hub_Config_close(void);
 
 void Hub_Var_init(void);
 Hub_Var* Hub_Var_get(const char* name);
+int Hub_Var_getCount(void);
+Hub_Var* Hub_Var_getByIndex(int index);
 int Hub_Var_setValue(const char* name, double value);
 int Hub_Var_addSubscriber(Hub_Client* client, const char* name);
 int Hub_Var_deleteSubscriber(Hub_Client* client, const char* name);
+Comm_Message* Hub_Var_getShmMessage(uint16_t request_id);
 void Hub_Var_close(void);
 
+void Hub_Stats_init(void);
+void Hub_Stats_countVarSet(Hub_Var* var, int fanout);
+void Hub_Stats_countVarGet(Hub_Var* var);
+void Hub_Stats_countNotification(int checked, int matched);
+void Hub_Stats_countLockWait(int64_t ns);
+void Hub_Stats_recordRequest(Hub_Stats_Namespace namespace, int64_t ns);
+Comm_Message* Hub_Stats_getMessage(const char* section, uint16_t request_id);
+void Hub_Stats_close(void);
+
+void Hub_Clock_init(void);
+Comm_Message* Hub_Clock_getMessage(uint16_t request_id);
+void Hub_Clock_broadcast(void);
+
+void Hub_Capture_init(void);
+void Hub_Capture_recordFrame(Hub_Client* client, Comm_PackedMessage* packed_message);
+void Hub_Capture_recordClose(Hub_Client* client);
+void Hub_Capture_close(void);
+
+void Hub_Telemetry_init(void);
+void Hub_Telemetry_record(Hub_Var* var, int64_t time, double value);
+void Hub_Telemetry_close(void);
+
+void Hub_Blob_init(void);
+int Hub_Blob_create(Hub_Client* client, const char* name, const char* segment);
+char* Hub_Blob_open(Hub_Client* client, const char* name);
+int Hub_Blob_publish(Hub_Client* client, const char* name, const char* slot, const char* sequence, const char* length);
+void Hub_Blob_closeChannel(Hub_Client* client, const char* name);
+void Hub_Blob_removeClient(Hub_Client* client);
+void Hub_Blob_close(void);
+
+void Hub_Federation_init(void);
+int Hub_Federation_forwardSet(const char* name, const char* value);
+int Hub_Federation_forwardNotification(const char* body);
+void Hub_Federation_addFilter(Notify_FilterType type, const char* filter);
+void Hub_Federation_close(void);
+
 void Hub_Logging_init(void);
 void Hub_Logging_log(short log_level, char* msg);
 void Hub_Logging_logWithName(char* app_name, short log_level, char* msg);
@@ -0,0 +1,76 @@
+/**
+ * \file
+ * \brief Layout of hub traffic capture files
+ */
+
+#ifndef __SEAWOLF_HUB_CAPTURE_INCLUDE_H
+#define __SEAWOLF_HUB_CAPTURE_INCLUDE_H
+
+#include <stdint.h>
+
+/**
+ * Identifies a hub capture file ("SWCP")
+ */
+#define HUB_CAPTURE_MAGIC 0x53574350
+
+/**
+ * Layout version. Version 1 captures have the same layout but include client
+ * passwords.
+ */
+#define HUB_CAPTURE_VERSION 2
+
+/**
+ * Components of a COMM AUTH frame before the password
+ */
+#define HUB_CAPTURE_AUTH "COMM\0AUTH"
+
+/**
+ * \brief Start of a capture file
+ *
+ * The header is followed by records until the end of the file. All fields are
+ * in the byte order of the hub which wrote the capture.
+ */
+typedef struct {
+    /**
+     * HUB_CAPTURE_MAGIC
+     */
+    uint32_t magic;
+
+    /**
+     * HUB_CAPTURE_VERSION
+     */
+    uint32_t version;
+
+    /**
+     * Time the capture started, from Timer_getTimestamp()
+     */
+    int64_t started;
+} Hub_Capture_Header;
+
+/**
+ * \brief A frame received from a client
+ *
+ * Followed by length bytes of the frame exactly as it was received, including
+ * the packed message prefix, except that COMM AUTH frames are recorded with an
+ * empty password so captures can be shared. A record with a length of 0 marks
+ * the client disconnecting. Records are written in the order they are queued, so times
+ * of records from different clients may be very slightly out of order.
+ */
+typedef struct {
+    /**
+     * Nanoseconds from the start of the capture to receiving the frame
+     */
+    int64_t time;
+
+    /**
+     * Client the frame was received from, unique for each connection
+     */
+    uint32_t client;
+
+    /**
+     * Length of the frame
+     */
+    uint32_t length;
+} Hub_Capture_Record;
+
+#endif // #ifndef __SEAWOLF_HUB_CAPTURE_INCLUDE_H
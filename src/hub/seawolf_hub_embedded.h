@@ -0,0 +1,15 @@
+/**
+ * \file
+ * \brief Running the hub inside an application
+ *
+ * Applications linked against libseawolf-hub.a can run a hub in their own
+ * process, see Hub_Embedded_start()
+ */
+
+#ifndef __SEAWOLF_HUB_EMBEDDED_INCLUDE_H
+#define __SEAWOLF_HUB_EMBEDDED_INCLUDE_H
+
+void Hub_Embedded_start(const char* conf_file);
+void Hub_Embedded_stop(void);
+
+#endif // #ifndef __SEAWOLF_HUB_EMBEDDED_INCLUDE_H
@@ -0,0 +1,254 @@
+/**
+ * \file
+ * \brief Layout of the hub statistics shared memory segment
+ */
+
+#ifndef __SEAWOLF_HUB_SHM_INCLUDE_H
+#define __SEAWOLF_HUB_SHM_INCLUDE_H
+
+#include <stdint.h>
+
+/**
+ * Identifies a hub statistics segment ("SWHS")
+ */
+#define HUB_SHM_MAGIC 0x53574853
+
+/**
+ * Layout version. Only incremented when existing fields change, since fields
+ * can be appended to each record with readers using the record sizes given in
+ * the header
+ */
+#define HUB_SHM_VERSION 2
+
+/**
+ * Size of a variable name in the segment, including the terminating null
+ */
+#define HUB_SHM_NAME_LEN 32
+
+/**
+ * \brief Name of the segment published by the hub listening on a port
+ */
+#define HUB_SHM_NAME_FORMAT "/seawolf_hub.%d"
+
+/**
+ * \brief Address a client record
+ */
+#define HUB_SHM_CLIENT(header, i) \
+    ((Hub_Shm_Client*) (((char*) (header)) + (header)->header_size + (i) * (header)->client_size))
+
+/**
+ * \brief Address a variable record
+ */
+#define HUB_SHM_VAR(header, i) \
+    ((Hub_Shm_Var*) (((char*) (header)) + (header)->header_size + (header)->max_clients * (header)->client_size + (i) * (header)->var_size))
+
+/**
+ * Request namespaces for which statistics are kept
+ */
+typedef enum {
+    HUB_STATS_COMM,
+    HUB_STATS_NOTIFY,
+    HUB_STATS_VAR,
+    HUB_STATS_WATCH,
+    HUB_STATS_LOG,
+    HUB_STATS_STATS,
+    HUB_STATS_BLOB,
+
+    /**
+     * Number of namespaces
+     */
+    HUB_STATS_NAMESPACES
+} Hub_Stats_Namespace;
+
+/**
+ * \brief Start of the segment
+ *
+ * The header is followed by max_clients client records and then var_count
+ * variable records. All counters are totals since the hub started. Readers
+ * should copy the segment and retry if sequence was odd or changed while
+ * copying.
+ */
+typedef struct {
+    /**
+     * HUB_SHM_MAGIC
+     */
+    uint32_t magic;
+
+    /**
+     * HUB_SHM_VERSION
+     */
+    uint32_t version;
+
+    /**
+     * Size of the header, which is the offset of the first client record
+     */
+    uint32_t header_size;
+
+    /**
+     * Size of each client record
+     */
+    uint32_t client_size;
+
+    /**
+     * Size of each variable record
+     */
+    uint32_t var_size;
+
+    /**
+     * Number of client records
+     */
+    uint32_t max_clients;
+
+    /**
+     * Number of variable records
+     */
+    uint32_t var_count;
+
+    /**
+     * Incremented before and after each update, so odd during an update
+     */
+    uint32_t sequence;
+
+    /**
+     * Process ID of the hub
+     */
+    int32_t pid;
+
+    /**
+     * Number of client records in use
+     */
+    uint32_t client_count;
+
+    /**
+     * Time the hub started, from Timer_getTimestamp()
+     */
+    int64_t started;
+
+    /**
+     * Time of the last update, from Timer_getTimestamp()
+     */
+    int64_t updated;
+
+    /**
+     * Notifications broadcast
+     */
+    uint64_t notifications;
+
+    /**
+     * Clients whose filters were checked against a notification
+     */
+    uint64_t filter_checks;
+
+    /**
+     * Clients whose filters matched a notification
+     */
+    uint64_t filter_hits;
+
+    /**
+     * Times a thread blocked waiting for the clients list or a client send
+     * lock
+     */
+    uint64_t lock_waits;
+
+    /**
+     * Total nanoseconds spent blocked on those locks
+     */
+    uint64_t lock_wait_ns;
+
+    /**
+     * Requests processed in each namespace
+     */
+    uint64_t requests[HUB_STATS_NAMESPACES];
+
+    /**
+     * Total nanoseconds spent processing requests in each namespace
+     */
+    uint64_t request_ns[HUB_STATS_NAMESPACES];
+
+    /**
+     * 99th percentile request processing time in each namespace
+     */
+    int64_t request_p99[HUB_STATS_NAMESPACES];
+} Hub_Shm_Header;
+
+/**
+ * \brief Counters for a connected client
+ */
+typedef struct {
+    /**
+     * Client socket
+     */
+    int32_t fd;
+
+    /**
+     * Hub_Client_State of the client
+     */
+    uint32_t state;
+
+    /**
+     * Messages received from the client
+     */
+    uint64_t messages_in;
+
+    /**
+     * Bytes received from the client
+     */
+    uint64_t bytes_in;
+
+    /**
+     * Messages sent to the client
+     */
+    uint64_t messages_out;
+
+    /**
+     * Bytes sent to the client
+     */
+    uint64_t bytes_out;
+
+    /**
+     * Messages which could not be sent to the client
+     */
+    uint64_t drops;
+
+    /**
+     * Bytes waiting in the socket send queue, or -1 if unknown
+     */
+    int64_t queued;
+} Hub_Shm_Client;
+
+/**
+ * \brief Counters for a variable
+ */
+typedef struct {
+    /**
+     * Variable name, truncated to fit
+     */
+    char name[HUB_SHM_NAME_LEN];
+
+    /**
+     * Successful sets
+     */
+    uint64_t sets;
+
+    /**
+     * Gets
+     */
+    uint64_t gets;
+
+    /**
+     * WATCH messages sent to subscribers
+     */
+    uint64_t fanout;
+
+    /**
+     * Current number of subscribers
+     */
+    uint32_t subscribers;
+
+    /**
+     * Unused, keeps the record a multiple of 8 bytes
+     */
+    uint32_t reserved;
+} Hub_Shm_Var;
+
+#endif // #ifndef __SEAWOLF_HUB_SHM_INCLUDE_H
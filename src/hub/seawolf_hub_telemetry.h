@@ -0,0 +1,151 @@
+/**
+ * \file
+ * \brief Layout of hub telemetry files
+ */
+
+#ifndef __SEAWOLF_HUB_TELEMETRY_INCLUDE_H
+#define __SEAWOLF_HUB_TELEMETRY_INCLUDE_H
+
+#include <stdint.h>
+
+/**
+ * Identifies a hub telemetry file ("SWTV")
+ */
+#define HUB_TELEMETRY_MAGIC 0x53575456
+
+/**
+ * Layout version
+ */
+#define HUB_TELEMETRY_VERSION 1
+
+/**
+ * Size of a variable name in the file, including the terminating null
+ */
+#define HUB_TELEMETRY_NAME_LEN 64
+
+/**
+ * Samples in each chunk. A multiple of 1024 so chunks are a whole number of
+ * pages
+ */
+#define HUB_TELEMETRY_CHUNK_SAMPLES 65536
+
+/**
+ * \brief Address the timestamp column of a chunk
+ */
+#define HUB_TELEMETRY_TIMES(header, base, i) \
+    ((int64_t*) (((char*) (base)) + (header)->data_offset + (i) * (header)->chunk_size))
+
+/**
+ * \brief Address the value column of a chunk
+ */
+#define HUB_TELEMETRY_VALUES(header, base, i) \
+    ((double*) (HUB_TELEMETRY_TIMES(header, base, i) + (header)->chunk_samples))
+
+/**
+ * \brief Address the variable column of a chunk
+ */
+#define HUB_TELEMETRY_VARS(header, base, i) \
+    ((uint32_t*) (HUB_TELEMETRY_VALUES(header, base, i) + (header)->chunk_samples))
+
+/**
+ * \brief Start of a telemetry file
+ *
+ * The header is followed by var_count names of HUB_TELEMETRY_NAME_LEN bytes at
+ * names_offset, max_chunks index entries at index_offset and chunk_count chunks
+ * of chunk_size bytes from data_offset. Each chunk holds chunk_samples
+ * timestamps, then as many values, then as many variable indexes. All fields
+ * are in the byte order of the hub which wrote the file.
+ */
+typedef struct {
+    /**
+     * HUB_TELEMETRY_MAGIC
+     */
+    uint32_t magic;
+
+    /**
+     * HUB_TELEMETRY_VERSION
+     */
+    uint32_t version;
+
+    /**
+     * Samples in each chunk
+     */
+    uint32_t chunk_samples;
+
+    /**
+     * Number of index entries, the most chunks the file can hold
+     */
+    uint32_t max_chunks;
+
+    /**
+     * Number of variables named
+     */
+    uint32_t var_count;
+
+    /**
+     * Number of chunks started
+     */
+    uint32_t chunk_count;
+
+    /**
+     * Offset of the variable names
+     */
+    uint64_t names_offset;
+
+    /**
+     * Offset of the chunk index
+     */
+    uint64_t index_offset;
+
+    /**
+     * Offset of the first chunk
+     */
+    uint64_t data_offset;
+
+    /**
+     * Size of each chunk
+     */
+    uint64_t chunk_size;
+
+    /**
+     * Time recording started, from Timer_getTimestamp()
+     */
+    int64_t started;
+
+    /**
+     * Wall clock time recording started, in nanoseconds since the epoch
+     */
+    int64_t started_wall;
+
+    /**
+     * Samples not recorded because the file was full
+     */
+    uint64_t dropped;
+} Hub_Telemetry_Header;
+
+/**
+ * \brief Chunk index entry
+ */
+typedef struct {
+    /**
+     * Time of the first sample in the chunk
+     */
+    int64_t first;
+
+    /**
+     * Time of the last sample in the chunk
+     */
+    int64_t last;
+
+    /**
+     * Samples in the chunk. Samples are written before the count is updated
+     */
+    uint32_t count;
+
+    /**
+     * Unused, keeps the entry a multiple of 8 bytes
+     */
+    uint32_t reserved;
+} Hub_Telemetry_Chunk;
+
+#endif // #ifndef __SEAWOLF_HUB_TELEMETRY_INCLUDE_H
@@ -0,0 +1,699 @@
+/**
+ * \file
+ * \brief Hub statistics
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#ifdef __SW_Linux__
+# include <linux/sockios.h>
+#endif
+
+/** Longest total length of the lines returned for one STATS request */
+#define STATS_MAX_LENGTH 60000
+
+/**
+ * Counters kept by each thread which processes requests
+ */
+typedef struct Hub_Stats_Counters_s {
+    /** Successful sets of each variable, indexed by Hub_Var.index */
+    uint64_t* var_sets;
+
+    /** Gets of each variable */
+    uint64_t* var_gets;
+
+    /** WATCH messages sent for each variable */
+    uint64_t* var_fanout;
+
+    /** Notifications broadcast */
+    uint64_t notifications;
+
+    /** Clients whose filters were checked against a notification */
+    uint64_t filter_checks;
+
+    /** Clients whose filters matched a notification */
+    uint64_t filter_hits;
+
+    /** Times the thread blocked on a contended lock */
+    uint64_t lock_waits;
+
+    /** Nanoseconds the thread spent blocked on contended locks */
+    uint64_t lock_wait_ns;
+
+    /** Request processing time for each namespace, allocated when first used */
+    Histogram* latency[HUB_STATS_NAMESPACES];
+
+    /** Next set of counters in the active list */
+    struct Hub_Stats_Counters_s* next;
+} Hub_Stats_Counters;
+
+static Hub_Stats_Counters* Hub_Stats_newCounters(void);
+static void Hub_Stats_mergeCounters(Hub_Stats_Counters* dest, const Hub_Stats_Counters* src);
+static void Hub_Stats_destroyCounters(Hub_Stats_Counters* counters);
+static void Hub_Stats_retireCounters(void* counters);
+static Hub_Stats_Counters* Hub_Stats_getCounters(void);
+static Hub_Stats_Counters* Hub_Stats_collect(void);
+static int Hub_Stats_getQueued(Hub_Client* client);
+static void Hub_Stats_openSegment(void);
+static void Hub_Stats_publish(void);
+static int Hub_Stats_publisher(void);
+static void Hub_Stats_clients(List* lines);
+static void Hub_Stats_vars(List* lines);
+static void Hub_Stats_notify(List* lines);
+static void Hub_Stats_latency(List* lines);
+
+/** Names of the request namespaces, indexed by Hub_Stats_Namespace */
+static const char* namespace_names[HUB_STATS_NAMESPACES] = {"COMM", "NOTIFY", "VAR", "WATCH", "LOG", "STATS", "BLOB"};
+
+/** Key for each thread's counters */
+static pthread_key_t counters_key;
+
+/** Protects the active list and the retired counters */
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Counters of all threads which are still running */
+static Hub_Stats_Counters* active = NULL;
+
+/** Totals of the counters of threads which have exited */
+static Hub_Stats_Counters* retired = NULL;
+
+/** Number of variables, fixed once the variable definitions are read */
+static int var_count = 0;
+
+/** Shared memory segment statistics are published to, or NULL */
+static Hub_Shm_Header* shm = NULL;
+
+/** Size of the shared memory segment */
+static size_t shm_size = 0;
+
+/** Name of the shared memory segment */
+static char* shm_name = NULL;
+
+/** Time between updates of the shared memory segment */
+static struct timespec publish_interval;
+
+/** Task which updates the shared memory segment */
+static Task_Handle publish_handle;
+
+/**
+ * \defgroup HubStats Statistics
+ * \brief Counters for hub introspection
+ *
+ * Statistics are returned in response to a STATS request from a connected
+ * client,
+ *
+ * <pre>
+ * -> STATS <section>
+ * <- STATS <section> <line> ...
+ * </pre>
+ *
+ * where each line is a set of space separated key=value pairs. The sections
+ * are,
+ *  - CLIENTS: messages and bytes in and out, send queue depth and dropped
+ *    messages for each connected client
+ *  - VARS: sets, gets and WATCH fan out for each variable
+ *  - NOTIFY: notifications broadcast and the rate at which client filters
+ *    matched them
+ *  - LATENCY: request processing time in nanoseconds for each namespace, and
+ *    time spent waiting for contended locks
+ *
+ * An unknown section is answered with STATS INVALID.
+ *
+ * Unless the stats_shm option is 0, the hub also publishes its statistics to
+ * a POSIX shared memory segment named /seawolf_hub.<port> every
+ * stats_interval seconds, with the layout given in seawolf_hub_shm.h. The
+ * segment can be read by monitors such as swtop without sending the hub any
+ * requests. It is created readable by all users but only writable by the hub.
+ *
+ * If the trace option is set, trace events are recorded by the hub threads and
+ * written as Chrome trace JSON to trace_file when the hub is sent SIGUSR2.
+ *
+ * Client counters are only written by the thread receiving from the client
+ * or while holding the client's send lock, which is held anyway. Everything
+ * else is counted in counters private to each thread, so recording takes no
+ * locks and a STATS request only locks out threads which are starting or
+ * exiting while it sums them.
+ *
+ * \{
+ */
+
+/**
+ * \brief Allocate zeroed counters
+ * \private
+ */
+static Hub_Stats_Counters* Hub_Stats_newCounters(void) {
+    Hub_Stats_Counters* counters = calloc(1, sizeof(Hub_Stats_Counters));
+
+    /* calloc(0) may return NULL, so allocate at least one element */
+    counters->var_sets = calloc(var_count + 1, sizeof(uint64_t));
+    counters->var_gets = calloc(var_count + 1, sizeof(uint64_t));
+    counters->var_fanout = calloc(var_count + 1, sizeof(uint64_t));
+
+    return counters;
+}
+
+/**
+ * \brief Add one set of counters to another
+ * \private
+ */
+static void Hub_Stats_mergeCounters(Hub_Stats_Counters* dest, const Hub_Stats_Counters* src) {
+    for(int i = 0; i < var_count; i++) {
+        dest->var_sets[i] += src->var_sets[i];
+        dest->var_gets[i] += src->var_gets[i];
+        dest->var_fanout[i] += src->var_fanout[i];
+    }
+
+    dest->notifications += src->notifications;
+    dest->filter_checks += src->filter_checks;
+    dest->filter_hits += src->filter_hits;
+    dest->lock_waits += src->lock_waits;
+    dest->lock_wait_ns += src->lock_wait_ns;
+
+    for(int i = 0; i < HUB_STATS_NAMESPACES; i++) {
+        if(src->latency[i] != NULL) {
+            if(dest->latency[i] == NULL) {
+                dest->latency[i] = Histogram_new();
+            }
+            Histogram_merge(dest->latency[i], src->latency[i]);
+        }
+    }
+}
+
+/**
+ * \brief Free counters
+ * \private
+ */
+static void Hub_Stats_destroyCounters(Hub_Stats_Counters* counters) {
+    for(int i = 0; i < HUB_STATS_NAMESPACES; i++) {
+        if(counters->latency[i] != NULL) {
+            Histogram_destroy(counters->latency[i]);
+        }
+    }
+
+    free(counters->var_sets);
+    free(counters->var_gets);
+    free(counters->var_fanout);
+    free(counters);
+}
+
+/**
+ * \brief Fold the counters of an exiting thread into the retired totals
+ * \private
+ *
+ * Called by pthreads when a thread with counters exits
+ *
+ * \param counters The thread's counters
+ */
+static void Hub_Stats_retireCounters(void* counters) {
+    Hub_Stats_Counters** prev;
+
+    pthread_mutex_lock(&counters_lock);
+    for(prev = &active; *prev != NULL; prev = &(*prev)->next) {
+        if(*prev == counters) {
+            *prev = (*prev)->next;
+            break;
+        }
+    }
+    Hub_Stats_mergeCounters(retired, counters);
+    pthread_mutex_unlock(&counters_lock);
+
+    Hub_Stats_destroyCounters(counters);
+}
+
+/**
+ * \brief Get the counters of the calling thread
+ * \private
+ *
+ * \return The thread's counters, created on first use
+ */
+static Hub_Stats_Counters* Hub_Stats_getCounters(void) {
+    Hub_Stats_Counters* counters = pthread_getspecific(counters_key);
+
+    if(counters == NULL) {
+        counters = Hub_Stats_newCounters();
+        pthread_setspecific(counters_key, counters);
+
+        pthread_mutex_lock(&counters_lock);
+        counters->next = active;
+        active = counters;
+        pthread_mutex_unlock(&counters_lock);
+    }
+
+    return counters;
+}
+
+/**
+ * \brief Sum the counters of all threads
+ * \private
+ *
+ * Counters still being written by other threads are read without
+ * synchronization, so a total may miss updates made while it is collected
+ *
+ * \return Totals which should be freed with Hub_Stats_destroyCounters()
+ */
+static Hub_Stats_Counters* Hub_Stats_collect(void) {
+    Hub_Stats_Counters* total = Hub_Stats_newCounters();
+
+    pthread_mutex_lock(&counters_lock);
+    Hub_Stats_mergeCounters(total, retired);
+    for(Hub_Stats_Counters* counters = active; counters != NULL; counters = counters->next) {
+        Hub_Stats_mergeCounters(total, counters);
+    }
+    pthread_mutex_unlock(&counters_lock);
+
+    return total;
+}
+
+/**
+ * \brief Get the number of bytes sent to a client but not yet acknowledged
+ * \private
+ *
+ * \return The number of bytes, or -1 if unknown
+ */
+static int Hub_Stats_getQueued(Hub_Client* client) {
+    int queued = -1;
+
+#ifdef __SW_Linux__
+    if(ioctl(client->sock, SIOCOUTQ, &queued) != 0) {
+        queued = -1;
+    }
+#endif
+
+    return queued;
+}
+
+/**
+ * \brief Describe each connected client
+ * \private
+ */
+static void Hub_Stats_clients(List* lines) {
+    List* clients = Hub_Net_getClients();
+    Hub_Client* client;
+
+    Hub_Net_acquireGlobalClientsLock();
+    for(int i = 0; (client = List_get(clients, i)) != NULL; i++) {
+        if(client->state == CLOSED) {
+            continue;
+        }
+
+        List_append(lines, strdup(Util_format("fd=%d state=%s msgs_in=%llu bytes_in=%llu msgs_out=%llu bytes_out=%llu queued=%d drops=%llu",
+                                              client->sock,
+                                              (client->state == CONNECTED) ? "CONNECTED" : "UNAUTHENTICATED",
+                                              (unsigned long long) client->messages_in,
+                                              (unsigned long long) client->bytes_in,
+                                              (unsigned long long) client->messages_out,
+                                              (unsigned long long) client->bytes_out,
+                                              Hub_Stats_getQueued(client),
+                                              (unsigned long long) client->drops)));
+    }
+    Hub_Net_releaseGlobalClientsLock();
+}
+
+/**
+ * \brief Describe each variable which has been used
+ * \private
+ */
+static void Hub_Stats_vars(List* lines) {
+    Hub_Stats_Counters* total = Hub_Stats_collect();
+
+    for(int i = 0; i < var_count; i++) {
+        if(total->var_sets[i] || total->var_gets[i]) {
+            List_append(lines, strdup(Util_format("var=%s sets=%llu gets=%llu fanout=%llu",
+                                                  Hub_Var_getByIndex(i)->name,
+                                                  (unsigned long long) total->var_sets[i],
+                                                  (unsigned long long) total->var_gets[i],
+                                                  (unsigned long long) total->var_fanout[i])));
+        }
+    }
+
+    Hub_Stats_destroyCounters(total);
+}
+
+/**
+ * \brief Describe notification filtering
+ * \private
+ */
+static void Hub_Stats_notify(List* lines) {
+    Hub_Stats_Counters* total = Hub_Stats_collect();
+
+    List_append(lines, strdup(Util_format("notifications=%llu filter_checks=%llu filter_hits=%llu hit_rate=%.4f",
+                                          (unsigned long long) total->notifications,
+                                          (unsigned long long) total->filter_checks,
+                                          (unsigned long long) total->filter_hits,
+                                          total->filter_checks ? ((double) total->filter_hits) / total->filter_checks : 0.0)));
+
+    Hub_Stats_destroyCounters(total);
+}
+
+/**
+ * \brief Describe request processing time for each namespace
+ * \private
+ */
+static void Hub_Stats_latency(List* lines) {
+    Hub_Stats_Counters* total = Hub_Stats_collect();
+    Histogram* latency;
+
+    for(int i = 0; i < HUB_STATS_NAMESPACES; i++) {
+        latency = total->latency[i];
+        if(latency == NULL) {
+            continue;
+        }
+
+        List_append(lines, strdup(Util_format("namespace=%s count=%llu min=%lld mean=%.0f p50=%lld p90=%lld p99=%lld p999=%lld max=%lld",
+                                              namespace_names[i],
+                                              (unsigned long long) Histogram_getCount(latency),
+                                              (long long) Histogram_getMin(latency),
+                                              Histogram_getMean(latency),
+                                              (long long) Histogram_getPercentile(latency, 50),
+                                              (long long) Histogram_getPercentile(latency, 90),
+                                              (long long) Histogram_getPercentile(latency, 99),
+                                              (long long) Histogram_getPercentile(latency, 99.9),
+                                              (long long) Histogram_getMax(latency))));
+    }
+
+    List_append(lines, strdup(Util_format("lock_waits=%llu lock_wait_ns=%llu",
+                                          (unsigned long long) total->lock_waits,
+                                          (unsigned long long) total->lock_wait_ns)));
+
+    Hub_Stats_destroyCounters(total);
+}
+
+/**
+ * \brief Create the shared memory segment
+ * \private
+ */
+static void Hub_Stats_openSegment(void) {
+    Hub_Shm_Var* record;
+    int fd;
+
+    shm_name = strdup(Util_format(HUB_SHM_NAME_FORMAT, atoi(Hub_Config_getOption("bind_port"))));
+    shm_size = sizeof(Hub_Shm_Header) + MAX_CLIENTS * sizeof(Hub_Shm_Client) + var_count * sizeof(Hub_Shm_Var);
+
+    fd = shm_open(shm_name, O_RDWR | O_CREAT, 0644);
+    if(fd == -1) {
+        Hub_Logging_log(ERROR, Util_format("Unable to create statistics segment %s: %s", shm_name, strerror(errno)));
+        free(shm_name);
+        shm_name = NULL;
+        return;
+    }
+
+    if(ftruncate(fd, shm_size) == 0) {
+        shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if(shm == NULL || shm == MAP_FAILED) {
+        Hub_Logging_log(ERROR, Util_format("Unable to map statistics segment %s: %s", shm_name, strerror(errno)));
+        shm_unlink(shm_name);
+        free(shm_name);
+        shm_name = NULL;
+        shm = NULL;
+        return;
+    }
+
+    /* The segment may be left over from a hub which did not exit cleanly */
+    memset(shm, 0, shm_size);
+
+    shm->magic = HUB_SHM_MAGIC;
+    shm->version = HUB_SHM_VERSION;
+    shm->header_size = sizeof(Hub_Shm_Header);
+    shm->client_size = sizeof(Hub_Shm_Client);
+    shm->var_size = sizeof(Hub_Shm_Var);
+    shm->max_clients = MAX_CLIENTS;
+    shm->var_count = var_count;
+    shm->pid = getpid();
+    shm->started = Timer_getTimestamp();
+
+    for(int i = 0; i < var_count; i++) {
+        record = HUB_SHM_VAR(shm, i);
+        strncpy(record->name, Hub_Var_getByIndex(i)->name, HUB_SHM_NAME_LEN - 1);
+    }
+}
+
+/**
+ * \brief Update the shared memory segment
+ * \private
+ */
+static void Hub_Stats_publish(void) {
+    Hub_Stats_Counters* total = Hub_Stats_collect();
+    List* clients = Hub_Net_getClients();
+    Hub_Shm_Client* client_record;
+    Hub_Shm_Var* var_record;
+    Hub_Client* client;
+    Histogram* latency;
+    uint32_t n = 0;
+
+    /* Readers retry while the sequence is odd */
+    __sync_add_and_fetch(&shm->sequence, 1);
+
+    shm->updated = Timer_getTimestamp();
+    shm->notifications = total->notifications;
+    shm->filter_checks = total->filter_checks;
+    shm->filter_hits = total->filter_hits;
+    shm->lock_waits = total->lock_waits;
+    shm->lock_wait_ns = total->lock_wait_ns;
+
+    for(int i = 0; i < HUB_STATS_NAMESPACES; i++) {
+        latency = total->latency[i];
+        if(latency != NULL) {
+            shm->requests[i] = Histogram_getCount(latency);
+            shm->request_ns[i] = (uint64_t) (Histogram_getMean(latency) * Histogram_getCount(latency));
+            shm->request_p99[i] = Histogram_getPercentile(latency, 99);
+        }
+    }
+
+    for(int i = 0; i < var_count; i++) {
+        var_record = HUB_SHM_VAR(shm, i);
+        var_record->sets = total->var_sets[i];
+        var_record->gets = total->var_gets[i];
+        var_record->fanout = total->var_fanout[i];
+        var_record->subscribers = List_getSize(Hub_Var_getByIndex(i)->subscribers);
+    }
+
+    Hub_Net_acquireGlobalClientsLock();
+    for(int i = 0; (client = List_get(clients, i)) != NULL && n < MAX_CLIENTS; i++) {
+        if(client->state == CLOSED) {
+            continue;
+        }
+
+        client_record = HUB_SHM_CLIENT(shm, n++);
+        client_record->fd = client->sock;
+        client_record->state = client->state;
+        client_record->messages_in = client->messages_in;
+        client_record->bytes_in = client->bytes_in;
+        client_record->messages_out = client->messages_out;
+        client_record->bytes_out = client->bytes_out;
+        client_record->drops = client->drops;
+        client_record->queued = Hub_Stats_getQueued(client);
+    }
+    Hub_Net_releaseGlobalClientsLock();
+    shm->client_count = n;
+
+    __sync_add_and_fetch(&shm->sequence, 1);
+
+    Hub_Stats_destroyCounters(total);
+}
+
+/**
+ * \brief Periodically update the shared memory segment
+ * \private
+ *
+ * \return Does not return. This task is killed in Hub_Stats_close
+ */
+static int Hub_Stats_publisher(void) {
+    while(true) {
+        /* Only allow the task to be killed between updates */
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        Hub_Stats_publish();
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+
+        nanosleep(&publish_interval, NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Initialize statistics
+ *
+ * Must be called after Hub_Var_init() and Hub_Net_init(), and before any
+ * requests are processed
+ */
+void Hub_Stats_init(void) {
+    double interval = atof(Hub_Config_getOption("stats_interval"));
+
+    var_count = Hub_Var_getCount();
+    retired = Hub_Stats_newCounters();
+    pthread_key_create(&counters_key, Hub_Stats_retireCounters);
+
+    if(Config_truth(Hub_Config_getOption("trace"))) {
+        if(strlen(Hub_Config_getOption("trace_file"))) {
+            Trace_setFile(Hub_Config_getOption("trace_file"));
+        }
+        Trace_setEnabled(true);
+        Trace_setLogger(Hub_Logging_log);
+        Trace_init();
+    }
+
+    if(atoi(Hub_Config_getOption("stats_shm")) == 0) {
+        return;
+    }
+
+    if(interval <= 0) {
+        Hub_Logging_log(ERROR, "stats_interval must be positive, using 1 second");
+        interval = 1;
+    }
+    publish_interval.tv_sec = (time_t) interval;
+    publish_interval.tv_nsec = (long) ((interval - publish_interval.tv_sec) * 1e9);
+
+    Hub_Stats_openSegment();
+    if(shm != NULL) {
+        publish_handle = Task_background(Hub_Stats_publisher);
+    }
+}
+
+/**
+ * \brief Count a successful variable set
+ *
+ * \param var The variable set
+ * \param fanout Number of subscribers sent the new value
+ */
+void Hub_Stats_countVarSet(Hub_Var* var, int fanout) {
+    Hub_Stats_Counters* counters = Hub_Stats_getCounters();
+
+    counters->var_sets[var->index]++;
+    counters->var_fanout[var->index] += fanout;
+}
+
+/**
+ * \brief Count a variable get
+ *
+ * \param var The variable read
+ */
+void Hub_Stats_countVarGet(Hub_Var* var) {
+    Hub_Stats_getCounters()->var_gets[var->index]++;
+}
+
+/**
+ * \brief Count a notification broadcast
+ *
+ * \param checked Number of clients whose filters were checked
+ * \param matched Number of clients whose filters matched
+ */
+void Hub_Stats_countNotification(int checked, int matched) {
+    Hub_Stats_Counters* counters = Hub_Stats_getCounters();
+
+    counters->notifications++;
+    counters->filter_checks += checked;
+    counters->filter_hits += matched;
+}
+
+/**
+ * \brief Count time spent blocked on a contended lock
+ *
+ * \param ns Nanoseconds spent waiting for the lock
+ */
+void Hub_Stats_countLockWait(int64_t ns) {
+    Hub_Stats_Counters* counters = Hub_Stats_getCounters();
+
+    counters->lock_waits++;
+    counters->lock_wait_ns += ns;
+}
+
+/**
+ * \brief Record the time taken to process a request
+ *
+ * \param namespace Namespace of the request
+ * \param ns Processing time in nanoseconds
+ */
+void Hub_Stats_recordRequest(Hub_Stats_Namespace namespace, int64_t ns) {
+    Hub_Stats_Counters* counters = Hub_Stats_getCounters();
+
+    if(counters->latency[namespace] == NULL) {
+        /* Allocate under the lock since a STATS request may be reading it */
+        pthread_mutex_lock(&counters_lock);
+        counters->latency[namespace] = Histogram_new();
+        pthread_mutex_unlock(&counters_lock);
+    }
+
+    Histogram_record(counters->latency[namespace], ns);
+}
+
+/**
+ * \brief Build the response to a STATS request
+ *
+ * \param section The requested section
+ * \param request_id Request ID to respond with
+ * \return A new message, or NULL if the section is unknown
+ */
+Comm_Message* Hub_Stats_getMessage(const char* section, uint16_t request_id) {
+    Comm_Message* message;
+    List* lines = List_new();
+    char* line;
+    size_t length = 0;
+    int count;
+
+    if(strcmp(section, "CLIENTS") == 0) {
+        Hub_Stats_clients(lines);
+    } else if(strcmp(section, "VARS") == 0) {
+        Hub_Stats_vars(lines);
+    } else if(strcmp(section, "NOTIFY") == 0) {
+        Hub_Stats_notify(lines);
+    } else if(strcmp(section, "LATENCY") == 0) {
+        Hub_Stats_latency(lines);
+    } else {
+        List_destroy(lines);
+        return NULL;
+    }
+
+    /* Drop lines which would not fit in a single message */
+    for(count = 0; count < List_getSize(lines); count++) {
+        length += strlen(List_get(lines, count)) + 1;
+        if(length > STATS_MAX_LENGTH) {
+            break;
+        }
+    }
+
+    message = Comm_Message_new(2 + count);
+    message->request_id = request_id;
+    message->components[0] = MemPool_strdup(message->alloc, "STATS");
+    message->components[1] = MemPool_strdup(message->alloc, section);
+
+    for(int i = 0; (line = List_get(lines, i)) != NULL; i++) {
+        if(i < count) {
+            message->components[2 + i] = MemPool_strdup(message->alloc, line);
+        }
+        free(line);
+    }
+    List_destroy(lines);
+
+    return message;
+}
+
+/**
+ * \brief Stop publishing statistics
+ *
+ * Stops updating the shared memory segment and removes it, and stops catching
+ * the trace signal. Counters are left in place since client threads may still
+ * be running.
+ */
+void Hub_Stats_close(void) {
+    Trace_close();
+
+    if(shm != NULL) {
+        Task_kill(publish_handle);
+        munmap(shm, shm_size);
+        shm_unlink(shm_name);
+        free(shm_name);
+        shm = NULL;
+    }
+}
+
+/** \} */
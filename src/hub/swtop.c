@@ -0,0 +1,434 @@
+/**
+ * \file
+ * \brief Live hub monitor
+ *
+ * Displays request, message and variable rates for a running hub, in the
+ * manner of top. The hub publishes its counters to a shared memory segment
+ * (see seawolf_hub_shm.h) which is only read here, so monitoring adds no load
+ * to the hub or its clients.
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub_shm.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Times to retry copying a segment which is being updated
+ */
+#define READ_RETRIES 100
+
+/**
+ * Monitor options
+ */
+typedef struct {
+    /** Name of the segment to read */
+    char* name;
+
+    /** Seconds between refreshes */
+    double delay;
+
+    /** Number of refreshes, or 0 to run until interrupted */
+    unsigned long iterations;
+
+    /** Number of variables to list */
+    int top_vars;
+
+    /** Append each refresh instead of redrawing the screen */
+    bool batch;
+} MonitorOptions;
+
+/**
+ * A copy of the segment
+ */
+typedef struct {
+    /** The copied segment */
+    Hub_Shm_Header* header;
+
+    /** Size of the copy */
+    size_t size;
+} Snapshot;
+
+static Snapshot* read_snapshot(const char* name);
+static void destroy_snapshot(Snapshot* snapshot);
+static double rate(uint64_t now, uint64_t before, double seconds);
+static Hub_Shm_Client* find_client(Snapshot* snapshot, const Hub_Shm_Client* client);
+static void display_requests(Snapshot* now, Snapshot* before, double seconds);
+static void display_clients(Snapshot* now, Snapshot* before, double seconds);
+static void display_vars(Snapshot* now, Snapshot* before, double seconds, int top_vars);
+static void display(const MonitorOptions* options, Snapshot* now, Snapshot* before);
+static void usage(char* arg0);
+
+/** Names of the request namespaces, indexed by Hub_Stats_Namespace */
+static const char* namespace_names[HUB_STATS_NAMESPACES] = {"COMM", "NOTIFY", "VAR", "WATCH", "LOG", "STATS", "BLOB"};
+
+/** Names of the client states */
+static const char* state_names[] = {"UNKNOWN", "UNAUTH", "CONNECTED", "CLOSED"};
+
+/**
+ * \brief Copy a consistent snapshot of a segment
+ *
+ * \param name Name of the segment
+ * \return A new snapshot, or NULL if the segment could not be read
+ */
+static Snapshot* read_snapshot(const char* name) {
+    Snapshot* snapshot;
+    Hub_Shm_Header* shared;
+    Hub_Shm_Header* header;
+    struct stat st;
+    uint32_t sequence;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if(fd == -1) {
+        return NULL;
+    }
+
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Hub_Shm_Header)) {
+        close(fd);
+        return NULL;
+    }
+
+    shared = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shared == MAP_FAILED) {
+        return NULL;
+    }
+
+    snapshot = malloc(sizeof(Snapshot));
+    snapshot->size = st.st_size;
+    snapshot->header = malloc(snapshot->size);
+    header = snapshot->header;
+
+    /* Copy until a copy is made without the hub updating the segment */
+    for(int i = 0; i < READ_RETRIES; i++) {
+        sequence = shared->sequence;
+        if(sequence % 2 == 0) {
+            __sync_synchronize();
+            memcpy(header, shared, snapshot->size);
+            __sync_synchronize();
+
+            if(shared->sequence == sequence) {
+                break;
+            }
+        }
+
+        header->magic = 0;
+        Util_usleep(0.001);
+    }
+    munmap(shared, snapshot->size);
+
+    if(header->magic != HUB_SHM_MAGIC || header->version != HUB_SHM_VERSION ||
+       header->header_size < sizeof(Hub_Shm_Header) ||
+       header->client_size < sizeof(Hub_Shm_Client) ||
+       header->var_size < sizeof(Hub_Shm_Var) ||
+       header->client_count > header->max_clients ||
+       header->header_size + (size_t) header->max_clients * header->client_size +
+       (size_t) header->var_count * header->var_size > snapshot->size) {
+        destroy_snapshot(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+static void destroy_snapshot(Snapshot* snapshot) {
+    if(snapshot != NULL) {
+        free(snapshot->header);
+        free(snapshot);
+    }
+}
+
+/**
+ * \brief Rate of change of a counter
+ */
+static double rate(uint64_t now, uint64_t before, double seconds) {
+    if(seconds <= 0 || now < before) {
+        return 0;
+    }
+    return (now - before) / seconds;
+}
+
+/**
+ * \brief Find the record for the same client in an earlier snapshot
+ *
+ * \return The record, or NULL if the client is new
+ */
+static Hub_Shm_Client* find_client(Snapshot* snapshot, const Hub_Shm_Client* client) {
+    Hub_Shm_Client* other;
+
+    if(snapshot == NULL) {
+        return NULL;
+    }
+
+    for(uint32_t i = 0; i < snapshot->header->client_count; i++) {
+        other = HUB_SHM_CLIENT(snapshot->header, i);
+
+        /* A reused descriptor has counters which went backwards */
+        if(other->fd == client->fd && other->messages_in <= client->messages_in &&
+           other->messages_out <= client->messages_out) {
+            return other;
+        }
+    }
+
+    return NULL;
+}
+
+static void display_requests(Snapshot* now, Snapshot* before, double seconds) {
+    Hub_Shm_Header* h = now->header;
+    Hub_Shm_Header* b = before ? before->header : NULL;
+    uint64_t requests, request_ns;
+    uint64_t waits, wait_ns;
+    uint64_t checks, hits;
+
+    printf("%-10s %10s %10s %10s\n", "REQUESTS", "/s", "MEAN_US", "P99_US");
+    for(int i = 0; i < HUB_STATS_NAMESPACES; i++) {
+        requests = h->requests[i] - (b ? b->requests[i] : 0);
+        request_ns = h->request_ns[i] - (b ? b->request_ns[i] : 0);
+
+        printf("%-10s %10.1f %10.2f %10.2f\n", namespace_names[i],
+               rate(h->requests[i], b ? b->requests[i] : 0, seconds),
+               requests ? request_ns / 1e3 / requests : 0.0,
+               h->request_p99[i] / 1e3);
+    }
+
+    checks = h->filter_checks - (b ? b->filter_checks : 0);
+    hits = h->filter_hits - (b ? b->filter_hits : 0);
+    printf("\nNotifications %.1f/s, filter hit rate %.1f%%\n",
+           rate(h->notifications, b ? b->notifications : 0, seconds),
+           checks ? 100.0 * hits / checks : 0.0);
+
+    waits = h->lock_waits - (b ? b->lock_waits : 0);
+    wait_ns = h->lock_wait_ns - (b ? b->lock_wait_ns : 0);
+    printf("Lock waits %.1f/s, mean wait %.2f us\n\n",
+           rate(h->lock_waits, b ? b->lock_waits : 0, seconds),
+           waits ? wait_ns / 1e3 / waits : 0.0);
+}
+
+static void display_clients(Snapshot* now, Snapshot* before, double seconds) {
+    Hub_Shm_Client* client;
+    Hub_Shm_Client* previous;
+    Hub_Shm_Client none = {0};
+
+    printf("%6s %-10s %10s %10s %10s %10s %10s %8s\n",
+           "FD", "STATE", "IN/s", "OUT/s", "KB_IN/s", "KB_OUT/s", "QUEUED", "DROPS");
+
+    for(uint32_t i = 0; i < now->header->client_count; i++) {
+        client = HUB_SHM_CLIENT(now->header, i);
+        previous = find_client(before, client);
+        if(previous == NULL) {
+            previous = &none;
+        }
+
+        printf("%6d %-10s %10.1f %10.1f %10.2f %10.2f %10lld %8llu\n",
+               client->fd,
+               client->state < 4 ? state_names[client->state] : "?",
+               rate(client->messages_in, previous->messages_in, seconds),
+               rate(client->messages_out, previous->messages_out, seconds),
+               rate(client->bytes_in, previous->bytes_in, seconds) / 1024,
+               rate(client->bytes_out, previous->bytes_out, seconds) / 1024,
+               (long long) client->queued,
+               (unsigned long long) client->drops);
+    }
+    printf("\n");
+}
+
+static void display_vars(Snapshot* now, Snapshot* before, double seconds, int top_vars) {
+    Hub_Shm_Header* h = now->header;
+    Hub_Shm_Var* var;
+    Hub_Shm_Var* previous;
+    Hub_Shm_Var none = {{0}};
+    uint32_t* order;
+    double* activity;
+    uint32_t swap;
+    int shown = 0;
+
+    /* Variables are only comparable between snapshots of the same hub */
+    if(before != NULL && before->header->var_count != h->var_count) {
+        before = NULL;
+    }
+
+    order = malloc(sizeof(uint32_t) * (h->var_count + 1));
+    activity = malloc(sizeof(double) * (h->var_count + 1));
+
+    for(uint32_t i = 0; i < h->var_count; i++) {
+        var = HUB_SHM_VAR(h, i);
+        previous = before ? HUB_SHM_VAR(before->header, i) : &none;
+
+        order[i] = i;
+        activity[i] = rate(var->sets, previous->sets, seconds) + rate(var->gets, previous->gets, seconds);
+    }
+
+    /* Partial selection sort for the busiest variables */
+    for(uint32_t i = 0; i < h->var_count && (int) i < top_vars; i++) {
+        for(uint32_t j = i + 1; j < h->var_count; j++) {
+            if(activity[order[j]] > activity[order[i]]) {
+                swap = order[i];
+                order[i] = order[j];
+                order[j] = swap;
+            }
+        }
+    }
+
+    printf("%-32s %10s %10s %10s %6s\n", "VARIABLE", "SETS/s", "GETS/s", "FANOUT/s", "SUBS");
+    for(uint32_t i = 0; i < h->var_count && shown < top_vars; i++) {
+        if(activity[order[i]] == 0 && shown > 0) {
+            break;
+        }
+
+        var = HUB_SHM_VAR(h, order[i]);
+        previous = before ? HUB_SHM_VAR(before->header, order[i]) : &none;
+
+        printf("%-32.*s %10.1f %10.1f %10.1f %6u\n", HUB_SHM_NAME_LEN, var->name,
+               rate(var->sets, previous->sets, seconds),
+               rate(var->gets, previous->gets, seconds),
+               rate(var->fanout, previous->fanout, seconds),
+               var->subscribers);
+        shown++;
+    }
+
+    free(order);
+    free(activity);
+}
+
+/**
+ * \brief Display one refresh
+ *
+ * \param options Monitor options
+ * \param now The latest snapshot
+ * \param before An earlier snapshot of the same hub, or NULL to give averages
+ *   since the hub started
+ */
+static void display(const MonitorOptions* options, Snapshot* now, Snapshot* before) {
+    Hub_Shm_Header* h = now->header;
+    int64_t uptime = (h->updated - h->started) / 1000000000;
+    double seconds;
+
+    if(before != NULL) {
+        seconds = (h->updated - before->header->updated) / 1e9;
+    } else {
+        seconds = (h->updated - h->started) / 1e9;
+    }
+
+    if(!options->batch) {
+        /* Clear the screen and return to the top left corner */
+        printf("\033[H\033[2J");
+    }
+
+    printf("hub pid %d, up %lld:%02lld:%02lld, %u clients, %s over %.1f s\n\n",
+           h->pid, (long long) (uptime / 3600), (long long) (uptime / 60 % 60), (long long) (uptime % 60),
+           h->client_count, before ? "rates" : "averages since start", seconds);
+
+    display_requests(now, before, seconds);
+    display_clients(now, before, seconds);
+    display_vars(now, before, seconds, options->top_vars);
+
+    printf("\n");
+    fflush(stdout);
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-b] [-p port | -s name] [-d delay] [-n iterations] [-v vars]\n", arg0);
+    printf("  -p port        Monitor the hub listening on port (default 31427)\n");
+    printf("  -s name        Read the named shared memory segment instead\n");
+    printf("  -d delay       Seconds between refreshes (default 1)\n");
+    printf("  -n iterations  Exit after this many refreshes (default 0, never)\n");
+    printf("  -v vars        Number of variables to list (default 10)\n");
+    printf("  -b             Batch mode, print refreshes one after another\n");
+}
+
+int main(int argc, char** argv) {
+    MonitorOptions options = {.name = NULL, .delay = 1, .iterations = 0, .top_vars = 10, .batch = false};
+    Snapshot* now = NULL;
+    Snapshot* before = NULL;
+    Snapshot* latest;
+    int port = 31427;
+    int opt;
+
+    while((opt = getopt(argc, argv, ":hbp:s:d:n:v:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'b':
+            options.batch = true;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 's':
+            options.name = optarg;
+            break;
+        case 'd':
+            options.delay = atof(optarg);
+            break;
+        case 'n':
+            options.iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 'v':
+            options.top_vars = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(options.name == NULL) {
+        options.name = strdup(Util_format(HUB_SHM_NAME_FORMAT, port));
+    }
+    options.delay = (options.delay <= 0) ? 1 : options.delay;
+
+    for(unsigned long n = 0; options.iterations == 0 || n < options.iterations; n++) {
+        if(n > 0) {
+            Util_usleep(options.delay);
+        }
+
+        latest = read_snapshot(options.name);
+        if(latest == NULL) {
+            /* The hub may not have started yet, or may be restarting */
+            printf("Unable to read hub statistics from %s\n", options.name);
+            fflush(stdout);
+            destroy_snapshot(now);
+            destroy_snapshot(before);
+            now = before = NULL;
+            continue;
+        }
+
+        if(kill(latest->header->pid, 0) == -1 && errno == ESRCH) {
+            /* Left behind by a hub which did not exit cleanly */
+            printf("Hub pid %d which published %s is not running\n", latest->header->pid, options.name);
+            fflush(stdout);
+            destroy_snapshot(latest);
+            continue;
+        }
+
+        if(now != NULL && (latest->header->pid != now->header->pid ||
+                           latest->header->started != now->header->started)) {
+            /* The hub restarted */
+            destroy_snapshot(now);
+            destroy_snapshot(before);
+            now = before = NULL;
+        }
+
+        if(now == NULL || latest->header->updated != now->header->updated) {
+            destroy_snapshot(before);
+            before = now;
+            now = latest;
+        } else {
+            /* Not updated since the last refresh, keep the last interval */
+            destroy_snapshot(latest);
+        }
+
+        display(&options, now, before);
+    }
+
+    destroy_snapshot(now);
+    destroy_snapshot(before);
+
+    return 0;
+}
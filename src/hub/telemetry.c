@@ -0,0 +1,253 @@
+/**
+ * \file
+ * \brief Telemetry recorder
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub.h"
+#include "seawolf_hub_telemetry.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static int Hub_Telemetry_openChunk(void);
+
+/** The telemetry file */
+static int telemetry_fd = -1;
+
+/** Mapping of the header, variable names and chunk index */
+static Hub_Telemetry_Header* header = NULL;
+
+/** Size of the header mapping */
+static size_t header_size;
+
+/** The chunk index, within the header mapping */
+static Hub_Telemetry_Chunk* chunk_index;
+
+/** Mapping of the chunk being filled */
+static void* chunk = NULL;
+
+/** Columns of the chunk being filled */
+static int64_t* chunk_times;
+static double* chunk_values;
+static uint32_t* chunk_vars;
+
+/** Samples in the chunk being filled */
+static uint32_t chunk_fill = 0;
+
+/** Set once the file can hold no more samples */
+static bool full = false;
+
+/** Samples are only recorded while true */
+static bool recording = false;
+
+/** Serializes appends */
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \defgroup HubTelemetry Telemetry
+ * \brief Records every variable update to a columnar file
+ * \{
+ */
+
+/**
+ * \brief Initialize the telemetry recorder
+ *
+ * If the telemetry_file option is set, every variable update is appended to it
+ * in the format given in seawolf_hub_telemetry.h. The file is written through
+ * shared memory mappings, one chunk at a time, so recording a sample costs a
+ * few stores and the kernel writes the pages out in the background. The file
+ * is never grown past telemetry_max_size megabytes, after which samples are
+ * counted as dropped. Must be called after Hub_Var_init().
+ */
+void Hub_Telemetry_init(void) {
+    const char* path = Hub_Config_getOption("telemetry_file");
+    uint32_t var_count = Hub_Var_getCount();
+    uint64_t max_size = strtoull(Hub_Config_getOption("telemetry_max_size"), NULL, 10) * 1024 * 1024;
+    uint64_t chunk_size = HUB_TELEMETRY_CHUNK_SAMPLES * (sizeof(int64_t) + sizeof(double) + sizeof(uint32_t));
+    uint32_t max_chunks = max_size / chunk_size;
+    long page_size = sysconf(_SC_PAGESIZE);
+    char* names;
+    struct timespec now;
+    uint32_t i;
+
+    if(strlen(path) == 0) {
+        return;
+    }
+
+    if(max_chunks == 0) {
+        max_chunks = 1;
+    }
+
+    telemetry_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(telemetry_fd == -1) {
+        Hub_Logging_log(ERROR, Util_format("Unable to open telemetry file %s: %s", path, strerror(errno)));
+        return;
+    }
+
+    /* Chunks are mapped individually so must start on a page boundary */
+    header_size = sizeof(Hub_Telemetry_Header) + var_count * HUB_TELEMETRY_NAME_LEN +
+                  max_chunks * sizeof(Hub_Telemetry_Chunk);
+    header_size = (header_size + page_size - 1) / page_size * page_size;
+
+    if(ftruncate(telemetry_fd, header_size) == 0) {
+        header = mmap(NULL, header_size, PROT_READ | PROT_WRITE, MAP_SHARED, telemetry_fd, 0);
+    }
+
+    if(header == NULL || header == MAP_FAILED) {
+        Hub_Logging_log(ERROR, Util_format("Unable to map telemetry file %s: %s", path, strerror(errno)));
+        close(telemetry_fd);
+        telemetry_fd = -1;
+        header = NULL;
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    header->magic = HUB_TELEMETRY_MAGIC;
+    header->version = HUB_TELEMETRY_VERSION;
+    header->chunk_samples = HUB_TELEMETRY_CHUNK_SAMPLES;
+    header->max_chunks = max_chunks;
+    header->var_count = var_count;
+    header->chunk_count = 0;
+    header->names_offset = sizeof(Hub_Telemetry_Header);
+    header->index_offset = header->names_offset + var_count * HUB_TELEMETRY_NAME_LEN;
+    header->data_offset = header_size;
+    header->chunk_size = chunk_size;
+    header->started = Timer_getTimestamp();
+    header->started_wall = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+
+    names = ((char*) header) + header->names_offset;
+    for(i = 0; i < var_count; i++) {
+        strncpy(names + i * HUB_TELEMETRY_NAME_LEN, Hub_Var_getByIndex(i)->name, HUB_TELEMETRY_NAME_LEN - 1);
+    }
+    chunk_index = (Hub_Telemetry_Chunk*) (((char*) header) + header->index_offset);
+
+    if(Hub_Telemetry_openChunk() != 0) {
+        Hub_Telemetry_close();
+        return;
+    }
+
+    recording = true;
+    Hub_Logging_log(INFO, Util_format("Recording telemetry to %s", path));
+}
+
+/**
+ * \brief Record a variable update
+ *
+ * \param var The variable
+ * \param time Time the variable was set, from Timer_getTimestamp()
+ * \param value The new value
+ */
+void Hub_Telemetry_record(Hub_Var* var, int64_t time, double value) {
+    Hub_Telemetry_Chunk* entry;
+
+    if(!recording) {
+        return;
+    }
+
+    pthread_mutex_lock(&record_lock);
+    if(!recording) {
+        /* Closed while waiting for the lock */
+        pthread_mutex_unlock(&record_lock);
+        return;
+    }
+
+    if(chunk_fill == header->chunk_samples && (full || Hub_Telemetry_openChunk() != 0)) {
+        header->dropped++;
+        pthread_mutex_unlock(&record_lock);
+        return;
+    }
+
+    chunk_times[chunk_fill] = time;
+    chunk_values[chunk_fill] = value;
+    chunk_vars[chunk_fill] = var->index;
+
+    entry = &chunk_index[header->chunk_count - 1];
+    if(chunk_fill == 0) {
+        entry->first = time;
+    }
+    entry->last = time;
+    chunk_fill++;
+
+    /* Readers of a live file trust the count, so it must not be seen before
+       the sample */
+    __sync_synchronize();
+    entry->count = chunk_fill;
+    pthread_mutex_unlock(&record_lock);
+}
+
+/**
+ * \brief Stop recording
+ *
+ * Unmaps and closes the telemetry file. Must be called before Hub_Var_close().
+ */
+void Hub_Telemetry_close(void) {
+    uint64_t samples;
+
+    if(header == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&record_lock);
+    recording = false;
+
+    samples = header->chunk_count ? (uint64_t) (header->chunk_count - 1) * header->chunk_samples + chunk_fill : 0;
+    Hub_Logging_log(INFO, Util_format("Recorded %llu telemetry samples, dropped %llu",
+                                      (unsigned long long) samples, (unsigned long long) header->dropped));
+
+    if(chunk) {
+        munmap(chunk, header->chunk_size);
+        chunk = NULL;
+    }
+    munmap(header, header_size);
+    header = NULL;
+    close(telemetry_fd);
+    telemetry_fd = -1;
+    pthread_mutex_unlock(&record_lock);
+}
+
+/** \} */
+
+/**
+ * \brief Extend the file by a chunk and map it in place of the full one
+ *
+ * Must be called with record_lock held, or before recording starts
+ *
+ * \return 0 on success, -1 if the file is full or could not be extended
+ */
+static int Hub_Telemetry_openChunk(void) {
+    uint64_t offset = header->data_offset + header->chunk_count * header->chunk_size;
+    void* next = MAP_FAILED;
+
+    if(header->chunk_count == header->max_chunks) {
+        Hub_Logging_log(WARNING, "Telemetry file is full, further samples will be dropped");
+        full = true;
+        return -1;
+    }
+
+    if(ftruncate(telemetry_fd, offset + header->chunk_size) == 0) {
+        next = mmap(NULL, header->chunk_size, PROT_READ | PROT_WRITE, MAP_SHARED, telemetry_fd, offset);
+    }
+
+    if(next == MAP_FAILED) {
+        Hub_Logging_log(ERROR, Util_format("Unable to extend telemetry file: %s", strerror(errno)));
+        full = true;
+        return -1;
+    }
+
+    if(chunk) {
+        munmap(chunk, header->chunk_size);
+    }
+
+    chunk = next;
+    chunk_times = chunk;
+    chunk_values = (double*) (chunk_times + header->chunk_samples);
+    chunk_vars = (uint32_t*) (chunk_values + header->chunk_samples);
+    chunk_fill = 0;
+    header->chunk_count++;
+
+    return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * \file
+ * \brief Telemetry export
+ *
+ * Writes the samples in a telemetry file recorded by a hub with the
+ * telemetry_file option as CSV, one row per variable update in the order they
+ * were recorded. Samples can be limited to some variables and to a window of
+ * time, in which case the chunk index is used to skip whole chunks and only
+ * the variable column of the remaining chunks is scanned. The file may be
+ * exported while the hub is still recording to it.
+ */
+
+#include "seawolf.h"
+#include "seawolf_hub_telemetry.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Export options
+ */
+typedef struct {
+    /** Telemetry file */
+    char* file;
+
+    /** Names of the variables to export, or NULL for all */
+    char** vars;
+
+    /** Number of variables in vars */
+    int var_count;
+
+    /** First time to export, in seconds from the start of the recording */
+    double start;
+
+    /** Last time to export, in seconds from the start of the recording */
+    double end;
+
+    /** Print times as seconds since the epoch */
+    bool absolute;
+
+    /** List the recorded variables and their sample counts instead */
+    bool list;
+} ExportOptions;
+
+static Hub_Telemetry_Header* load_telemetry(const char* file, size_t* size);
+static void print_time(const Hub_Telemetry_Header* header, int64_t time, bool absolute);
+static int export_csv(const Hub_Telemetry_Header* header, uint32_t chunks, const ExportOptions* options);
+static void list_vars(const Hub_Telemetry_Header* header, uint32_t chunks);
+static void usage(char* arg0);
+
+/**
+ * \brief Map a telemetry file and check its header
+ *
+ * \param file Path of the file
+ * \param size Set to the size of the mapping
+ * \return The mapped file, or NULL on error
+ */
+static Hub_Telemetry_Header* load_telemetry(const char* file, size_t* size) {
+    Hub_Telemetry_Header* header;
+    struct stat st;
+    int fd;
+
+    fd = open(file, O_RDONLY);
+    if(fd == -1 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", file, strerror(errno));
+        return NULL;
+    }
+
+    if(st.st_size < (off_t) sizeof(Hub_Telemetry_Header)) {
+        fprintf(stderr, "%s is not a version %d hub telemetry file\n", file, HUB_TELEMETRY_VERSION);
+        close(fd);
+        return NULL;
+    }
+
+    *size = st.st_size;
+    header = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(header == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s: %s\n", file, strerror(errno));
+        return NULL;
+    }
+
+    if(header->magic != HUB_TELEMETRY_MAGIC || header->version != HUB_TELEMETRY_VERSION ||
+       header->data_offset > *size) {
+        fprintf(stderr, "%s is not a version %d hub telemetry file\n", file, HUB_TELEMETRY_VERSION);
+        munmap(header, *size);
+        return NULL;
+    }
+
+    return header;
+}
+
+/**
+ * \brief Print the time of a sample
+ *
+ * \param header The telemetry file
+ * \param time Time of the sample, from Timer_getTimestamp() in the hub
+ * \param absolute Print seconds since the epoch rather than since the start of
+ * the recording
+ */
+static void print_time(const Hub_Telemetry_Header* header, int64_t time, bool absolute) {
+    int64_t ns = time - header->started;
+
+    if(absolute) {
+        ns += header->started_wall;
+    }
+
+    if(ns < 0) {
+        printf("-");
+        ns = -ns;
+    }
+    printf("%lld.%09lld", (long long) (ns / 1000000000), (long long) (ns % 1000000000));
+}
+
+/**
+ * \brief Write the selected samples as CSV
+ *
+ * \param header The telemetry file
+ * \param chunks Number of chunks in the file
+ * \param options Export options
+ * \return 0 on success, -1 if a variable was not recorded
+ */
+static int export_csv(const Hub_Telemetry_Header* header, uint32_t chunks, const ExportOptions* options) {
+    const char* names = ((const char*) header) + header->names_offset;
+    const Hub_Telemetry_Chunk* chunk_index = (const Hub_Telemetry_Chunk*) (((const char*) header) + header->index_offset);
+    int64_t start = header->started + (int64_t) (options->start * 1e9);
+    int64_t end = options->end < 0 ? INT64_MAX : header->started + (int64_t) (options->end * 1e9);
+    bool* selected = calloc(header->var_count, sizeof(bool));
+    const int64_t* times;
+    const double* values;
+    const uint32_t* vars;
+    uint32_t count;
+    uint32_t i, j;
+    int k;
+
+    for(k = 0; k < options->var_count; k++) {
+        for(i = 0; i < header->var_count; i++) {
+            if(strncmp(names + i * HUB_TELEMETRY_NAME_LEN, options->vars[k], HUB_TELEMETRY_NAME_LEN) == 0) {
+                selected[i] = true;
+                break;
+            }
+        }
+
+        if(i == header->var_count) {
+            fprintf(stderr, "Variable %s was not recorded\n", options->vars[k]);
+            free(selected);
+            return -1;
+        }
+    }
+
+    if(options->var_count == 0) {
+        for(i = 0; i < header->var_count; i++) {
+            selected[i] = true;
+        }
+    }
+
+    printf("time,variable,value\n");
+    for(i = 0; i < chunks; i++) {
+        count = chunk_index[i].count;
+        if(count == 0 || chunk_index[i].last < start || chunk_index[i].first > end) {
+            continue;
+        }
+
+        /* Read the count before the samples it covers */
+        __sync_synchronize();
+
+        times = HUB_TELEMETRY_TIMES(header, header, i);
+        values = HUB_TELEMETRY_VALUES(header, header, i);
+        vars = HUB_TELEMETRY_VARS(header, header, i);
+        for(j = 0; j < count; j++) {
+            if(vars[j] >= header->var_count || !selected[vars[j]] || times[j] < start || times[j] > end) {
+                continue;
+            }
+
+            print_time(header, times[j], options->absolute);
+            printf(",%.*s,%.15g\n", HUB_TELEMETRY_NAME_LEN, names + vars[j] * HUB_TELEMETRY_NAME_LEN, values[j]);
+        }
+    }
+
+    free(selected);
+    return 0;
+}
+
+/**
+ * \brief Print the number of samples recorded for each variable
+ *
+ * \param header The telemetry file
+ * \param chunks Number of chunks in the file
+ */
+static void list_vars(const Hub_Telemetry_Header* header, uint32_t chunks) {
+    const char* names = ((const char*) header) + header->names_offset;
+    const Hub_Telemetry_Chunk* chunk_index = (const Hub_Telemetry_Chunk*) (((const char*) header) + header->index_offset);
+    uint64_t* counts = calloc(header->var_count, sizeof(uint64_t));
+    uint64_t total = 0;
+    const uint32_t* vars;
+    uint32_t count;
+    uint32_t i, j;
+
+    for(i = 0; i < chunks; i++) {
+        count = chunk_index[i].count;
+        __sync_synchronize();
+
+        vars = HUB_TELEMETRY_VARS(header, header, i);
+        for(j = 0; j < count; j++) {
+            if(vars[j] < header->var_count) {
+                counts[vars[j]]++;
+            }
+        }
+        total += count;
+    }
+
+    printf("variable,samples\n");
+    for(i = 0; i < header->var_count; i++) {
+        printf("%.*s,%llu\n", HUB_TELEMETRY_NAME_LEN, names + i * HUB_TELEMETRY_NAME_LEN, (unsigned long long) counts[i]);
+    }
+
+    fprintf(stderr, "%llu samples in %u chunks, %llu dropped\n", (unsigned long long) total, chunks,
+            (unsigned long long) header->dropped);
+    free(counts);
+}
+
+static void usage(char* arg0) {
+    printf("Usage: %s [-h] [-l] [-a] [-v variable]... [-s seconds] [-e seconds] telemetry\n", arg0);
+    printf("  -l          List recorded variables and their sample counts\n");
+    printf("  -a          Print times as seconds since the epoch rather than since the start\n");
+    printf("  -v variable Export only this variable, may be given more than once\n");
+    printf("  -s seconds  Export only samples this long after the start or later\n");
+    printf("  -e seconds  Export only samples this long after the start or earlier\n");
+}
+
+int main(int argc, char** argv) {
+    ExportOptions options = {.file = NULL, .vars = NULL, .var_count = 0, .start = 0, .end = -1,
+                             .absolute = false, .list = false};
+    Hub_Telemetry_Header* header;
+    uint32_t chunks;
+    size_t size;
+    int opt;
+    int ret;
+
+    options.vars = malloc(argc * sizeof(char*));
+
+    while((opt = getopt(argc, argv, ":hlav:s:e:")) != -1) {
+        switch(opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'l':
+            options.list = true;
+            break;
+        case 'a':
+            options.absolute = true;
+            break;
+        case 'v':
+            options.vars[options.var_count++] = optarg;
+            break;
+        case 's':
+            options.start = atof(optarg);
+            break;
+        case 'e':
+            options.end = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(optind != argc - 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    options.file = argv[optind];
+
+    header = load_telemetry(options.file, &size);
+    if(header == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    /* The hub may have started chunks since the file was mapped */
+    chunks = header->chunk_count;
+    if(chunks > (size - header->data_offset) / header->chunk_size) {
+        chunks = (size - header->data_offset) / header->chunk_size;
+    }
+
+    if(options.list) {
+        list_vars(header, chunks);
+        ret = 0;
+    } else {
+        ret = export_csv(header, chunks, &options);
+    }
+
+    munmap(header, size);
+    free(options.vars);
+    return ret == 0 ? 0 : EXIT_FAILURE;
+}
@@ -4,11 +4,23 @@
  */
 
 #include "seawolf.h"
+#include "seawolf/var_shm.h"
 #include "seawolf_hub.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static void Hub_Var_openShm(void);
+static void Hub_Var_publishShm(Hub_Var* var);
+
 /** Variable storage */
 static Dictionary* var_cache = NULL;
 
+/** All variables, in the order given by Hub_Var.index */
+static List* var_list = NULL;
+
 /** List of variables which are marked as persistent */
 static List* persistent_variables = NULL;
 
@@ -32,6 +44,15 @@ static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
  */
 static int do_flush_flag = 0;
 
+/** Variable table shared with clients on the same host, or NULL */
+static Var_ShmHeader* var_shm = NULL;
+
+/** Size of the variable table segment */
+static size_t var_shm_size;
+
+/** Name of the variable table segment */
+static char* var_shm_name = NULL;
+
 /**
  * \defgroup var Variable DB
  * \brief Routines for accessing the variable database
@@ -231,6 +252,7 @@ static void Hub_Var_readDefinitions(void) {
 
     /* Populate variable cache */
     var_cache = Dictionary_new();
+    var_list = List_new();
     persistent_variables = List_new();
 
     var_names = Dictionary_getKeys(defs);
@@ -264,11 +286,14 @@ static void Hub_Var_readDefinitions(void) {
         new_var->persistent = persistent;
         new_var->readonly = readonly;
         new_var->subscribers = List_new();
+        new_var->index = List_getSize(var_list);
+        new_var->replicated = false;
         
         pthread_rwlock_init(&new_var->lock, NULL);
 
         /* Save variable to cache */
         Dictionary_set(var_cache, var_name, new_var);
+        List_append(var_list, new_var);
 
         /* If this variable is persistent put it into the list of persistent
            variables */
@@ -294,6 +319,112 @@ void Hub_Var_init(void) {
         Hub_Var_readPersistentValues();
         db_flush_handle = Task_background(Hub_Var_dbFlusher);
     }
+
+    if(atoi(Hub_Config_getOption("var_shm"))) {
+        Hub_Var_openShm();
+    }
+}
+
+/**
+ * \brief Create the shared variable table
+ *
+ * Creates a shared memory segment laid out as described in seawolf/var_shm.h
+ * holding the value of every variable, which Hub_Var_setValue() keeps up to
+ * date. Clients on the same host find it with a VAR SHM request and map it to
+ * read variables without a round trip to the hub. Sets still go through the
+ * hub so they are ordered, persisted and sent to subscribers.
+ */
+static void Hub_Var_openShm(void) {
+    int var_count = List_getSize(var_list);
+    struct timespec now;
+    Hub_Var* var;
+    int fd;
+
+    var_shm_name = strdup(Util_format(VAR_SHM_NAME_FORMAT, atoi(Hub_Config_getOption("bind_port"))));
+    var_shm_size = sizeof(Var_ShmHeader) + var_count * (VAR_SHM_NAME_LEN + sizeof(Var_ShmSlot));
+
+    fd = shm_open(var_shm_name, O_RDWR | O_CREAT, 0644);
+    if(fd == -1) {
+        Hub_Logging_log(ERROR, Util_format("Unable to create variable table %s: %s", var_shm_name, strerror(errno)));
+        free(var_shm_name);
+        var_shm_name = NULL;
+        return;
+    }
+
+    if(ftruncate(fd, var_shm_size) == 0) {
+        var_shm = mmap(NULL, var_shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if(var_shm == NULL || var_shm == MAP_FAILED) {
+        Hub_Logging_log(ERROR, Util_format("Unable to map variable table %s: %s", var_shm_name, strerror(errno)));
+        shm_unlink(var_shm_name);
+        free(var_shm_name);
+        var_shm_name = NULL;
+        var_shm = NULL;
+        return;
+    }
+
+    /* The segment may be left over from a hub which did not exit cleanly */
+    memset(var_shm, 0, var_shm_size);
+
+    /* Distinguishes this hub from any other which has used the same name */
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    var_shm->magic = VAR_SHM_MAGIC;
+    var_shm->version = VAR_SHM_VERSION;
+    var_shm->var_count = var_count;
+    var_shm->slot_size = sizeof(Var_ShmSlot);
+    var_shm->token = ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec) ^ ((uint64_t) getpid() << 32);
+    var_shm->names_offset = sizeof(Var_ShmHeader);
+    var_shm->slots_offset = var_shm->names_offset + var_count * VAR_SHM_NAME_LEN;
+
+    for(int i = 0; (var = List_get(var_list, i)) != NULL; i++) {
+        strncpy(VAR_SHM_NAME(var_shm, i), var->name, VAR_SHM_NAME_LEN - 1);
+        Hub_Var_publishShm(var);
+    }
+}
+
+/**
+ * \brief Copy the value of a variable to the shared variable table
+ *
+ * Must be called with the variable write locked, so there is only ever one
+ * writer of each slot
+ *
+ * \param var The variable
+ */
+static void Hub_Var_publishShm(Hub_Var* var) {
+    Var_ShmSlot* slot = VAR_SHM_SLOT(var_shm, var->index);
+
+    slot->sequence++;
+    __sync_synchronize();
+    slot->value = var->value;
+    __sync_synchronize();
+    slot->sequence++;
+}
+
+/**
+ * \brief Describe the shared variable table
+ *
+ * Build the response to a VAR SHM request. The response gives the name of the
+ * segment and the token in its header, or no arguments if the table is not
+ * published
+ *
+ * \param request_id ID of the request being answered
+ * \return A new message which should be destroyed by the caller
+ */
+Comm_Message* Hub_Var_getShmMessage(uint16_t request_id) {
+    Comm_Message* response = Comm_Message_new(var_shm ? 4 : 2);
+
+    response->request_id = request_id;
+    response->components[0] = MemPool_strdup(response->alloc, "VAR");
+    response->components[1] = MemPool_strdup(response->alloc, "SHM");
+    if(var_shm) {
+        response->components[2] = MemPool_strdup(response->alloc, var_shm_name);
+        response->components[3] = MemPool_strdup(response->alloc, Util_format("%llu", (unsigned long long) var_shm->token));
+    }
+
+    return response;
 }
 
 /**
@@ -310,6 +441,25 @@ Hub_Var* Hub_Var_get(const char* name) {
     return var;
 }
 
+/**
+ * \brief Return the number of variables
+ *
+ * \return Number of variables in the variable definitions
+ */
+int Hub_Var_getCount(void) {
+    return List_getSize(var_list);
+}
+
+/**
+ * \brief Return a variable by its index
+ *
+ * \param index Index of the variable, from 0 to Hub_Var_getCount() - 1
+ * \return The variable, or NULL if index is out of range
+ */
+Hub_Var* Hub_Var_getByIndex(int index) {
+    return List_get(var_list, index);
+}
+
 /**
  * \brief Set a variable value
  *
@@ -324,11 +474,15 @@ Hub_Var* Hub_Var_get(const char* name) {
 int Hub_Var_setValue(const char* name, double value) {
     static char* watch_0 = "WATCH";
     char value_str[32];
+    char stamp_str[24];
 
     Hub_Var* var = Dictionary_get(var_cache, name);
     Hub_Client* subscriber;
     Comm_Message* message;
-    Comm_PackedMessage* packed;
+    Comm_PackedMessage* packed = NULL;
+    Comm_PackedMessage* packed_stamped = NULL;
+    int64_t stamp;
+    int i;
 
     if(var == NULL) {
         return -1;
@@ -338,8 +492,15 @@ int Hub_Var_setValue(const char* name, double value) {
         return -2;
     }
 
+    Trace_begin("Hub_Var_setValue");
+
     pthread_rwlock_wrlock(&var->lock);
     var->value = value;
+    stamp = Timer_getTimestamp();
+    Hub_Telemetry_record(var, stamp, value);
+    if(var_shm) {
+        Hub_Var_publishShm(var);
+    }
     if(var->persistent) {
         Hub_Var_flushPersistent();
     }
@@ -347,24 +508,44 @@ int Hub_Var_setValue(const char* name, double value) {
 
     /* Don't waste time building the message if there are no subscribers */
     if(List_getSize(var->subscribers) == 0) {
+        Hub_Stats_countVarSet(var, 0);
+        Trace_end("Hub_Var_setValue");
         return 0;
     }
 
-    message = Comm_Message_new(3);
+    message = Comm_Message_new(4);
     message->components[0] = watch_0;
     message->components[1] = (char*) name;
     message->components[2] = value_str;
+    message->components[3] = stamp_str;
 
     pthread_rwlock_rdlock(&var->lock);
     snprintf(value_str, sizeof(value_str), "%f", var->value);
-
-    packed = Comm_packMessage(message);
-    for(int i = 0; (subscriber = List_get(var->subscribers, i)) != NULL; i++) {
-        Hub_Net_sendPackedMessage(subscriber, packed);
+    snprintf(stamp_str, sizeof(stamp_str), "%lld", (long long) stamp);
+
+    /* Subscribers are sent the update with or without the time it was set, so
+       pack each form of the message the first time it is needed */
+    for(i = 0; (subscriber = List_get(var->subscribers, i)) != NULL; i++) {
+        if(subscriber->watch_timestamps) {
+            if(packed_stamped == NULL) {
+                message->count = 4;
+                packed_stamped = Comm_packMessage(message);
+            }
+            Hub_Net_sendPackedMessage(subscriber, packed_stamped);
+        } else {
+            if(packed == NULL) {
+                message->count = 3;
+                packed = Comm_packMessage(message);
+            }
+            Hub_Net_sendPackedMessage(subscriber, packed);
+        }
     }
     pthread_rwlock_unlock(&var->lock);
 
+    Hub_Stats_countVarSet(var, i);
+
     Comm_Message_destroy(message);
+    Trace_end("Hub_Var_setValue");
 
     return 0;
 }
@@ -441,9 +622,19 @@ void Hub_Var_close(void) {
     char* var_name;
     Hub_Var* var;
 
+    if(var_shm) {
+        munmap(var_shm, var_shm_size);
+        shm_unlink(var_shm_name);
+        free(var_shm_name);
+        var_shm = NULL;
+    }
+
     if(persistent_variables) {
-        Task_kill(db_flush_handle);
-        Task_wait(db_flush_handle);
+        /* The flusher only runs if there are persistent variables, and
+           Task_kill() already waits for it to exit */
+        if(List_getSize(persistent_variables)) {
+            Task_kill(db_flush_handle);
+        }
         List_destroy(persistent_variables);
     }
 
@@ -458,6 +649,7 @@ void Hub_Var_close(void) {
         }
 
         List_destroy(var_names);
+        List_destroy(var_list);
         Dictionary_destroy(var_cache);
     }
 }
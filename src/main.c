@@ -92,10 +92,13 @@ void Seawolf_init(const char* name) {
                       forward notification messages to it before it's ready for
                       them */
     Comm_init();
+    Clock_init();
     Var_init();
+    Blob_init();
     Logging_init();
     Serial_init();
     Timer_init();
+    Trace_init();
 
     /* Log message announcing application launch */
     Logging_log(INFO, "Initialized");
@@ -107,11 +110,20 @@ void Seawolf_init(const char* name) {
  * Load the options in the given configuration file when Seawolf_init() is called
  *
  * The valid configuration options are,
- *  - comm_server - This option specifies the IP address of hub server (default is 127.0.0.1)
+ *  - comm_server - This option specifies the IP address of hub server, or unix: followed by the path of the hub's Unix domain socket (default is 127.0.0.1)
  *  - comm_port - The port of the hub server (default is 31427)
  *  - comm_password - The password to authenticate with the hub server using (default is empty)
+ *  - comm_latency_stats - Record the round trip time of requests to the hub, see Comm_setLatencyStats() (default is false)
+ *  - comm_latency_log_interval - Seconds between logging round trip statistics, 0 to not log them (default is 0)
+ *  - var_timestamps - Ask the hub to timestamp variable updates so their delivery latency can be measured, see Var_setTimestamps() (default is false)
+ *  - var_shm - Read variables from the hub's shared variable table when running on the same host, see Var_setSharedMemory() (default is true)
  *  - log_level - The lowest priority of log messages to log. Should be one of DEBUG, INFO, NORMAL, WARNING, ERROR, or CRITICAL (default is NORMAL)
  *  - log_replicate_stdout - Replicate log messages to standard output (default is true)
+ *  - timer_clock - Clock source used by Timer objects, either monotonic or tsc (default is monotonic)
+ *  - clock_source - Time base for timers, sleeps and scheduling. One of real, virtual for a local virtual clock, or hub to share the hub's virtual clock (default is real)
+ *  - clock_rate - Initial rate of a local virtual clock as a multiple of real time, 0 to start paused (default is 1)
+ *  - trace - Record trace events, see Trace_setEnabled(). Sending the process SIGUSR2 writes the trace (default is false)
+ *  - trace_file - File the trace is written to (default is /tmp/seawolf-trace.<pid>.json)
  *
  * \param filename File to load configuration from
  */
@@ -136,6 +148,8 @@ static void Seawolf_processConfig(void) {
     char* option;
     char* value;
     short level;
+    Clock_Source clock_source = Clock_getSource();
+    double clock_rate = Clock_getRate();
 
     config = Config_readFile(seawolf_config_file);
 
@@ -175,6 +189,14 @@ static void Seawolf_processConfig(void) {
             Comm_setServer(value);
         } else if(strcmp(option, "comm_port") == 0) {
             Comm_setPort(atoi(value));
+        } else if(strcmp(option, "comm_latency_stats") == 0) {
+            Comm_setLatencyStats(Config_truth(value));
+        } else if(strcmp(option, "comm_latency_log_interval") == 0) {
+            Comm_setLatencyLogInterval(atof(value));
+        } else if(strcmp(option, "var_timestamps") == 0) {
+            Var_setTimestamps(Config_truth(value));
+        } else if(strcmp(option, "var_shm") == 0) {
+            Var_setSharedMemory(Config_truth(value));
         } else if(strcmp(option, "log_level") == 0) {
             level = Logging_getLevelFromName(value);
             if(level == -1) {
@@ -184,6 +206,30 @@ static void Seawolf_processConfig(void) {
             }
         } else if(strcmp(option, "log_replicate_stdout") == 0) {
             Logging_replicateStdio(Config_truth(value));
+        } else if(strcmp(option, "timer_clock") == 0) {
+            if(strcmp(value, "monotonic") == 0) {
+                Timer_setClockSource(TIMER_CLOCK_MONOTONIC);
+            } else if(strcmp(value, "tsc") == 0) {
+                Timer_setClockSource(TIMER_CLOCK_TSC);
+            } else {
+                Logging_log(ERROR, Util_format("Invalid timer clock '%s'", value));
+            }
+        } else if(strcmp(option, "clock_source") == 0) {
+            if(strcmp(value, "real") == 0) {
+                clock_source = CLOCK_SOURCE_REAL;
+            } else if(strcmp(value, "virtual") == 0) {
+                clock_source = CLOCK_SOURCE_VIRTUAL;
+            } else if(strcmp(value, "hub") == 0) {
+                clock_source = CLOCK_SOURCE_HUB;
+            } else {
+                Logging_log(ERROR, Util_format("Invalid clock source '%s'", value));
+            }
+        } else if(strcmp(option, "clock_rate") == 0) {
+            clock_rate = atof(value);
+        } else if(strcmp(option, "trace") == 0) {
+            Trace_setEnabled(Config_truth(value));
+        } else if(strcmp(option, "trace_file") == 0) {
+            Trace_setFile(value);
         } else {
             Logging_log(WARNING, Util_format("Unknown configuration option '%s'", option));
         }
@@ -193,6 +239,11 @@ static void Seawolf_processConfig(void) {
 
     List_destroy(options);
     Dictionary_destroy(config);
+
+    /* Set the rate before selecting the source so a virtual clock starts at
+       the configured rate. A hub clock runs at the rate set by the hub */
+    Clock_setRate(clock_rate);
+    Clock_setSource(clock_source);
 }
 
 #ifdef CATCH_SIGNALS
@@ -276,10 +327,14 @@ void Seawolf_close(void) {
     /* Announce closing */
     Logging_log(INFO, "Closing");
 
+    Trace_close();
     Serial_close();
     Logging_close();
-    Var_close();
+
+    /* Stop the receive thread before freeing the state it delivers into */
     Comm_close();
+    Blob_close();
+    Var_close();
     Notify_close();
     Util_close();
     MemPool_close();
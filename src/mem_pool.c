@@ -88,6 +88,9 @@ static List* blocks = NULL;
 static List* descriptor_pool = NULL;
 static MemPool_Alloc* free_descriptors = NULL;
 
+/* Number of MemPool_init() calls not yet matched by MemPool_close() */
+static int users = 0;
+
 static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static MemPool_Block* MemPool_allocNewBlock(void);
@@ -99,22 +102,35 @@ static void MemPool_releaseChunk(MemPool_Alloc* alloc);
 /**
  * \brief Initialize the MemPool component
  *
- * Initialize the MemPool component
+ * Initialize the MemPool component. Both libseawolf and a hub embedded in the
+ * same process use the pool, so each call must be matched by a call to
+ * MemPool_close() and only the first call initializes it
  */
 void MemPool_init(void) {
-    descriptor_pool = List_new();
-    blocks = List_new();
+    pthread_mutex_lock(&pool_lock);
+    if(users++ == 0) {
+        descriptor_pool = List_new();
+        blocks = List_new();
+    }
+    pthread_mutex_unlock(&pool_lock);
 }
 
 /**
  * \brief Close the MemPool component
  *
- * Close the MemPool component
+ * Close the MemPool component once every MemPool_init() call has been matched
  */
 void MemPool_close(void) {
     MemPool_Alloc* descriptor_group;
     MemPool_Block* block;
 
+    pthread_mutex_lock(&pool_lock);
+    if(users == 0 || --users > 0) {
+        pthread_mutex_unlock(&pool_lock);
+        return;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
     while ((block = List_remove(blocks, 0)) != NULL) {
         free(block->base);
         free(block);
@@ -125,6 +141,7 @@ void MemPool_close(void) {
         free(descriptor_group);
     }
     List_destroy(descriptor_pool);
+    free_descriptors = NULL;
 }
 
 /**
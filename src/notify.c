@@ -197,6 +197,32 @@ void Notify_filter(Notify_FilterType filter_type, char* filter) {
     Comm_Message_destroy(message);
 }
 
+/**
+ * \brief Check a notification against a filter
+ *
+ * Apply a filter, as registered with Notify_filter(), to the body of a
+ * notification. Used by the hub and seawolf-proxy to decide which applications
+ * a notification is sent to, so that both apply filters the same way.
+ *
+ * \param filter_type One of FILTER_MATCH, FILTER_ACTION, or FILTER_PREFIX.
+ * \param filter The filter text
+ * \param notification The notification body, the action and parameter
+ * separated by a space
+ * \return True if the notification passes the filter
+ */
+bool Notify_matchFilter(Notify_FilterType filter_type, const char* filter, const char* notification) {
+    switch(filter_type) {
+    case FILTER_MATCH:
+        return strcmp(notification, filter) == 0;
+
+    case FILTER_ACTION:
+    case FILTER_PREFIX:
+        return strncmp(notification, filter, strlen(filter)) == 0;
+    }
+
+    return false;
+}
+
 /**
  * \brief Close initialize component
  * \private
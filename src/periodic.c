@@ -0,0 +1,254 @@
+/**
+ * \file
+ * \brief Periodic real-time loops
+ */
+
+/* CPU affinity is a GNU extension */
+#if defined(__SW_Linux__) && !defined(__SW_Blackfin__)
+# define _GNU_SOURCE
+# define PERIODIC_AFFINITY
+#endif
+
+#include "seawolf.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+static void Task_Periodic_applyOptions(Task_Periodic* periodic);
+static void* Task_Periodic_loop(void* _periodic);
+
+/**
+ * \defgroup Periodic Periodic loops
+ * \ingroup Multitasking
+ * \brief Drift free periodic loops with jitter statistics
+ *
+ * A periodic loop calls a function at fixed deadlines on the Clock, which is
+ * the monotonic clock unless a virtual clock is selected. Each deadline is
+ * computed from the previous one rather than from when the function returned,
+ * so timing errors do not accumulate as they do with a loop around
+ * Util_usleep().
+ *
+ * \{
+ */
+
+/**
+ * \brief Apply the options of a loop to the calling thread
+ * \private
+ */
+static void Task_Periodic_applyOptions(Task_Periodic* periodic) {
+    struct sched_param param;
+    int rc;
+
+    if(periodic->options.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+        Logging_log(WARNING, __Util_format("Unable to lock memory for periodic loop: %s", strerror(errno)));
+    }
+
+    if(periodic->options.cpu >= 0) {
+#ifdef PERIODIC_AFFINITY
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(periodic->options.cpu, &cpus);
+        rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if(rc) {
+            Logging_log(WARNING, __Util_format("Unable to pin periodic loop to CPU %d: %s", periodic->options.cpu, strerror(rc)));
+        }
+#else
+        Logging_log(WARNING, "CPU affinity is not supported on this platform");
+#endif
+    }
+
+    if(periodic->options.priority > 0) {
+        param.sched_priority = periodic->options.priority;
+        rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(rc) {
+            Logging_log(WARNING, __Util_format("Unable to set SCHED_FIFO priority %d for periodic loop: %s", periodic->options.priority, strerror(rc)));
+        }
+    }
+}
+
+/**
+ * \brief Periodic loop thread
+ * \private
+ *
+ * \param _periodic The Task_Periodic cast to void*
+ * \return NULL
+ */
+static void* Task_Periodic_loop(void* _periodic) {
+    Task_Periodic* periodic = (Task_Periodic*) _periodic;
+    int64_t deadline;
+    int64_t target;
+    int64_t woke;
+    int64_t finished;
+    uint64_t missed;
+    bool stop;
+    int rc;
+
+    Task_Periodic_applyOptions(periodic);
+
+    deadline = Clock_now() + periodic->period;
+
+    while(true) {
+        target = deadline;
+        Clock_sleepUntil(target);
+        woke = Clock_now();
+
+        rc = periodic->func();
+        finished = Clock_now();
+
+        /* Skip any deadlines which passed while func was running */
+        missed = 0;
+        deadline += periodic->period;
+        if(finished >= deadline) {
+            missed = (finished - deadline) / periodic->period + 1;
+            deadline += missed * periodic->period;
+        }
+
+        pthread_mutex_lock(&periodic->lock);
+        periodic->stats.iterations++;
+        periodic->stats.overruns += missed;
+        Histogram_record(&periodic->stats.latency, woke - target);
+        Histogram_record(&periodic->stats.runtime, finished - woke);
+        stop = periodic->stop;
+        pthread_mutex_unlock(&periodic->lock);
+
+        if(stop || rc) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Initialize periodic loop options to their defaults
+ *
+ * The defaults leave the loop thread on any CPU with the default scheduling
+ * policy, do not lock memory and do not log statistics
+ *
+ * \param options The options to initialize
+ */
+void Task_PeriodicOptions_init(Task_PeriodicOptions* options) {
+    options->cpu = -1;
+    options->priority = 0;
+    options->lock_memory = false;
+    options->log_stats = false;
+}
+
+/**
+ * \brief Start a periodic loop
+ *
+ * Start a new thread which calls func every period seconds until func returns
+ * non-zero or Task_Periodic_stop() is called. If a call overruns its period,
+ * the missed deadlines are counted as overruns and skipped.
+ *
+ * \param func The function to call each period. Returning non-zero stops the
+ *   loop
+ * \param period Seconds between calls
+ * \param options Loop options, or NULL for the defaults
+ * \return A handle to the loop, which must be passed to Task_Periodic_stop()
+ */
+Task_Periodic* Task_periodic(int (*func)(void), double period, const Task_PeriodicOptions* options) {
+    Task_Periodic* periodic = malloc(sizeof(Task_Periodic));
+
+    periodic->func = func;
+    periodic->period = (int64_t) (period * 1e9);
+    periodic->period = (periodic->period < 1) ? 1 : periodic->period;
+    periodic->stop = false;
+
+    if(options) {
+        periodic->options = *options;
+    } else {
+        Task_PeriodicOptions_init(&periodic->options);
+    }
+
+    periodic->stats.iterations = 0;
+    periodic->stats.overruns = 0;
+    Histogram_init(&periodic->stats.latency);
+    Histogram_init(&periodic->stats.runtime);
+    pthread_mutex_init(&periodic->lock, NULL);
+
+    pthread_create(&periodic->thread, NULL, Task_Periodic_loop, periodic);
+
+    return periodic;
+}
+
+/**
+ * \brief Get the statistics of a loop
+ *
+ * \param periodic The loop
+ * \param[out] stats A copy of the current statistics
+ */
+void Task_Periodic_getStats(Task_Periodic* periodic, Task_PeriodicStats* stats) {
+    pthread_mutex_lock(&periodic->lock);
+    *stats = periodic->stats;
+    pthread_mutex_unlock(&periodic->lock);
+}
+
+/**
+ * \brief Reset the statistics of a loop
+ *
+ * \param periodic The loop
+ */
+void Task_Periodic_resetStats(Task_Periodic* periodic) {
+    pthread_mutex_lock(&periodic->lock);
+    periodic->stats.iterations = 0;
+    periodic->stats.overruns = 0;
+    Histogram_init(&periodic->stats.latency);
+    Histogram_init(&periodic->stats.runtime);
+    pthread_mutex_unlock(&periodic->lock);
+}
+
+/**
+ * \brief Log the statistics of a loop
+ *
+ * Log a summary of the iteration count, overruns, and wake up latency and
+ * runtime percentiles at INFO level
+ *
+ * \param periodic The loop
+ */
+void Task_Periodic_logStats(Task_Periodic* periodic) {
+    Task_PeriodicStats* stats = malloc(sizeof(Task_PeriodicStats));
+
+    Task_Periodic_getStats(periodic, stats);
+
+    Logging_log(INFO, __Util_format("Periodic loop (%.3f ms): %llu iterations, %llu overruns, "
+                                    "latency us p50 %.1f p99 %.1f max %.1f, runtime us p50 %.1f p99 %.1f max %.1f",
+                                    periodic->period * 1e-6,
+                                    (unsigned long long) stats->iterations,
+                                    (unsigned long long) stats->overruns,
+                                    Histogram_getPercentile(&stats->latency, 50) * 1e-3,
+                                    Histogram_getPercentile(&stats->latency, 99) * 1e-3,
+                                    Histogram_getMax(&stats->latency) * 1e-3,
+                                    Histogram_getPercentile(&stats->runtime, 50) * 1e-3,
+                                    Histogram_getPercentile(&stats->runtime, 99) * 1e-3,
+                                    Histogram_getMax(&stats->runtime) * 1e-3));
+
+    free(stats);
+}
+
+/**
+ * \brief Stop a loop
+ *
+ * Request the loop stop, wait for it to finish its current period and free
+ * the loop. Must be called even if the loop stopped itself.
+ *
+ * \param periodic The loop to stop
+ */
+void Task_Periodic_stop(Task_Periodic* periodic) {
+    pthread_mutex_lock(&periodic->lock);
+    periodic->stop = true;
+    pthread_mutex_unlock(&periodic->lock);
+
+    pthread_join(periodic->thread, NULL);
+
+    if(periodic->options.log_stats) {
+        Task_Periodic_logStats(periodic);
+    }
+
+    pthread_mutex_destroy(&periodic->lock);
+    free(periodic);
+}
+
+/** \} */
@@ -0,0 +1,354 @@
+/**
+ * \file
+ * \brief Banks of PID controllers
+ */
+
+#include "seawolf.h"
+
+#include <math.h>
+
+/**
+ * Number of double arrays holding one value per controller
+ */
+#define PIDBANK_DOUBLE_FIELDS 11
+
+/**
+ * Number of int arrays holding one value per controller
+ */
+#define PIDBANK_INT_FIELDS 3
+
+static void PIDBank_updateTerms(int n, double delta_t,
+                                const double* restrict p, const double* restrict i,
+                                const double* restrict i_inv, const double* restrict sp,
+                                const double* restrict active_region, double* restrict e_last,
+                                double* restrict e_dt, double* restrict running,
+                                double* restrict diff, const double* restrict pv,
+                                double* restrict mv);
+static void PIDBank_filterDerivatives(PIDBank* bank);
+
+/**
+ * \defgroup PIDBank PID controller bank
+ * \ingroup Utilities
+ * \brief Update many PID controllers at once
+ *
+ * A PIDBank holds a fixed number of PID controllers in struct-of-arrays form
+ * and updates all of them with a single call, sharing one time delta. Each
+ * controller behaves as a PID object would, but the update loops run over
+ * contiguous arrays without branches so the compiler can vectorize them, and
+ * the derivative filter keeps a running sum so its cost does not depend on its
+ * length.
+ *
+ * Controllers are identified by their index, from 0 to one less than the
+ * number of controllers in the bank.
+ *
+ * \{
+ */
+
+/**
+ * \brief Create a new bank of controllers
+ *
+ * All controllers start with a set point and coefficients of 0, no active
+ * region and a derivative filter of length 1, paused as a new PID is.
+ *
+ * \param n Number of controllers
+ * \return The new bank, or NULL on failure
+ */
+PIDBank* PIDBank_new(int n) {
+    PIDBank* bank;
+    double* values;
+    int* indices;
+
+    if(n < 1) {
+        return NULL;
+    }
+
+    bank = malloc(sizeof(PIDBank));
+    values = calloc(PIDBANK_DOUBLE_FIELDS * n, sizeof(double));
+    indices = calloc(PIDBANK_INT_FIELDS * n, sizeof(int));
+    if(bank == NULL || values == NULL || indices == NULL) {
+        free(bank);
+        free(values);
+        free(indices);
+        return NULL;
+    }
+
+    bank->n = n;
+    bank->timer = Timer_new();
+
+    /* Fields are carved out of single allocations, p and d_offset own them */
+    bank->p = values;
+    bank->i = values + n;
+    bank->i_inv = values + 2 * n;
+    bank->d = values + 3 * n;
+    bank->sp = values + 4 * n;
+    bank->active_region = values + 5 * n;
+    bank->e_last = values + 6 * n;
+    bank->e_dt = values + 7 * n;
+    bank->running = values + 8 * n;
+    bank->diff = values + 9 * n;
+    bank->d_sum = values + 10 * n;
+
+    bank->d_offset = indices;
+    bank->d_n = indices + n;
+    bank->d_head = indices + 2 * n;
+
+    bank->d_buf = calloc(n, sizeof(double));
+    for(int k = 0; k < n; k++) {
+        bank->active_region[k] = -1;
+        bank->d_offset[k] = k;
+        bank->d_n[k] = 1;
+    }
+
+    return bank;
+}
+
+/**
+ * \brief Get the number of controllers in a bank
+ *
+ * \param bank The bank
+ * \return The number of controllers
+ */
+int PIDBank_getCount(PIDBank* bank) {
+    return bank->n;
+}
+
+/**
+ * \brief Change coefficients
+ *
+ * \param bank The bank
+ * \param k Index of the controller
+ * \param p The proportional coefficient
+ * \param i The integral coefficient
+ * \param d The differential coefficient
+ */
+void PIDBank_setCoefficients(PIDBank* bank, int k, double p, double i, double d) {
+    bank->p[k] = p;
+    bank->i[k] = i;
+    bank->i_inv[k] = (i == 0) ? 0 : 1 / i;
+    bank->d[k] = d;
+}
+
+/**
+ * \brief Change the set point for a controller
+ *
+ * As with PID_setSetPoint() the controller is paused until its next update
+ *
+ * \param bank The bank
+ * \param k Index of the controller
+ * \param sp The new set point for the controller
+ */
+void PIDBank_setSetPoint(PIDBank* bank, int k, double sp) {
+    bank->sp[k] = sp;
+    bank->running[k] = 0;
+}
+
+/**
+ * \brief Define the (plus/minus) size of the active region of a controller
+ *
+ * Outside this region the integral term is reset. See PID_setActiveRegion()
+ *
+ * \param bank The bank
+ * \param k Index of the controller
+ * \param active_region Size of the region, or -1 for no region
+ */
+void PIDBank_setActiveRegion(PIDBank* bank, int k, double active_region) {
+    bank->active_region[k] = active_region;
+}
+
+/**
+ * \brief Set the length of the derivative filter of a controller
+ *
+ * The derivative term uses the mean of the last n error derivatives. The
+ * filter history of the controller is cleared.
+ *
+ * \param bank The bank
+ * \param k Index of the controller
+ * \param n Number of derivatives to average
+ * \return 0 on success, or -1 if n is less than 1 or memory could not be
+ *   allocated
+ */
+int PIDBank_setDerivativeBufferSize(PIDBank* bank, int k, int n) {
+    double* d_buf;
+    int total = 0;
+    int offset = 0;
+
+    if(n < 1) {
+        return -1;
+    }
+
+    for(int j = 0; j < bank->n; j++) {
+        total += (j == k) ? n : bank->d_n[j];
+    }
+
+    d_buf = calloc(total, sizeof(double));
+    if(d_buf == NULL) {
+        Logging_log(ERROR, "Unable to allocate PID bank derivative buffer");
+        return -1;
+    }
+
+    /* Repack the histories with the new length for controller k */
+    for(int j = 0; j < bank->n; j++) {
+        if(j == k) {
+            bank->d_n[j] = n;
+            bank->d_head[j] = 0;
+            bank->d_sum[j] = 0;
+        } else {
+            memcpy(d_buf + offset, bank->d_buf + bank->d_offset[j], bank->d_n[j] * sizeof(double));
+        }
+        bank->d_offset[j] = offset;
+        offset += bank->d_n[j];
+    }
+
+    free(bank->d_buf);
+    bank->d_buf = d_buf;
+
+    return 0;
+}
+
+/**
+ * \brief Temporarily pause a controller
+ *
+ * See PID_pause()
+ *
+ * \param bank The bank
+ * \param k Index of the controller
+ */
+void PIDBank_pause(PIDBank* bank, int k) {
+    bank->running[k] = 0;
+}
+
+/**
+ * \brief Reset the integral component of a controller
+ *
+ * \param bank The bank
+ * \param k Index of the controller
+ */
+void PIDBank_resetIntegral(PIDBank* bank, int k) {
+    bank->e_dt[k] = 0;
+}
+
+/**
+ * \brief Compute the proportional and integral terms and raw derivatives
+ * \private
+ *
+ * Written without branches, and with restrict qualified arguments so the
+ * arrays are known not to overlap, so that the loop can be vectorized
+ */
+static void PIDBank_updateTerms(int n, double delta_t,
+                                const double* restrict p, const double* restrict i,
+                                const double* restrict i_inv, const double* restrict sp,
+                                const double* restrict active_region, double* restrict e_last,
+                                double* restrict e_dt, double* restrict running,
+                                double* restrict diff, const double* restrict pv,
+                                double* restrict mv) {
+    for(int k = 0; k < n; k++) {
+        double e = sp[k] - pv[k];
+        double previous = e_dt[k];
+        double integral = previous + delta_t * e;
+        double limit = i_inv[k];
+
+        /* Prevent I from over-saturating */
+        integral = (integral * i[k] > 1) ? limit : integral;
+        integral = (integral * i[k] < -1) ? -limit : integral;
+
+        /* Reset outside the linear region */
+        integral = ((active_region[k] > 0) & (fabs(e) > active_region[k])) ? 0 : integral;
+
+        /* Paused controllers keep their integral and skip the I term */
+        integral = (running[k] > 0) ? integral : previous;
+        e_dt[k] = integral;
+        mv[k] = p[k] * e + running[k] * i[k] * integral;
+
+        diff[k] = (e - e_last[k]) / delta_t;
+        e_last[k] = e;
+        running[k] = 1;
+    }
+}
+
+/**
+ * \brief Apply the derivative filters
+ * \private
+ *
+ * Replace each raw derivative in diff with the mean of the last d_n raw
+ * derivatives of that controller. The running sums are recomputed each time a
+ * history wraps around so rounding errors do not accumulate.
+ */
+static void PIDBank_filterDerivatives(PIDBank* bank) {
+    double* history;
+    int head;
+
+    for(int k = 0; k < bank->n; k++) {
+        if(bank->d_n[k] == 1) {
+            continue;
+        }
+
+        history = bank->d_buf + bank->d_offset[k];
+        head = bank->d_head[k];
+
+        bank->d_sum[k] += bank->diff[k] - history[head];
+        history[head] = bank->diff[k];
+
+        if(++head == bank->d_n[k]) {
+            head = 0;
+            bank->d_sum[k] = 0;
+            for(int j = 0; j < bank->d_n[k]; j++) {
+                bank->d_sum[k] += history[j];
+            }
+        }
+
+        bank->d_head[k] = head;
+        bank->diff[k] = bank->d_sum[k] / bank->d_n[k];
+    }
+}
+
+/**
+ * \brief Update all controllers
+ *
+ * Equivalent to calling PID_update() on each controller, with the time delta
+ * taken once for the whole bank since the last update or its creation
+ *
+ * \param bank The bank
+ * \param pv The new process variable of each controller
+ * \param[out] mv The new manipulated variable of each controller
+ */
+void PIDBank_update(PIDBank* bank, const double* pv, double* mv) {
+    PIDBank_updateWithDelta(bank, Timer_getDelta(bank->timer), pv, mv);
+}
+
+/**
+ * \brief Update all controllers with a given time delta
+ *
+ * As PIDBank_update(), for callers which already know the time since the
+ * last update
+ *
+ * \param bank The bank
+ * \param delta_t Seconds since the last update
+ * \param pv The new process variable of each controller
+ * \param[out] mv The new manipulated variable of each controller
+ */
+void PIDBank_updateWithDelta(PIDBank* bank, double delta_t, const double* pv, double* mv) {
+    PIDBank_updateTerms(bank->n, delta_t, bank->p, bank->i, bank->i_inv, bank->sp,
+                        bank->active_region, bank->e_last, bank->e_dt, bank->running,
+                        bank->diff, pv, mv);
+
+    PIDBank_filterDerivatives(bank);
+
+    for(int k = 0; k < bank->n; k++) {
+        mv[k] += bank->d[k] * bank->diff[k];
+    }
+}
+
+/**
+ * \brief Destroy a bank
+ *
+ * \param bank The bank to free
+ */
+void PIDBank_destroy(PIDBank* bank) {
+    Timer_destroy(bank->timer);
+    free(bank->d_buf);
+    free(bank->p);
+    free(bank->d_offset);
+    free(bank);
+}
+
+/** \} */
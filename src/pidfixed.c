@@ -0,0 +1,367 @@
+/**
+ * \file
+ * \brief Fixed point PID controller
+ */
+
+#include "seawolf.h"
+
+/**
+ * Largest power of two a gain can be scaled by. Leaves one fractional bit for
+ * rounding and enough headroom to sum the three terms without overflow
+ */
+#define PIDFIXED_MAX_SHIFT (PIDFIXED_FRAC_BITS - 3)
+
+/**
+ * Extra fractional bits kept in the integral so that small increments are not
+ * lost to rounding
+ */
+#define PIDFIXED_INTEGRAL_GUARD (PIDFIXED_FRAC_BITS / 2)
+
+/**
+ * Smallest power of two a gain can be scaled by. Small gains are normalized so
+ * their fraction keeps its precision
+ */
+#define PIDFIXED_MIN_SHIFT (-(PIDFIXED_FRAC_BITS / 2))
+
+static PIDFixed_Value PIDFixed_saturate(PIDFixed_Accum value);
+static PIDFixed_Accum PIDFixed_applyGain(PIDFixed_Gain gain, PIDFixed_Accum value, int guard);
+static PIDFixed_Gain PIDFixed_makeGain(double gain, int max_shift);
+static void PIDFixed_updateGains(PIDFixed* pid);
+
+/**
+ * \defgroup PIDFixed Fixed point PID controller
+ * \ingroup Utilities
+ * \brief A PID controller using only integer arithmetic
+ *
+ * A counterpart to the PID controller for processors without a floating point
+ * unit, such as the Blackfin, where double arithmetic is emulated in software.
+ * Set points, process variables and outputs are fractions in [-1, 1), so
+ * callers scale their signals by a full scale value. Values are Q31 by default,
+ * or Q15 if the library and application are built with PID_FIXED_Q15 defined
+ * (as the Blackfin build does), which suits processors with 16 bit
+ * multipliers.
+ *
+ * Controllers run at a fixed period given when they are created rather than
+ * timing each update, so the update involves no clock reads or division. All
+ * arithmetic saturates instead of overflowing. The integral term is limited to
+ * the output range, matching the limit of PID_update() when outputs are
+ * normalized to [-1, 1], and the derivative filter is the same moving average.
+ * Coefficients are given as doubles since they are only converted when set.
+ *
+ * \{
+ */
+
+/**
+ * \brief Limit a wide value to the range of a PIDFixed_Value
+ * \private
+ */
+static PIDFixed_Value PIDFixed_saturate(PIDFixed_Accum value) {
+    if(value > PIDFIXED_MAX) {
+        return PIDFIXED_MAX;
+    } else if(value < PIDFIXED_MIN) {
+        return PIDFIXED_MIN;
+    }
+    return (PIDFixed_Value) value;
+}
+
+/**
+ * \brief Multiply a value by a gain
+ * \private
+ *
+ * \param gain The gain
+ * \param value A value of at most twice the range of a PIDFixed_Value
+ * \param guard Number of extra fractional bits to keep in the result
+ * \return The rounded product, not saturated
+ */
+static PIDFixed_Accum PIDFixed_applyGain(PIDFixed_Gain gain, PIDFixed_Accum value, int guard) {
+    int shift = PIDFIXED_FRAC_BITS - gain.shift - guard;
+    PIDFixed_Accum product = gain.mantissa * value;
+
+    /* The product of a full scale mantissa and a value of twice the range
+       leaves no room to add the rounding bit, so halve it first. Shifts are
+       always at least 3, and the result is the same as rounding the full
+       product. */
+    return ((product >> 1) + (((PIDFixed_Accum) 1) << (shift - 2))) >> (shift - 1);
+}
+
+/**
+ * \brief Convert a gain to a fraction and power of two
+ * \private
+ *
+ * \param gain The gain
+ * \param max_shift Largest power of two the fraction may be scaled by
+ */
+static PIDFixed_Gain PIDFixed_makeGain(double gain, int max_shift) {
+    PIDFixed_Gain fixed = {0, 0};
+    double mantissa = gain;
+
+    while((mantissa >= 1.0 || mantissa <= -1.0) && fixed.shift < max_shift) {
+        mantissa /= 2;
+        fixed.shift++;
+    }
+
+    while(mantissa != 0 && mantissa < 0.5 && mantissa > -0.5 && fixed.shift > PIDFIXED_MIN_SHIFT) {
+        mantissa *= 2;
+        fixed.shift--;
+    }
+
+    if(mantissa >= 1.0 || mantissa <= -1.0) {
+        Logging_log(WARNING, __Util_format("PID gain %f is too large for fixed point, saturating", gain));
+    }
+
+    fixed.mantissa = PIDFixed_fromDouble(mantissa);
+    return fixed;
+}
+
+/**
+ * \brief Recompute the fixed point gains from the coefficients
+ * \private
+ */
+static void PIDFixed_updateGains(PIDFixed* pid) {
+    pid->p = PIDFixed_makeGain(pid->coefficients[0], PIDFIXED_MAX_SHIFT);
+    pid->i = PIDFixed_makeGain(pid->coefficients[1] * pid->period, PIDFIXED_MAX_SHIFT - PIDFIXED_INTEGRAL_GUARD);
+    pid->d = PIDFixed_makeGain(pid->coefficients[2] / (pid->period * pid->d_n), PIDFIXED_MAX_SHIFT);
+}
+
+/**
+ * \brief Convert a double to a fixed point value
+ *
+ * \param value A value, saturated to [-1, 1)
+ * \return The nearest fixed point value
+ */
+PIDFixed_Value PIDFixed_fromDouble(double value) {
+    double scaled = value * (((PIDFixed_Accum) 1) << PIDFIXED_FRAC_BITS);
+
+    if(scaled >= PIDFIXED_MAX) {
+        return PIDFIXED_MAX;
+    } else if(scaled <= PIDFIXED_MIN) {
+        return PIDFIXED_MIN;
+    }
+
+    return (PIDFixed_Value) ((scaled < 0) ? scaled - 0.5 : scaled + 0.5);
+}
+
+/**
+ * \brief Convert a fixed point value to a double
+ *
+ * \param value A fixed point value
+ * \return The value as a double
+ */
+double PIDFixed_toDouble(PIDFixed_Value value) {
+    return ((double) value) / (((PIDFixed_Accum) 1) << PIDFIXED_FRAC_BITS);
+}
+
+/**
+ * \brief Saturating addition
+ *
+ * \return a + b, limited to [-1, 1)
+ */
+PIDFixed_Value PIDFixed_add(PIDFixed_Value a, PIDFixed_Value b) {
+    return PIDFixed_saturate((PIDFixed_Accum) a + b);
+}
+
+/**
+ * \brief Saturating subtraction
+ *
+ * \return a - b, limited to [-1, 1)
+ */
+PIDFixed_Value PIDFixed_sub(PIDFixed_Value a, PIDFixed_Value b) {
+    return PIDFixed_saturate((PIDFixed_Accum) a - b);
+}
+
+/**
+ * \brief Saturating multiplication
+ *
+ * \return a * b, rounded and limited to [-1, 1)
+ */
+PIDFixed_Value PIDFixed_mul(PIDFixed_Value a, PIDFixed_Value b) {
+    PIDFixed_Gain gain = {a, 0};
+    return PIDFixed_saturate(PIDFixed_applyGain(gain, b, 0));
+}
+
+/**
+ * \brief Create a new fixed point PID controller
+ *
+ * \param period Seconds between calls to PIDFixed_update()
+ * \param sp The initial set point
+ * \param p Initial proportional coefficient
+ * \param i Initial integral coefficient
+ * \param d Initial differential coefficient
+ * \return The new controller, or NULL on failure
+ */
+PIDFixed* PIDFixed_new(double period, PIDFixed_Value sp, double p, double i, double d) {
+    PIDFixed* pid = malloc(sizeof(PIDFixed));
+    if(pid == NULL) {
+        return NULL;
+    }
+
+    pid->d_buf = calloc(1, sizeof(PIDFixed_Value));
+    if(pid->d_buf == NULL) {
+        free(pid);
+        return NULL;
+    }
+
+    pid->d_n = 1;
+    pid->d_head = 0;
+    pid->period = period;
+    pid->sp = sp;
+    pid->active_region = 0;
+    pid->integral = 0;
+    pid->paused = true;
+
+    PIDFixed_setCoefficients(pid, p, i, d);
+
+    return pid;
+}
+
+/**
+ * \brief Temporarily pause a controller
+ *
+ * See PID_pause()
+ *
+ * \param pid The controller object
+ */
+void PIDFixed_pause(PIDFixed* pid) {
+    pid->paused = true;
+}
+
+/**
+ * \brief Update and return the manipulated variable
+ *
+ * \param pid The controller object
+ * \param pv The new process variable
+ * \return The new manipulated variable
+ */
+PIDFixed_Value PIDFixed_update(PIDFixed* pid, PIDFixed_Value pv) {
+    const PIDFixed_Accum integral_max = ((PIDFixed_Accum) PIDFIXED_MAX) << PIDFIXED_INTEGRAL_GUARD;
+    PIDFixed_Value e = PIDFixed_sub(pid->sp, pv);
+    PIDFixed_Accum mv;
+    PIDFixed_Accum e_change;
+
+    mv = PIDFixed_applyGain(pid->p, e, 0);
+
+    if(pid->paused == false) {
+        /* The integral term saturates at the output range */
+        pid->integral += PIDFixed_applyGain(pid->i, e, PIDFIXED_INTEGRAL_GUARD);
+        if(pid->integral > integral_max) {
+            pid->integral = integral_max;
+        } else if(pid->integral < -integral_max) {
+            pid->integral = -integral_max;
+        }
+
+        /* Reset outside the linear region */
+        if(pid->active_region > 0 && (e > pid->active_region || e < -pid->active_region)) {
+            pid->integral = 0;
+        }
+
+        mv += (pid->integral + (((PIDFixed_Accum) 1) << (PIDFIXED_INTEGRAL_GUARD - 1))) >> PIDFIXED_INTEGRAL_GUARD;
+    }
+
+    /* The mean of the last d_n derivatives is the change in error over d_n
+       periods, so only the error d_n updates ago is needed */
+    e_change = (PIDFixed_Accum) e - pid->d_buf[pid->d_head];
+    pid->d_buf[pid->d_head] = e;
+    pid->d_head = (pid->d_head + 1 == pid->d_n) ? 0 : pid->d_head + 1;
+
+    mv += PIDFixed_applyGain(pid->d, e_change, 0);
+
+    pid->paused = false;
+
+    return PIDFixed_saturate(mv);
+}
+
+/**
+ * \brief Reset the integral component
+ *
+ * \param pid The controller object
+ */
+void PIDFixed_resetIntegral(PIDFixed* pid) {
+    pid->integral = 0;
+}
+
+/**
+ * \brief Change coefficients
+ *
+ * \param pid The controller object
+ * \param p The proportional coefficient
+ * \param i The integral coefficient
+ * \param d The differential coefficient
+ */
+void PIDFixed_setCoefficients(PIDFixed* pid, double p, double i, double d) {
+    pid->coefficients[0] = p;
+    pid->coefficients[1] = i;
+    pid->coefficients[2] = d;
+    PIDFixed_updateGains(pid);
+}
+
+/**
+ * \brief Change the set point for the controller
+ *
+ * As with PID_setSetPoint() the controller is paused until its next update
+ *
+ * \param pid The controller object
+ * \param sp The new set point
+ */
+void PIDFixed_setSetPoint(PIDFixed* pid, PIDFixed_Value sp) {
+    pid->sp = sp;
+    pid->paused = true;
+}
+
+/**
+ * \brief Define the (plus/minus) size of the active region
+ *
+ * Outside this region the integral term is reset. See PID_setActiveRegion()
+ *
+ * \param pid The controller object
+ * \param active_region Size of the region, or 0 for no region
+ */
+void PIDFixed_setActiveRegion(PIDFixed* pid, PIDFixed_Value active_region) {
+    pid->active_region = active_region;
+}
+
+/**
+ * \brief Set the length of the derivative filter
+ *
+ * The derivative term uses the mean of the last n error derivatives. The
+ * filter history is cleared.
+ *
+ * \param pid The controller object
+ * \param n Number of derivatives to average
+ * \return 0 on success, or -1 if n is less than 1 or memory could not be
+ *   allocated
+ */
+int PIDFixed_setDerivativeBufferSize(PIDFixed* pid, int n) {
+    PIDFixed_Value* d_buf;
+
+    if(n < 1) {
+        return -1;
+    }
+
+    d_buf = calloc(n, sizeof(PIDFixed_Value));
+    if(d_buf == NULL) {
+        Logging_log(ERROR, "Unable to allocate fixed point PID derivative buffer");
+        return -1;
+    }
+
+    free(pid->d_buf);
+    pid->d_buf = d_buf;
+    pid->d_n = n;
+    pid->d_head = 0;
+
+    /* The derivative gain includes the filter length */
+    PIDFixed_updateGains(pid);
+
+    return 0;
+}
+
+/**
+ * \brief Destroy the controller object
+ *
+ * \param pid The controller object
+ */
+void PIDFixed_destroy(PIDFixed* pid) {
+    free(pid->d_buf);
+    free(pid);
+}
+
+/** \} */
@@ -0,0 +1,572 @@
+/**
+ * \file
+ * \brief Deadline scheduler
+ */
+
+#include "seawolf.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * Number of slots in each level of the wheel
+ */
+#define WHEEL_SIZE (1 << SCHEDULER_WHEEL_BITS)
+
+/**
+ * Mask selecting a slot index
+ */
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+
+/**
+ * Furthest distance, in ticks, which can be represented by the wheel
+ */
+#define WHEEL_RANGE (1LL << (SCHEDULER_WHEEL_BITS * SCHEDULER_WHEEL_LEVELS))
+
+/**
+ * A scheduled callback
+ * \private
+ */
+struct Scheduler_Entry {
+    /**
+     * Identifier returned to the caller
+     * \private
+     */
+    int id;
+
+    /**
+     * Tick at which the callback is due
+     * \private
+     */
+    int64_t expires;
+
+    /**
+     * Period in ticks, or 0 for a one shot callback
+     * \private
+     */
+    int64_t period;
+
+    /**
+     * The callback
+     * \private
+     */
+    void (*func)(void*);
+
+    /**
+     * Argument to pass to func
+     * \private
+     */
+    void* arg;
+
+    /**
+     * Set when a periodic callback is cancelled while running
+     * \private
+     */
+    bool cancelled;
+
+    /**
+     * Head of the slot list this entry is in, NULL while running
+     * \private
+     */
+    struct Scheduler_Entry** slot;
+
+    /**
+     * Previous entry in the slot
+     * \private
+     */
+    struct Scheduler_Entry* prev;
+
+    /**
+     * Next entry in the slot
+     * \private
+     */
+    struct Scheduler_Entry* next;
+};
+
+static void Scheduler_start(void);
+static void Scheduler_insert(struct Scheduler_Entry* entry);
+static void Scheduler_unlink(struct Scheduler_Entry* entry);
+static void Scheduler_cascade(int level);
+static void Scheduler_runSlot(struct Scheduler_Entry** slot);
+static int64_t Scheduler_nextTick(void);
+static void Scheduler_clockChanged(void);
+static void* Scheduler_thread(void* unused);
+static int Scheduler_add(int64_t expires, int64_t period, void (*func)(void*), void* arg);
+
+/**
+ * \defgroup Scheduler Deadline scheduler
+ * \ingroup Multitasking
+ * \brief Run callbacks at deadlines or periodically from a single thread
+ *
+ * All callbacks are run from a single scheduler thread, started on first use,
+ * which keeps pending callbacks in a hierarchical timer wheel. Adding and
+ * cancelling a callback is O(1) regardless of the number pending, so large
+ * numbers of timeouts are cheap. Callbacks should be short since they delay
+ * every other callback while they run. Deadlines are times on the Clock, so
+ * callbacks follow a virtual clock when one is selected.
+ *
+ * \{
+ */
+
+/**
+ * \cond Scheduler_Internal
+ * \internal
+ */
+
+/**
+ * The timer wheel. Each slot is a doubly linked list of entries
+ */
+static struct Scheduler_Entry* wheel[SCHEDULER_WHEEL_LEVELS][WHEEL_SIZE];
+
+/**
+ * The next tick to be processed
+ */
+static int64_t current_tick = 0;
+
+/**
+ * Number of entries in the wheel or running
+ */
+static int pending_count = 0;
+
+/**
+ * Next identifier to hand out
+ */
+static int next_id = 1;
+
+/**
+ * Maps identifiers to entries
+ */
+static Dictionary* entries = NULL;
+
+/**
+ * The entry whose callback is currently running
+ */
+static struct Scheduler_Entry* running_entry = NULL;
+
+/**
+ * Protects all scheduler state
+ */
+static pthread_mutex_t scheduler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signaled when the wheel changes and the scheduler thread should recompute
+ * its wake up time
+ */
+static pthread_cond_t scheduler_changed = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Signaled after each callback completes
+ */
+static pthread_cond_t callback_done = PTHREAD_COND_INITIALIZER;
+
+/**
+ * The scheduler thread
+ */
+static pthread_t scheduler_thread;
+
+/**
+ * Ensures the scheduler thread is started once
+ */
+static pthread_once_t scheduler_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \endcond Scheduler_Internal
+ */
+
+/**
+ * \brief Start the scheduler thread
+ * \private
+ */
+static void Scheduler_start(void) {
+    pthread_attr_t attr;
+
+    entries = Dictionary_new();
+    current_tick = Clock_now() / SCHEDULER_RESOLUTION;
+    Clock_addListener(Scheduler_clockChanged);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&scheduler_thread, &attr, Scheduler_thread, NULL);
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * \brief Place an entry in the wheel
+ * \private
+ *
+ * Entries less than WHEEL_SIZE ticks away go in the first level, which is
+ * processed one slot per tick. Entries further away go in a higher level and
+ * are moved down as their deadline approaches. Must be called with the
+ * scheduler lock held.
+ */
+static void Scheduler_insert(struct Scheduler_Entry* entry) {
+    int64_t expires = (entry->expires > current_tick) ? entry->expires : current_tick;
+    int64_t delta = expires - current_tick;
+    struct Scheduler_Entry** slot;
+    int level;
+
+    if(delta >= WHEEL_RANGE) {
+        /* Park it as far away as possible, it will be placed again when the
+           slot is cascaded */
+        expires = current_tick + WHEEL_RANGE - 1;
+        delta = WHEEL_RANGE - 1;
+    }
+
+    for(level = 0; level < SCHEDULER_WHEEL_LEVELS - 1; level++) {
+        if(delta < (1LL << (SCHEDULER_WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+
+    slot = &wheel[level][(expires >> (SCHEDULER_WHEEL_BITS * level)) & WHEEL_MASK];
+
+    entry->slot = slot;
+    entry->prev = NULL;
+    entry->next = *slot;
+    if(*slot) {
+        (*slot)->prev = entry;
+    }
+    *slot = entry;
+}
+
+/**
+ * \brief Remove an entry from its slot
+ * \private
+ */
+static void Scheduler_unlink(struct Scheduler_Entry* entry) {
+    if(entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        *entry->slot = entry->next;
+    }
+
+    if(entry->next) {
+        entry->next->prev = entry->prev;
+    }
+
+    entry->slot = NULL;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+/**
+ * \brief Move the entries of the current slot of a level down the wheel
+ * \private
+ */
+static void Scheduler_cascade(int level) {
+    struct Scheduler_Entry** slot = &wheel[level][(current_tick >> (SCHEDULER_WHEEL_BITS * level)) & WHEEL_MASK];
+    struct Scheduler_Entry* entry = *slot;
+    struct Scheduler_Entry* next;
+
+    *slot = NULL;
+    while(entry) {
+        next = entry->next;
+        Scheduler_insert(entry);
+        entry = next;
+    }
+}
+
+/**
+ * \brief Run every entry in a slot
+ * \private
+ *
+ * Called with the scheduler lock held, which is released while each callback
+ * runs. Entries added to the slot by a callback are run as well.
+ */
+static void Scheduler_runSlot(struct Scheduler_Entry** slot) {
+    struct Scheduler_Entry* entry;
+
+    while(*slot) {
+        entry = *slot;
+        Scheduler_unlink(entry);
+        running_entry = entry;
+
+        pthread_mutex_unlock(&scheduler_lock);
+        entry->func(entry->arg);
+        pthread_mutex_lock(&scheduler_lock);
+
+        running_entry = NULL;
+        pthread_cond_broadcast(&callback_done);
+
+        if(entry->period && !entry->cancelled) {
+            /* Schedule relative to the deadline rather than now so the period
+               does not drift, skipping any periods which were missed */
+            while(entry->expires <= current_tick) {
+                entry->expires += entry->period;
+            }
+            Scheduler_insert(entry);
+        } else {
+            Dictionary_removeInt(entries, entry->id);
+            pending_count--;
+            free(entry);
+        }
+    }
+}
+
+/**
+ * \brief Find the next tick the scheduler needs to wake up for
+ * \private
+ *
+ * The scheduler sleeps until the earliest deadline of any pending entry, even
+ * one still in a higher level of the wheel. Cascades which fall due while it
+ * sleeps are caught up with when it wakes.
+ *
+ * \return The earliest tick at which an entry is due, or -1 if nothing is
+ *   pending
+ */
+static int64_t Scheduler_nextTick(void) {
+    struct Scheduler_Entry* entry;
+    int64_t next_tick = -1;
+    int shift;
+
+    if(pending_count == 0) {
+        return -1;
+    }
+
+    for(int64_t tick = current_tick; tick < current_tick + WHEEL_SIZE; tick++) {
+        if(wheel[0][tick & WHEEL_MASK]) {
+            next_tick = tick;
+            break;
+        }
+    }
+
+    for(int level = 1; level < SCHEDULER_WHEEL_LEVELS; level++) {
+        shift = SCHEDULER_WHEEL_BITS * level;
+
+        /* Slots after the current one are in deadline order. The current slot
+           may also hold entries which have wrapped around the level, so it is
+           checked without ending the search */
+        for(int i = 0; i < WHEEL_SIZE; i++) {
+            entry = wheel[level][((current_tick >> shift) + i) & WHEEL_MASK];
+            for(; entry; entry = entry->next) {
+                if(next_tick == -1 || entry->expires < next_tick) {
+                    next_tick = entry->expires;
+                }
+            }
+
+            if(i > 0 && wheel[level][((current_tick >> shift) + i) & WHEEL_MASK]) {
+                break;
+            }
+        }
+    }
+
+    return (next_tick != -1 && next_tick < current_tick) ? current_tick : next_tick;
+}
+
+/**
+ * \brief Wake the scheduler thread to recompute its delay after the clock is
+ *   stepped or changes rate
+ * \private
+ */
+static void Scheduler_clockChanged(void) {
+    pthread_mutex_lock(&scheduler_lock);
+    pthread_cond_signal(&scheduler_changed);
+    pthread_mutex_unlock(&scheduler_lock);
+}
+
+/**
+ * \brief Scheduler thread main loop
+ * \private
+ */
+static void* Scheduler_thread(void* unused) {
+    struct timespec deadline;
+    int64_t next_tick;
+    int64_t now_tick;
+    int64_t delay;
+
+    pthread_mutex_lock(&scheduler_lock);
+
+    while(true) {
+        next_tick = Scheduler_nextTick();
+
+        delay = (next_tick == -1) ? -1 : Clock_getRealDelay(next_tick * SCHEDULER_RESOLUTION);
+
+        if(delay == -1) {
+            /* Nothing pending or the clock is paused */
+            pthread_cond_wait(&scheduler_changed, &scheduler_lock);
+            continue;
+        } else if(delay > 0) {
+            /* Condition variables wait on the realtime clock */
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += delay / 1000000000LL;
+            deadline.tv_nsec += delay % 1000000000LL;
+            if(deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            if(pthread_cond_timedwait(&scheduler_changed, &scheduler_lock, &deadline) != ETIMEDOUT) {
+                continue;
+            }
+        }
+
+        now_tick = Clock_now() / SCHEDULER_RESOLUTION;
+        while(current_tick <= now_tick) {
+            /* Cascade each level whose lower levels have wrapped */
+            for(int level = 1; level < SCHEDULER_WHEEL_LEVELS; level++) {
+                if(current_tick & ((1LL << (SCHEDULER_WHEEL_BITS * level)) - 1)) {
+                    break;
+                }
+                Scheduler_cascade(level);
+            }
+
+            Scheduler_runSlot(&wheel[0][current_tick & WHEEL_MASK]);
+            current_tick++;
+        }
+    }
+
+    pthread_mutex_unlock(&scheduler_lock);
+    return NULL;
+}
+
+/**
+ * \brief Add an entry to the wheel
+ * \private
+ */
+static int Scheduler_add(int64_t expires, int64_t period, void (*func)(void*), void* arg) {
+    struct Scheduler_Entry* entry = malloc(sizeof(struct Scheduler_Entry));
+    int id;
+
+    pthread_once(&scheduler_once, Scheduler_start);
+
+    pthread_mutex_lock(&scheduler_lock);
+
+    if(pending_count == 0) {
+        /* Nothing is pending so the scheduler thread may have been asleep for
+           a long time. Skip the ticks it missed */
+        current_tick = Clock_now() / SCHEDULER_RESOLUTION;
+    }
+
+    do {
+        id = next_id;
+        next_id = (next_id == INT_MAX) ? 1 : next_id + 1;
+    } while(Dictionary_existsInt(entries, id));
+
+    entry->id = id;
+    entry->expires = expires;
+    entry->period = period;
+    entry->func = func;
+    entry->arg = arg;
+    entry->cancelled = false;
+
+    Scheduler_insert(entry);
+    Dictionary_setInt(entries, id, entry);
+    pending_count++;
+
+    pthread_cond_signal(&scheduler_changed);
+    pthread_mutex_unlock(&scheduler_lock);
+
+    return id;
+}
+
+/**
+ * \brief Run a callback after a delay
+ *
+ * \param delay Seconds to wait before calling func
+ * \param func Callback to run from the scheduler thread
+ * \param arg Argument to pass to func
+ * \return An identifier which can be passed to Scheduler_cancel()
+ */
+int Scheduler_after(double delay, void (*func)(void*), void* arg) {
+    return Scheduler_at(Clock_now() + (int64_t) (delay * 1e9), func, arg);
+}
+
+/**
+ * \brief Run a callback at a deadline
+ *
+ * \param deadline Time to call func at, as returned by Clock_now()
+ * \param func Callback to run from the scheduler thread
+ * \param arg Argument to pass to func
+ * \return An identifier which can be passed to Scheduler_cancel()
+ */
+int Scheduler_at(int64_t deadline, void (*func)(void*), void* arg) {
+    int64_t expires = (deadline + SCHEDULER_RESOLUTION - 1) / SCHEDULER_RESOLUTION;
+    return Scheduler_add(expires, 0, func, arg);
+}
+
+/**
+ * \brief Run a callback periodically
+ *
+ * Call func every period seconds, starting one period from now, until it is
+ * cancelled. Deadlines are computed from the previous deadline so the period
+ * does not drift. If a callback overruns, the missed calls are skipped.
+ *
+ * \param period Seconds between calls. Rounded up to SCHEDULER_RESOLUTION
+ * \param func Callback to run from the scheduler thread
+ * \param arg Argument to pass to func
+ * \return An identifier which can be passed to Scheduler_cancel()
+ */
+int Scheduler_every(double period, void (*func)(void*), void* arg) {
+    int64_t ticks = (int64_t) ((period * 1e9 + SCHEDULER_RESOLUTION - 1) / SCHEDULER_RESOLUTION);
+    int64_t start = Clock_now() / SCHEDULER_RESOLUTION;
+
+    ticks = (ticks < 1) ? 1 : ticks;
+    return Scheduler_add(start + ticks, ticks, func, arg);
+}
+
+/**
+ * \brief Cancel a callback
+ *
+ * Prevent a pending callback from running. If the callback is currently
+ * running then wait for it to complete (unless called from the callback
+ * itself). Once this returns the callback will not be called again and any
+ * resources it uses can be freed.
+ *
+ * \param id The identifier returned when the callback was scheduled
+ * \return 0 if the callback was cancelled before it (or for a periodic
+ *   callback, its next call) ran, or -1 if it had already run or the
+ *   identifier is not known
+ */
+int Scheduler_cancel(int id) {
+    struct Scheduler_Entry* entry;
+    int rc = 0;
+
+    if(entries == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&scheduler_lock);
+
+    entry = Dictionary_getInt(entries, id);
+    if(entry == NULL) {
+        rc = -1;
+    } else if(entry == running_entry) {
+        /* One shot callbacks have already run at this point */
+        rc = entry->period ? 0 : -1;
+        entry->cancelled = true;
+
+        if(!pthread_equal(pthread_self(), scheduler_thread)) {
+            while(running_entry == entry) {
+                pthread_cond_wait(&callback_done, &scheduler_lock);
+            }
+        }
+    } else {
+        Scheduler_unlink(entry);
+        Dictionary_removeInt(entries, id);
+        pending_count--;
+        free(entry);
+    }
+
+    pthread_mutex_unlock(&scheduler_lock);
+
+    return rc;
+}
+
+/**
+ * \brief Get the number of pending callbacks
+ *
+ * \return Number of scheduled callbacks which have not yet run or been
+ *   cancelled, including periodic callbacks
+ */
+int Scheduler_getPendingCount(void) {
+    int count;
+
+    pthread_mutex_lock(&scheduler_lock);
+    count = pending_count;
+    pthread_mutex_unlock(&scheduler_lock);
+
+    return count;
+}
+
+/** \} */
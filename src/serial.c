@@ -264,6 +264,29 @@ void Serial_flush(SerialPort sp) {
     tcflush(sp, TCIOFLUSH); /* Zero input buffers */
 }
 
+/**
+ * \brief Flush only input buffers
+ *
+ * Discard received but unread data, leaving output which has not been
+ * transmitted yet in place
+ *
+ * \param sp A handler for a serial port to flush
+ */
+void Serial_flushInput(SerialPort sp) {
+    tcflush(sp, TCIFLUSH);
+}
+
+/**
+ * \brief Wait for output to be transmitted
+ *
+ * Block until all data written to the port has been transmitted
+ *
+ * \param sp A handler for a serial port
+ */
+void Serial_drain(SerialPort sp) {
+    tcdrain(sp);
+}
+
 /**
  * \brief Set blocking
  *
@@ -360,8 +383,16 @@ int Serial_get(SerialPort sp, void* buffer, size_t count) {
 
         n = read(sp, buffer_c, count);
 
+        // if interrupted by a signal, try again
+        if(n == -1 && errno == EINTR) {
+            continue;
+
         // if error occured, report it
-        if(n == -1) {
+        } else if(n == -1) {
+            return -1;
+
+        // if the device hung up nothing more will arrive
+        } else if(n == 0 && (fd.revents & POLLHUP)) {
             return -1;
 
         // if no bytes read, treat it as writing a NULL character
@@ -378,6 +409,116 @@ int Serial_get(SerialPort sp, void* buffer, size_t count) {
     return 0;
 }
 
+/**
+ * \brief Create a buffered reader
+ *
+ * Create a buffered reader for the given serial port. Reads are performed in
+ * chunks of up to SERIAL_READER_BUFFER_SIZE bytes and each chunk is tagged with
+ * the time it was read. Data buffered in a reader is not visible to
+ * Serial_get() and friends, so a port should be read through only one of the
+ * two interfaces.
+ *
+ * \param sp Handler for the device to read from
+ * \return A new reader or NULL on failure
+ */
+Serial_Reader* Serial_Reader_new(SerialPort sp) {
+    Serial_Reader* reader = malloc(sizeof(Serial_Reader));
+    if(reader == NULL) {
+        return NULL;
+    }
+
+    reader->sp = sp;
+    reader->head = 0;
+    reader->length = 0;
+    reader->timestamp = 0;
+
+    return reader;
+}
+
+/**
+ * \brief Read the next chunk into a reader
+ *
+ * Read as much data as is available (up to the size of the buffer) and record
+ * the time of the read. Blocks for data if the port is blocking.
+ *
+ * \param reader The reader to fill
+ * \return -1 if an error occurs or no data is available, 0 otherwise
+ */
+static int Serial_Reader_fill(Serial_Reader* reader) {
+    struct pollfd fd = {.fd = reader->sp, .events = POLLRDNORM};
+    int blocking = (~fcntl(reader->sp, F_GETFL)) & O_NONBLOCK;
+    ssize_t n;
+
+    do {
+        if(blocking) {
+            poll(&fd, 1, -1);
+        }
+
+        n = read(reader->sp, reader->buffer, SERIAL_READER_BUFFER_SIZE);
+
+        /* Stamp the chunk as close to the read as possible */
+        reader->timestamp = Timer_getTimestamp();
+    } while((n == -1 && errno == EINTR) || (n == 0 && blocking && !(fd.revents & POLLHUP)));
+
+    if(n <= 0) {
+        return -1;
+    }
+
+    reader->head = 0;
+    reader->length = n;
+
+    return 0;
+}
+
+/**
+ * \brief Get a byte from a buffered reader
+ *
+ * Return the next byte from the reader, reading a new chunk from the device if
+ * the buffer is empty
+ *
+ * \param reader The reader to read from
+ * \param[out] timestamp If not NULL, the receive time of the byte in
+ *   nanoseconds (see Timer_getTimestamp()) is stored here
+ * \return -1 in case of failure, otherwise the byte read
+ */
+int Serial_Reader_getByte(Serial_Reader* reader, int64_t* timestamp) {
+    if(reader->head == reader->length) {
+        if(Serial_Reader_fill(reader) == -1) {
+            return -1;
+        }
+    }
+
+    if(timestamp) {
+        *timestamp = reader->timestamp;
+    }
+
+    return reader->buffer[reader->head++];
+}
+
+/**
+ * \brief Get the number of buffered bytes
+ *
+ * Return the number of bytes already read from the device but not yet returned
+ * by Serial_Reader_getByte()
+ *
+ * \param reader The reader to check
+ * \return The number of bytes buffered
+ */
+size_t Serial_Reader_buffered(Serial_Reader* reader) {
+    return reader->length - reader->head;
+}
+
+/**
+ * \brief Destroy a buffered reader
+ *
+ * Free the reader. The underlying serial port is not closed.
+ *
+ * \param reader The reader to destroy
+ */
+void Serial_Reader_destroy(Serial_Reader* reader) {
+    free(reader);
+}
+
 /**
  * \brief Send a byte
  *
@@ -34,25 +34,45 @@ struct WrapperArgs {
 };
 
 /**
- * Arguments passed to Task_watcher()
+ * State shared between Task_watchdog() and its scheduled timeout
  * \private
  */
-struct WatcherArgs {
+struct WatchdogArgs {
     /**
-     * Thread to watch
+     * The function to be called
+     * \private
+     */
+    int (*func)(void);
+
+    /**
+     * Return value of func() stored here
+     * \private
+     */
+    int return_value;
+
+    /**
+     * Thread running func
+     * \private
+     */
+    pthread_t thread;
+
+    /**
+     * Set by the thread once func has returned so it is no longer cancelled
      * \private
      */
-    pthread_t* dependant;
+    bool finished;
 
     /**
-     * How long to wait
+     * Protects finished
      * \private
      */
-    double timeout;
+    pthread_mutex_t lock;
 };
 
 static void* Task_callWrapper(void* _args);
-static void* Task_watcher(void* _args);
+static void* Task_watchdogWrapper(void* _args);
+static void Task_watchdogExpired(void* _args);
+static void Task_cancelCallback(void* _token);
 
 /**
  * \defgroup Task Task scheduling and management
@@ -95,26 +115,62 @@ static void* Task_callWrapper(void* _args) {
  * \brief Call wrapper for watchdog
  * \private
  *
- * _args is cast to a WatcherArgs pointer (args). This function sleeps, and if
- * it is not canceled before returning from the sleep call, cancels the thread
- * given by args->dependant
+ * Call WatchdogArgs->func and mark it finished so that the timeout no longer
+ * cancels the thread
  *
- * \param _args A WatcherArgs pointer cast to void*
+ * \param _args A WatchdogArgs pointer cast to void*
  * \return NULL
  */
-static void* Task_watcher(void* _args) {
-    struct WatcherArgs* args = (struct WatcherArgs*)_args;
-    Util_usleep(args->timeout);
-    pthread_cancel(*args->dependant);
+static void* Task_watchdogWrapper(void* _args) {
+    struct WatchdogArgs* args = (struct WatchdogArgs*) _args;
+    int return_value = args->func();
+
+    pthread_mutex_lock(&args->lock);
+    args->return_value = return_value;
+    args->finished = true;
+    pthread_mutex_unlock(&args->lock);
+
     return NULL;
 }
 
+/**
+ * \brief Watchdog timeout
+ * \private
+ *
+ * Run by the scheduler when a watchdog expires. Cancels the watched thread if
+ * it is still running
+ *
+ * \param _args A WatchdogArgs pointer cast to void*
+ */
+static void Task_watchdogExpired(void* _args) {
+    struct WatchdogArgs* args = (struct WatchdogArgs*) _args;
+
+    pthread_mutex_lock(&args->lock);
+    if(!args->finished) {
+        pthread_cancel(args->thread);
+    }
+    pthread_mutex_unlock(&args->lock);
+}
+
+/**
+ * \brief Cancellation token timeout
+ * \private
+ *
+ * \param _token A Task_CancelToken pointer cast to void*
+ */
+static void Task_cancelCallback(void* _token) {
+    Task_CancelToken_cancel((Task_CancelToken*) _token);
+}
+
 /**
  * \brief Run a function with a timeout
  *
  * Run the given function with a timeout. If the function runs longer than the
  * timeout allows, the function call will be terminated and this function will
- * return
+ * return. The function is run in its own thread and terminated with
+ * pthread_cancel(), so it must not hold locks or other resources across
+ * cancellation points. Prefer Task_timeout() for functions which can check a
+ * cancellation token.
  *
  * \param func Function to call
  * \param timeout Number of seconds before killing the function call and
@@ -123,25 +179,67 @@ static void* Task_watcher(void* _args) {
  * \return 0 if func returned before the timeout expired, or -1 if a timeout occured
  */
 int Task_watchdog(int (*func)(void), double timeout, int* retval) {
-    pthread_t func_th;
-    pthread_t watchdog_th;
-    struct WrapperArgs func_args = {func, 0, false};
-    struct WatcherArgs watchdog_args = {&func_th, timeout};
-    int timed_out = -1;
-
-    pthread_create(&func_th, NULL, Task_callWrapper, &func_args);
-    pthread_create(&watchdog_th, NULL, Task_watcher, &watchdog_args);
-
-    /* Wait for main function - may be canceled by watcher */
-    if(pthread_join(func_th, NULL) == 0) {
-        (*retval) = func_args.return_value;
-        timed_out = 0;
+    struct WatchdogArgs args;
+    void* result;
+    int timer;
+
+    args.func = func;
+    args.return_value = 0;
+    args.finished = false;
+    pthread_mutex_init(&args.lock, NULL);
+
+    pthread_create(&args.thread, NULL, Task_watchdogWrapper, &args);
+    timer = Scheduler_after(timeout, Task_watchdogExpired, &args);
+
+    /* Wait for main function - may be canceled by the timeout */
+    pthread_join(args.thread, &result);
+
+    /* Ensure the timeout is not running and will not run */
+    Scheduler_cancel(timer);
+    pthread_mutex_destroy(&args.lock);
+
+    if(result == PTHREAD_CANCELED) {
+        return -1;
+    }
+
+    if(retval) {
+        (*retval) = args.return_value;
     }
+    return 0;
+}
+
+/**
+ * \brief Run a function with a cooperative timeout
+ *
+ * Run the given function in the calling thread, passing it a cancellation
+ * token which is cancelled once the timeout expires. The function is expected
+ * to check the token with Task_CancelToken_isCancelled() and return early once
+ * it is cancelled. No threads are created; the timeout is a single entry in
+ * the scheduler.
+ *
+ * \param func Function to call
+ * \param arg Argument passed to func along with the token
+ * \param timeout Number of seconds before the token is cancelled
+ * \param retval If not NULL, the return value of func will be stored here
+ * \return 0 if func returned before the timeout expired, or -1 if the token
+ * was cancelled
+ */
+int Task_timeout(int (*func)(Task_CancelToken*, void*), void* arg, double timeout, int* retval) {
+    Task_CancelToken* token = Task_CancelToken_new();
+    int timer = Task_CancelToken_cancelAfter(token, timeout);
+    int return_value = func(token, arg);
+    int timed_out;
 
-    /* Cancel and wait for watcher */
-    pthread_cancel(watchdog_th);
-    pthread_join(watchdog_th, NULL);
+    /* Check the token as soon as func returns, so a timeout firing between
+       the return and cancelling the timer does not count against a call
+       which completed */
+    timed_out = Task_CancelToken_isCancelled(token) ? -1 : 0;
+    Scheduler_cancel(timer);
+    Task_CancelToken_destroy(token);
 
+    if(retval) {
+        (*retval) = return_value;
+    }
     return timed_out;
 }
 
@@ -230,4 +328,69 @@ void Task_wait(Task_Handle task) {
     pthread_join(task, NULL);
 }
 
+/**
+ * \brief Create a cancellation token
+ *
+ * \return A new, uncancelled token
+ */
+Task_CancelToken* Task_CancelToken_new(void) {
+    Task_CancelToken* token = malloc(sizeof(Task_CancelToken));
+
+    token->cancelled = false;
+    pthread_mutex_init(&token->lock, NULL);
+
+    return token;
+}
+
+/**
+ * \brief Cancel a token
+ *
+ * \param token The token to cancel
+ */
+void Task_CancelToken_cancel(Task_CancelToken* token) {
+    pthread_mutex_lock(&token->lock);
+    token->cancelled = true;
+    pthread_mutex_unlock(&token->lock);
+}
+
+/**
+ * \brief Check a token
+ *
+ * \param token The token to check
+ * \return True if the token has been cancelled
+ */
+bool Task_CancelToken_isCancelled(Task_CancelToken* token) {
+    bool cancelled;
+
+    pthread_mutex_lock(&token->lock);
+    cancelled = token->cancelled;
+    pthread_mutex_unlock(&token->lock);
+
+    return cancelled;
+}
+
+/**
+ * \brief Cancel a token after a timeout
+ *
+ * Schedule the token to be cancelled. The returned identifier must be passed
+ * to Scheduler_cancel() before the token is destroyed.
+ *
+ * \param token The token to cancel
+ * \param timeout Seconds until the token is cancelled
+ * \return A scheduler identifier for the timeout
+ */
+int Task_CancelToken_cancelAfter(Task_CancelToken* token, double timeout) {
+    return Scheduler_after(timeout, Task_cancelCallback, token);
+}
+
+/**
+ * \brief Destroy a token
+ *
+ * \param token The token to destroy
+ */
+void Task_CancelToken_destroy(Task_CancelToken* token) {
+    pthread_mutex_destroy(&token->lock);
+    free(token);
+}
+
 /** \} */
@@ -5,7 +5,27 @@
 
 #include "seawolf.h"
 
-static double get_monotonic_seconds(void);
+#include <time.h>
+
+/* The time stamp counter can be read directly on x86 */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define TIMER_HAVE_TSC
+#endif
+
+/**
+ * How long to calibrate the time stamp counter for, in nanoseconds
+ */
+#define TSC_CALIBRATION_TIME 20000000LL
+
+static int64_t get_monotonic_nanoseconds(void);
+static int64_t get_tsc_nanoseconds(void);
+static int64_t get_nanoseconds(void);
+
+#ifdef TIMER_HAVE_TSC
+static uint64_t read_tsc(void);
+static bool tsc_is_invariant(void);
+static void calibrate_tsc(void);
+#endif
 
 #ifdef __SW_Darwin__
 
@@ -13,24 +33,120 @@ static double get_monotonic_seconds(void);
 
 static mach_timebase_info_data_t timebase;
 
-static double get_monotonic_seconds(void) {
+static int64_t get_monotonic_nanoseconds(void) {
     uint64_t now = mach_absolute_time();
-    double nanoseconds = ((double) now * timebase.numer) / timebase.denom;
-    return nanoseconds * 1e-9;
+
+    if(timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+
+    return (int64_t) ((now * timebase.numer) / timebase.denom);
 }
 
 #else
 
-# include <time.h>
-
-static double get_monotonic_seconds(void) {
+static int64_t get_monotonic_nanoseconds(void) {
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
-    return ((double) now.tv_sec) + (((double) now.tv_nsec) * 1e-9);
+    return ((int64_t) now.tv_sec) * 1000000000LL + now.tv_nsec;
 }
 
 #endif
 
+/**
+ * \cond Timer_Internal
+ * \internal
+ */
+
+/**
+ * Clock source used by Timer objects
+ */
+static Timer_ClockSource clock_source = TIMER_CLOCK_MONOTONIC;
+
+/**
+ * Monotonic time at which the TSC was calibrated
+ */
+static int64_t tsc_base_ns = 0;
+
+/**
+ * TSC value at which it was calibrated
+ */
+static uint64_t tsc_base = 0;
+
+/**
+ * Nanoseconds per TSC tick
+ */
+static double tsc_period = 0;
+
+/**
+ * \endcond Timer_Internal
+ */
+
+#ifdef TIMER_HAVE_TSC
+
+static uint64_t read_tsc(void) {
+    uint32_t low, high;
+    __asm__ __volatile__("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t) high << 32) | low;
+}
+
+/**
+ * Check for a TSC which runs at a constant rate in all power states
+ */
+static bool tsc_is_invariant(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    __asm__ __volatile__("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0x80000000), "c" (0));
+    if(eax < 0x80000007) {
+        return false;
+    }
+
+    __asm__ __volatile__("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0x80000007), "c" (0));
+    return (edx & (1 << 8)) != 0;
+}
+
+/**
+ * Measure the TSC rate against the monotonic clock
+ */
+static void calibrate_tsc(void) {
+    struct timespec delay = {0, TSC_CALIBRATION_TIME};
+    int64_t start_ns, end_ns;
+    uint64_t start, end;
+
+    start_ns = get_monotonic_nanoseconds();
+    start = read_tsc();
+
+    nanosleep(&delay, NULL);
+
+    end_ns = get_monotonic_nanoseconds();
+    end = read_tsc();
+
+    tsc_period = ((double) (end_ns - start_ns)) / (end - start);
+    tsc_base_ns = end_ns;
+    tsc_base = end;
+}
+
+static int64_t get_tsc_nanoseconds(void) {
+    return tsc_base_ns + (int64_t) ((int64_t) (read_tsc() - tsc_base) * tsc_period);
+}
+
+#else
+
+static int64_t get_tsc_nanoseconds(void) {
+    return get_monotonic_nanoseconds();
+}
+
+#endif
+
+static int64_t get_nanoseconds(void) {
+    if(Clock_isVirtual()) {
+        return Clock_now();
+    } else if(clock_source == TIMER_CLOCK_TSC) {
+        return get_tsc_nanoseconds();
+    }
+    return get_monotonic_nanoseconds();
+}
+
 /**
  * \defgroup Timer Timer
  * \ingroup Utilities
@@ -44,6 +160,78 @@ void Timer_init(void) {
 #endif
 }
 
+/**
+ * \brief Select the clock source used by timers
+ *
+ * Timer objects and Timer_now() read the monotonic clock by default. On x86
+ * processors with an invariant time stamp counter the counter can be used
+ * instead, which is considerably cheaper to read. The counter is calibrated
+ * against the monotonic clock when selected, which takes a few milliseconds.
+ * This can also be set with the timer_clock configuration option. When a
+ * virtual Clock source is selected timers follow it instead.
+ *
+ * \param source The clock source to use
+ * \return 0 on success, or -1 if the source is not available in which case the
+ *   monotonic clock is used
+ */
+int Timer_setClockSource(Timer_ClockSource source) {
+    if(source == TIMER_CLOCK_MONOTONIC) {
+        clock_source = TIMER_CLOCK_MONOTONIC;
+        return 0;
+    }
+
+#ifdef TIMER_HAVE_TSC
+    if(tsc_is_invariant()) {
+        if(tsc_period == 0) {
+            calibrate_tsc();
+        }
+        clock_source = TIMER_CLOCK_TSC;
+        return 0;
+    }
+#endif
+
+    Logging_log(WARNING, "No invariant time stamp counter available, using the monotonic clock");
+    clock_source = TIMER_CLOCK_MONOTONIC;
+    return -1;
+}
+
+/**
+ * \brief Get the clock source used by timers
+ *
+ * \return The current clock source
+ */
+Timer_ClockSource Timer_getClockSource(void) {
+    return clock_source;
+}
+
+/**
+ * \brief Get a monotonic timestamp
+ *
+ * Return the current value of the system monotonic clock in nanoseconds. The
+ * clock has an arbitrary epoch but is shared by all processes on the host, so
+ * timestamps taken in different processes can be compared directly.
+ *
+ * \return Nanoseconds on the monotonic clock
+ */
+int64_t Timer_getTimestamp(void) {
+    return get_monotonic_nanoseconds();
+}
+
+/**
+ * \brief Get the current time from the timer clock source
+ *
+ * Return the current time in nanoseconds from the clock source selected with
+ * Timer_setClockSource(). The epoch matches Timer_getTimestamp(), but when
+ * using the time stamp counter the two may drift apart slightly over time, so
+ * only differences between values returned by this function should be relied
+ * upon.
+ *
+ * \return Nanoseconds on the timer clock
+ */
+int64_t Timer_now(void) {
+    return get_nanoseconds();
+}
+
 /**
  * \brief Return a new Timer object
  *
@@ -63,6 +251,35 @@ Timer* Timer_new(void) {
     return tm;
 }
 
+/**
+ * \brief Get a time delta in nanoseconds
+ *
+ * Return the time delta in nanoseconds since the last call to
+ * Timer_getDeltaNS() or Timer_getDelta(), or since the Timer was created
+ *
+ * \param tm The timer to get the delta for
+ * \return Nanoseconds since the timer being created or the last delta
+ */
+int64_t Timer_getDeltaNS(Timer* tm) {
+    int64_t now = get_nanoseconds();
+    int64_t diff = now - tm->last;
+    tm->last = now;
+
+    return diff;
+}
+
+/**
+ * \brief Get total time delay in nanoseconds
+ *
+ * Get the time delta in nanoseconds since the Timer was created or last reset
+ *
+ * \param tm The timer to get the delay for
+ * \return Nanoseconds since timer reset or timer creation
+ */
+int64_t Timer_getTotalNS(Timer* tm) {
+    return get_nanoseconds() - tm->base;
+}
+
 /**
  * \brief Get a time delta
  *
@@ -74,11 +291,7 @@ Timer* Timer_new(void) {
  * Timer_getDelta()
  */
 double Timer_getDelta(Timer* tm) {
-    double now = get_monotonic_seconds();
-    double diff = now - tm->last;
-    tm->last = now;
-
-    return diff;
+    return Timer_getDeltaNS(tm) * 1e-9;
 }
 
 /**
@@ -90,7 +303,7 @@ double Timer_getDelta(Timer* tm) {
  * \return Seconds since timer reset or timer creation
  */
 double Timer_getTotal(Timer* tm) {
-    return get_monotonic_seconds() - tm->base;
+    return Timer_getTotalNS(tm) * 1e-9;
 }
 
 /**
@@ -102,7 +315,7 @@ double Timer_getTotal(Timer* tm) {
  */
 void Timer_reset(Timer* tm) {
     /* Store the time into base and copy to last */
-    tm->last = tm->base = get_monotonic_seconds();
+    tm->last = tm->base = get_nanoseconds();
 }
 
 /**
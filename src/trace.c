@@ -0,0 +1,531 @@
+/**
+ * \file
+ * \brief Event tracing
+ */
+
+#include "seawolf.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+/**
+ * \cond Trace_Private
+ * \internal
+ */
+
+/**
+ * A single trace event
+ */
+typedef struct {
+    /** Time of the event, from Timer_getTimestamp() */
+    int64_t timestamp;
+
+    /** Duration of a complete event */
+    int64_t duration;
+
+    /** Event name. Must be a string constant */
+    const char* name;
+
+    /** Chrome trace event phase, one of B, E, i or X */
+    char phase;
+} Trace_Event;
+
+/**
+ * Events recorded by a single thread. Only the owning thread writes to a ring,
+ * so recording an event takes no locks. Readers copy the events and then use
+ * head to discard any which were overwritten while copying.
+ */
+typedef struct Trace_Ring_s {
+    /** Most recent TRACE_RING_SIZE events */
+    Trace_Event events[TRACE_RING_SIZE];
+
+    /** Number of events written since the ring was claimed */
+    volatile uint64_t head;
+
+    /** Thread ID used in the trace */
+    int tid;
+
+    /** Thread name */
+    char name[TRACE_NAME_LEN];
+
+    /** True while owned by a running thread */
+    bool in_use;
+
+    /** Next ring in the list of all rings */
+    struct Trace_Ring_s* next;
+} Trace_Ring;
+
+/** If true, events are recorded */
+static bool enabled = false;
+
+/** File written by Trace_dump() when no file is given */
+static char* trace_file = NULL;
+
+/** Function messages about dumps are logged through */
+static void (*logger)(short level, char* message) = Logging_log;
+
+/** Thread specific ring */
+static pthread_key_t ring_key;
+
+/** Initializes ring_key once */
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/** All rings, including those released by exited threads */
+static Trace_Ring* rings = NULL;
+
+/** Thread ID of the next ring to be claimed */
+static int next_tid = 1;
+
+/** Protects rings and next_tid */
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Written to by the signal handler to request a dump */
+static int dump_pipe[2] = {-1, -1};
+
+/** Task handle of the thread waiting for dump requests */
+static Task_Handle dump_thread;
+
+/** Handler for the dump signal before Trace_init() */
+static struct sigaction old_dump_action;
+
+/** Component initialization status */
+static bool initialized = false;
+
+static void Trace_createKey(void);
+static void Trace_releaseRing(void* ring);
+static Trace_Ring* Trace_getRing(void);
+static void Trace_record(const char* name, char phase, int64_t timestamp, int64_t duration);
+static const char* Trace_getFile(char* buffer, size_t size);
+static void Trace_writeString(FILE* out, const char* string);
+static void Trace_catchSignal(int sig);
+static int Trace_dumpThread(void);
+
+/**
+ * \endcond Trace_Private
+ */
+
+/**
+ * \defgroup Trace Tracing
+ * \ingroup Utilities
+ * \brief Low overhead per-thread event tracing with Chrome trace export
+ * \{
+ */
+
+/**
+ * \brief Initialize the Trace component
+ *
+ * If tracing is enabled, SIGUSR2 is caught and causes the trace to be written
+ * to the file set by Trace_setFile()
+ *
+ * \private
+ */
+void Trace_init(void) {
+    struct sigaction action;
+
+    if(!enabled || initialized) {
+        return;
+    }
+
+    if(pipe(dump_pipe) != 0) {
+        logger(ERROR, __Util_format("Unable to create trace dump pipe: %s", strerror(errno)));
+        return;
+    }
+
+    initialized = true;
+    dump_thread = Task_background(&Trace_dumpThread);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Trace_catchSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR2, &action, &old_dump_action);
+}
+
+/**
+ * \brief Enable or disable tracing
+ *
+ * Events are only recorded while tracing is enabled. Must be enabled before
+ * Seawolf_init() for the dump signal to be caught.
+ *
+ * \param do_enable If true, record events
+ */
+void Trace_setEnabled(bool do_enable) {
+    enabled = do_enable;
+}
+
+/**
+ * \brief Check if tracing is enabled
+ *
+ * \return True if events are being recorded
+ */
+bool Trace_enabled(void) {
+    return enabled;
+}
+
+/**
+ * \brief Set the trace file
+ *
+ * \param filename File written by Trace_dump() and on receipt of SIGUSR2. The
+ * default is TRACE_DEFAULT_FILE
+ */
+void Trace_setFile(const char* filename) {
+    if(trace_file) {
+        free(trace_file);
+    }
+
+    trace_file = strdup(filename);
+}
+
+/**
+ * \brief Set the function messages about dumps are logged through
+ *
+ * By default messages are logged with Logging_log(), which sends them to the
+ * hub. A process which is not a hub client, such as the hub itself, should set
+ * its own logging function before calling Trace_init().
+ *
+ * \param func Function to log messages with, or NULL for Logging_log()
+ */
+void Trace_setLogger(void (*func)(short level, char* message)) {
+    logger = func ? func : Logging_log;
+}
+
+/**
+ * \brief Name the calling thread in the trace
+ *
+ * \param name Thread name, truncated to TRACE_NAME_LEN - 1 characters
+ */
+void Trace_setThreadName(const char* name) {
+    Trace_Ring* ring;
+
+    if(!enabled || (ring = Trace_getRing()) == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&rings_lock);
+    strncpy(ring->name, name, TRACE_NAME_LEN - 1);
+    ring->name[TRACE_NAME_LEN - 1] = '\0';
+    pthread_mutex_unlock(&rings_lock);
+}
+
+/**
+ * \brief Begin a span
+ *
+ * \param name Span name. Must be a string constant
+ */
+void Trace_begin(const char* name) {
+    if(enabled) {
+        Trace_record(name, 'B', Timer_getTimestamp(), 0);
+    }
+}
+
+/**
+ * \brief End the span most recently begun by the calling thread
+ *
+ * \param name Span name. Must be a string constant
+ */
+void Trace_end(const char* name) {
+    if(enabled) {
+        Trace_record(name, 'E', Timer_getTimestamp(), 0);
+    }
+}
+
+/**
+ * \brief Record an instantaneous event
+ *
+ * \param name Event name. Must be a string constant
+ */
+void Trace_instant(const char* name) {
+    if(enabled) {
+        Trace_record(name, 'i', Timer_getTimestamp(), 0);
+    }
+}
+
+/**
+ * \brief Record a span which ends now
+ *
+ * Useful for code with several return paths which already takes a start time
+ *
+ * \param name Span name. Must be a string constant
+ * \param start Start of the span, from Timer_getTimestamp()
+ */
+void Trace_complete(const char* name, int64_t start) {
+    if(enabled) {
+        Trace_record(name, 'X', start, Timer_getTimestamp() - start);
+    }
+}
+
+/**
+ * \brief Write the trace
+ *
+ * Write the events held for every thread as Chrome trace event JSON, which can
+ * be loaded by chrome://tracing or Perfetto. Threads may keep recording while
+ * the trace is written.
+ *
+ * \param filename File to write, or NULL for the file set by Trace_setFile()
+ * \return 0 on success, -1 if the file could not be written
+ */
+int Trace_dump(const char* filename) {
+    char default_file[64];
+    Trace_Event* events;
+    Trace_Ring* ring;
+    Trace_Event* event;
+    uint64_t first, head;
+    bool comma = false;
+    int pid = getpid();
+    FILE* out;
+
+    if(filename == NULL) {
+        filename = Trace_getFile(default_file, sizeof(default_file));
+    }
+
+    out = fopen(filename, "w");
+    if(out == NULL) {
+        return -1;
+    }
+
+    events = malloc(sizeof(Trace_Event) * TRACE_RING_SIZE);
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    pthread_mutex_lock(&rings_lock);
+    for(ring = rings; ring != NULL; ring = ring->next) {
+        head = ring->head;
+        __sync_synchronize();
+
+        first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+        for(uint64_t i = first; i < head; i++) {
+            events[i & (TRACE_RING_SIZE - 1)] = ring->events[i & (TRACE_RING_SIZE - 1)];
+        }
+
+        /* Skip events the thread overwrote while they were being copied */
+        __sync_synchronize();
+        if(ring->head > TRACE_RING_SIZE && ring->head - TRACE_RING_SIZE > first) {
+            first = ring->head - TRACE_RING_SIZE;
+        }
+
+        fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                comma ? "," : "", pid, ring->tid);
+        Trace_writeString(out, ring->name);
+        fprintf(out, "}}");
+        comma = true;
+
+        for(uint64_t i = first; i < head; i++) {
+            event = &events[i & (TRACE_RING_SIZE - 1)];
+
+            fprintf(out, ",\n{\"name\":");
+            Trace_writeString(out, event->name);
+            fprintf(out, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                    event->phase, event->timestamp / 1000.0, pid, ring->tid);
+
+            if(event->phase == 'X') {
+                fprintf(out, ",\"dur\":%.3f", event->duration / 1000.0);
+            } else if(event->phase == 'i') {
+                fprintf(out, ",\"s\":\"t\"");
+            }
+            fprintf(out, "}");
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    fprintf(out, "\n]}\n");
+    free(events);
+
+    if(fclose(out) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Close the Trace component
+ *
+ * Stop catching the dump signal. Rings are kept since other threads may still
+ * be recording events.
+ *
+ * \private
+ */
+void Trace_close(void) {
+    if(!initialized) {
+        return;
+    }
+
+    initialized = false;
+    sigaction(SIGUSR2, &old_dump_action, NULL);
+    Task_kill(dump_thread);
+
+    close(dump_pipe[0]);
+    close(dump_pipe[1]);
+}
+
+/** \} */
+
+/**
+ * \cond Trace_Private
+ * \internal
+ */
+
+/**
+ * \brief Create the thread specific ring key
+ */
+static void Trace_createKey(void) {
+    pthread_key_create(&ring_key, Trace_releaseRing);
+}
+
+/**
+ * \brief Release the ring of an exiting thread
+ *
+ * The ring can then be claimed by a new thread. Its events are kept until then.
+ *
+ * \param ring The ring
+ */
+static void Trace_releaseRing(void* ring) {
+    pthread_mutex_lock(&rings_lock);
+    ((Trace_Ring*) ring)->in_use = false;
+    pthread_mutex_unlock(&rings_lock);
+}
+
+/**
+ * \brief Get the ring of the calling thread
+ *
+ * Claims a released ring or allocates a new one the first time a thread
+ * records an event
+ *
+ * \return The ring, or NULL if one could not be allocated
+ */
+static Trace_Ring* Trace_getRing(void) {
+    Trace_Ring* ring;
+
+    pthread_once(&ring_key_once, Trace_createKey);
+
+    ring = pthread_getspecific(ring_key);
+    if(ring != NULL) {
+        return ring;
+    }
+
+    pthread_mutex_lock(&rings_lock);
+    for(ring = rings; ring != NULL && ring->in_use; ring = ring->next);
+
+    if(ring == NULL) {
+        ring = malloc(sizeof(Trace_Ring));
+        if(ring == NULL) {
+            pthread_mutex_unlock(&rings_lock);
+            return NULL;
+        }
+
+        ring->next = rings;
+        rings = ring;
+    }
+
+    ring->head = 0;
+    ring->tid = next_tid++;
+    snprintf(ring->name, TRACE_NAME_LEN, "Thread %d", ring->tid);
+    ring->in_use = true;
+    pthread_mutex_unlock(&rings_lock);
+
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+/**
+ * \brief Record an event in the calling thread's ring
+ */
+static void Trace_record(const char* name, char phase, int64_t timestamp, int64_t duration) {
+    Trace_Ring* ring = Trace_getRing();
+    Trace_Event* event;
+
+    if(ring == NULL) {
+        return;
+    }
+
+    event = &ring->events[ring->head & (TRACE_RING_SIZE - 1)];
+    event->timestamp = timestamp;
+    event->duration = duration;
+    event->name = name;
+    event->phase = phase;
+
+    /* Publish the event before advancing the head */
+    __sync_synchronize();
+    ring->head++;
+}
+
+/**
+ * \brief Get the file the trace is written to by default
+ *
+ * \param buffer Buffer to format the default file name in
+ * \param size Size of buffer
+ * \return The file set by Trace_setFile(), or TRACE_DEFAULT_FILE
+ */
+static const char* Trace_getFile(char* buffer, size_t size) {
+    if(trace_file) {
+        return trace_file;
+    }
+
+    snprintf(buffer, size, TRACE_DEFAULT_FILE, (int) getpid());
+    return buffer;
+}
+
+/**
+ * \brief Write a JSON string
+ */
+static void Trace_writeString(FILE* out, const char* string) {
+    fputc('"', out);
+    for(; *string != '\0'; string++) {
+        if(*string == '"' || *string == '\\') {
+            fputc('\\', out);
+            fputc(*string, out);
+        } else if((unsigned char) *string < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char) *string);
+        } else {
+            fputc(*string, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * \brief Request a dump from the dump thread
+ *
+ * Only async-signal-safe functions may be called here, so the request is
+ * passed through a pipe
+ */
+static void Trace_catchSignal(int sig) {
+    int saved_errno = errno;
+
+    if(write(dump_pipe[1], "d", 1) < 0) {
+        /* Nothing can be done from a signal handler */
+    }
+
+    errno = saved_errno;
+}
+
+/**
+ * \brief Write the trace each time it is requested
+ *
+ * Spawned by Trace_init()
+ *
+ * \return Does not return. This task is killed in Trace_close()
+ */
+static int Trace_dumpThread(void) {
+    char default_file[64];
+    const char* filename;
+    char request;
+
+    while(read(dump_pipe[0], &request, 1) == 1) {
+        /* Only allow the task to be killed while waiting */
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        filename = Trace_getFile(default_file, sizeof(default_file));
+        if(Trace_dump(filename) == 0) {
+            logger(INFO, __Util_format("Wrote trace to %s", filename));
+        } else {
+            logger(ERROR, __Util_format("Unable to write trace to %s: %s", filename, strerror(errno)));
+        }
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * \endcond Trace_Private
+ */
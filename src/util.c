@@ -153,13 +153,19 @@ char* __Util_format(char* format, ...) {
 /**
  * \brief Sleep
  *
- * Pause for s seconds
+ * Pause for s seconds. With a virtual Clock these are seconds of clock time
  *
  * \param s Seconds to sleep
  */
 void Util_usleep(double s) {
     /* Construct a timespec object with the length of time taken from s */
     struct timespec ts;
+
+    if(Clock_isVirtual()) {
+        Clock_sleep(s);
+        return;
+    }
+
     ts.tv_sec = (int)s;
     ts.tv_nsec = (s - ts.tv_sec) * 1e9;
 
@@ -248,6 +254,8 @@ void Util_close(void) {
         }
     }
     free(format_buffers);
+    format_buffers = NULL;
+    buffer_count = 0;
 
     for(int i = 0; i < buffer_count_internal; i++) {
         if(format_buffers_internal[i].buff) {
@@ -255,6 +263,8 @@ void Util_close(void) {
         }
     }
     free(format_buffers_internal);
+    format_buffers_internal = NULL;
+    buffer_count_internal = 0;
 }
 
 /** \} */
@@ -4,6 +4,12 @@
  */
 
 #include "seawolf.h"
+#include "seawolf/var_shm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 typedef struct {
     float* writeback;
@@ -13,9 +19,39 @@ typedef struct {
 
     bool poked;
 
+    /* Local time the hub published the current value, or -1 if unknown */
+    int64_t published;
+
+    /* Nanoseconds from publishing the current value to receiving it, or -1 if
+       unknown */
+    int64_t latency;
+
     pthread_rwlock_t lock;
 } Subscription;
 
+/* A value set by this process which the hub may not have applied yet */
+typedef struct {
+    /* Sequence the variable's shared table slot reaches once the hub has
+       applied every set sent by this process */
+    uint32_t sequence;
+
+    float value;
+
+    /* Cleared once the slot reaches sequence */
+    bool pending;
+} PendingSet;
+
+/**
+ * Number of COMM TIME exchanges used to estimate the hub clock offset
+ */
+#define VAR_TIME_SAMPLES 8
+
+/**
+ * Attempts to read a slot of the shared variable table before asking the hub
+ * instead
+ */
+#define VAR_SHM_RETRIES 1000
+
 /** If true, then notications are sent out with variable updates */
 static bool notify = true;
 
@@ -33,7 +69,38 @@ static pthread_cond_t new_data_available = PTHREAD_COND_INITIALIZER;
 
 static pthread_rwlock_t subscriptions_lock = PTHREAD_RWLOCK_INITIALIZER;
 
-static void Var_inputNewValue(char* name, float value);
+/** If true, then the hub is asked to timestamp variable updates */
+static bool timestamps = false;
+
+/** Publish to delivery latency of all timestamped updates */
+static Histogram update_latency;
+
+/** Protects update_latency */
+static pthread_mutex_t update_latency_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** If true, then the hub's shared variable table is used when available */
+static bool use_shm = true;
+
+/** The hub's shared variable table, or NULL if it is not mapped */
+static Var_ShmHeader* shm_table = NULL;
+
+/** Size of the shared variable table mapping */
+static size_t shm_table_size;
+
+/** Slots of the shared variable table by variable name */
+static Dictionary* shm_slots = NULL;
+
+/** Values set by this process, by variable name, for variables in the table */
+static Dictionary* shm_pending = NULL;
+
+/** Protects the entries of shm_pending */
+static pthread_mutex_t shm_pending_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void Var_inputNewValue(char* name, float value, int64_t published);
+static void Var_openShm(void);
+static bool Var_readShm(Var_ShmSlot* slot, float* value);
+static void Var_setPending(char* name, Var_ShmSlot* slot, float value);
+static bool Var_getPending(char* name, Var_ShmSlot* slot, float* value);
 
 /**
  * \defgroup Var Shared variable
@@ -47,9 +114,28 @@ static void Var_inputNewValue(char* name, float value);
  * \private
  */
 void Var_init(void) {
+    Comm_Message* request;
+
     ro_cache = Dictionary_new();
     subscriptions = Dictionary_new();
+    Histogram_init(&update_latency);
     initialized = true;
+
+    if(timestamps) {
+        request = Comm_Message_new(2);
+        request->components[0] = "WATCH";
+        request->components[1] = "TIMESTAMPS";
+        Comm_sendMessage(request);
+        Comm_Message_destroy(request);
+
+        if(Comm_syncHubTime(VAR_TIME_SAMPLES) != 0) {
+            Logging_log(ERROR, "Unable to estimate the hub clock offset");
+        }
+    }
+
+    if(use_shm) {
+        Var_openShm();
+    }
 }
 
 /**
@@ -67,6 +153,7 @@ float Var_get(char* name) {
     Comm_Message* variable_request;
     Comm_Message* response;
     Subscription* subscription;
+    Var_ShmSlot* slot;
     float value;
     float* cached;
 
@@ -87,6 +174,13 @@ float Var_get(char* name) {
         return value;
     }
 
+    if(shm_slots) {
+        slot = Dictionary_get(shm_slots, name);
+        if(slot && (Var_getPending(name, slot, &value) || Var_readShm(slot, &value))) {
+            return value;
+        }
+    }
+
     cached = Dictionary_get(ro_cache, name);
     if(cached) {
         return (*cached);
@@ -118,6 +212,173 @@ float Var_get(char* name) {
     return value;
 }
 
+/**
+ * \brief Map the hub's shared variable table
+ *
+ * Asks the hub where its shared variable table is and maps it read only. The
+ * table is only used if it carries the token the hub gave, which it can not if
+ * the hub is on another host.
+ */
+static void Var_openShm(void) {
+    Comm_Message* request;
+    Comm_Message* response;
+    Var_ShmHeader* table = MAP_FAILED;
+    unsigned long long token;
+    struct stat st;
+    int fd;
+
+    request = Comm_Message_new(2);
+    request->components[0] = "VAR";
+    request->components[1] = "SHM";
+    Comm_assignRequestID(request);
+    response = Comm_sendMessage(request);
+    Comm_Message_destroy(request);
+
+    if(response == NULL) {
+        return;
+    }
+
+    if(response->count != 4) {
+        Comm_Message_destroy(response);
+        return;
+    }
+
+    token = strtoull(response->components[3], NULL, 10);
+    fd = shm_open(response->components[2], O_RDONLY, 0);
+    Comm_Message_destroy(response);
+
+    if(fd == -1) {
+        /* Expected when the hub is on another host */
+        return;
+    }
+
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(Var_ShmHeader)) {
+        table = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if(table == MAP_FAILED) {
+        return;
+    }
+
+    if(table->magic != VAR_SHM_MAGIC || table->version != VAR_SHM_VERSION || table->token != token ||
+       table->slots_offset + (uint64_t) table->var_count * table->slot_size > (uint64_t) st.st_size) {
+        munmap(table, st.st_size);
+        return;
+    }
+
+    shm_table = table;
+    shm_table_size = st.st_size;
+    shm_slots = Dictionary_new();
+    shm_pending = Dictionary_new();
+    for(uint32_t i = 0; i < table->var_count; i++) {
+        Dictionary_set(shm_slots, VAR_SHM_NAME(table, i), VAR_SHM_SLOT(table, i));
+    }
+
+    Logging_log(DEBUG, "Reading variables from the hub's shared variable table");
+}
+
+/**
+ * \brief Read a variable from the shared variable table
+ *
+ * \param slot Slot of the variable
+ * \param[out] value Set to the value of the variable
+ * \return True if a consistent value was read, false if the hub was in the
+ * middle of writing the slot every time it was tried
+ */
+static bool Var_readShm(Var_ShmSlot* slot, float* value) {
+    uint32_t sequence;
+    double copy;
+
+    for(int i = 0; i < VAR_SHM_RETRIES; i++) {
+        sequence = slot->sequence;
+        __sync_synchronize();
+        copy = slot->value;
+        __sync_synchronize();
+
+        if((sequence & 1) == 0 && slot->sequence == sequence) {
+            *value = copy;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * \brief Remember a value sent to the hub
+ *
+ * Sets are not acknowledged, so the shared table may not reflect a set for a
+ * short time after Var_set() returns. The hub applies sets in order, each
+ * advancing the sequence of the variable's slot by two, so until the slot has
+ * advanced past every set sent the last value set is returned by Var_get()
+ * instead, as the hub would usually have returned it to a VAR GET sent after
+ * the set.
+ *
+ * This is a heuristic rather than a guarantee. The slot cannot tell which
+ * client each set came from, so sets from other clients which the hub applies
+ * before this one also advance the sequence. Var_get() may then briefly return
+ * the other client's value until this set lands, even though a VAR GET sent
+ * after the set would have returned this one.
+ *
+ * \param name The variable
+ * \param slot Slot of the variable, read before the set is sent
+ * \param value The value being set
+ */
+static void Var_setPending(char* name, Var_ShmSlot* slot, float value) {
+    PendingSet* pending;
+    uint32_t current;
+
+    pthread_mutex_lock(&shm_pending_lock);
+    pending = Dictionary_get(shm_pending, name);
+    if(pending == NULL) {
+        pending = malloc(sizeof(PendingSet));
+        pending->pending = false;
+        Dictionary_set(shm_pending, name, pending);
+    }
+
+    /* A write in progress will leave the sequence one higher, and that is not
+       the hub applying this set */
+    current = (slot->sequence + 1) & ~1U;
+    if(pending->pending && (int32_t) (pending->sequence - current) > 0) {
+        /* Earlier sets are still in flight */
+        pending->sequence += 2;
+    } else {
+        pending->sequence = current + 2;
+    }
+    pending->value = value;
+    pending->pending = true;
+    pthread_mutex_unlock(&shm_pending_lock);
+}
+
+/**
+ * \brief Return a value set by this process which the hub has not yet applied
+ *
+ * \param name The variable
+ * \param slot Slot of the variable
+ * \param[out] value Set to the pending value
+ * \return True if there is a pending value
+ */
+static bool Var_getPending(char* name, Var_ShmSlot* slot, float* value) {
+    PendingSet* pending = Dictionary_get(shm_pending, name);
+    bool found = false;
+
+    if(pending == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&shm_pending_lock);
+    if(pending->pending && (int32_t) (slot->sequence - pending->sequence) < 0) {
+        *value = pending->value;
+        found = true;
+    } else {
+        pending->pending = false;
+    }
+    pthread_mutex_unlock(&shm_pending_lock);
+
+    return found;
+}
+
 /**
  * \brief Set a variable
  *
@@ -131,12 +392,17 @@ void Var_set(char* name, float value) {
     static char* command = "SET";
 
     Comm_Message* variable_set = Comm_Message_new(4);
+    Var_ShmSlot* slot;
 
     variable_set->components[0] = namespace;
     variable_set->components[1] = command;
     variable_set->components[2] = name;
     variable_set->components[3] = strdup(__Util_format("%.4f", value));
 
+    if(shm_slots && (slot = Dictionary_get(shm_slots, name)) != NULL) {
+        Var_setPending(name, slot, value);
+    }
+
     Comm_sendMessage(variable_set);
 
     if(notify) {
@@ -144,7 +410,7 @@ void Var_set(char* name, float value) {
     }
 
     if(Dictionary_get(subscriptions, name)) {
-        Var_inputNewValue(name, value);
+        Var_inputNewValue(name, value, -1);
     }
 
     free(variable_set->components[3]);
@@ -170,6 +436,8 @@ int Var_subscribe(char* name) {
     s->last = Var_get(name);
     s->current = s->last;
     s->poked = false;
+    s->published = -1;
+    s->latency = -1;
     pthread_rwlock_init(&s->lock, NULL);
 
     request->components[0] = namespace;
@@ -350,6 +618,81 @@ void Var_touch(char* name) {
     pthread_rwlock_unlock(&subscriptions_lock);
 }
 
+/**
+ * \brief Get the time a variable's value was published
+ *
+ * Requires timestamps to be enabled with Var_setTimestamps()
+ *
+ * \param name Name of a subscribed variable
+ * \return The time the hub published the current value, converted to the
+ * local Timer_getTimestamp() clock, or -1 if the value was not received with a
+ * timestamp
+ */
+int64_t Var_getTimestamp(char* name) {
+    Subscription* s;
+    int64_t published;
+
+    pthread_rwlock_rdlock(&subscriptions_lock); {
+        s = Dictionary_get(subscriptions, name);
+        if(s == NULL) {
+            Logging_log(CRITICAL, Util_format("Subscription call on unsubscribed variable '%s'", name));
+            Seawolf_exitError();
+        }
+
+        pthread_rwlock_rdlock(&s->lock); {
+            published = s->published;
+        }
+        pthread_rwlock_unlock(&s->lock);
+    }
+    pthread_rwlock_unlock(&subscriptions_lock);
+
+    return published;
+}
+
+/**
+ * \brief Get the delivery latency of a variable's value
+ *
+ * Requires timestamps to be enabled with Var_setTimestamps(). The latency is
+ * only as accurate as the estimate of the hub clock offset, see
+ * Comm_getHubTimeUncertainty(), and is limited to be at least 0.
+ *
+ * \param name Name of a subscribed variable
+ * \return Nanoseconds between the hub publishing the current value and it
+ * being received, or -1 if the value was not received with a timestamp
+ */
+int64_t Var_getLatency(char* name) {
+    Subscription* s;
+    int64_t latency;
+
+    pthread_rwlock_rdlock(&subscriptions_lock); {
+        s = Dictionary_get(subscriptions, name);
+        if(s == NULL) {
+            Logging_log(CRITICAL, Util_format("Subscription call on unsubscribed variable '%s'", name));
+            Seawolf_exitError();
+        }
+
+        pthread_rwlock_rdlock(&s->lock); {
+            latency = s->latency;
+        }
+        pthread_rwlock_unlock(&s->lock);
+    }
+    pthread_rwlock_unlock(&subscriptions_lock);
+
+    return latency;
+}
+
+/**
+ * \brief Get the delivery latency of all variable updates
+ *
+ * \param latency Histogram to store the latency in nanoseconds of every
+ * timestamped update received in
+ */
+void Var_getLatencyStats(Histogram* latency) {
+    pthread_mutex_lock(&update_latency_lock);
+    *latency = update_latency;
+    pthread_mutex_unlock(&update_latency_lock);
+}
+
 /**
  * \brief Wait for a variable update
  *
@@ -373,9 +716,20 @@ void Var_sync(void) {
  *
  * \param name Name of the variable to update
  * \param value New value of the variable
+ * \param published Local time the hub published the value, or -1 if unknown
  */
-static void Var_inputNewValue(char* name, float value) {
+static void Var_inputNewValue(char* name, float value, int64_t published) {
     Subscription* s;
+    int64_t latency = -1;
+
+    if(published != -1) {
+        latency = Timer_getTimestamp() - published;
+        latency = (latency < 0) ? 0 : latency;
+
+        pthread_mutex_lock(&update_latency_lock);
+        Histogram_record(&update_latency, latency);
+        pthread_mutex_unlock(&update_latency_lock);
+    }
 
     /* OH NOES!!!
 
@@ -387,6 +741,8 @@ static void Var_inputNewValue(char* name, float value) {
             pthread_rwlock_wrlock(&s->lock); {
                 s->current = value;
                 s->poked = true;
+                s->published = published;
+                s->latency = latency;
 
                 if(s->writeback) {
                     (*s->writeback) = s->current;
@@ -413,11 +769,18 @@ static void Var_inputNewValue(char* name, float value) {
  * \param message The input message
  */
 void Var_inputMessage(Comm_Message* message) {
+    int64_t published = -1;
     float value;
 
-    if(message->count == 3) {
+    if(message->count == 3 || message->count == 4) {
         value = atof(message->components[2]);
-        Var_inputNewValue(message->components[1], value);
+
+        /* Convert the hub's timestamp to local time */
+        if(message->count == 4) {
+            published = atoll(message->components[3]) - Comm_getHubTimeOffset();
+        }
+
+        Var_inputNewValue(message->components[1], value, published);
     }
 
     Comm_Message_destroy(message);
@@ -437,6 +800,39 @@ void Var_setAutoNotify(bool autonotify) {
     notify = autonotify;
 }
 
+/**
+ * \brief Control update timestamps
+ *
+ * If set to true, the hub is asked to send the time each variable was set
+ * along with updates to subscribed variables, and the offset between the hub
+ * and local clocks is estimated with Comm_syncHubTime(). The time and latency
+ * of updates are then available from Var_getTimestamp(), Var_getLatency() and
+ * Var_getLatencyStats(). Must be called before Seawolf_init(), and requires a
+ * hub which supports the COMM TIME request.
+ *
+ * \param enabled If true, request timestamped updates
+ */
+void Var_setTimestamps(bool enabled) {
+    timestamps = enabled;
+}
+
+/**
+ * \brief Control use of the shared variable table
+ *
+ * If set to true and the hub runs on the same host, Var_get() reads variables
+ * the application is not subscribed to from a table the hub keeps in shared
+ * memory, rather than asking the hub for them. Reads then take nanoseconds
+ * instead of a round trip to the hub. Var_set() is unaffected, but a value read
+ * shortly after setting it may, if other applications set the same variable
+ * concurrently, be one set before this application's set. Must be called
+ * before Seawolf_init(). Enabled by default.
+ *
+ * \param enabled If true, use the shared variable table when it is available
+ */
+void Var_setSharedMemory(bool enabled) {
+    use_shm = enabled;
+}
+
 /**
  * \brief Close the Var component
  * \private
@@ -446,6 +842,21 @@ void Var_close(void) {
     int n;
 
     if(initialized) {
+        if(shm_table) {
+            keys = Dictionary_getKeys(shm_pending);
+            n = List_getSize(keys);
+            for(int i = 0; i < n; i++) {
+                free(Dictionary_get(shm_pending, List_get(keys, i)));
+            }
+
+            List_destroy(keys);
+            Dictionary_destroy(shm_pending);
+            Dictionary_destroy(shm_slots);
+            munmap(shm_table, shm_table_size);
+            shm_slots = NULL;
+            shm_table = NULL;
+        }
+
         /* Free readonly variable cache */
         keys = Dictionary_getKeys(ro_cache);
         n = List_getSize(keys);